@@ -22,7 +22,8 @@ const double IMPOSSIBLE = -1000000000;
 void HapAligner::align_seq_to_hap(Haplotype* haplotype,
 				  const char* seq_0, int seq_len, const double* base_log_wrong, const double* base_log_correct,
 				  double* match_matrix, double* insert_matrix, double* deletion_matrix,
-				  int* best_artifact_size, int* best_artifact_pos, double& left_prob){
+				  int* best_artifact_size, int* best_artifact_pos, double& left_prob,
+				  StutterEmissions* emissions, const StutterEmissions* prev_emissions, bool rescore){
   // NOTE: Input matrix structure: Row = Haplotype position, Column = Read index
   double* L_log_probs = new double[seq_len];
  
@@ -41,17 +42,36 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
   int matrix_index    = seq_len;
   int stutter_R       = -1; // Haplotype index for right boundary of most recent stutter block
 
+  // Read the haplotype's bases and homopolymer lengths directly from its flattened buffers
+  const char* hap_seq             = haplotype->flat_seq();
+  const unsigned int* homop_lens  = haplotype->homopolymer_lengths();
+
   // Fill in matrix row by row, iterating through each haplotype block
   for (int block_index = 0; block_index < haplotype->num_blocks(); block_index++){
-    const std::string& block_seq = haplotype->get_seq(block_index);
+    int block_start              = haplotype->block_start(block_index);
+    int block_size               = haplotype->block_size(block_index);
+    const char* block_seq        = hap_seq + block_start;
     bool stutter_block           = (haplotype->get_block(block_index)->get_repeat_info()) != NULL;
 
+    // When rescoring, the rows preceding the repeat block are unchanged, so only restore the entries used to combine both sides of the seed
+    if (rescore && !stutter_block && stutter_R == -1){
+      int first_index  = haplotype_index;
+      haplotype_index += block_size + (block_index == 0 ? -1 : 0);
+      matrix_index     = seq_len*haplotype_index;
+      for (int i = first_index; i < haplotype_index; i++)
+	match_matrix[seq_len*i + seq_len-1] = emissions->flank_lls[i];
+      continue;
+    }
+
     // Skip any blocks to the left of the last changed block (as we can reuse the alignments)
-    if (haplotype->last_changed() != -1 && block_index < haplotype->last_changed()){
-      haplotype_index += block_seq.size() + (block_index == 0 ? -1 : 0);
+    if (!rescore && haplotype->last_changed() != -1 && block_index < haplotype->last_changed()){
+      haplotype_index += block_size + (block_index == 0 ? -1 : 0);
       matrix_index     = seq_len*haplotype_index;
-      if (stutter_block)
+      if (stutter_block){
 	stutter_R = haplotype_index - 1;
+	if (emissions != NULL)
+	  *emissions = *prev_emissions;
+      }
       continue;
     }
 
@@ -62,7 +82,7 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
       RepeatStutterInfo* rep_info   = haplotype->get_block(block_index)->get_repeat_info();
       int period                    = rep_info->get_period();
       int block_option              = haplotype->cur_index(block_index);
-      int block_len                 = block_seq.size();
+      int block_len                 = block_size;
       int prev_row_index            = seq_len*(haplotype_index-1);            // Index into matrix for haplotype character preceding stutter block (column = 0) 
       matrix_index                  = seq_len*(haplotype_index+block_len-1);  // Index into matrix for rightmost character in stutter block (column = 0)
       int num_stutter_artifacts     = (rep_info->max_insertion()-rep_info->max_deletion())/period + 1;
@@ -71,10 +91,25 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
       std::vector<double> block_probs(num_stutter_artifacts); // Reuse in each iteration to avoid reallocation penalty
       int j = 0;
 
+      // Record the block's stutter-independent terms along with the entries preceding the block, which are needed to combine both sides of the seed when rescoring
+      double* block_lls = NULL;
+      if (emissions != NULL){
+	if (!rescore){
+	  emissions->flank_lls.resize(haplotype_index);
+	  for (int i = 0; i < haplotype_index; i++)
+	    emissions->flank_lls[i] = match_matrix[seq_len*i + seq_len-1];
+	  emissions->pre_block_lls.assign(match_matrix + prev_row_index, match_matrix + prev_row_index + seq_len);
+	  emissions->block_lls.resize(seq_len*num_stutter_artifacts);
+	}
+	else
+	  std::copy(emissions->pre_block_lls.begin(), emissions->pre_block_lls.end(), match_matrix + prev_row_index);
+	block_lls = emissions->block_lls.data();
+      }
+
       // If this haplotype and its predecessor have a suffix match that exceeds the maximum
       // haplotype bases used for a subset of the read position, we can reuse the match probabilities
       // for those positions as they're identical
-      if (haplotype->last_changed() != -1){
+      if (!rescore && haplotype->last_changed() != -1){
 	int suffix_match_length = haplotype->get_block(block_index)->suffix_match_len(block_option);
 	int old_matrix_index    = seq_len*(haplotype_index+haplotype->get_block(block_index)->get_seq(block_option-1).size()-1);
 	int num_copies          = std::min(seq_len, suffix_match_length + rep_info->max_deletion());
@@ -84,6 +119,8 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
 	  deletion_matrix[matrix_index] = IMPOSSIBLE;
 	  // NOTE: No need to update artifact size and position as they're unchanged from last iteration
 	}
+	if (block_lls != NULL)
+	  std::copy(prev_emissions->block_lls.begin(), prev_emissions->block_lls.begin() + j*num_stutter_artifacts, block_lls);
       }
 
       for (; j < seq_len; ++j, ++matrix_index){
@@ -92,9 +129,16 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
 	double best_LL = IMPOSSIBLE;
 	artifact_size_ptr[j] = -10000;
 	for (int artifact_size = rep_info->max_deletion(); artifact_size <= rep_info->max_insertion(); artifact_size += period){
-	  int art_pos          = -1;
-	  int base_len         = std::min(block_len+artifact_size, j+1);
-	  double prob          = stutter_aligner->align_stutter_region_reverse(base_len, seq_0+j, base_log_wrong+j, base_log_correct+j, artifact_size, art_pos);
+	  int art_pos     = -1;
+	  int base_len    = std::min(block_len+artifact_size, j+1);
+	  double prob;
+	  if (rescore)
+	    prob = block_lls[j*num_stutter_artifacts + art_idx];
+	  else {
+	    prob = stutter_aligner->align_stutter_region_reverse(base_len, seq_0+j, base_log_wrong+j, base_log_correct+j, artifact_size, art_pos);
+	    if (block_lls != NULL)
+	      block_lls[j*num_stutter_artifacts + art_idx] = prob;
+	  }
 	  double pre_prob      = (j-base_len < 0 ? 0 : match_matrix[j-base_len + prev_row_index]);
 	  block_probs[art_idx] = rep_info->log_prob_pcr_artifact(block_option, artifact_size) + prob + pre_prob;
 	  if (block_probs[art_idx] > best_LL){
@@ -116,16 +160,16 @@ void HapAligner::align_seq_to_hap(Haplotype* haplotype,
     }
     else {
       // Handle normal n -> n-1 transitions while preventing sequencing indels from extending into preceding stutter blocks
+      const unsigned int* block_homop_lens = homop_lens + block_start;
       int coord_index      = (block_index == 0 ? 1 : 0);
-      int homopolymer_len  = haplotype->homopolymer_length(block_index, std::max(0, coord_index-1));
+      int homopolymer_len  = block_homop_lens[std::max(0, coord_index-1)];
 
-      for (; coord_index < block_seq.size(); ++coord_index, ++haplotype_index){
+      for (; coord_index < block_size; ++coord_index, ++haplotype_index){
 	assert(matrix_index == seq_len*haplotype_index);
 	char hap_char = block_seq[coord_index];
 	
 	// Update the homopolymer tract length
-	homopolymer_len = std::min(MAX_HOMOP_LEN, std::max(haplotype->homopolymer_length(block_index, coord_index),
-							   haplotype->homopolymer_length(block_index, std::max(0, coord_index-1))));
+	homopolymer_len = std::min(MAX_HOMOP_LEN, std::max(block_homop_lens[coord_index], block_homop_lens[std::max(0, coord_index-1)]));
 
 	// Boundary conditions for leftmost base in read
 	match_matrix[matrix_index]    = (seq_0[0] == hap_char ? base_log_correct[0] : base_log_wrong[0]);
@@ -181,7 +225,7 @@ double HapAligner::compute_aln_logprob(int base_seq_len, int seed_base,
   int num_seeds = 0;
   for (int block_index = 0; block_index < fw_haplotype_->num_blocks(); block_index++)
     if (fw_haplotype_->get_block(block_index)->get_repeat_info() == NULL)
-      num_seeds += fw_haplotype_->get_seq(block_index).size();
+      num_seeds += fw_haplotype_->block_size(block_index);
   double SEED_LOG_MATCH_PRIOR = -int_log(num_seeds);
   
   double max_LL;
@@ -209,19 +253,21 @@ double HapAligner::compute_aln_logprob(int base_seq_len, int seed_base,
   double* l_match_ptr  = l_match_matrix  + (lflank_len - 1);
   double* r_match_ptr  = r_match_matrix  + (rflank_len*(hapsize-2) - 1);
   int hap_index = 1;
+  const char* hap_seq = fw_haplotype_->flat_seq();
   for (int block_index = 0; block_index < fw_haplotype_->num_blocks(); ++block_index){
-    const std::string& block_seq = fw_haplotype_->get_seq(block_index);
-    bool stutter_block           = fw_haplotype_->get_block(block_index)->get_repeat_info() != NULL;
+    int block_size        = fw_haplotype_->block_size(block_index);
+    const char* block_seq = hap_seq + fw_haplotype_->block_start(block_index);
+    bool stutter_block    = fw_haplotype_->get_block(block_index)->get_repeat_info() != NULL;
     if (stutter_block){
       // Update matrix pointers
-      l_match_ptr += lflank_len*block_seq.size();
-      r_match_ptr -= rflank_len*block_seq.size();
-      hap_index   += block_seq.size();
+      l_match_ptr += lflank_len*block_size;
+      r_match_ptr -= rflank_len*block_size;
+      hap_index   += block_size;
       continue;
     }
     else {
       int coord_index     = (block_index == 0 ? 1 : 0); // Avoid situation where seed is aligned with first base
-      int end_coord_index = (block_index == fw_haplotype_->num_blocks()-1 ? block_seq.size()-1 : block_seq.size()); // Avoid situation where seed is aligned with last base
+      int end_coord_index = (block_index == fw_haplotype_->num_blocks()-1 ? block_size-1 : block_size); // Avoid situation where seed is aligned with last base
       for (; coord_index < end_coord_index; ++coord_index, ++hap_index){
 	log_probs.push_back(SEED_LOG_MATCH_PRIOR + (seed_char == block_seq[coord_index] ? log_seed_correct : log_seed_wrong) + *l_match_ptr + *r_match_ptr);
 	if (log_probs.back() > max_LL){
@@ -311,11 +357,22 @@ int HapAligner::calc_seed_base(Alignment& aln){
   return best_seed;
 }
 
-void HapAligner::process_reads(std::vector<Alignment>& alignments, int init_read_index, BaseQuality* base_quality,
-			       double* aln_probs, int* seed_positions){
+bool HapAligner::process_reads(std::vector<Alignment>& alignments, int init_read_index, BaseQuality* base_quality,
+			       double* aln_probs, int* seed_positions, LocusBudget* budget, std::vector<StutterEmissions>* emissions){
   AlignmentTrace trace(fw_haplotype_->num_blocks());
   double* prob_ptr = aln_probs + (init_read_index*fw_haplotype_->num_combs());
+  std::vector<StutterEmissions*> hap_emissions(fw_haplotype_->num_combs());
+  if (emissions != NULL){
+    emissions->clear();
+    emissions->resize(2*alignments.size()*fw_haplotype_->num_combs());
+  }
   for (unsigned int i = 0; i < alignments.size(); i++){
+    if (budget != NULL){
+      if (budget->exceeded())
+	return false;
+      budget->add_cells((int64_t)alignments[i].get_sequence().size()*fw_haplotype_->max_size()*fw_haplotype_->num_combs());
+    }
+
     int seed_base = calc_seed_base(alignments[i]);
     seed_positions[init_read_index+i] = seed_base;
     if (seed_base == -1){
@@ -324,7 +381,37 @@ void HapAligner::process_reads(std::vector<Alignment>& alignments, int init_read
 	*prob_ptr = 0;
     }
     else {
-      process_read(alignments[i], seed_base, base_quality, false, prob_ptr, trace);
+      if (emissions != NULL){
+	for (int j = 0; j < fw_haplotype_->num_combs(); j++)
+	  hap_emissions[j] = emissions->data() + 2*(j*alignments.size() + i);
+	process_read(alignments[i], seed_base, base_quality, false, prob_ptr, trace, hap_emissions.data());
+      }
+      else
+	process_read(alignments[i], seed_base, base_quality, false, prob_ptr, trace);
+      prob_ptr += fw_haplotype_->num_combs();
+    }
+  }
+  return true;
+}
+
+void HapAligner::rescore_reads(std::vector<Alignment>& alignments, BaseQuality* base_quality, const std::vector<StutterEmissions*>& hap_emissions,
+			       double* aln_probs, int* seed_positions){
+  assert(hap_emissions.size() == fw_haplotype_->num_combs());
+  AlignmentTrace trace(fw_haplotype_->num_blocks());
+  double* prob_ptr = aln_probs;
+  std::vector<StutterEmissions*> read_emissions(hap_emissions.size());
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    int seed_base     = calc_seed_base(alignments[i]);
+    seed_positions[i] = seed_base;
+    if (seed_base == -1){
+      // Assign all haplotypes the same zero LL
+      for (unsigned int j = 0; j < fw_haplotype_->num_combs(); ++j, ++prob_ptr)
+	*prob_ptr = 0;
+    }
+    else {
+      for (unsigned int j = 0; j < hap_emissions.size(); j++)
+	read_emissions[j] = hap_emissions[j] + 2*i;
+      process_read(alignments[i], seed_base, base_quality, false, prob_ptr, trace, read_emissions.data(), true);
       prob_ptr += fw_haplotype_->num_combs();
     }
   }
@@ -553,7 +640,7 @@ std::string HapAligner::retrace(Haplotype* haplotype, const char* read_seq,
 }
 
 void HapAligner::process_read(Alignment& aln, int seed_base, BaseQuality* base_quality, bool retrace_aln,
-			      double* prob_ptr, AlignmentTrace& trace){
+			      double* prob_ptr, AlignmentTrace& trace, StutterEmissions** hap_emissions, bool rescore){
   assert(seed_base != -1);
   assert(aln.get_sequence().size() == aln.get_base_qualities().size());
 
@@ -590,15 +677,21 @@ void HapAligner::process_read(Alignment& aln, int seed_base, BaseQuality* base_q
   std::reverse(base_log_wrong+seed_base+1,   base_log_wrong+base_seq_len);
   std::reverse(base_log_correct+seed_base+1, base_log_correct+base_seq_len);
 
+  int hap_index = 0;
   do {
     // Perform alignment to current haplotype
     double l_prob, r_prob;
     int max_index;
+    StutterEmissions* emissions      = (hap_emissions == NULL ? NULL : hap_emissions[hap_index]);
+    StutterEmissions* prev_emissions = (hap_emissions == NULL || hap_index == 0 ? NULL : hap_emissions[hap_index-1]);
     align_seq_to_hap(fw_haplotype_, base_seq, seed_base, base_log_wrong, base_log_correct,
-		     l_match_matrix, l_insert_matrix, l_deletion_matrix, l_best_artifact_size, l_best_artifact_pos, l_prob);
+		     l_match_matrix, l_insert_matrix, l_deletion_matrix, l_best_artifact_size, l_best_artifact_pos, l_prob,
+		     emissions, prev_emissions, rescore);
 
     align_seq_to_hap(rev_haplotype_, rev_rseq.c_str(), rev_rseq.size(), base_log_wrong+seed_base+1, base_log_correct+seed_base+1,
-		     r_match_matrix, r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, r_prob);
+		     r_match_matrix, r_insert_matrix, r_deletion_matrix, r_best_artifact_size, r_best_artifact_pos, r_prob,
+		     (emissions == NULL ? NULL : emissions+1), (prev_emissions == NULL ? NULL : prev_emissions+1), rescore);
+    hap_index++;
     
     double LL = compute_aln_logprob(base_seq_len, seed_base, base_seq[seed_base], base_log_wrong[seed_base], base_log_correct[seed_base],
 				    l_match_matrix, l_insert_matrix, l_deletion_matrix, l_prob, r_match_matrix, r_insert_matrix, r_deletion_matrix, r_prob, max_index);
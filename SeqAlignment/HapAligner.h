@@ -7,8 +7,29 @@
 #include "AlignmentData.h"
 #include "AlignmentTraceback.h"
 #include "../base_quality.h"
+#include "../locus_budget.h"
 #include "Haplotype.h"
 
+/*
+ * Terms of a read's alignment to a haplotype that don't depend on the repeat block's stutter model, for one side of the seed.
+ * Recording them while aligning allows the read to be rescored after the stutter model changes by recombining them with
+ * the new stutter probabilities and realigning only the flank that follows the repeat block
+ */
+class StutterEmissions {
+ public:
+  // Log-likelihood of the read's bases aligned to the repeat block for each read position and stutter artifact size,
+  // excluding the probability of the artifact. Indexed by read position*number of artifact sizes + artifact index
+  std::vector<double> block_lls;
+
+  // Match matrix entries for each read position in the haplotype position preceding the repeat block
+  std::vector<double> pre_block_lls;
+
+  // Match matrix entries for the read base adjacent to the seed in each haplotype position preceding the repeat block
+  std::vector<double> flank_lls;
+
+  size_t bytes() const { return sizeof(double)*(block_lls.size() + pre_block_lls.size() + flank_lls.size()); }
+};
+
 class HapAligner {
  private:
   Haplotype* fw_haplotype_;
@@ -19,12 +40,17 @@ class HapAligner {
   /**
    * Align the sequence contained in SEQ_0 -> SEQ_N using the recursion
    * 0 -> 1 -> 2 ... N
+   *
+   * If EMISSIONS isn't NULL and RESCORE is false, the stutter model-independent terms are recorded in it, reusing
+   * PREV_EMISSIONS (recorded for the previous haplotype) where the alignments are shared. If RESCORE is true, the
+   * rows preceding the repeat block and the block's terms are instead taken from EMISSIONS
    **/
   void align_seq_to_hap(Haplotype* haplotype,
 			const char* seq_0, int seq_len,
 			const double* base_log_wrong, const double* base_log_correct,
 			double* match_matrix, double* insert_matrix, double* deletion_matrix,
-			int* best_artifact_size, int* best_artifact_pos, double& left_prob);
+			int* best_artifact_size, int* best_artifact_pos, double& left_prob,
+			StutterEmissions* emissions, const StutterEmissions* prev_emissions, bool rescore);
 
   /**
    * Compute the log-probability of the alignment given the 
@@ -63,10 +89,28 @@ class HapAligner {
    **/
   int calc_seed_base(Alignment& alignment);
 
+  /*
+   * Aligns the read to each haplotype. If HAP_EMISSIONS isn't NULL, it contains the left and right StutterEmissions for
+   * each haplotype, which are either recorded or, if RESCORE is true, used to rescore the read. Rescored alignments can't be retraced
+   */
   void process_read(Alignment& aln, int seed_base, BaseQuality* base_quality, bool retrace_aln,
-		    double* prob_ptr, AlignmentTrace& traced_aln);
+		    double* prob_ptr, AlignmentTrace& traced_aln, StutterEmissions** hap_emissions=NULL, bool rescore=false);
 
-  void process_reads(std::vector<Alignment>& alignments, int init_read_index, BaseQuality* base_quality,
+  /*
+   * Aligns each read to each haplotype. If BUDGET isn't NULL, the matrix cells for each read are added to the budget
+   * and the alignment stops as soon as the budget is exceeded, in which case false is returned.
+   * If EMISSIONS isn't NULL, it's filled with the left and right StutterEmissions of each read for each haplotype,
+   * where the entries for haplotype h and read i begin at index 2*(h*number of reads + i)
+   */
+  bool process_reads(std::vector<Alignment>& alignments, int init_read_index, BaseQuality* base_quality,
+		     double* aln_probs, int* seed_positions, LocusBudget* budget=NULL, std::vector<StutterEmissions>* emissions=NULL);
+
+  /*
+   * Recomputes each read's alignment probabilities after the repeat block's stutter model has changed, without realigning the
+   * bases preceding the block on either side of the seed. HAP_EMISSIONS contains a pointer for each haplotype to the
+   * StutterEmissions recorded by process_reads() for the same reads, where the entries for read i begin at index 2*i
+   */
+  void rescore_reads(std::vector<Alignment>& alignments, BaseQuality* base_quality, const std::vector<StutterEmissions*>& hap_emissions,
 		     double* aln_probs, int* seed_positions);
 
   /*
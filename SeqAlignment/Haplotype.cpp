@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <assert.h>
 
 #include "../error.h"
@@ -56,37 +57,72 @@ void Haplotype::adjust_indels(std::string& ref_hap_al, std::string& alt_hap_al){
 }
 
 
-void Haplotype::aln_haps_to_ref(){
-  std::string ref_hap_seq = get_seq(), alt_hap_seq;
+std::string Haplotype::aln_hap_to_ref(const std::string& alt_hap_seq){
   std::string ref_hap_al, alt_hap_al;
   float score;
   std::vector<BamTools::CigarOp> cigar_list;
+  if (!NeedlemanWunsch::Align(ref_hap_seq_, alt_hap_seq, ref_hap_al, alt_hap_al, &score, cigar_list, true))
+    printErrorAndDie("Failed to left-align haplotype sequence to reference allele");
 
-  do {
-    alt_hap_seq = get_seq();
-    if (!NeedlemanWunsch::Align(ref_hap_seq, alt_hap_seq, ref_hap_al, alt_hap_al, &score, cigar_list, true))
-      printErrorAndDie("Failed to left-align haplotype sequence to reference allele");
-    cigar_list.clear();
-
-    // Attempt to merge indels inside of repeat block
-    adjust_indels(ref_hap_al, alt_hap_al);
-
-    std::string aln_info = ""; aln_info.reserve(alt_hap_al.size());
-    for (unsigned int i = 0; i < alt_hap_al.size(); i++){
-      if (ref_hap_al[i] == '-')
-	aln_info += 'I';
-      else if (alt_hap_al[i] == '-')
-	aln_info += 'D';
-      else
-	aln_info += 'M';
-    }
-    hap_aln_info_.push_back(aln_info);
+  // Attempt to merge indels inside of repeat block
+  adjust_indels(ref_hap_al, alt_hap_al);
+
+  std::string aln_info = ""; aln_info.reserve(alt_hap_al.size());
+  for (unsigned int i = 0; i < alt_hap_al.size(); i++){
+    if (ref_hap_al[i] == '-')
+      aln_info += 'I';
+    else if (alt_hap_al[i] == '-')
+      aln_info += 'D';
+    else
+      aln_info += 'M';
+  }
+  return aln_info;
+}
+
+const std::string& Haplotype::get_aln_info(){
+  auto info_iter = hap_aln_info_.find(counter_);
+  if (info_iter != hap_aln_info_.end())
+    return info_iter->second;
+
+  if (aln_info_order_.size() == MAX_CACHED_ALN_INFO){
+    hap_aln_info_.erase(aln_info_order_.front());
+    aln_info_order_.pop_front();
+  }
+  aln_info_order_.push_back(counter_);
+  std::string& aln_info = hap_aln_info_[counter_];
+  if (fw_hap_ == NULL)
+    aln_info = aln_hap_to_ref(get_seq());
+  else {
+    // Use the reverse of the forward haplotype's alignment, as aligning the reversed sequences
+    // would right align indels instead of left aligning them
+    std::string fw_seq = get_seq();
+    std::reverse(fw_seq.begin(), fw_seq.end());
+    aln_info = fw_hap_->aln_hap_to_ref(fw_seq);
+    std::reverse(aln_info.begin(), aln_info.end());
   }
-  while (next());
-  reset();
+  return aln_info;
+}
+
+void Haplotype::update_flat_buffers(){
+  int first_block = flat_dirty_from_;
+  block_starts_.resize(blocks_.size()+1, 0);
+  flat_seq_.resize(block_starts_[first_block]);
+  for (int i = first_block; i < blocks_.size(); i++){
+    flat_seq_.append(get_seq(i));
+    block_starts_[i+1] = flat_seq_.size();
+  }
+
+  homop_lens_.resize(flat_seq_.size());
+  for (int i = first_block; i < blocks_.size(); i++){
+    bool repeat_block = (blocks_[i]->get_repeat_info() != NULL);
+    for (int j = 0; j < block_starts_[i+1]-block_starts_[i]; j++)
+      homop_lens_[block_starts_[i]+j] = (repeat_block ? 0 : homopolymer_length(i, j));
+  }
+  flat_dirty_from_ = blocks_.size();
 }
 
 void Haplotype::init(){
+  flat_dirty_from_ = 0;
   ncombs_   = 1;
   cur_size_ = 0;
   for (int i = 0; i < blocks_.size(); i++){
@@ -131,6 +167,16 @@ bool Haplotype::next(){
   cur_size_        -= blocks_[index]->size(counts_[index]);
   counts_[index]   += dirs_[index];
   cur_size_        += blocks_[index]->size(counts_[index]);
+
+  // Homopolymers in the preceding blocks can extend into the changed block, including through blocks that consist of a single homopolymer,
+  // so the lengths are stale back to the first block whose run can reach it
+  int dirty_block = index;
+  while (dirty_block > 0){
+    const std::string& seq = get_seq(--dirty_block);
+    if (!seq.empty() && seq.find_first_not_of(seq[0]) != std::string::npos)
+      break;
+  }
+  flat_dirty_from_ = std::min(flat_dirty_from_, dirty_block);
   if (counts_[index] == 0 || counts_[index] == nopts_[index]-1)
     dirs_[index] *= -1;
 
@@ -233,11 +279,7 @@ Haplotype* Haplotype::reverse( std::vector<HapBlock*>& rev_blocks){
   Haplotype* rev_hap = new Haplotype(rev_blocks);
   rev_hap->inc_rev_  = true;
 
-  // Set the haplotype alignments to the reverse of those in the current haplotype
-  // Can't use the values obtained from the constructor as the reverse
-  // haplotype would have right align indels instead of left aligning them
-  rev_hap->hap_aln_info_ = hap_aln_info_;
-  for (auto iter = rev_hap->hap_aln_info_.begin(); iter != rev_hap->hap_aln_info_.end(); iter++)
-    std::reverse(iter->begin(), iter->end());
+  // The reverse haplotype's alignments are the reverse of those in the current haplotype
+  rev_hap->fw_hap_   = this;
   return rev_hap;
 }
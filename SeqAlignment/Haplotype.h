@@ -2,9 +2,11 @@
 #define HAPLOTYPE_H_
 
 #include <assert.h>
+#include <deque>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "HapBlock.h"
@@ -26,10 +28,24 @@ class Haplotype {
   unsigned int left_homopolymer_len(char c, int block_index);
   unsigned int right_homopolymer_len(char c, int block_index);
 
-  std::vector<std::string> hap_aln_info_;
-  void aln_haps_to_ref();
+  // Alignment info for each haplotype relative to the reference haplotype, keyed by the haplotype's index. Each entry is computed
+  // the first time it's requested, and only the MAX_CACHED_ALN_INFO most recently computed entries are retained
+  static const int MAX_CACHED_ALN_INFO = 64;
+  std::string ref_hap_seq_;
+  std::unordered_map<int, std::string> hap_aln_info_;
+  std::deque<int> aln_info_order_;
+  Haplotype* fw_hap_; // For reversed haplotypes, the haplotype they were reversed from, which must outlive them. Otherwise NULL
+  std::string aln_hap_to_ref(const std::string& alt_hap_seq);
   void adjust_indels(std::string& ref_hap_al, std::string& alt_hap_al);
 
+  // Contiguous copy of the current haplotype's bases and homopolymer lengths. As only the blocks from the last changed block onwards
+  // differ after next(), the buffers are only rebuilt from block FLAT_DIRTY_FROM_ onwards, and only once they're next accessed
+  std::string flat_seq_;
+  std::vector<int> block_starts_;            // Index of each block's first base in the buffers, followed by the haplotype's size
+  std::vector<unsigned int> homop_lens_;     // homopolymer_length() for each base in a non-repeat block, and 0 for repeat blocks
+  int flat_dirty_from_;
+  void update_flat_buffers();
+
  public:
   Haplotype(std::vector<HapBlock*>& blocks) {
     max_size_ = 0;
@@ -46,7 +62,8 @@ class Haplotype {
     nchanges_.resize(blocks_.size());
     inc_rev_ = false;
     init();
-    aln_haps_to_ref();
+    ref_hap_seq_ = get_seq();
+    fw_hap_      = NULL;
   }
 
   void print_nchanges(std::ostream& out) {
@@ -62,7 +79,6 @@ class Haplotype {
   }
   
   inline const std::string& get_seq(int block_index)     { return blocks_[block_index]->get_seq(counts_[block_index]); }
-  inline const std::string& get_aln_info()               { return hap_aln_info_[counter_]; }
   inline HapBlock* get_block(int block_index)            { return blocks_[block_index]; }
   inline HapBlock* get_first_block()                     { return blocks_.front(); }
   inline HapBlock* get_last_block()                      { return blocks_.back();  }
@@ -78,6 +94,12 @@ class Haplotype {
   inline int cur_index(int block_index)            const { return counts_[block_index]; }
   inline bool reversed()                           const { return inc_rev_; }
 
+  // Accessors for the flattened haplotype. The pointers remain valid until the haplotype is next changed
+  inline const char* flat_seq()                          { if (flat_dirty_from_ < num_blocks()) update_flat_buffers(); return flat_seq_.data();   }
+  inline const unsigned int* homopolymer_lengths()       { if (flat_dirty_from_ < num_blocks()) update_flat_buffers(); return homop_lens_.data(); }
+  inline int block_start(int block_index)                { if (flat_dirty_from_ < num_blocks()) update_flat_buffers(); return block_starts_[block_index]; }
+  inline int block_size(int block_index)                 { int end = block_start(block_index+1); return end - block_starts_[block_index]; }
+
 
   void get_coordinates(int hap_pos, int& block, int& block_pos){
     assert(hap_pos >= 0 && hap_pos < cur_size_);
@@ -99,6 +121,12 @@ class Haplotype {
     return ss.str();
   }
 
+  /*
+   * Returns a string describing how the current haplotype aligns to the reference haplotype, with an I, D or M for each
+   * inserted, deleted or matched base. The reference remains valid until MAX_CACHED_ALN_INFO other haplotypes' info is computed
+   */
+  const std::string& get_aln_info();
+
   void print(std::ostream& out) {
     for (int i = 0; i < num_blocks(); i++)
       out << get_seq(i);
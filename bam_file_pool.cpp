@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "bam_file_pool.h"
+#include "error.h"
+
+BamFilePool::BamFilePool(const std::vector<std::string>& bam_files, const std::vector<std::string>& bam_indexes, int max_open_files,
+			 const BamTools::RefVector* ref_vector){
+  if (bam_files.size() != bam_indexes.size())
+    printErrorAndDie("Number of BAM files and BAM index files provided to the BAM file pool must match");
+  if (bam_files.empty())
+    printErrorAndDie("BAM file pool requires at least one BAM file");
+  if (max_open_files < 1)
+    printErrorAndDie("BAM file pool must allow at least one open BAM file");
+
+  bam_files_      = bam_files;
+  bam_indexes_    = bam_indexes;
+  max_open_files_ = max_open_files;
+  readers_        = std::vector<BamTools::BamReader*>(bam_files.size(), NULL);
+  lru_iters_      = std::vector<std::list<int>::iterator>(bam_files.size(), lru_files_.end());
+  opened_before_  = std::vector<bool>(bam_files.size(), false);
+  have_region_    = false;
+  forward_        = false;
+  cur_file_       = -1;
+  num_visited_    = 0;
+  cur_reader_     = NULL;
+  num_hits_       = 0;
+  num_opens_      = 0;
+  num_reopens_    = 0;
+  num_evictions_  = 0;
+  open_time_      = 0;
+
+  // The reference sequences of the first BAM are used for all BAMs, as is the case for the BamMultiReader
+  if (ref_vector != NULL)
+    ref_vector_ = *ref_vector;
+  else {
+    BamTools::BamReader* reader = acquire(0);
+    ref_vector_  = reader->GetReferenceData();
+    header_text_ = reader->GetHeaderText();
+  }
+}
+
+const std::string& BamFilePool::get_header_text(){
+  if (header_text_.empty())
+    header_text_ = acquire(0)->GetHeaderText();
+  return header_text_;
+}
+
+BamTools::BamReader* BamFilePool::acquire(int file_index){
+  if (readers_[file_index] != NULL){
+    num_hits_++;
+    lru_files_.splice(lru_files_.begin(), lru_files_, lru_iters_[file_index]);
+    return readers_[file_index];
+  }
+
+  if (lru_files_.size() >= max_open_files_){
+    close_file(lru_files_.back());
+    num_evictions_++;
+  }
+
+  std::chrono::steady_clock::time_point open_start = std::chrono::steady_clock::now();
+  BamTools::BamReader* reader = new BamTools::BamReader();
+  if (!reader->Open(bam_files_[file_index]))
+    printErrorAndDie("Failed to open BAM file " + bam_files_[file_index] + ": " + reader->GetErrorString());
+  if (!reader->OpenIndex(bam_indexes_[file_index]))
+    printErrorAndDie("Failed to open BAM index file " + bam_indexes_[file_index]);
+  if (!ref_vector_.empty() && !same_references(reader->GetReferenceData()))
+    printErrorAndDie("BAM file " + bam_files_[file_index] + " has different reference sequences than BAM file " + bam_files_[0]);
+  open_time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - open_start).count();
+
+  if (opened_before_[file_index])
+    num_reopens_++;
+  else
+    num_opens_++;
+  opened_before_[file_index] = true;
+
+  readers_[file_index] = reader;
+  lru_files_.push_front(file_index);
+  lru_iters_[file_index] = lru_files_.begin();
+  return reader;
+}
+
+bool BamFilePool::same_references(const BamTools::RefVector& ref_vector) const {
+  if (ref_vector.size() != ref_vector_.size())
+    return false;
+  for (unsigned int i = 0; i < ref_vector.size(); i++)
+    if (ref_vector[i].RefName.compare(ref_vector_[i].RefName) != 0 || ref_vector[i].RefLength != ref_vector_[i].RefLength)
+      return false;
+  return true;
+}
+
+void BamFilePool::close_file(int file_index){
+  if (readers_[file_index] == NULL)
+    return;
+  if (readers_[file_index] == cur_reader_)
+    cur_reader_ = NULL;
+  readers_[file_index]->Close();
+  delete readers_[file_index];
+  readers_[file_index] = NULL;
+  lru_files_.erase(lru_iters_[file_index]);
+  lru_iters_[file_index] = lru_files_.end();
+}
+
+int BamFilePool::get_reference_id(const std::string& chrom){
+  for (unsigned int i = 0; i < ref_vector_.size(); i++)
+    if (ref_vector_[i].RefName.compare(chrom) == 0)
+      return i;
+  return -1;
+}
+
+bool BamFilePool::set_region(int chrom_id, int32_t start, int32_t stop){
+  if (chrom_id < 0 || chrom_id >= ref_vector_.size())
+    return false;
+  have_region_     = true;
+  region_chrom_id_ = chrom_id;
+  region_start_    = start;
+  region_stop_     = stop;
+  num_visited_     = 0;
+  cur_reader_      = NULL;
+
+  // Alternate the direction in which the BAMs are visited, so that the most recently used handles from the previous region
+  // are the first ones required for this region. Visiting them in the same order for each region would instead result
+  // in every BAM being evicted before it's reused whenever the pool is smaller than the number of BAMs
+  forward_  = !forward_;
+  cur_file_ = (forward_ ? -1 : bam_files_.size());
+  return true;
+}
+
+bool BamFilePool::get_next_alignment_core(BamTools::BamAlignment& alignment){
+  if (!have_region_)
+    return false;
+
+  while (true){
+    if (cur_reader_ != NULL && cur_reader_->GetNextAlignmentCore(alignment))
+      return true;
+
+    // Advance to the next BAM
+    if (num_visited_ == bam_files_.size()){
+      have_region_ = false;
+      cur_reader_  = NULL;
+      return false;
+    }
+    cur_file_ += (forward_ ? 1 : -1);
+    num_visited_++;
+    cur_reader_ = acquire(cur_file_);
+    if (!cur_reader_->SetRegion(region_chrom_id_, region_start_, region_chrom_id_, region_stop_)){
+      std::stringstream error_msg;
+      error_msg << "Failed to set the region " << ref_vector_[region_chrom_id_].RefName << ":" << region_start_ << "-" << region_stop_
+		<< " for BAM file " << bam_files_[cur_file_];
+      printErrorAndDie(error_msg.str());
+    }
+  }
+}
+
+void BamFilePool::close(){
+  for (unsigned int i = 0; i < readers_.size(); i++)
+    close_file(i);
+  have_region_ = false;
+  cur_reader_  = NULL;
+}
+
+StreamingBamReader::StreamingBamReader(BamTools::BamReader& reader) : reader_(reader){
+  ref_vector_      = reader.GetReferenceData();
+  stream_done_     = false;
+  prev_ref_id_     = -1;
+  prev_pos_        = -1;
+  have_region_     = false;
+  region_chrom_id_ = -1;
+  region_start_    = -1;
+  region_stop_     = -1;
+  next_index_      = 0;
+  num_reads_       = 0;
+  max_buffered_    = 0;
+}
+
+bool StreamingBamReader::read_next(BamTools::BamAlignment& alignment){
+  if (stream_done_)
+    return false;
+  if (!reader_.GetNextAlignmentCore(alignment) || alignment.RefID == -1){
+    // Unplaced reads are at the end of a coordinate-sorted stream
+    stream_done_ = true;
+    return false;
+  }
+  num_reads_++;
+
+  if (alignment.RefID < prev_ref_id_ || (alignment.RefID == prev_ref_id_ && alignment.Position < prev_pos_)){
+    std::stringstream error_msg;
+    error_msg << "The BAM stream isn't sorted by coordinate: read " << num_reads_ << " at " << ref_vector_[alignment.RefID].RefName << ":"
+	      << alignment.Position << " follows a read at " << ref_vector_[prev_ref_id_].RefName << ":" << prev_pos_ << "\n"
+	      << "Please sort the stream using samtools sort before piping it to HipSTR";
+    printErrorAndDie(error_msg.str());
+  }
+  prev_ref_id_ = alignment.RefID;
+  prev_pos_    = alignment.Position;
+  return true;
+}
+
+bool StreamingBamReader::set_region(int chrom_id, int32_t start, int32_t stop){
+  if (chrom_id < 0 || chrom_id >= ref_vector_.size())
+    return false;
+  if (have_region_ && (chrom_id < region_chrom_id_ || (chrom_id == region_chrom_id_ && start < region_start_)))
+    printErrorAndDie("Regions must be processed in the order of the BAM stream's reference sequences and positions");
+  have_region_     = true;
+  region_chrom_id_ = chrom_id;
+  region_start_    = start;
+  region_stop_     = stop;
+  next_index_      = 0;
+
+  // Discard buffered alignments that end before the region, as the later regions can't overlap them either
+  std::deque<BamTools::BamAlignment> retained;
+  for (auto aln_iter = buffer_.begin(); aln_iter != buffer_.end(); aln_iter++)
+    if (aln_iter->RefID > chrom_id || (aln_iter->RefID == chrom_id && aln_iter->GetEndPosition() >= start))
+      retained.push_back(*aln_iter);
+  buffer_.swap(retained);
+
+  // Read the stream until it passes the end of the region
+  BamTools::BamAlignment alignment;
+  while ((buffer_.empty() || (buffer_.back().RefID == chrom_id && buffer_.back().Position <= stop)) && read_next(alignment)){
+    if (alignment.RefID < chrom_id || (alignment.RefID == chrom_id && alignment.GetEndPosition() < start))
+      continue;
+    buffer_.push_back(alignment);
+  }
+  max_buffered_ = std::max(max_buffered_, buffer_.size());
+  return true;
+}
+
+bool StreamingBamReader::get_next_alignment_core(BamTools::BamAlignment& alignment){
+  if (!have_region_)
+    return false;
+  while (next_index_ < buffer_.size()){
+    const BamTools::BamAlignment& buffered = buffer_[next_index_++];
+    if (buffered.RefID != region_chrom_id_ || buffered.Position > region_stop_)
+      break;
+    if (buffered.GetEndPosition() < region_start_)
+      continue;
+    alignment = buffered;
+    return true;
+  }
+  next_index_ = buffer_.size();
+  return false;
+}
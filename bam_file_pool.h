@@ -0,0 +1,176 @@
+#ifndef BAM_FILE_POOL_H_
+#define BAM_FILE_POOL_H_
+
+#include <stdint.h>
+
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "bamtools/include/api/BamAlignment.h"
+#include "bamtools/include/api/BamAux.h"
+#include "bamtools/include/api/BamMultiReader.h"
+#include "bamtools/include/api/BamReader.h"
+
+/*
+ * Interface used by the BamProcessor to extract the alignments in the vicinity of each locus,
+ * so that the reads can either be merged across all BAMs or read from each BAM in turn
+ */
+class BamRegionReader {
+ public:
+  virtual ~BamRegionReader(){}
+
+  virtual const BamTools::RefVector& get_reference_data() = 0;
+
+  virtual int get_reference_id(const std::string& chrom) = 0;
+
+  /* Restricts subsequent calls to get_next_alignment_core() to alignments overlapping [START, STOP] on chromosome CHROM_ID */
+  virtual bool set_region(int chrom_id, int32_t start, int32_t stop) = 0;
+
+  virtual bool get_next_alignment_core(BamTools::BamAlignment& alignment) = 0;
+
+  /* Returns true iff the reader can't seek, in which case regions must be requested in the order of the reads' reference IDs and positions */
+  virtual bool sequential(){ return false; }
+};
+
+/* Position-sorted merge of the alignments across all BAMs, with one open handle per BAM */
+class MergedBamReader : public BamRegionReader {
+ private:
+  BamTools::BamMultiReader& reader_;
+  BamTools::RefVector ref_vector_;
+
+ public:
+  explicit MergedBamReader(BamTools::BamMultiReader& reader) : reader_(reader){
+    ref_vector_ = reader.GetReferenceData();
+  }
+
+  const BamTools::RefVector& get_reference_data() { return ref_vector_; }
+
+  int get_reference_id(const std::string& chrom) { return reader_.GetReferenceID(chrom); }
+
+  bool set_region(int chrom_id, int32_t start, int32_t stop){
+    return reader_.SetRegion(chrom_id, start, chrom_id, stop);
+  }
+
+  bool get_next_alignment_core(BamTools::BamAlignment& alignment){
+    return reader_.GetNextAlignmentCore(alignment);
+  }
+};
+
+/*
+ * Reads the alignments for each region from one BAM at a time, rather than merging them across BAMs.
+ * At most MAX_OPEN_FILES BAMs are open at once, and the least recently used handle is closed whenever another BAM
+ * needs to be opened. This allows cohorts with more BAMs than the file descriptor limit to be analyzed, at the cost of reopening
+ * and reseeking evicted BAMs. As the alignments aren't merged, they're only sorted by position within each BAM.
+ *
+ * Pool statistics distinguish between hits (the BAM was already open), first opens, reopens of evicted BAMs and evictions,
+ * along with the total time spent opening BAMs and loading their indexes
+ */
+class BamFilePool : public BamRegionReader {
+ private:
+  std::vector<std::string> bam_files_, bam_indexes_;
+  std::vector<BamTools::BamReader*> readers_;
+  std::list<int> lru_files_;                         // Indices of open BAMs, from most to least recently used
+  std::vector<std::list<int>::iterator> lru_iters_;
+  int max_open_files_;
+  BamTools::RefVector ref_vector_;
+  std::string header_text_;
+
+  // State of the current region
+  bool have_region_;
+  int region_chrom_id_;
+  int32_t region_start_, region_stop_;
+  bool forward_;       // Whether the BAMs are being visited in increasing or decreasing order for the current region
+  int cur_file_, num_visited_;
+  BamTools::BamReader* cur_reader_;
+
+  // Pool statistics
+  int64_t num_hits_, num_opens_, num_reopens_, num_evictions_;
+  double open_time_;   // Wall-clock seconds spent opening BAMs and loading their indexes
+  std::vector<bool> opened_before_;
+
+  /* Returns an open reader for the BAM with index FILE_INDEX, evicting the least recently used BAM if the pool is full */
+  BamTools::BamReader* acquire(int file_index);
+
+  void close_file(int file_index);
+
+  /* Returns true iff REF_VECTOR has the same names and lengths as the pool's reference sequences */
+  bool same_references(const BamTools::RefVector& ref_vector) const;
+
+ public:
+  /*
+   * Opens each BAM and loads its index only when a region first requires it. The reference sequences shared by all BAMs
+   * are taken from REF_VECTOR if it isn't NULL (e.g. when they've been cached), and otherwise from the first BAM
+   */
+  BamFilePool(const std::vector<std::string>& bam_files, const std::vector<std::string>& bam_indexes, int max_open_files,
+	      const BamTools::RefVector* ref_vector = NULL);
+
+  ~BamFilePool(){
+    close();
+  }
+
+  const BamTools::RefVector& get_reference_data() { return ref_vector_;  }
+
+  /* Returns the header of the first BAM, opening it if required */
+  const std::string& get_header_text();
+
+  int get_reference_id(const std::string& chrom);
+
+  bool set_region(int chrom_id, int32_t start, int32_t stop);
+
+  bool get_next_alignment_core(BamTools::BamAlignment& alignment);
+
+  void close();
+
+  int64_t num_hits()      const { return num_hits_;      }
+  int64_t num_opens()     const { return num_opens_;     }
+  int64_t num_reopens()   const { return num_reopens_;   }
+  int64_t num_evictions() const { return num_evictions_; }
+  double  open_time()     const { return open_time_;     }
+};
+
+/*
+ * Reads a single coordinate-sorted BAM stream, such as one piped from an aligner to stdin, without an index. As the stream can't be
+ * reseeked, regions must be requested in order of their reference IDs and start coordinates. The alignments are buffered only while they
+ * may overlap the current region or a later one, and the stream is read only until it passes the end of the current region
+ */
+class StreamingBamReader : public BamRegionReader {
+ private:
+  BamTools::BamReader& reader_;
+  BamTools::RefVector ref_vector_;
+  std::deque<BamTools::BamAlignment> buffer_;  // Alignments that may overlap the current or later regions, in stream order
+  bool stream_done_;
+  int32_t prev_ref_id_, prev_pos_;             // Coordinates of the most recent alignment read from the stream
+
+  // State of the current region
+  bool have_region_;
+  int region_chrom_id_;
+  int32_t region_start_, region_stop_;
+  size_t next_index_;
+
+  // Stream statistics
+  int64_t num_reads_;
+  size_t max_buffered_;
+
+  /* Reads the next mapped alignment from the stream into ALIGNMENT. Returns false once the stream is exhausted */
+  bool read_next(BamTools::BamAlignment& alignment);
+
+ public:
+  explicit StreamingBamReader(BamTools::BamReader& reader);
+
+  const BamTools::RefVector& get_reference_data() { return ref_vector_; }
+
+  int get_reference_id(const std::string& chrom) { return reader_.GetReferenceID(chrom); }
+
+  bool set_region(int chrom_id, int32_t start, int32_t stop);
+
+  bool get_next_alignment_core(BamTools::BamAlignment& alignment);
+
+  bool sequential(){ return true; }
+
+  int64_t num_reads()    const { return num_reads_;    }
+  size_t max_buffered()  const { return max_buffered_; }
+};
+
+#endif
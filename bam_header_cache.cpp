@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "bam_header_cache.h"
+#include "error.h"
+#include "stringops.h"
+
+bool BamHeaderCache::get_file_stamp(const std::string& path, FileStamp& stamp){
+  struct stat file_info;
+  if (stat(path.c_str(), &file_info) != 0)
+    return false;
+  stamp.size  = file_info.st_size;
+  stamp.mtime = file_info.st_mtime;
+  return true;
+}
+
+void BamHeaderCache::load(){
+  std::ifstream input(filename_.c_str());
+  if (!input.is_open())
+    return;
+
+  // Discard the cache if it was written by a different version, as it'll be rebuilt from the BAMs
+  std::string line;
+  if (!std::getline(input, line) || line.compare("##bam_header_cache_version=" + std::to_string(VERSION)) != 0){
+    modified_ = true;
+    return;
+  }
+
+  std::vector<std::string> tokens;
+  while (std::getline(input, line)){
+    tokens.clear();
+    split_by_delim(line, '\t', tokens);
+    if (tokens.size() != 9 || tokens[0].compare("BAM") != 0)
+      printErrorAndDie("Malformed BAM header cache file " + filename_ + ". Please delete it and rerun the analysis");
+
+    CacheEntry& entry       = entries_[tokens[1]];
+    entry.bam_stamp.size    = std::stoll(tokens[2]);
+    entry.bam_stamp.mtime   = std::stoll(tokens[3]);
+    entry.index_file        = tokens[4];
+    entry.index_stamp.size  = std::stoll(tokens[5]);
+    entry.index_stamp.mtime = std::stoll(tokens[6]);
+    int num_read_groups     = std::stoi(tokens[7]);
+    int num_references      = std::stoi(tokens[8]);
+    entry.read_groups.clear();
+    entry.references.clear();
+    for (int i = 0; i < num_read_groups; i++){
+      tokens.clear();
+      if (!std::getline(input, line))
+	printErrorAndDie("Malformed BAM header cache file " + filename_ + ". Please delete it and rerun the analysis");
+      split_by_delim(line, '\t', tokens);
+      if (tokens.size() != 5 || tokens[0].compare("RG") != 0)
+	printErrorAndDie("Malformed BAM header cache file " + filename_ + ". Please delete it and rerun the analysis");
+      entry.read_groups.push_back(CachedReadGroup(tokens[1], tokens[2], tokens[3], tokens[4].compare("1") == 0));
+    }
+    for (int i = 0; i < num_references; i++){
+      tokens.clear();
+      if (!std::getline(input, line))
+	printErrorAndDie("Malformed BAM header cache file " + filename_ + ". Please delete it and rerun the analysis");
+      split_by_delim(line, '\t', tokens);
+      if (tokens.size() != 3 || tokens[0].compare("REF") != 0)
+	printErrorAndDie("Malformed BAM header cache file " + filename_ + ". Please delete it and rerun the analysis");
+      entry.references.push_back(CachedReference(tokens[1], std::stoi(tokens[2])));
+    }
+  }
+  input.close();
+}
+
+bool BamHeaderCache::lookup(const std::string& bam_file, const std::string& index_file,
+			    std::vector<CachedReadGroup>& read_groups, std::vector<CachedReference>& references){
+  auto entry_iter = entries_.find(bam_file);
+  FileStamp bam_stamp, index_stamp;
+  if (entry_iter == entries_.end() || entry_iter->second.index_file.compare(index_file) != 0
+      || !get_file_stamp(bam_file, bam_stamp) || !get_file_stamp(index_file, index_stamp)
+      || !(bam_stamp == entry_iter->second.bam_stamp) || !(index_stamp == entry_iter->second.index_stamp)){
+    num_misses_++;
+    return false;
+  }
+  read_groups = entry_iter->second.read_groups;
+  references  = entry_iter->second.references;
+  num_hits_++;
+  return true;
+}
+
+void BamHeaderCache::update(const std::string& bam_file, const std::string& index_file,
+			    const std::vector<CachedReadGroup>& read_groups, const std::vector<CachedReference>& references){
+  CacheEntry entry;
+  if (!get_file_stamp(bam_file, entry.bam_stamp) || !get_file_stamp(index_file, entry.index_stamp))
+    return;
+  entry.index_file  = index_file;
+  entry.read_groups = read_groups;
+  entry.references  = references;
+  entries_[bam_file] = entry;
+  modified_          = true;
+}
+
+void BamHeaderCache::save(){
+  if (!modified_)
+    return;
+
+  // Write to a temporary file and then rename it, so that concurrent jobs never observe a partially written cache
+  std::stringstream tmp_name;
+  tmp_name << filename_ << ".tmp." << getpid();
+  std::ofstream output(tmp_name.str().c_str());
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the BAM header cache file " + tmp_name.str() + " for writing");
+  output << "##bam_header_cache_version=" << VERSION << "\n";
+  for (auto entry_iter = entries_.begin(); entry_iter != entries_.end(); entry_iter++){
+    const CacheEntry& entry = entry_iter->second;
+    output << "BAM"                      << "\t" << entry_iter->first       << "\t"
+	   << entry.bam_stamp.size       << "\t" << entry.bam_stamp.mtime   << "\t"
+	   << entry.index_file           << "\t"
+	   << entry.index_stamp.size     << "\t" << entry.index_stamp.mtime << "\t"
+	   << entry.read_groups.size()   << "\t" << entry.references.size() << "\n";
+    for (auto rg_iter = entry.read_groups.begin(); rg_iter != entry.read_groups.end(); rg_iter++)
+      output << "RG" << "\t" << rg_iter->id << "\t" << rg_iter->sample << "\t" << rg_iter->library << "\t" << (rg_iter->has_library ? 1 : 0) << "\n";
+    for (auto ref_iter = entry.references.begin(); ref_iter != entry.references.end(); ref_iter++)
+      output << "REF" << "\t" << ref_iter->name << "\t" << ref_iter->length << "\n";
+  }
+  output.close();
+  if (output.fail() || rename(tmp_name.str().c_str(), filename_.c_str()) != 0)
+    printErrorAndDie("Failed to write the BAM header cache file " + filename_);
+  modified_ = false;
+}
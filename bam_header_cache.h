@@ -0,0 +1,108 @@
+#ifndef BAM_HEADER_CACHE_H_
+#define BAM_HEADER_CACHE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+class CachedReadGroup {
+ public:
+  std::string id, sample, library;
+  bool has_library;
+
+  CachedReadGroup(){
+    has_library = false;
+  }
+
+  CachedReadGroup(const std::string& rg_id, const std::string& rg_sample, const std::string& rg_library, bool rg_has_library){
+    id          = rg_id;
+    sample      = rg_sample;
+    library     = rg_library;
+    has_library = rg_has_library;
+  }
+};
+
+class CachedReference {
+ public:
+  std::string name;
+  int32_t length;
+
+  CachedReference(){
+    length = 0;
+  }
+
+  CachedReference(const std::string& ref_name, int32_t ref_length){
+    name   = ref_name;
+    length = ref_length;
+  }
+};
+
+/*
+ * Persistent manifest of the read groups, reference sequences and index files for a cohort of BAMs, so that repeated runs over the same
+ * BAMs (e.g. the shards of a scattered job) don't need to reopen every BAM to parse its header. When the BAMs are read using a pool of
+ * file handles, the cached reference sequences also allow each BAM and its index to be opened only once a locus requires them.
+ * Each entry is validated against the size and modification time of the BAM and its index, and stale or missing entries are refreshed by the caller.
+ *
+ * The cache is a versioned, tab-delimited text file containing one BAM line per file followed by one RG line per read group
+ * and one REF line per reference sequence:
+ *   BAM  <path>  <size>  <mtime>  <index path>  <index size>  <index mtime>  <number of read groups>  <number of references>
+ *   RG   <id>    <sample>  <library>  <has library>
+ *   REF  <name>  <length>
+ */
+class BamHeaderCache {
+ private:
+  class FileStamp {
+  public:
+    int64_t size, mtime;
+    FileStamp(){ size = -1; mtime = -1; }
+    bool operator==(const FileStamp& other) const { return size == other.size && mtime == other.mtime; }
+  };
+
+  class CacheEntry {
+  public:
+    FileStamp bam_stamp, index_stamp;
+    std::string index_file;
+    std::vector<CachedReadGroup> read_groups;
+    std::vector<CachedReference> references;
+  };
+
+  const static int VERSION = 2;
+  std::string filename_;
+  std::map<std::string, CacheEntry> entries_;
+  bool modified_;
+  int num_hits_, num_misses_;
+
+  static bool get_file_stamp(const std::string& path, FileStamp& stamp);
+
+  void load();
+
+ public:
+  explicit BamHeaderCache(const std::string& filename){
+    filename_   = filename;
+    modified_   = false;
+    num_hits_   = 0;
+    num_misses_ = 0;
+    load();
+  }
+
+  /*
+   * Returns true and fills in the read groups and reference sequences iff the cache has an entry for the BAM and index whose
+   * sizes and modification times match the files on disk
+   */
+  bool lookup(const std::string& bam_file, const std::string& index_file,
+	      std::vector<CachedReadGroup>& read_groups, std::vector<CachedReference>& references);
+
+  /* Adds or replaces the entry for the BAM using the current state of the BAM and index files */
+  void update(const std::string& bam_file, const std::string& index_file,
+	      const std::vector<CachedReadGroup>& read_groups, const std::vector<CachedReference>& references);
+
+  int num_hits()   const { return num_hits_;   }
+  int num_misses() const { return num_misses_; }
+
+  /* Rewrites the cache file if any of its entries were added or replaced */
+  void save();
+};
+
+#endif
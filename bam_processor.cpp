@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <locale>
@@ -11,6 +13,7 @@
 #include "alignment_filters.h"
 #include "error.h"
 #include "pcr_duplicates.h"
+#include "read_reservoir.h"
 #include "seqio.h"
 #include "stringops.h"
 #include "SeqAlignment/AlignmentOps.h"
@@ -130,13 +133,28 @@ std::string BamProcessor::get_read_group(BamTools::BamAlignment& aln, std::map<s
   return iter->second;
 }
 
-std::string BamProcessor::trim_alignment_name(BamTools::BamAlignment& aln){
-  std::string aln_name = aln.Name;
-  if (aln_name.size() > 2){
-    if (aln_name[aln_name.size()-2] == '/')
-      aln_name.resize(aln_name.size()-2);
+std::string BamProcessor::get_sample(BamTools::BamAlignment& aln, std::map<std::string, std::string>& rg_to_sample){
+  return (use_bam_rgs_ ? get_read_group(aln, rg_to_sample) : rg_to_sample[aln.Filename]);
+}
+
+bool BamProcessor::lookup_sample(BamTools::BamAlignment& aln, std::map<std::string, std::string>& rg_to_sample, std::string& sample){
+  std::string key = aln.Filename;
+  if (use_bam_rgs_){
+    std::string rg;
+    char tag_type = 'Z';
+    if (!aln.GetTagType("RG", tag_type) || !aln.GetTag("RG", rg))
+      return false;
+    key += rg;
   }
-  return aln_name;
+  auto sample_iter = rg_to_sample.find(key);
+  if (sample_iter == rg_to_sample.end())
+    return false;
+  sample = sample_iter->second;
+  return true;
+}
+
+std::string BamProcessor::trim_alignment_name(BamTools::BamAlignment& aln){
+  return ReadReservoir::read_unit_name(aln.Name);
 }
 
 std::string get_str_ref_allele(uint32_t start, uint32_t end, std::string& chrom_seq){
@@ -161,15 +179,16 @@ void BamProcessor::modify_and_write_alns(std::vector<BamTools::BamAlignment>& al
 
 }
 
-void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::string& chrom_seq, 
+void BamProcessor::read_and_filter_reads(BamRegionReader& reader, std::string& chrom_seq, 
 					 std::vector<Region>::iterator region_iter,
 					 std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
-					 std::vector<std::string>& rg_names,
-					 std::vector< std::vector<BamTools::BamAlignment> >& paired_strs_by_rg,
-					 std::vector< std::vector<BamTools::BamAlignment> >& mate_pairs_by_rg,
-					 std::vector< std::vector<BamTools::BamAlignment> >& unpaired_strs_by_rg,
-					 BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer){
-  locus_read_filter_time_ = clock();
+					 BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
+					 LocusReads& locus, std::ostream& log){
+  std::chrono::steady_clock::time_point filter_start = std::chrono::steady_clock::now();
+  std::vector<std::string>& rg_names = locus.rg_names;
+  std::vector< std::vector<BamTools::BamAlignment> >& paired_strs_by_rg   = locus.paired_strs_by_rg;
+  std::vector< std::vector<BamTools::BamAlignment> >& mate_pairs_by_rg    = locus.mate_pairs_by_rg;
+  std::vector< std::vector<BamTools::BamAlignment> >& unpaired_strs_by_rg = locus.unpaired_strs_by_rg;
 
   bool pass_to_bam     = pass_writer.IsOpen();
   bool filtered_to_bam = filt_writer.IsOpen();
@@ -180,14 +199,20 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
   int32_t bp_before_indel = 0, end_match_window = 0, num_end_matches = 0, read_has_N = 0, hard_clip = 0, soft_clip = 0, split_alignment = 0, low_qual_score = 0;
   BamTools::BamAlignment alignment;
 
-  const BamTools::RefVector& ref_vector = reader.GetReferenceData();
+  const BamTools::RefVector& ref_vector = reader.get_reference_data();
   std::vector<BamTools::BamAlignment> paired_str_alns, mate_alns, unpaired_str_alns;
   std::map<std::string, BamTools::BamAlignment> potential_strs, potential_mates;
   const std::string FILTER_TAG_NAME = "FT";
   const std::string FILTER_TAG_TYPE = "Z";
-  TOO_MANY_READS = false;
+  locus.too_many_reads = false;
+
+  // Passing STR reads are collected by a reservoir, which retains at most MAX_SAMPLE_READS read pairs per sample (if > 0)
+  std::vector<BamTools::BamAlignment> downsampled_alignments;
+  ReadReservoir reservoir(MAX_SAMPLE_READS, region_iter->start(), paired_str_alns, mate_alns, unpaired_str_alns,
+			  (pass_to_bam ? &region_alignments : NULL), (filtered_to_bam ? &downsampled_alignments : NULL));
+  int32_t num_downsampled = 0;
 
-  while (reader.GetNextAlignmentCore(alignment)){
+  while (reader.get_next_alignment_core(alignment)){
     // Discard reads that don't overlap the STR region and whose mate pair has no chance of overlapping the region
     if (alignment.Position > region_iter->stop() || alignment.GetEndPosition() < region_iter->start()){
       if (!alignment.IsPaired() || alignment.MatePosition == alignment.Position)
@@ -203,8 +228,9 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
       printErrorAndDie("Failed to build char data for BamAlignment");
 
     // Stop parsing reads if we've already exceeded the maximum number for downstream analyses
-    if (paired_str_alns.size() > MAX_TOTAL_READS){
-      TOO_MANY_READS = true;
+    // When downsampling, the reservoirs bound the number of retained reads, so the locus is never skipped
+    if (!reservoir.bounded() && reservoir.num_paired_str_reads() > MAX_TOTAL_READS){
+      locus.too_many_reads = true;
       break;
     }
 
@@ -212,6 +238,21 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
 	continue;
     assert(alignment.CigarData.size() > 0 && alignment.RefID != -1);
 
+    // When downsampling, discard reads whose read pair can no longer be retained by the sample's reservoir.
+    // Discarded reads that overlap the STR are reported like any other filtered read
+    if (reservoir.bounded()){
+      std::string sample;
+      if (lookup_sample(alignment, rg_to_sample, sample) && reservoir.rejects(sample, alignment)){
+	if (alignment.Position < region_iter->stop() && alignment.GetEndPosition() >= region_iter->start()){
+	  read_count++;
+	  num_downsampled++;
+	  if (filtered_to_bam)
+	    downsampled_alignments.push_back(alignment);
+	}
+	continue;
+      }
+    }
+
     // Only apply tests to putative STR reads that overlap the STR region
     if (alignment.Position < region_iter->stop() && alignment.GetEndPosition() >= region_iter->start()){
       bool pass_one = false; // Denotes if read passed first set of simpler filters
@@ -316,14 +357,8 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
 	if (aln_iter != potential_mates.end()){
 	  std::vector< std::pair<std::string, int32_t> > p_1, p_2;
 	  get_valid_pairings(alignment, aln_iter->second, ref_vector, p_1, p_2);
-	  if (p_1.size() == 1 && p_1[0].second == alignment.Position){
-	    paired_str_alns.push_back(alignment);
-	    mate_alns.push_back(aln_iter->second);
-	    if (pass_to_bam){
-	      region_alignments.push_back(alignment);
-	      region_alignments.push_back(aln_iter->second);
-	    }
-	  }
+	  if (p_1.size() == 1 && p_1[0].second == alignment.Position)
+	    reservoir.add_pair(get_sample(alignment, rg_to_sample), alignment, aln_iter->second, false);
 	  else {
 	    unique_mapping++;
 	    filter.append("NO_UNIQUE_MAPPING");
@@ -341,15 +376,8 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
 	  if (str_iter != potential_strs.end()){
 	    std::vector< std::pair<std::string, int32_t> > p_1, p_2;
 	    get_valid_pairings(alignment, str_iter->second, ref_vector, p_1, p_2);
-	    if (p_1.size() == 1 && p_1[0].second == alignment.Position){
-	      paired_str_alns.push_back(alignment);
-	      mate_alns.push_back(str_iter->second);
-	      if(pass_to_bam) region_alignments.push_back(alignment);
-
-	      paired_str_alns.push_back(str_iter->second);
-	      mate_alns.push_back(alignment);
-	      if (pass_to_bam) region_alignments.push_back(str_iter->second);
-	    }
+	    if (p_1.size() == 1 && p_1[0].second == alignment.Position)
+	      reservoir.add_pair(get_sample(alignment, rg_to_sample), alignment, str_iter->second, true);
 	    else {
 	      unique_mapping += 2;
 	      std::string filter = "NO_UNIQUE_MAPPING";
@@ -384,14 +412,8 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
       if (aln_iter != potential_strs.end()){
 	std::vector< std::pair<std::string, int32_t> > p_1, p_2;
 	get_valid_pairings(aln_iter->second, alignment, ref_vector, p_1, p_2);
-	if (p_1.size() == 1 && p_1[0].second == aln_iter->second.Position){
-	  paired_str_alns.push_back(aln_iter->second);
-	  mate_alns.push_back(alignment);
-	  if (pass_to_bam){
-	    region_alignments.push_back(aln_iter->second);
-	    region_alignments.push_back(alignment);
-	  }
-	}
+	if (p_1.size() == 1 && p_1[0].second == aln_iter->second.Position)
+	  reservoir.add_pair(get_sample(aln_iter->second, rg_to_sample), aln_iter->second, alignment, false);
 	else {
 	  unique_mapping++;
 	  std::string filter = "NO_UNIQUE_MAPPING";
@@ -425,10 +447,8 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
       filter = "NO_MATE_PAIR";
     }
 
-    if (filter.empty()){
-      unpaired_str_alns.push_back(aln_iter->second);
-      if (pass_to_bam) region_alignments.push_back(aln_iter->second);
-    }
+    if (filter.empty())
+      reservoir.add_unpaired(get_sample(aln_iter->second, rg_to_sample), aln_iter->second);
     else {
       if (filtered_to_bam){
 	filtered_alignments.push_back(aln_iter->second);
@@ -438,25 +458,37 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
     }
   }
   potential_strs.clear(); potential_mates.clear();
-  logger() << "Found " << paired_str_alns.size() << " fully paired reads and " << unpaired_str_alns.size() << " unpaired reads" << std::endl;
+  locus.downsample_frac = reservoir.finish();
+  num_downsampled      += reservoir.num_discarded();
+  if (locus.downsample_frac < 1.0)
+    log << "Downsampled reads to at most " << MAX_SAMPLE_READS << " read pairs per sample, retaining an estimated "
+	<< 100*locus.downsample_frac << "% of STR reads" << std::endl;
+  for (auto aln_iter = downsampled_alignments.begin(); aln_iter != downsampled_alignments.end(); aln_iter++){
+    filtered_alignments.push_back(*aln_iter);
+    if (!filtered_alignments.back().AddTag(FILTER_TAG_NAME, FILTER_TAG_TYPE, std::string("DOWNSAMPLED")))
+      printErrorAndDie("Failed to add filter tag to alignment");
+  }
+  log << "Found " << paired_str_alns.size() << " fully paired reads and " << unpaired_str_alns.size() << " unpaired reads" << std::endl;
   
-  logger() << read_count << " reads overlapped region, of which "
-	   << "\n\t" << split_alignment  << " had an SA (split alignment) BAM tag"
-	   << "\n\t" << read_has_N       << " had an 'N' base call"
-	   << "\n\t" << mapping_quality  << " had too low of a mapping quality"
-	   << "\n\t" << low_qual_score   << " had low base quality scores"
-	   << "\n\t" << not_spanning     << " did not span the STR";
+  log << read_count << " reads overlapped region, of which "
+      << "\n\t" << split_alignment  << " had an SA (split alignment) BAM tag"
+      << "\n\t" << read_has_N       << " had an 'N' base call"
+      << "\n\t" << mapping_quality  << " had too low of a mapping quality"
+      << "\n\t" << low_qual_score   << " had low base quality scores"
+      << "\n\t" << not_spanning     << " did not span the STR";
   if (false)
-    logger() << "\n\t" << hard_clip        << " had too many hard clipped bases"
-	     << "\n\t" << soft_clip        << " had too many soft clipped bases"
-	     << "\n\t" << flank_len        << " had too bps in one or more flanks"
-	     << "\n\t" << bp_before_indel  << " had too few bp before the first indel"
-	     << "\n\t" << end_match_window << " did not have the maximal number of end matches within the specified window"
-	     << "\n\t" << num_end_matches  << " had too few bp matches along the ends";
-  logger() << "\n\t" << unique_mapping   << " did not have a unique mapping";
+    log << "\n\t" << hard_clip        << " had too many hard clipped bases"
+	<< "\n\t" << soft_clip        << " had too many soft clipped bases"
+	<< "\n\t" << flank_len        << " had too bps in one or more flanks"
+	<< "\n\t" << bp_before_indel  << " had too few bp before the first indel"
+	<< "\n\t" << end_match_window << " did not have the maximal number of end matches within the specified window"
+	<< "\n\t" << num_end_matches  << " had too few bp matches along the ends";
+  log << "\n\t" << unique_mapping   << " did not have a unique mapping";
   if (REQUIRE_PAIRED_READS)
-    logger() << "\n\t" << num_filt_unpaired_reads << " did not have a mate pair";
-  logger() << "\n" << (paired_str_alns.size()+unpaired_str_alns.size()) << " PASSED ALL FILTERS" << "\n" << std::endl;
+    log << "\n\t" << num_filt_unpaired_reads << " did not have a mate pair";
+  if (reservoir.bounded())
+    log << "\n\t" << num_downsampled << " were discarded when downsampling";
+  log << "\n" << (paired_str_alns.size()+unpaired_str_alns.size()) << " PASSED ALL FILTERS" << "\n" << std::endl;
     
   // Output the reads passing all filters to a BAM file (if requested)
   if (pass_writer.IsOpen())
@@ -471,7 +503,7 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
   for (unsigned int type = 0; type < 2; ++type){
     std::vector<BamTools::BamAlignment>& aln_src  = (type == 0 ? paired_str_alns : unpaired_str_alns);
     for (unsigned int i = 0; i < aln_src.size(); ++i){
-      std::string rg = use_bam_rgs_ ? get_read_group(aln_src[i], rg_to_sample): rg_to_sample[aln_src[i].Filename];
+      std::string rg = get_sample(aln_src[i], rg_to_sample);
       int rg_index;
       auto index_iter = rg_indices.find(rg);
       if (index_iter == rg_indices.end()){
@@ -496,11 +528,83 @@ void BamProcessor::read_and_filter_reads(BamTools::BamMultiReader& reader, std::
     }
   }
 
-  locus_read_filter_time_  = (clock() - locus_read_filter_time_)/CLOCKS_PER_SEC;
-  total_read_filter_time_ += locus_read_filter_time_;
+  locus.read_filter_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - filter_start).count();
+}
+
+// Returns the reader's ID for the chromosome, allowing for a chr prefix in the region name but not the BAMs
+static int lookup_reference_id(BamRegionReader& reader, const std::string& chrom){
+  int chrom_id = reader.get_reference_id(chrom);
+  if (chrom_id == -1 && chrom.size() > 3 && chrom.substr(0, 3).compare("chr") == 0)
+    chrom_id = reader.get_reference_id(chrom.substr(3));
+  return chrom_id;
+}
+
+// Sorts the regions by the reader's reference IDs and then by their coordinates. Regions on unknown chromosomes are placed first,
+// as they're skipped without reading any alignments
+static void order_regions_by_reference(BamRegionReader& reader, std::vector<Region>& regions){
+  std::vector< std::pair<int, Region> > keyed_regions;
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++)
+    keyed_regions.push_back(std::pair<int, Region>(lookup_reference_id(reader, region_iter->chrom()), *region_iter));
+  std::sort(keyed_regions.begin(), keyed_regions.end());
+  for (unsigned int i = 0; i < keyed_regions.size(); i++)
+    regions[i] = keyed_regions[i].second;
+}
+
+void BamProcessor::load_locus_reads(BamRegionReader& reader, FastaReference* fasta_ref, std::string& fasta_dir,
+				    std::vector<Region>::iterator region_iter, int& cur_chrom_id, std::shared_ptr<std::string>& chrom_seq,
+				    std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
+				    BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
+				    LocusReads& locus, std::ostream& log){
+  locus.skipped = true;
+  log << "Processing region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << std::endl;
+  int chrom_id = lookup_reference_id(reader, region_iter->chrom());
+
+  if (chrom_id == -1){
+    log << "\n" << "WARNING: No reference sequence for chromosome " << region_iter->chrom() << " found in BAMs"  << "\n"
+	<< "\t" << "Please ensure that the names of reference sequences in your BED file match those in you BAMs" << "\n"
+	<< "\t" << "Skipping region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << "\n" << std::endl;
+    return;
+  }
+
+  if (region_iter->stop() - region_iter->start() > MAX_STR_LENGTH){
+    log << "Skipping region as the reference allele length exceeds the threshold (" << region_iter->stop()-region_iter->start() << " vs " << MAX_STR_LENGTH << ")" << "\n"
+	<< "You can increase this threshold using the --max-str-length option" << std::endl;
+    return;
+  }
+
+  // Read FASTA sequence for chromosome. Regions that are still queued keep the previous chromosome's sequence
+  if (cur_chrom_id != chrom_id){
+    cur_chrom_id      = chrom_id;
+    chrom_seq         = std::make_shared<std::string>();
+    std::string chrom = region_iter->chrom();
+    if (fasta_ref != NULL)
+      *chrom_seq = fasta_ref->getSequence(chrom);
+    else
+      readFastaFromDir(chrom+".fa", fasta_dir, *chrom_seq);
+    assert(chrom_seq->size() != 0);
+  }
+  locus.chrom_seq = chrom_seq;
+
+  if (region_iter->start() < 50 || region_iter->stop()+50 >= chrom_seq->size()){
+    log << "Skipping region within 50bp of the end of the contig" << std::endl;
+    return;
+  }
+
+  std::chrono::steady_clock::time_point seek_start = std::chrono::steady_clock::now();
+  if(!reader.set_region(chrom_id, (region_iter->start() < MAX_MATE_DIST ? 0: region_iter->start()-MAX_MATE_DIST),
+			region_iter->stop() + MAX_MATE_DIST)){
+    printErrorAndDie("One or more BAM files failed to set the region properly");
+  }
+  locus.bam_seek_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - seek_start).count();
+
+  read_and_filter_reads(reader, *chrom_seq, region_iter, rg_to_sample, rg_to_library, pass_writer, filt_writer, locus, log);
+
+  if (rem_pcr_dups_)
+    remove_pcr_duplicates(base_quality_, use_bam_rgs_, rg_to_library, locus.paired_strs_by_rg, locus.mate_pairs_by_rg, locus.unpaired_strs_by_rg, log);
+  locus.skipped = false;
 }
 
-void BamProcessor::process_regions(BamTools::BamMultiReader& reader, 
+void BamProcessor::process_regions(BamRegionReader& reader, 
 				   std::string& region_file, std::string& fasta_dir,
 				   std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
 				   BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
@@ -509,6 +613,10 @@ void BamProcessor::process_regions(BamTools::BamMultiReader& reader,
   readRegions(region_file, regions, max_regions, chrom, logger());
   orderRegions(regions);
 
+  // Readers that can't seek require the regions in the order of their alignments
+  if (reader.sequential())
+    order_regions_by_reference(reader, regions);
+
   FastaReference* fasta_ref = NULL;
   if (is_file(fasta_dir)){
     fasta_ref = new FastaReference();
@@ -516,62 +624,56 @@ void BamProcessor::process_regions(BamTools::BamMultiReader& reader,
     fasta_ref->open(fasta_dir);
   }
 
-  std::string ref_seq;
-  BamTools::RefVector ref_vector = reader.GetReferenceData();
-  int cur_chrom_id = -1; std::string chrom_seq;
-  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
-    logger() << "Processing region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << std::endl;
-    int chrom_id = reader.GetReferenceID(region_iter->chrom());
-    if (chrom_id == -1 && region_iter->chrom().size() > 3 && region_iter->chrom().substr(0, 3).compare("chr") == 0)
-      chrom_id = reader.GetReferenceID(region_iter->chrom().substr(3));
-
-    if (chrom_id == -1){
-      logger() << "\n" << "WARNING: No reference sequence for chromosome " << region_iter->chrom() << " found in BAMs"  << "\n"
-	       << "\t" << "Please ensure that the names of reference sequences in your BED file match those in you BAMs" << "\n"
-	       << "\t" << "Skipping region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << "\n" << std::endl;
-      continue;
-    }
+  // Skip any regions completed by an interrupted run, and record the progress after each region
+  int32_t num_completed = num_completed_regions(regions);
+  int32_t num_regions   = regions.size();
+
+  // When prefetching, the reader, FASTA reference, BAM writers and read group maps are only used by the prefetching thread,
+  // and each region's log messages are buffered until the region is processed
+  int cur_chrom_id = -1;
+  std::shared_ptr<std::string> chrom_seq;
+  ReadPrefetcher* prefetcher = NULL;
+  if (PREFETCH_LOCI > 0){
+    logger() << "Prefetching the reads for up to " << PREFETCH_LOCI << " regions on a separate thread" << std::endl;
+    prefetcher = new ReadPrefetcher(num_completed, num_regions, PREFETCH_LOCI, [&](int32_t index, LocusReads& locus){
+	load_locus_reads(reader, fasta_ref, fasta_dir, regions.begin()+index, cur_chrom_id, chrom_seq,
+			 rg_to_sample, rg_to_library, pass_writer, filt_writer, locus, locus.log);
+      });
+  }
 
-    if (region_iter->stop() - region_iter->start() > MAX_STR_LENGTH){
-      logger() << "Skipping region as the reference allele length exceeds the threshold (" << region_iter->stop()-region_iter->start() << " vs " << MAX_STR_LENGTH << ")" << "\n"
-	       << "You can increase this threshold using the --max-str-length option" << std::endl;
-      continue;
-    }
-    
-    // Read FASTA sequence for chromosome 
-    if (cur_chrom_id != chrom_id){
-      cur_chrom_id      = chrom_id;
-      std::string chrom = region_iter->chrom();
-      if (fasta_ref != NULL)
-	chrom_seq = fasta_ref->getSequence(chrom);
-      else
-	readFastaFromDir(chrom+".fa", fasta_dir, chrom_seq);
-      assert(chrom_seq.size() != 0);
+  for (int32_t index = num_completed; index < num_regions; index++, region_completed(regions, ++num_completed)){
+    LocusReads* locus;
+    if (prefetcher != NULL){
+      locus = prefetcher->next();
+      logger() << locus->log.str() << std::flush;
     }
-
-    if (region_iter->start() < 50 || region_iter->stop()+50 >= chrom_seq.size()){
-      logger() << "Skipping region within 50bp of the end of the contig" << std::endl;
-      continue;
+    else {
+      locus = new LocusReads();
+      load_locus_reads(reader, fasta_ref, fasta_dir, regions.begin()+index, cur_chrom_id, chrom_seq,
+		       rg_to_sample, rg_to_library, pass_writer, filt_writer, *locus, logger());
     }
 
-    locus_bam_seek_time_ = clock();
-    if(!reader.SetRegion(chrom_id, (region_iter->start() < MAX_MATE_DIST ? 0: region_iter->start()-MAX_MATE_DIST), 
-			 chrom_id, region_iter->stop() + MAX_MATE_DIST)){
-      printErrorAndDie("One or more BAM files failed to set the region properly");
+    if (!locus->skipped){
+      locus_bam_seek_time_     = locus->bam_seek_time;
+      total_bam_seek_time_    += locus_bam_seek_time_;
+      locus_read_filter_time_  = locus->read_filter_time;
+      total_read_filter_time_ += locus_read_filter_time_;
+      locus_downsample_frac_   = locus->downsample_frac;
+      TOO_MANY_READS           = locus->too_many_reads;
+
+      Region& region = regions[index];
+      std::string& locus_chrom_seq = *(locus->chrom_seq);
+      std::string ref_allele = get_str_ref_allele(region.start(), region.stop(), locus_chrom_seq);
+      process_reads(locus->paired_strs_by_rg, locus->mate_pairs_by_rg, locus->unpaired_strs_by_rg, locus->rg_names, region, ref_allele, locus_chrom_seq, out);
     }
-    locus_bam_seek_time_  =  (clock() - locus_bam_seek_time_)/CLOCKS_PER_SEC;
-    total_bam_seek_time_ += locus_bam_seek_time_;
-
-    std::vector<std::string> rg_names;
-    std::vector< std::vector<BamTools::BamAlignment> > paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg;
-    read_and_filter_reads(reader, chrom_seq, region_iter, rg_to_sample, rg_to_library, rg_names,
-			  paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, pass_writer, filt_writer);
-
-    if (rem_pcr_dups_)
-      remove_pcr_duplicates(base_quality_, use_bam_rgs_, rg_to_library, paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, logger());
+    delete locus;
+  }
 
-    std::string ref_allele = get_str_ref_allele(region_iter->start(), region_iter->stop(), chrom_seq);
-    process_reads(paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg, rg_names, *region_iter, ref_allele, chrom_seq, out);
+  if (prefetcher != NULL){
+    total_prefetch_stall_time_ = prefetcher->stall_time();
+    total_prefetch_idle_time_  = prefetcher->idle_time();
+    mean_prefetch_depth_       = prefetcher->mean_queue_depth();
+    delete prefetcher;
   }
 
   if (fasta_ref != NULL)
@@ -3,17 +3,21 @@
 
 #include <iostream>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "bamtools/include/api/BamAlignment.h"
-#include "bamtools/include/api/BamMultiReader.h"
 #include "bamtools/include/api/BamWriter.h"
 
+#include "bam_file_pool.h"
 #include "base_quality.h"
 #include "error.h"
+#include "read_prefetcher.h"
 #include "region.h"
 
+class FastaReference;
+
 class BamProcessor {
  private:
   bool use_bam_rgs_;
@@ -24,6 +28,12 @@ class BamProcessor {
   double locus_bam_seek_time_;
   double total_read_filter_time_;
   double locus_read_filter_time_;
+  double total_prefetch_stall_time_;
+  double total_prefetch_idle_time_;
+  double mean_prefetch_depth_;
+
+  // Estimated fraction of the current locus' STR reads retained after per-sample downsampling
+  double locus_downsample_frac_;
 
   void extract_mappings(BamTools::BamAlignment& aln, const BamTools::RefVector& ref_vector,
 			std::vector< std::pair<std::string, int32_t> >& chrom_pos_pairs);
@@ -31,17 +41,30 @@ class BamProcessor {
   void get_valid_pairings(BamTools::BamAlignment& aln_1, BamTools::BamAlignment& aln_2, const BamTools::RefVector& ref_vector,
 			  std::vector< std::pair<std::string, int32_t> >& p1, std::vector< std::pair<std::string, int32_t> >& p2);
 
-  void read_and_filter_reads(BamTools::BamMultiReader& reader, std::string& chrom_seq,
+  // Stores the region's reads and filtering statistics in LOCUS and writes its log messages to LOG. Doesn't modify any members,
+  // so that it can be invoked by the read prefetching thread
+  void read_and_filter_reads(BamRegionReader& reader, std::string& chrom_seq,
 			     std::vector<Region>::iterator region_iter,
 			     std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
-			     std::vector<std::string>& rg_names,
-			     std::vector< std::vector<BamTools::BamAlignment> >& paired_strs_by_rg,
-			     std::vector< std::vector<BamTools::BamAlignment> >& mate_pairs_by_rg,
-			     std::vector< std::vector<BamTools::BamAlignment> >& unpaired_strs_by_rg,
-			     BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer);
+			     BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
+			     LocusReads& locus, std::ostream& log);
+
+  // Loads the reads for the region into LOCUS, or marks it as skipped if it can't be genotyped. CUR_CHROM_ID and CHROM_SEQ
+  // track the most recently loaded chromosome, which is only reread when the region is on a different chromosome
+  void load_locus_reads(BamRegionReader& reader, FastaReference* fasta_ref, std::string& fasta_dir,
+			std::vector<Region>::iterator region_iter, int& cur_chrom_id, std::shared_ptr<std::string>& chrom_seq,
+			std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
+			BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
+			LocusReads& locus, std::ostream& log);
 
  std::string get_read_group(BamTools::BamAlignment& aln, std::map<std::string, std::string>& read_group_mapping);
 
+ // Returns the sample associated with the alignment's read group (or BAM file, if custom read groups are used)
+ std::string get_sample(BamTools::BamAlignment& aln, std::map<std::string, std::string>& rg_to_sample);
+
+ // Identical to get_sample(), except that it returns false instead of terminating if the alignment has no known sample
+ bool lookup_sample(BamTools::BamAlignment& aln, std::map<std::string, std::string>& rg_to_sample, std::string& sample);
+
  std::string trim_alignment_name(BamTools::BamAlignment& aln);
 
  void modify_and_write_alns(std::vector<BamTools::BamAlignment>& alignments,
@@ -71,12 +94,18 @@ class BamProcessor {
    locus_bam_seek_time_     = -1;
    total_read_filter_time_  = 0;
    locus_read_filter_time_  = -1;
+   total_prefetch_stall_time_ = 0;
+   total_prefetch_idle_time_  = 0;
+   mean_prefetch_depth_       = 0;
+   PREFETCH_LOCI            = 0;
    MAX_SOFT_CLIPS           = 1000;
    MAX_HARD_CLIPS           = 1000;
    MAX_STR_LENGTH           = 100;
    MIN_SUM_QUAL_LOG_PROB    = -10;
    log_to_file_             = false;
    MAX_TOTAL_READS          = 25000;
+   MAX_SAMPLE_READS         = 0;
+   locus_downsample_frac_   = 1.0;
    BASE_QUAL_TRIM           = ' ';
  }
 
@@ -89,17 +118,30 @@ class BamProcessor {
  double locus_bam_seek_time()    { return locus_bam_seek_time_;    }
  double total_read_filter_time() { return total_read_filter_time_; }
  double locus_read_filter_time() { return locus_read_filter_time_; }
+ double locus_downsample_frac()  { return locus_downsample_frac_;  }
+ double total_prefetch_stall_time() { return total_prefetch_stall_time_; }
+ double total_prefetch_idle_time()  { return total_prefetch_idle_time_;  }
+ double mean_prefetch_depth()       { return mean_prefetch_depth_;       }
  void use_custom_read_groups()   { use_bam_rgs_ = false;           }
  void allow_pcr_dups()           { rem_pcr_dups_ = false;          }
 
  void set_min_mapping_quality(int quality) { MIN_MAPPING_QUALITY = quality; }
 
- void process_regions(BamTools::BamMultiReader& reader,
+ void process_regions(BamRegionReader& reader,
 		      std::string& region_file, std::string& fasta_dir,
 		      std::map<std::string, std::string>& rg_to_sample, std::map<std::string, std::string>& rg_to_library,
 		      BamTools::BamWriter& pass_writer, BamTools::BamWriter& filt_writer,
 		      std::ostream& out, int32_t max_regions, std::string chrom);
   
+ /*
+  * Returns the number of regions, in the order they'll be processed, that were completed by a previous run and can be skipped.
+  * Subclasses that can resume interrupted runs override this method
+  */
+ virtual int32_t num_completed_regions(const std::vector<Region>& regions){ return 0; }
+
+ // Invoked after each region is processed or skipped, with the number of regions completed so far
+ virtual void region_completed(const std::vector<Region>& regions, int32_t num_completed){}
+
  virtual void process_reads(std::vector< std::vector<BamTools::BamAlignment> >& paired_strs_by_rg,
 			    std::vector< std::vector<BamTools::BamAlignment> >& mate_pairs_by_rg,
 			    std::vector< std::vector<BamTools::BamAlignment> >& unpaired_strs_by_rg,
@@ -151,6 +193,8 @@ class BamProcessor {
  int     REQUIRE_PAIRED_READS;  // Only utilize paired STR reads to genotype individuals
  double  MIN_SUM_QUAL_LOG_PROB;
  int32_t MAX_TOTAL_READS;       // Skip loci where the number of STR reads passing all filters exceeds this limit
+ int32_t MAX_SAMPLE_READS;      // If > 0, downsample each sample to at most this many STR read pairs instead of applying MAX_TOTAL_READS
+ int32_t PREFETCH_LOCI;         // If > 0, the reads for up to this many upcoming regions are loaded on a separate thread during genotyping
  char    BASE_QUAL_TRIM;        // Trim boths ends of the read until encountering a base with quality greater than this threshold
  bool    TOO_MANY_READS;        // Flag set if the current locus being processed as too many reads
 };
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <assert.h>
+#include <limits.h>
 #include <map>
 #include <sstream>
 
@@ -9,21 +10,40 @@
 #include "mathops.h"
 #include "stringops.h"
 
-std::string BaseQuality::median_base_qualities(const std::vector<const std::string*>& qualities){
-  assert(qualities.size() > 0);
+std::string BaseQuality::median_base_qualities(const std::string& arena, const std::vector<int64_t>& starts, const std::vector<int32_t>& reads){
+  assert(reads.size() > 0);
 
   // Check that all base quality strings are of the same length
-  for (unsigned int i = 0; i < qualities.size(); i++)
-    if (qualities[i]->size() != qualities[0]->size())
+  int64_t length = starts[reads[0]+1] - starts[reads[0]];
+  for (unsigned int i = 0; i < reads.size(); i++)
+    if (starts[reads[i]+1] - starts[reads[i]] != length)
       printErrorAndDie("All base quality strings must be of the same length when averaging probabilities");
 
-  std::string median_qualities(qualities[0]->size(), 'N');
-  for (unsigned int i = 0; i < qualities[0]->size(); i++){
-    std::vector<char> quals;
-    for (unsigned int j = 0; j < qualities.size(); j++)
-      quals.push_back(qualities[j]->at(i));
-    std::sort(quals.begin(), quals.end());
-    median_qualities[i] = quals[quals.size()/2];
+  if (reads.size() == 1)
+    return arena.substr(starts[reads[0]], length);
+
+  // Select each position's median from a histogram of its qualities. Bins are offset by CHAR_MIN so that they're in the same
+  // order as sorted chars, and only the range of bins used by a position is cleared afterwards
+  int counts[256] = {0};
+  size_t median_rank = reads.size()/2;
+  std::string median_qualities(length, 'N');
+  for (int64_t i = 0; i < length; i++){
+    int min_bin = 255, max_bin = 0;
+    for (unsigned int j = 0; j < reads.size(); j++){
+      int bin = arena[starts[reads[j]]+i] - CHAR_MIN;
+      counts[bin]++;
+      min_bin = std::min(min_bin, bin);
+      max_bin = std::max(max_bin, bin);
+    }
+
+    size_t num_below = 0;
+    int bin = min_bin;
+    while (num_below + counts[bin] <= median_rank)
+      num_below += counts[bin++];
+    median_qualities[i] = (char)(bin + CHAR_MIN);
+
+    for (bin = min_bin; bin <= max_bin; bin++)
+      counts[bin] = 0;
   }
   return median_qualities;
 }
@@ -82,7 +82,11 @@ class BaseQuality {
     return sum;
   }
 
-  std::string median_base_qualities(const std::vector<const std::string*>& qualities);
+  /*
+   * Returns the median quality at each position across the quality strings of the provided reads, where read i's qualities are
+   * ARENA[STARTS[i], STARTS[i+1]). The median of N qualities is the element at index N/2 after sorting them
+   */
+  std::string median_base_qualities(const std::string& arena, const std::vector<int64_t>& starts, const std::vector<int32_t>& reads);
 
   void deduce_quality_encodings(BamTools::BamMultiReader& reader);
 };
@@ -20,16 +20,220 @@ Typical usage:
 bgzfostream inherits from std::ostream and can be used interchangeably.
 bgzfistream inherits from std::istream and can be used interchangeably.
 
+Output streams can compress blocks using multiple threads (set_threads) and
+can build a tabix index for VCF-formatted output as it is written
+(build_index). Record offsets are tracked in uncompressed coordinates and
+resolved against the BGZF block headers when the stream is closed, as the
+compressed address of a block isn't known until its worker thread is done.
+
+An output stream can also resume writing a file left by an interrupted run
+(resume). The file is truncated at the uncompressed offset of a checkpoint,
+which must lie within the complete blocks that reached the disk, and the
+part of the block containing the offset that precedes it is rewritten.
+
 TODO:
 `. Replace 'err()' with proper STL exceptions.
 
 ************************************************************************/
 
 #include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <istream>
 #include <ostream>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #include "htslib/htslib/bgzf.h"
+#include "htslib/htslib/hts.h"
+
+/*
+ * Builds a tabix (or CSI, for very long contigs) index for a BGZF-compressed VCF from its uncompressed contents, which are provided
+ * in order using track(). Record offsets are tracked in uncompressed coordinates and are resolved against the sizes of the file's
+ * BGZF blocks when the index is written, so the file's blocks can be of any size
+ */
+class bgzf_vcf_indexer {
+ private:
+  struct index_record {
+    int32_t  tid, beg, end;
+    uint64_t offset;  // Uncompressed offset of the end of the record
+  };
+
+  uint64_t num_tracked;
+  uint64_t first_record_offset;
+  uint64_t line_start;
+  int num_tabs;
+  bool header_line;
+  std::string line_prefix;
+  std::map<std::string, int32_t> contig_indices;
+  std::vector<std::string> contigs;
+  std::vector<index_record> records;
+
+  // Extract the contig and coordinates from the CHROM, POS and REF fields of a VCF record
+  void add_record(uint64_t end_offset){
+    size_t i_1 = line_prefix.find('\t');
+    size_t i_2 = line_prefix.find('\t', i_1+1);
+    size_t i_3 = line_prefix.find('\t', i_2+1);
+    std::string chrom = line_prefix.substr(0, i_1);
+    int32_t pos       = atoi(line_prefix.c_str()+i_1+1);
+
+    std::map<std::string, int32_t>::iterator contig_iter = contig_indices.find(chrom);
+    if (contig_iter == contig_indices.end()){
+      contig_iter = contig_indices.insert(std::pair<std::string, int32_t>(chrom, contigs.size())).first;
+      contigs.push_back(chrom);
+    }
+    if (records.empty())
+      first_record_offset = line_start;
+
+    index_record record;
+    record.tid    = contig_iter->second;
+    record.beg    = pos-1;
+    record.end    = pos-1 + (int32_t)(line_prefix.size()-i_3-1);
+    record.offset = end_offset;
+    records.push_back(record);
+  }
+
+  static uint64_t virtual_offset(uint64_t offset, const std::vector<uint64_t>& block_addresses, const std::vector<uint64_t>& block_starts,
+				 const std::string& filename){
+    if (offset > block_starts.back())
+      errx(1, "Record offset exceeds the size of %s", filename.c_str());
+    if (block_starts.size() == 1)
+      return 0;
+
+    // Offsets at the boundary of two blocks are assigned to the start of the latter block
+    size_t block = std::upper_bound(block_starts.begin(), block_starts.end()-1, offset) - block_starts.begin() - 1;
+    return (block_addresses[block] << 16) | (offset - block_starts[block]);
+  }
+
+ public:
+  bgzf_vcf_indexer(){
+    reset();
+  }
+
+  void reset(){
+    num_tracked         = 0;
+    first_record_offset = 0;
+    line_start          = 0;
+    num_tabs            = 0;
+    header_line         = false;
+    line_prefix.clear();
+    contig_indices.clear();
+    contigs.clear();
+    records.clear();
+  }
+
+  /* Number of uncompressed bytes tracked */
+  uint64_t size(){ return num_tracked; }
+
+  void track(const char* s, std::streamsize n){
+    for (std::streamsize i = 0; i < n; i++){
+      char c = s[i];
+      if (c == '\n'){
+	if (!header_line && num_tabs >= 4)
+	  add_record(num_tracked+i+1);
+	line_start  = num_tracked+i+1;
+	num_tabs    = 0;
+	header_line = false;
+	line_prefix.clear();
+      }
+      else if (num_tabs < 4 && !header_line){
+	if (c == '#' && line_start == num_tracked+i)
+	  header_line = true;
+	else if (c == '\t')
+	  num_tabs++;
+	if (num_tabs < 4)
+	  line_prefix.push_back(c);
+      }
+    }
+    num_tracked += n;
+  }
+
+  /*
+   * Determines the address and uncompressed starting offset of each complete BGZF block in the file, followed by the
+   * address of the end of the last complete block and the total uncompressed size of the complete blocks
+   */
+  static void read_blocks(const std::string& path, std::vector<uint64_t>& block_addresses, std::vector<uint64_t>& block_starts){
+    FILE* input = fopen(path.c_str(), "rb");
+    if (input == NULL)
+      err(1, "Failed to open %s to read its BGZF blocks", path.c_str());
+    struct stat file_info;
+    if (fstat(fileno(input), &file_info) != 0)
+      err(1, "Failed to determine the size of %s", path.c_str());
+
+    block_addresses.clear();
+    block_starts.clear();
+    uint64_t address = 0, uncompressed_offset = 0;
+    uint8_t header[18], isize[4];
+    while (fread(header, 1, 18, input) == 18){
+      if (header[0] != 31 || header[1] != 139)
+	errx(1, "Malformed BGZF block header in %s", path.c_str());
+      uint64_t block_size = ((uint64_t)header[16] | ((uint64_t)header[17] << 8)) + 1;
+      if (address + block_size > (uint64_t)file_info.st_size)
+	break;
+
+      // The last 4 bytes of each block contain its uncompressed size
+      if (fseeko(input, (off_t)(address+block_size-4), SEEK_SET) != 0 || fread(isize, 1, 4, input) != 4)
+	err(1, "Failed to read a BGZF block in %s", path.c_str());
+      block_addresses.push_back(address);
+      block_starts.push_back(uncompressed_offset);
+      address             += block_size;
+      uncompressed_offset += (uint64_t)isize[0] | ((uint64_t)isize[1] << 8) | ((uint64_t)isize[2] << 16) | ((uint64_t)isize[3] << 24);
+      if (fseeko(input, (off_t)address, SEEK_SET) != 0)
+	err(1, "Failed to seek in %s while reading its BGZF blocks", path.c_str());
+    }
+    fclose(input);
+    block_addresses.push_back(address);
+    block_starts.push_back(uncompressed_offset);
+  }
+
+  /* Writes the index for the closed file, whose uncompressed contents must have been tracked */
+  void write_index(const std::string& filename){
+    int64_t max_end = 0;
+    for (std::vector<index_record>::iterator rec_iter = records.begin(); rec_iter != records.end(); rec_iter++)
+      max_end = std::max(max_end, (int64_t)rec_iter->end);
+    int min_shift = 14, n_lvls = 5, fmt = HTS_FMT_TBI;
+    if (max_end >= (1 << 29)){
+      int64_t s = 1 << min_shift;
+      for (n_lvls = 0; max_end + 256 > s; ++n_lvls, s <<= 3);
+      fmt = HTS_FMT_CSI;
+    }
+
+    std::vector<uint64_t> block_addresses, block_starts;
+    read_blocks(filename, block_addresses, block_starts);
+
+    hts_idx_t* idx = hts_idx_init(contigs.size(), fmt, virtual_offset(first_record_offset, block_addresses, block_starts, filename), min_shift, n_lvls);
+    for (std::vector<index_record>::iterator rec_iter = records.begin(); rec_iter != records.end(); rec_iter++){
+      if (hts_idx_push(idx, rec_iter->tid, rec_iter->beg, rec_iter->end, virtual_offset(rec_iter->offset, block_addresses, block_starts, filename), 1) < 0){
+	warnx("Records in %s are not sorted. No index will be written", filename.c_str());
+	hts_idx_destroy(idx);
+	return;
+      }
+    }
+    hts_idx_finish(idx, virtual_offset(num_tracked, block_addresses, block_starts, filename));
+
+    // Store the contig names and the VCF column configuration in the same layout as tabix
+    std::string names;
+    for (std::vector<std::string>::iterator contig_iter = contigs.begin(); contig_iter != contigs.end(); contig_iter++)
+      names.append(contig_iter->c_str(), contig_iter->size()+1);
+    uint32_t config[7] = {2, 1, 2, 0, '#', 0, (uint32_t)names.size()};
+    uint8_t* meta = (uint8_t*)malloc(sizeof(config) + names.size());
+    memcpy(meta, config, sizeof(config));
+    memcpy(meta+sizeof(config), names.data(), names.size());
+    hts_idx_set_meta(idx, sizeof(config) + names.size(), meta, 0);
+
+    if (hts_idx_save(idx, filename.c_str(), fmt) != 0)
+      err(1, "Failed to write the index for %s", filename.c_str());
+    hts_idx_destroy(idx);
+  }
+};
 
 class bgzf_streambuf : public std::streambuf {
  private:
@@ -37,9 +241,29 @@ class bgzf_streambuf : public std::streambuf {
   std::string filename;
   int cur_val;
 
+  uint64_t num_written;  // Uncompressed bytes written to the file
+
+  // On-the-fly index state
+  bool index_;
+  bgzf_vcf_indexer indexer;
+
+  void write(const char* s, std::streamsize n){
+    ssize_t i = bgzf_write(_fp, s, n);
+    if (i < 0)
+      err(1,"bgzf_write(%s) failed", filename.c_str());
+    if ((std::streamsize)i != n)
+      err(1,"bgzf_write(%s) wrote only %zd, asked for %zu bytes",
+	  filename.c_str(), i, n);
+    if (index_)
+      indexer.track(s, n);
+    num_written += n;
+  }
+
  public:
  bgzf_streambuf(): _fp(NULL){ 
-    cur_val = -999;
+    cur_val     = -999;
+    index_      = false;
+    num_written = 0;
   }
   
   virtual ~bgzf_streambuf(){
@@ -53,7 +277,86 @@ class bgzf_streambuf : public std::streambuf {
     _fp = bgzf_open(_filename, mode);
     if (_fp == NULL)
       err(1,"bgzf_open(%s,%s) failed", _filename, mode);
+    filename    = _filename;
+    num_written = 0;
+  }
+
+  /* Compress blocks using the provided number of threads */
+  void set_threads(int n_threads){
+    if (_fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: set_threads: called on non-open stream");
+    if (n_threads > 1 && bgzf_mt(_fp, n_threads, 256) != 0)
+      errx(1, "bgzf_mt(%s) failed", filename.c_str());
+  }
+
+  /* Build a tabix index for the VCF records written to the stream, which is saved alongside the file on close */
+  void build_index(){
+    if (_fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: build_index: called on non-open stream");
+    if (filename.compare("-") == 0)
+      return;
+    index_ = true;
+    indexer.reset();
+  }
+
+  /* End the current BGZF block, so that subsequent output starts in a new block */
+  void flush_block(){
+    if (_fp == NULL)
+      throw std::invalid_argument("bgzf_streambuf: flush_block: called on non-open stream");
+    if (bgzf_flush(_fp) != 0)
+      errx(1, "bgzf_flush(%s) failed", filename.c_str());
+  }
+
+  /* Number of uncompressed bytes written to the stream */
+  uint64_t uncompressed_offset(){ return num_written; }
+
+  /*
+   * Reopens a BGZF file written by an interrupted run and truncates it at the provided uncompressed offset, so that subsequent writes
+   * continue the file as if it had been written without interruption. If INDEX is true, a tabix index for the records preceding the
+   * offset and all subsequent records is constructed. Returns false without modifying the file if it doesn't contain the offset in
+   * complete blocks, as can happen when the interruption prevented buffered blocks from being written
+   */
+  bool resume(const char* _filename, uint64_t offset, int n_threads, bool index){
+    if (_fp != NULL)
+      throw std::invalid_argument("bgzf_streambuf: resume: called on an open stream");
+
+    std::vector<uint64_t> block_addresses, block_starts;
+    bgzf_vcf_indexer::read_blocks(_filename, block_addresses, block_starts);
+    if (offset > block_starts.back())
+      return false;
+    size_t block = std::upper_bound(block_starts.begin(), block_starts.end()-1, offset) - block_starts.begin() - 1;
+    if (block_starts.size() == 1)
+      block = 0;
+
+    // Read the blocks preceding the offset's block to rebuild the index, and the part of its block that will be rewritten
+    BGZF* input = bgzf_open(_filename, "r");
+    if (input == NULL)
+      err(1, "bgzf_open(%s,r) failed", _filename);
     filename = _filename;
+    index_   = index;
+    indexer.reset();
+    std::vector<char> buffer(BGZF_MAX_BLOCK_SIZE);
+    uint64_t num_read = 0;
+    while (num_read < block_starts[block]){
+      std::streamsize n = (std::streamsize)std::min((uint64_t)BGZF_BLOCK_SIZE, block_starts[block]-num_read);
+      if (bgzf_read(input, buffer.data(), n) != n)
+	errx(1, "Failed to read the first %llu bytes of %s", (unsigned long long)offset, _filename);
+      if (index_)
+	indexer.track(buffer.data(), n);
+      num_read += n;
+    }
+    std::streamsize tail_size = (std::streamsize)(offset-num_read);
+    if (tail_size > 0 && bgzf_read(input, buffer.data(), tail_size) != tail_size)
+      errx(1, "Failed to read the first %llu bytes of %s", (unsigned long long)offset, _filename);
+    bgzf_close(input);
+
+    if (truncate(_filename, (off_t)block_addresses[block]) != 0)
+      err(1, "Failed to truncate %s", _filename);
+    open(_filename, "a");
+    set_threads(n_threads);
+    num_written = num_read;
+    write(buffer.data(), tail_size);
+    return true;
   }
   
   void close(){
@@ -63,8 +366,13 @@ class bgzf_streambuf : public std::streambuf {
     int i = bgzf_close(_fp);
     if (i != 0)
       err(1,"bgzf_close(%s) failed", filename.c_str());
-    
     _fp = NULL;
+
+    if (index_){
+      indexer.write_index(filename);
+      index_ = false;
+      indexer.reset();
+    }
     filename = "";
   }
   
@@ -93,28 +401,14 @@ class bgzf_streambuf : public std::streambuf {
 
   virtual int overflow(int c = EOF){
     char z = (char) c;
-    ssize_t i = bgzf_write(_fp, &z, 1);
-    if (i < 0) {
-      err(1,"bgzf_write(%s) failed", filename.c_str());
-      return EOF;
-    }
+    write(&z, 1);
     return c;
   }
 
   virtual std::streamsize xsputn (const char* s, std::streamsize n){
     if ( _fp == NULL)
       throw std::invalid_argument("bgzf_streambuf: overflow: called on non-open stream");
-    
-    ssize_t i = bgzf_write(_fp, s, n);
-    if (i < 0) {
-      err(1,"bgzf_write(%s) failed", filename.c_str());
-      return EOF;
-    }
-    if ((std::streamsize)i != n) {
-      err(1,"bgzf_write(%s) wrote only %zd, asked for %zu bytes",
-	  filename.c_str(), i, n);
-      return EOF;
-    }
+    write(s, n);
     return (std::streamsize)n;
   }
 };
@@ -158,6 +452,29 @@ class bgzfostream : public std::ostream {
     rdbuf(&buf);
   }
 
+  void set_threads(int n_threads){
+    buf.set_threads(n_threads);
+  }
+
+  void build_index(){
+    buf.build_index();
+  }
+
+  void flush_block(){
+    buf.flush_block();
+  }
+
+  uint64_t uncompressed_offset(){
+    return buf.uncompressed_offset();
+  }
+
+  bool resume(const char* filename, uint64_t offset, int n_threads, bool index){
+    if (!buf.resume(filename, offset, n_threads, index))
+      return false;
+    rdbuf(&buf);
+    return true;
+  }
+
   void close(){
     buf.close();
   }
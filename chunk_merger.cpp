@@ -0,0 +1,163 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+#include "chunk_merger.h"
+#include "error.h"
+#include "stringops.h"
+
+static bool allele_length_lt(const std::string& s1, const std::string& s2){
+  return (s1.size() != s2.size() ? s1.size() < s2.size() : s1 < s2);
+}
+
+void ChunkAlleleMerger::add_chunk(int32_t vcf_pos, const std::vector<std::string>& alleles){
+  assert(!alleles.empty());
+  chunk_positions_.push_back(vcf_pos-1);
+  chunk_alleles_.push_back(alleles);
+}
+
+void ChunkAlleleMerger::merge(const Region& region, const std::string& chrom_seq, std::vector<std::string>& alleles, int32_t& pos){
+  assert(!chunk_alleles_.empty());
+  assert(alleles.empty());
+
+  // Determine the window spanned by all of the chunks' reference alleles
+  int32_t start = chunk_positions_[0], end = chunk_positions_[0] + chunk_alleles_[0][0].size();
+  for (unsigned int i = 1; i < chunk_alleles_.size(); i++){
+    start = std::min(start, chunk_positions_[i]);
+    end   = std::max(end,   (int32_t)(chunk_positions_[i] + chunk_alleles_[i][0].size()));
+  }
+
+  // Pad each allele with the reference sequence so that it spans the window
+  std::string ref_allele = uppercase(chrom_seq.substr(start, end-start));
+  std::set<std::string> alt_alleles;
+  for (unsigned int i = 0; i < chunk_alleles_.size(); i++){
+    int32_t chunk_end       = chunk_positions_[i] + chunk_alleles_[i][0].size();
+    std::string left_flank  = uppercase(chrom_seq.substr(start, chunk_positions_[i]-start));
+    std::string right_flank = uppercase(chrom_seq.substr(chunk_end, end-chunk_end));
+    for (unsigned int j = 1; j < chunk_alleles_[i].size(); j++){
+      std::string allele = left_flank + uppercase(chunk_alleles_[i][j]) + right_flank;
+      if (allele.compare(ref_allele) != 0)
+	alt_alleles.insert(allele);
+    }
+  }
+  alleles.push_back(ref_allele);
+  alleles.insert(alleles.end(), alt_alleles.begin(), alt_alleles.end());
+
+  // Trim sequence shared by all alleles from the right until reaching the STR or a mismatched base
+  while (end > region.stop()){
+    bool trim = true;
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      if (alleles[i].size() <= 1 || alleles[i].back() != alleles[0].back()){
+	trim = false;
+	break;
+      }
+    if (!trim) break;
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      alleles[i].pop_back();
+    end--;
+  }
+
+  // Trim shared sequence from the left until reaching the STR, but retain a shared leading base
+  // so that the alleles remain anchored to the same reference base
+  while (start < region.start()){
+    bool trim = true;
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      if (alleles[i].size() <= 2 || alleles[i][0] != alleles[0][0] || alleles[i][1] != alleles[0][1]){
+	trim = false;
+	break;
+      }
+    if (!trim) break;
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      alleles[i].erase(0, 1);
+    start++;
+  }
+
+  std::sort(alleles.begin()+1, alleles.end(), allele_length_lt);
+  pos = start;
+}
+
+bool ChunkRecordMerger::is_summed_info_key(const std::string& key){
+  return (key.compare("NSKIP") == 0 || key.compare("NFILT") == 0 || key.compare("DP") == 0 || key.compare("DSNP") == 0 ||
+	  key.compare("DFILT") == 0 || key.compare("DSTUTTER") == 0 || key.compare("DFLANKINDEL") == 0 ||
+	  key.compare("AN") == 0 || key.compare("REFAC") == 0 || key.compare("AC") == 0);
+}
+
+void ChunkRecordMerger::add_chunk(const std::string& record, const std::vector<std::string>& sample_names){
+  std::string line = record;
+  if (!line.empty() && line.back() == '\n')
+    line.pop_back();
+
+  std::vector<std::string> fields;
+  split_by_delim(line, '\t', fields);
+  if (fields.size() != 9 + sample_names.size())
+    printErrorAndDie("Number of sample columns in a chunk's VCF record doesn't match its number of samples");
+
+  std::vector<std::string> info_items;
+  split_by_delim(fields[7], ';', info_items);
+  std::vector< std::pair<std::string, std::string> > info;
+  for (unsigned int i = 0; i < info_items.size(); i++){
+    size_t eq_index = info_items[i].find('=');
+    if (eq_index == std::string::npos)
+      info.push_back(std::pair<std::string, std::string>(info_items[i], ""));
+    else
+      info.push_back(std::pair<std::string, std::string>(info_items[i].substr(0, eq_index), info_items[i].substr(eq_index+1)));
+  }
+
+  if (num_chunks_ == 0){
+    fixed_fields_ = std::vector<std::string>(fields.begin(), fields.begin()+7);
+    info_         = info;
+    format_       = fields[8];
+  }
+  else {
+    for (unsigned int i = 0; i < 7; i++)
+      if (fields[i].compare(fixed_fields_[i]) != 0)
+	printErrorAndDie("Chunks of samples were genotyped using different alleles");
+    if (info.size() != info_.size() || format_.compare(fields[8]) != 0)
+      printErrorAndDie("Chunks of samples produced VCF records with different fields");
+
+    for (unsigned int i = 0; i < info.size(); i++){
+      if (info[i].first.compare(info_[i].first) != 0)
+	printErrorAndDie("Chunks of samples produced VCF records with different INFO fields");
+      if (!is_summed_info_key(info[i].first))
+	continue;
+
+      // Sum each of the comma-separated counts
+      std::vector<std::string> prev_counts, new_counts;
+      split_by_delim(info_[i].second, ',', prev_counts);
+      split_by_delim(info[i].second,  ',', new_counts);
+      if (prev_counts.size() != new_counts.size())
+	printErrorAndDie("Chunks of samples produced INFO fields with different numbers of values");
+      std::stringstream summed_counts;
+      for (unsigned int j = 0; j < new_counts.size(); j++)
+	summed_counts << (j == 0 ? "" : ",") << atol(prev_counts[j].c_str()) + atol(new_counts[j].c_str());
+      info_[i].second = summed_counts.str();
+    }
+  }
+
+  for (unsigned int i = 0; i < sample_names.size(); i++)
+    sample_columns_[sample_names[i]] = fields[9+i];
+  num_chunks_++;
+}
+
+void ChunkRecordMerger::write(const std::vector<std::string>& sample_names, std::ostream& out){
+  assert(num_chunks_ > 0);
+  std::stringstream record;
+  for (unsigned int i = 0; i < fixed_fields_.size(); i++)
+    record << (i == 0 ? "" : "\t") << fixed_fields_[i];
+  record << "\t";
+  for (unsigned int i = 0; i < info_.size(); i++){
+    record << (i == 0 ? "" : ";") << info_[i].first;
+    if (!info_[i].second.empty())
+      record << "=" << info_[i].second;
+  }
+  record << "\t" << format_;
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    auto column_iter = sample_columns_.find(sample_names[i]);
+    record << "\t" << (column_iter == sample_columns_.end() ? "." : column_iter->second);
+  }
+  record << "\n";
+  out << record.str();
+}
@@ -0,0 +1,78 @@
+#ifndef CHUNK_MERGER_H_
+#define CHUNK_MERGER_H_
+
+#include <stdint.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "region.h"
+
+/*
+ * Combines the candidate alleles identified when a locus is genotyped independently in each chunk of samples.
+ * Each chunk's alleles are padded with the reference sequence so that they span the same window, the union of
+ * the padded alleles is formed and any flanking sequence shared by all of the alleles outside the STR is trimmed
+ */
+class ChunkAlleleMerger {
+ private:
+  std::vector<int32_t> chunk_positions_;                // 0-based start of each chunk's alleles
+  std::vector< std::vector<std::string> > chunk_alleles_;
+
+ public:
+  bool empty() const { return chunk_alleles_.empty(); }
+
+  /* Adds the alleles reported for a chunk, where VCF_POS is the 1-based position of the alleles and the first allele is the reference */
+  void add_chunk(int32_t vcf_pos, const std::vector<std::string>& alleles);
+
+  /*
+   * Stores the merged alleles in ALLELES, with the reference allele first and the remaining alleles sorted by length,
+   * and the 0-based position of their first base in POS
+   */
+  void merge(const Region& region, const std::string& chrom_seq, std::vector<std::string>& alleles, int32_t& pos);
+
+  void clear(){
+    chunk_positions_.clear();
+    chunk_alleles_.clear();
+  }
+};
+
+/*
+ * Combines the VCF records written for a locus by each chunk of samples into a single record. Every chunk must have been
+ * genotyped using the same alleles and stutter model, so the records only differ in their sample columns and in
+ * the INFO fields that are totals across samples, which are summed
+ */
+class ChunkRecordMerger {
+ private:
+  std::vector<std::string> fixed_fields_;                      // CHROM through FILTER
+  std::vector< std::pair<std::string, std::string> > info_;    // INFO key-value pairs, in order
+  std::string format_;
+  std::map<std::string, std::string> sample_columns_;
+  int num_chunks_;
+
+  static bool is_summed_info_key(const std::string& key);
+
+ public:
+  ChunkRecordMerger(){
+    num_chunks_ = 0;
+  }
+
+  int num_chunks() const { return num_chunks_; }
+
+  /* Adds a tab-delimited VCF record whose sample columns correspond to SAMPLE_NAMES */
+  void add_chunk(const std::string& record, const std::vector<std::string>& sample_names);
+
+  /* Writes the merged record with a column for each of the samples, using a missing value for samples that weren't in any chunk */
+  void write(const std::vector<std::string>& sample_names, std::ostream& out);
+
+  void clear(){
+    fixed_fields_.clear();
+    info_.clear();
+    format_.clear();
+    sample_columns_.clear();
+    num_chunks_ = 0;
+  }
+};
+
+#endif
@@ -11,6 +11,7 @@
 
 #include "denovo_scanner.h"
 #include "error.h"
+#include "gl_sidecar.h"
 #include "pedigree.h"
 #include "stringops.h"
 #include "version.h"
@@ -29,6 +30,11 @@ void print_usage(){
 	    << "\t" << "                                   "  << "\t" << " File should be identical to --snp-vcf argument provided to HipSTR during genotyping" << "\n"
 	    << "\t" << "--str-vcf    <str_gts.vcf.gz>      "  << "\t" << "Bgzipped input VCF file containing STR genotypes previously generated by HipSTR"      << "\n"
 	    << "\t" << "--denovo-vcf <denovos.vcf.gz>      "  << "\t" << "Bgzipped output VCF file containing likelihoods of de novo mutations"                 << "\n" << "\n"
+
+	    << "Optional input parameters:" << "\n"
+	    << "\t" << "--gl-bin     <str_gls.bin>         "  << "\t" << "Binary genotype likelihood file generated by HipSTR's --gl-bin option alongside"    << "\n"
+	    << "\t" << "                                   "  << "\t" << " the STR VCF. If provided, likelihoods are read from this file instead of the VCF."  << "\n"
+	    << "\t" << "                                   "  << "\t" << " The file must contain a record for every polymorphic STR in the VCF"                << "\n" << "\n"
     
 	    << "Optional output parameters:" << "\n"
 	    << "\t" << "--log <log.txt>                  "  << "\t" << "Output the log information to the provided file. By default, the log will be "        << "\n"
@@ -39,14 +45,21 @@ void print_usage(){
 	    << "\t" << "--chrom         <chrom>          "  << "\t" << "Only consider STRs on the provided chromosome"                                        << "\n"
 	    << "\t" << "--haploid-chrs  <list_of_chroms> "  << "\t" << "Comma separated list of chromosomes to treat as haploid"                              << "\n"
 	    << "\t" << "                                 "  << "\t" << " By default, all chromosomes are treated as diploid"                                  << "\n"
+	    << "\t" << "--prune-gl-mass <frac>           "  << "\t" << "Skip parental phased genotypes that account for less than this fraction of the"     << "\n"
+	    << "\t" << "                                 "  << "\t" << " parent's genotype likelihood mass. Speeds up loci with many alleles, but"          << "\n"
+	    << "\t" << "                                 "  << "\t" << " underestimates likelihoods by at most the error bound reported in the log"       << "\n"
+	    << "\t" << "                                 "  << "\t" << " (Default = 0, no pruning)"                                                        << "\n"
 	    << "\t" << "--skip-snps     <snp_list.txt>   "  << "\t" << "File containing SNPs to omit from the analysis. Each line should contain a "          << "\n"
 	    << "\t" << "                                 "  << "\t" << " position in the format CHROMOSOME:START"                                             << "\n"
+	    << "\t" << "--threads       <num_threads>    "  << "\t" << "Number of threads used to compute the likelihoods for each locus' families"        << "\n"
+	    << "\t" << "                                 "  << "\t" << " (Default = 1). Output is identical for any number of threads"                     << "\n"
 	    << "\t" << "--version                        "  << "\t" << "Print DenovoFinder version and exit"                                                  << "\n"
 	    << "\n";
 }
   
 void parse_command_line_args(int argc, char** argv, std::string& fam_file, std::string& snp_vcf_file, std::string& str_vcf_file, std::string& denovo_vcf_file,
-			     std::string& chrom, std::string& log_file, std::string& haploid_chr_string, std::string& snp_skip_file){
+			     std::string& chrom, std::string& log_file, std::string& haploid_chr_string, std::string& snp_skip_file, std::string& gl_bin_file,
+			     double& prune_gl_mass, int& num_threads){
   if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
     print_usage();
     exit(0);
@@ -59,13 +72,16 @@ void parse_command_line_args(int argc, char** argv, std::string& fam_file, std::
     {"chrom",           required_argument, 0, 'c'},
     {"denovo-vcf",      required_argument, 0, 'd'},
     {"fam",             required_argument, 0, 'f'},
+    {"gl-bin",          required_argument, 0, 'g'},
     {"log",             required_argument, 0, 'l'},
     {"h",               no_argument, &print_help, 1},
     {"help",            no_argument, &print_help, 1},
     {"version",         no_argument, &print_version, 1},
     {"skip-snps",       required_argument, 0, 'm'},
+    {"prune-gl-mass",   required_argument, 0, 'p'},
     {"str-vcf",         required_argument, 0, 'o'},
     {"haploid-chrs",    required_argument, 0, 't'},
+    {"threads",         required_argument, 0, 'n'},
     {"snp-vcf",         required_argument, 0, 'v'},
     {0, 0, 0, 0}
   };
@@ -74,7 +90,7 @@ void parse_command_line_args(int argc, char** argv, std::string& fam_file, std::
   int c;
   while (true){
     int option_index = 0;
-    c = getopt_long(argc, argv, "c:d:f:l:m:o:t:v:", long_options, &option_index);
+    c = getopt_long(argc, argv, "c:d:f:g:l:m:n:o:p:t:v:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -90,15 +106,28 @@ void parse_command_line_args(int argc, char** argv, std::string& fam_file, std::
     case 'f':
       fam_file = std::string(optarg);
       break;
+    case 'g':
+      gl_bin_file = std::string(optarg);
+      break;
     case 'l':
       log_file = std::string(optarg);
       break;
     case 'm':
       snp_skip_file = std::string(optarg);
       break;
+    case 'n':
+      num_threads = atoi(optarg);
+      if (num_threads <= 0)
+	printErrorAndDie("--threads must be greater than 0");
+      break;
     case 'o':
       str_vcf_file = std::string(optarg);
       break;
+    case 'p':
+      prune_gl_mass = atof(optarg);
+      if (prune_gl_mass < 0 || prune_gl_mass >= 1)
+	printErrorAndDie("--prune-gl-mass must be a fraction in the range [0, 1)");
+      break;
     case 't':
       haploid_chr_string = std::string(optarg);
       break;
@@ -152,8 +181,11 @@ int main(int argc, char** argv){
   std::string full_command = full_command_ss.str();
 
   std::string fam_file = "", snp_vcf_file = "", str_vcf_file = "", denovo_vcf_file = "";
-  std::string chrom = "", log_file = "", haploid_chr_string  = "", snp_skip_file = "";
-  parse_command_line_args(argc, argv, fam_file, snp_vcf_file, str_vcf_file, denovo_vcf_file, chrom, log_file, haploid_chr_string, snp_skip_file);
+  std::string chrom = "", log_file = "", haploid_chr_string  = "", snp_skip_file = "", gl_bin_file = "";
+  double prune_gl_mass = 0;
+  int num_threads      = 1;
+  parse_command_line_args(argc, argv, fam_file, snp_vcf_file, str_vcf_file, denovo_vcf_file, chrom, log_file, haploid_chr_string, snp_skip_file, gl_bin_file,
+			  prune_gl_mass, num_threads);
 
   if (fam_file.empty())
     printErrorAndDie("--fam option required");
@@ -220,9 +252,24 @@ int main(int argc, char** argv){
   if (!snp_skip_file.empty())
     read_site_skip_list(snp_skip_file, sites_to_skip);
 
+  // Memory map the binary genotype likelihoods, if provided
+  GLSidecarReader* gl_reader = NULL;
+  if (!gl_bin_file.empty()){
+    if (!file_exists(gl_bin_file))
+      printErrorAndDie("Genotype likelihood file " + gl_bin_file + " does not exist. Please ensure that the path provided to --gl-bin is valid");
+    gl_reader = new GLSidecarReader(gl_bin_file);
+    logger << "Read the index for " << gl_reader->num_loci() << " loci from the genotype likelihood file" << "\n";
+  }
+
   DenovoScanner denovo_scanner(families, denovo_vcf_file, full_command);
+  if (gl_reader != NULL)
+    denovo_scanner.use_gl_sidecar(gl_reader);
+  denovo_scanner.set_prune_gl_mass(prune_gl_mass);
+  denovo_scanner.set_threads(num_threads);
   denovo_scanner.scan(snp_vcf_file, str_vcf, sites_to_skip, logger);
   denovo_scanner.finish();
+  if (gl_reader != NULL)
+    delete gl_reader;
 
   total_time = (clock() - total_time)/CLOCKS_PER_SEC;
   logger << "DenovoFinder execution finished: Total runtime = " << total_time << " sec" << std::endl;
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cfloat>
+#include <map>
 #include <vector>
 
 #include "denovo_scanner.h"
@@ -8,6 +10,7 @@
 #include "haplotype_tracker.h"
 #include "mathops.h"
 #include "mutation_model.h"
+#include "thread_pool.h"
 #include "vcf_input.h"
 
 std::string DenovoScanner::BPDIFFS_KEY = "BPDIFFS";
@@ -126,14 +129,228 @@ void DenovoScanner::add_family_to_record(NuclearFamily& family, double total_ll_
     denovo_vcf_ << "," << total_lls_one_other[i];
 }
 
+/*
+ * Computes the total log-likelihood that no mutations occurred in the family, along with the log-likelihoods that a single de novo or
+ * other mutation occurred in each child. Given the inheritance pattern, each child's genotype is determined by the maternal allele and
+ * paternal allele it received, so each child's GL and its mutations to each allele are tabulated once per pair of transmitted alleles.
+ * A mutation is de novo if the mutated allele is absent from both parents, so for each maternal genotype, prefix and suffix sums over the
+ * mutated allele exclude the mother's alleles and each paternal transmitted allele. Each child's de novo likelihood is then obtained
+ * for every paternal genotype by excluding the father's untransmitted allele, requiring constant work per child and parental genotype.
+ * Parental phased genotypes that contribute less than a fraction prune_gl_mass_ of the parent's total likelihood are skipped, in which
+ * case error_bound is set to an upper bound on the amount by which the resulting log-likelihoods are underestimated
+ */
+void DenovoScanner::compute_family_likelihoods(NuclearFamily& family, PhasedGL& phased_gls, DiploidGenotypePrior& dip_gt_priors, MutationModel& mut_model,
+					       std::vector<int>& maternal_indices, std::vector<int>& paternal_indices, int num_alleles,
+					       double& total_ll_no_mutation, std::vector<double>& total_lls_one_denovo, std::vector<double>& total_lls_one_other,
+					       int64_t& num_configs, double& error_bound){
+  const int num_genotypes = num_alleles*num_alleles;
+  const int num_children  = family.get_children().size();
+
+  // Log-likelihood of each phased genotype for both parents, along with the genotypes that survive pruning
+  std::vector<double> mat_lls(num_genotypes), pat_lls(num_genotypes);
+  int mother_gl_index = phased_gls.get_sample_index(family.get_mother());
+  int father_gl_index = phased_gls.get_sample_index(family.get_father());
+  for (int gt_a = 0; gt_a < num_alleles; gt_a++){
+    for (int gt_b = 0; gt_b < num_alleles; gt_b++){
+      mat_lls[gt_a*num_alleles + gt_b] = dip_gt_priors.log_phased_genotype_prior(gt_a, gt_b, family.get_mother()) + phased_gls.get_gl(mother_gl_index, gt_a, gt_b);
+      pat_lls[gt_a*num_alleles + gt_b] = dip_gt_priors.log_phased_genotype_prior(gt_a, gt_b, family.get_father()) + phased_gls.get_gl(father_gl_index, gt_a, gt_b);
+    }
+  }
+  std::vector<int> mat_gts, pat_gts;
+  double mat_total_ll = log_sum_exp(mat_lls), pat_total_ll = log_sum_exp(pat_lls);
+  double mat_kept_ll  = select_parental_genotypes(mat_lls, mat_total_ll, mat_gts);
+  double pat_kept_ll  = select_parental_genotypes(pat_lls, pat_total_ll, pat_gts);
+
+  // Tabulate each child's GL and single-mutation log-likelihoods for every pair of transmitted maternal and paternal alleles
+  std::vector<int> mat_haps(num_children), pat_haps(num_children);
+  std::vector< std::vector<double> > no_mut_lls(num_children), mut_allele_lls(num_children);
+  std::vector<double> max_no_mut_lls(num_children, -DBL_MAX), max_mut_lls(num_children, -DBL_MAX);
+  for (int child_index = 0; child_index < num_children; child_index++){
+    // Maternal indices 0 and 1 (2 and 3) transmit to the child's first (second) haplotype,
+    // while indices 0 and 2 (1 and 3) transmit the parent's first (second) haplotype
+    assert((maternal_indices[child_index] < 2) != (paternal_indices[child_index] < 2));
+    bool mat_first         = (maternal_indices[child_index] < 2);
+    mat_haps[child_index]  = maternal_indices[child_index]%2;
+    pat_haps[child_index]  = paternal_indices[child_index]%2;
+
+    int child_gl_index = phased_gls.get_sample_index(family.get_children()[child_index]);
+    no_mut_lls[child_index].resize(num_genotypes);
+    mut_allele_lls[child_index].resize(num_genotypes*num_alleles);
+    std::vector<double> all_lls;
+    for (int mat_allele = 0; mat_allele < num_alleles; mat_allele++){
+      for (int pat_allele = 0; pat_allele < num_alleles; pat_allele++){
+	int child_i = (mat_first ? mat_allele : pat_allele);
+	int child_j = (mat_first ? pat_allele : mat_allele);
+	int gt_index = mat_allele*num_alleles + pat_allele;
+	no_mut_lls[child_index][gt_index] = phased_gls.get_gl(child_gl_index, child_i, child_j);
+	max_no_mut_lls[child_index]       = std::max(max_no_mut_lls[child_index], no_mut_lls[child_index][gt_index]);
+
+	// All putative mutations on haplotypes #1 and #2, combined by the mutated allele
+	all_lls.clear();
+	for (int mut_allele = 0; mut_allele < num_alleles; mut_allele++){
+	  double* mut_allele_ll = &(mut_allele_lls[child_index][gt_index*num_alleles + mut_allele]);
+	  *mut_allele_ll = -DBL_MAX;
+	  if (mut_allele != child_i){
+	    double prob = phased_gls.get_gl(child_gl_index, mut_allele, child_j) + mut_model.log_prior_mutation(child_i, mut_allele);
+	    *mut_allele_ll = prob;
+	    all_lls.push_back(prob);
+	  }
+	  if (mut_allele != child_j){
+	    double prob = phased_gls.get_gl(child_gl_index, child_i, mut_allele) + mut_model.log_prior_mutation(child_j, mut_allele);
+	    *mut_allele_ll = (*mut_allele_ll == -DBL_MAX ? prob : log_sum_exp(*mut_allele_ll, prob));
+	    all_lls.push_back(prob);
+	  }
+	}
+	max_mut_lls[child_index] = std::max(max_mut_lls[child_index], log_sum_exp(all_lls));
+      }
+    }
+  }
+
+  double ll_no_mutation_max = -DBL_MAX/2, ll_no_mutation_total = 0.0;
+  std::vector<double> ll_one_denovo_max(num_children, -DBL_MAX/2), ll_one_denovo_total(num_children, 0.0);
+  std::vector<double>  ll_one_other_max(num_children, -DBL_MAX/2),  ll_one_other_total(num_children, 0.0);
+  std::vector<int> gt_indices(num_children);
+  std::vector<double> other_lls;
+
+  // For each child, the log-likelihood of mutations to alleles below (prefix) and above (suffix) each allele, excluding the
+  // mother's alleles and the paternal transmitted allele. Indexed by paternal transmitted allele*number of alleles + allele
+  std::vector< std::vector<double> > denovo_prefix_lls(num_children, std::vector<double>(num_genotypes));
+  std::vector< std::vector<double> > denovo_suffix_lls(num_children, std::vector<double>(num_genotypes));
+
+  // Iterate over all retained maternal and paternal genotypes
+  for (auto mat_iter = mat_gts.begin(); mat_iter != mat_gts.end(); mat_iter++){
+    int mat_alleles[2] = {*mat_iter/num_alleles, *mat_iter%num_alleles};
+    for (int child_index = 0; child_index < num_children; child_index++){
+      int mat_allele = mat_alleles[mat_haps[child_index]];
+      double* prefix_lls = denovo_prefix_lls[child_index].data();
+      double* suffix_lls = denovo_suffix_lls[child_index].data();
+      for (int pat_allele = 0; pat_allele < num_alleles; pat_allele++){
+	const double* allele_lls = mut_allele_lls[child_index].data() + (mat_allele*num_alleles + pat_allele)*num_alleles;
+	double* prefix = prefix_lls + pat_allele*num_alleles;
+	double* suffix = suffix_lls + pat_allele*num_alleles;
+	double prefix_ll = -DBL_MAX, suffix_ll = -DBL_MAX;
+	for (int lo = 0, hi = num_alleles-1; lo < num_alleles; lo++, hi--){
+	  if (lo != mat_alleles[0] && lo != mat_alleles[1] && lo != pat_allele && allele_lls[lo] != -DBL_MAX)
+	    prefix_ll = (prefix_ll == -DBL_MAX ? allele_lls[lo] : log_sum_exp(prefix_ll, allele_lls[lo]));
+	  if (hi != mat_alleles[0] && hi != mat_alleles[1] && hi != pat_allele && allele_lls[hi] != -DBL_MAX)
+	    suffix_ll = (suffix_ll == -DBL_MAX ? allele_lls[hi] : log_sum_exp(suffix_ll, allele_lls[hi]));
+	  prefix[lo] = prefix_ll;
+	  suffix[hi] = suffix_ll;
+	}
+      }
+    }
+
+    for (auto pat_iter = pat_gts.begin(); pat_iter != pat_gts.end(); pat_iter++){
+      int pat_alleles[2] = {*pat_iter/num_alleles, *pat_iter%num_alleles};
+      num_configs++;
+
+      double no_mutation_config_ll = mat_lls[*mat_iter] + pat_lls[*pat_iter];
+      for (int child_index = 0; child_index < num_children; child_index++){
+	gt_indices[child_index] = mat_alleles[mat_haps[child_index]]*num_alleles + pat_alleles[pat_haps[child_index]];
+	no_mutation_config_ll  += no_mut_lls[child_index][gt_indices[child_index]];
+      }
+      update_streaming_log_sum_exp(no_mutation_config_ll, ll_no_mutation_max, ll_no_mutation_total);
+
+      // Distinct alleles present in the parental genotypes. Mutations to any other allele are de novo
+      int parental_alleles[4], num_parental_alleles = 0;
+      int candidates[4] = {mat_alleles[0], mat_alleles[1], pat_alleles[0], pat_alleles[1]};
+      for (int i = 0; i < 4; i++)
+	if (std::find(parental_alleles, parental_alleles+num_parental_alleles, candidates[i]) == parental_alleles+num_parental_alleles)
+	  parental_alleles[num_parental_alleles++] = candidates[i];
+
+      // Compute the likelihood that a single mutation occurs, and it occurs in the current child
+      for (int child_index = 0; child_index < num_children; child_index++){
+	int gt_index     = gt_indices[child_index];
+	double config_ll = no_mutation_config_ll - no_mut_lls[child_index][gt_index];
+
+	// De novo mutations exclude the father's untransmitted allele from the maternal genotype's prefix and suffix sums
+	int pat_allele        = pat_alleles[pat_haps[child_index]];
+	int pat_untransmitted = pat_alleles[1-pat_haps[child_index]];
+	const double* prefix = denovo_prefix_lls[child_index].data() + pat_allele*num_alleles;
+	const double* suffix = denovo_suffix_lls[child_index].data() + pat_allele*num_alleles;
+	double prefix_ll     = (pat_untransmitted > 0             ? prefix[pat_untransmitted-1] : -DBL_MAX);
+	double suffix_ll     = (pat_untransmitted < num_alleles-1 ? suffix[pat_untransmitted+1] : -DBL_MAX);
+	double denovo_ll     = (prefix_ll == -DBL_MAX ? suffix_ll : (suffix_ll == -DBL_MAX ? prefix_ll : log_sum_exp(prefix_ll, suffix_ll)));
+	if (denovo_ll != -DBL_MAX)
+	  update_streaming_log_sum_exp(config_ll + denovo_ll, ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]);
+
+	// Other mutations are to one of the parental alleles
+	const double* allele_lls = mut_allele_lls[child_index].data() + gt_index*num_alleles;
+	other_lls.clear();
+	for (int i = 0; i < num_parental_alleles; i++)
+	  if (allele_lls[parental_alleles[i]] != -DBL_MAX)
+	    other_lls.push_back(allele_lls[parental_alleles[i]]);
+	if (!other_lls.empty())
+	  update_streaming_log_sum_exp(config_ll + log_sum_exp(other_lls), ll_one_other_max[child_index], ll_one_other_total[child_index]);
+      }
+    }
+  }
+
+  // Compute total LL for each scenario
+  total_ll_no_mutation = finish_streaming_log_sum_exp(ll_no_mutation_max, ll_no_mutation_total);
+  total_lls_one_denovo.clear();
+  total_lls_one_other.clear();
+  for (int child_index = 0; child_index < num_children; child_index++){
+    total_lls_one_denovo.push_back(finish_streaming_log_sum_exp(ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]));
+    total_lls_one_other.push_back(finish_streaming_log_sum_exp(ll_one_other_max[child_index], ll_one_other_total[child_index]));
+  }
+
+  // Bound the likelihood of the pruned configurations by their parental likelihood times the largest possible contribution from the children
+  error_bound = 0.0;
+  double pruned_frac = 1.0 - exp(mat_kept_ll - mat_total_ll + pat_kept_ll - pat_total_ll);
+  if (pruned_frac <= 0)
+    return;
+  double pruned_ll       = mat_total_ll + pat_total_ll + log(pruned_frac);
+  double max_children_ll = sum(max_no_mut_lls);
+  error_bound = log1p(exp(pruned_ll + max_children_ll - total_ll_no_mutation));
+  for (int child_index = 0; child_index < num_children; child_index++){
+    double max_mut_ll = pruned_ll + max_children_ll - max_no_mut_lls[child_index] + max_mut_lls[child_index];
+    double mut_ll     = log_sum_exp(total_lls_one_denovo[child_index], total_lls_one_other[child_index]);
+    error_bound       = std::max(error_bound, log1p(exp(max_mut_ll - mut_ll)));
+  }
+}
+
+double DenovoScanner::select_parental_genotypes(std::vector<double>& gt_lls, double total_ll, std::vector<int>& gts){
+  gts.clear();
+  if (prune_gl_mass_ <= 0){
+    for (int gt_index = 0; gt_index < gt_lls.size(); gt_index++)
+      gts.push_back(gt_index);
+    return total_ll;
+  }
+
+  // Always retain the most likely genotype, even if it falls below the threshold
+  int best_gt = std::max_element(gt_lls.begin(), gt_lls.end()) - gt_lls.begin();
+  double min_ll = total_ll + log(prune_gl_mass_);
+  std::vector<double> kept_lls;
+  for (int gt_index = 0; gt_index < gt_lls.size(); gt_index++){
+    if (gt_index == best_gt || gt_lls[gt_index] >= min_ll){
+      gts.push_back(gt_index);
+      kept_lls.push_back(gt_lls[gt_index]);
+    }
+  }
+  return log_sum_exp(kept_lls);
+}
+
 void DenovoScanner::scan(std::string& snp_vcf_file, VCF::VCFReader& str_vcf, std::set<std::string>& sites_to_skip,
 			 std::ostream& logger){
   HaplotypeTracker haplotype_tracker(families_, snp_vcf_file, window_size_);
+  ThreadPool thread_pool(num_threads_);
   VCF::Variant str_variant;
   int32_t num_strs  = 0;
+
+  // Number of records at the current position with each number of alleles, used to select among sidecar records that share a position
+  std::string prev_chrom = "";
+  int32_t prev_pos       = -1;
+  std::map<int, int> allele_count_occurrences;
   while (str_vcf.get_next_variant(str_variant)){
     num_strs++;
     int num_alleles = str_variant.num_alleles();
+    if (str_variant.get_position() != prev_pos || str_variant.get_chromosome() != prev_chrom){
+      prev_chrom = str_variant.get_chromosome();
+      prev_pos   = str_variant.get_position();
+      allele_count_occurrences.clear();
+    }
+    int occurrence = allele_count_occurrences[num_alleles]++;
     if (num_alleles <= 1)
       continue;
 
@@ -141,7 +358,7 @@ void DenovoScanner::scan(std::string& snp_vcf_file, VCF::VCFReader& str_vcf, std
     int end;    str_variant.get_INFO_value_single_int(END_KEY, end);
     logger << "Processing STR region " << str_variant.get_chromosome() << ":" << start << "-" << end << " with " << num_alleles << " alleles" << "\n";
 
-    PhasedGL phased_gls(str_variant);
+    PhasedGL phased_gls(gl_reader_, str_variant, occurrence);
     logger << "\t";
     haplotype_tracker.advance(str_variant.get_chromosome(), str_variant.get_position(), sites_to_skip, logger);
 
@@ -150,124 +367,56 @@ void DenovoScanner::scan(std::string& snp_vcf_file, VCF::VCFReader& str_vcf, std
     initialize_vcf_record(str_variant);
 
     logger << "\t" << "Computing log-likelihoods for mutation scenarios" << "\n";
-    for (auto family_iter = families_.begin(); family_iter != families_.end(); family_iter++){
+    int num_families = families_.size();
+    std::vector<int> scan_for_denovo(num_families, 0);
+    std::vector< std::vector<int> > maternal_indices(num_families), paternal_indices(num_families);
+    int family_index = 0;
+    for (auto family_iter = families_.begin(); family_iter != families_.end(); family_iter++, family_index++){
       // Determine if all samples have well-phased SNP haplotypes and infer the inheritance pattern
-      std::vector<int> maternal_indices, paternal_indices;
       std::set<int32_t> bad_sites;
-      bool scan_for_denovo = haplotype_tracker.infer_haplotype_inheritance(*family_iter, MAX_BEST_SCORE, MIN_SECOND_BEST_SCORE,
-									   maternal_indices, paternal_indices, bad_sites);
+      bool scan_family = haplotype_tracker.infer_haplotype_inheritance(*family_iter, MAX_BEST_SCORE, MIN_SECOND_BEST_SCORE,
+								       maternal_indices[family_index], paternal_indices[family_index], bad_sites);
 
       // Don't look for de novos if any of the family members are missing genotype likelihoods
-      scan_for_denovo &= phased_gls.has_sample(family_iter->get_mother());
-      scan_for_denovo &= phased_gls.has_sample(family_iter->get_father());
-      if (scan_for_denovo)
+      scan_family &= phased_gls.has_sample(family_iter->get_mother());
+      scan_family &= phased_gls.has_sample(family_iter->get_father());
+      if (scan_family)
 	for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); ++child_iter)
-	  scan_for_denovo &= phased_gls.has_sample(*child_iter);
+	  scan_family &= phased_gls.has_sample(*child_iter);
+      scan_for_denovo[family_index] = scan_family;
+    }
 
-      if (!scan_for_denovo)
+    // The likelihood computations for each family are independent once the inheritance patterns are known,
+    // so they're distributed across the thread pool and their results are stored in per-family slots
+    std::vector<double> total_ll_no_mutation(num_families), error_bounds(num_families, 0.0);
+    std::vector< std::vector<double> > total_lls_one_denovo(num_families), total_lls_one_other(num_families);
+    std::vector<int64_t> num_configs(num_families, 0);
+    thread_pool.run(num_families, [&](int index){
+	if (!scan_for_denovo[index])
+	  return;
+	assert(families_[index].get_children().size() == maternal_indices[index].size() && maternal_indices[index].size() == paternal_indices[index].size());
+	compute_family_likelihoods(families_[index], phased_gls, dip_gt_priors, mut_model, maternal_indices[index], paternal_indices[index], num_alleles,
+				   total_ll_no_mutation[index], total_lls_one_denovo[index], total_lls_one_other[index], num_configs[index], error_bounds[index]);
+      });
+
+    // Add each family's mutation likelihoods to the VCF record in the original family order
+    int64_t evaluated_configs = 0, total_configs = 0;
+    double max_error_bound = 0.0;
+    for (family_index = 0; family_index < num_families; family_index++){
+      if (!scan_for_denovo[family_index]){
 	denovo_vcf_ << "\t" << ".";
-      else {
-	assert(family_iter->get_children().size() == maternal_indices.size() && maternal_indices.size() == paternal_indices.size());
-	double ll_no_mutation_max = -DBL_MAX/2, ll_no_mutation_total = 0.0;
-	std::vector<double> ll_one_denovo_max(family_iter->get_children().size(), -DBL_MAX/2), ll_one_denovo_total(family_iter->get_children().size(), 0.0);
-	std::vector<double>  ll_one_other_max(family_iter->get_children().size(), -DBL_MAX/2),  ll_one_other_total(family_iter->get_children().size(), 0.0);
-
-	int mother_gl_index = phased_gls.get_sample_index(family_iter->get_mother());
-	int father_gl_index = phased_gls.get_sample_index(family_iter->get_father());
-	std::vector<int> children_gl_index;
-	for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); ++child_iter)
-	  children_gl_index.push_back(phased_gls.get_sample_index(*child_iter));
-
-	// Iterate over all maternal genotypes
-	for (int mat_i = 0; mat_i < num_alleles; mat_i++){
-	  for (int mat_j = 0; mat_j < num_alleles; mat_j++){
-	    double mat_ll = dip_gt_priors.log_phased_genotype_prior(mat_i, mat_j, family_iter->get_mother()) + phased_gls.get_gl(mother_gl_index, mat_i, mat_j);
-
-	    // Iterate over all paternal genotypes
-	    for (int pat_i = 0; pat_i < num_alleles; pat_i++){
-	      for (int pat_j = 0; pat_j < num_alleles; pat_j++){
-		double pat_ll = dip_gt_priors.log_phased_genotype_prior(pat_i, pat_j, family_iter->get_father()) + phased_gls.get_gl(father_gl_index, pat_i, pat_j);
-
-		double no_mutation_config_ll = mat_ll + pat_ll;
-
-		// Iterate over all the children to compute the likelihood for no denovos
-		int child_index = 0;
-		for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); ++child_iter, ++child_index){
-		  int child_i, child_j;
-
-		  if (maternal_indices[child_index] == 0)       child_i = mat_i;
-		  else if (maternal_indices[child_index] == 1)  child_i = mat_j;
-		  else if (maternal_indices[child_index] == 2)  child_j = mat_i;
-		  else                                          child_j = mat_j;
-
-		  if (paternal_indices[child_index] == 0)       child_i = pat_i;
-		  else if (paternal_indices[child_index] == 1)  child_i = pat_j;
-		  else if (paternal_indices[child_index] == 2)  child_j = pat_i;
-		  else                                          child_j = pat_j;
-
-		  no_mutation_config_ll += phased_gls.get_gl(children_gl_index[child_index], child_i, child_j);
-		}
-		update_streaming_log_sum_exp(no_mutation_config_ll, ll_no_mutation_max, ll_no_mutation_total);
-
-		// Iterate over all the children to compute the likelihood that a single mutation occurs, and it occurs in the current child
-		child_index = 0;
-                for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); ++child_iter, ++child_index){
-		  int child_i, child_j;
-
-		  if (maternal_indices[child_index] == 0)       child_i = mat_i;
-		  else if (maternal_indices[child_index] == 1)  child_i = mat_j;
-		  else if (maternal_indices[child_index] == 2)  child_j = mat_i;
-		  else                                          child_j = mat_j;
-
-		  if (paternal_indices[child_index] == 0)       child_i = pat_i;
-		  else if (paternal_indices[child_index] == 1)  child_i = pat_j;
-		  else if (paternal_indices[child_index] == 2)  child_j = pat_i;
-		  else                                          child_j = pat_j;
-
-		  double config_ll = no_mutation_config_ll - phased_gls.get_gl(children_gl_index[child_index], child_i, child_j);
-
-		  // All putative mutations on haplotype #1
-		  for (int mut_allele = 0; mut_allele < num_alleles; mut_allele++){
-		    if (mut_allele == child_i)
-		      continue;
-		    double prob = config_ll + phased_gls.get_gl(children_gl_index[child_index], mut_allele, child_j) + mut_model.log_prior_mutation(child_i, mut_allele);
-		    if (mut_allele != mat_i && mut_allele != mat_j && mut_allele != pat_i && mut_allele != pat_j)
-		      update_streaming_log_sum_exp(prob, ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]);
-		    else
-		      update_streaming_log_sum_exp(prob, ll_one_other_max[child_index], ll_one_other_total[child_index]);
-		  }
-
-		  // All putative mutations on haplotype #2
-		  for (int mut_allele = 0; mut_allele < num_alleles; mut_allele++){
-		    if (mut_allele == child_j)
-		      continue;
-		    double prob = config_ll + phased_gls.get_gl(children_gl_index[child_index], child_i, mut_allele) + mut_model.log_prior_mutation(child_j, mut_allele);
-		    if (mut_allele != mat_i && mut_allele != mat_j && mut_allele != pat_i && mut_allele != pat_j)
-		      update_streaming_log_sum_exp(prob, ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]);
-		    else
-		      update_streaming_log_sum_exp(prob, ll_one_other_max[child_index], ll_one_other_total[child_index]);
-		  }
-		}
-	      }
-	    }
-	  }
-	}
-
-	// Compute total LL for each scenario
-	double total_ll_no_mutation = finish_streaming_log_sum_exp(ll_no_mutation_max, ll_no_mutation_total);
-
-	std::vector<double> total_lls_one_denovo, total_lls_one_other;
-	int child_index = 0;
-	for (auto child_iter = family_iter->get_children().begin(); child_iter != family_iter->get_children().end(); ++child_iter, ++child_index){
-	  total_lls_one_denovo.push_back(finish_streaming_log_sum_exp(ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]));
-	  total_lls_one_other.push_back(finish_streaming_log_sum_exp(ll_one_other_max[child_index], ll_one_other_total[child_index]));
-	}
-
-	// Add family's mutation likelihoods to the VCF record
-	add_family_to_record(*family_iter, total_ll_no_mutation, total_lls_one_denovo, total_lls_one_other);
+	continue;
       }
+      add_family_to_record(families_[family_index], total_ll_no_mutation[family_index], total_lls_one_denovo[family_index], total_lls_one_other[family_index]);
+      evaluated_configs += num_configs[family_index];
+      total_configs     += (int64_t)num_alleles*num_alleles*num_alleles*num_alleles;
+      max_error_bound    = std::max(max_error_bound, error_bounds[family_index]);
     }
 
+    if (prune_gl_mass_ > 0)
+      logger << "\t" << "Evaluated " << evaluated_configs << " out of " << total_configs << " parental genotype configurations after pruning. "
+	     << "Log-likelihoods are underestimated by at most " << max_error_bound << "\n";
+
     // End of VCF record line
     denovo_vcf_ << "\n";
   }
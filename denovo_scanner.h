@@ -2,6 +2,7 @@
 #define DENOVO_SCANNER_H_
 
 #include <assert.h>
+#include <math.h>
 
 #include <iostream>
 #include <vector>
@@ -10,7 +11,10 @@
 #include <string>
 
 #include "bgzf_streams.h"
+#include "gl_sidecar.h"
+#include "mutation_model.h"
 #include "pedigree.h"
+#include "vcf_input.h"
 #include "vcf_reader.h"
 
 class DiploidGenotypePrior {
@@ -26,6 +30,14 @@ class DiploidGenotypePrior {
     compute_allele_freqs(str_variant, families);
   }
 
+  DiploidGenotypePrior(const std::vector<double>& allele_freqs){
+    num_alleles_  = allele_freqs.size();
+    allele_freqs_ = allele_freqs;
+    assert(num_alleles_ > 0);
+    for (int i = 0; i < allele_freqs_.size(); i++)
+      log_allele_freqs_.push_back(log10(allele_freqs_[i]));
+  }
+
   /* Returns the log10 prior for the given phased genotype, assuming Hardy-Weinberg equilibrium */
   double log_phased_genotype_prior(int gt_a, int gt_b, const std::string& sample){
     if (gt_a < 0 || gt_a >= num_alleles_)
@@ -45,21 +57,41 @@ class DenovoScanner {
   int32_t window_size_;
   std::vector<NuclearFamily> families_;
   bgzfostream denovo_vcf_;
+  GLSidecarReader* gl_reader_; // If not NULL, phased GLs are read from this file instead of the STR VCF
+  double prune_gl_mass_;       // Parental genotypes below this fraction of the parent's likelihood are skipped. Disabled if <= 0
+  int num_threads_;            // Number of threads across which each locus' families are distributed
 
   void write_vcf_header(std::string& full_command);
   void initialize_vcf_record(VCF::Variant& str_variant);
   void add_family_to_record(NuclearFamily& family, double total_ll_no_denovo, std::vector<double>& total_lls_one_denovo, std::vector<double>& total_lls_one_other);
 
+  double select_parental_genotypes(std::vector<double>& gt_lls, double total_ll, std::vector<int>& gts);
+
  public:
   DenovoScanner(std::vector<NuclearFamily>& families, std::string& output_file, std::string& full_command){
-    families_    = families;
-    window_size_ = 500000;
+    families_      = families;
+    window_size_   = 500000;
+    gl_reader_     = NULL;
+    prune_gl_mass_ = 0;
+    num_threads_   = 1;
     denovo_vcf_.open(output_file.c_str());
+    denovo_vcf_.build_index();
     denovo_vcf_.precision(3);
     denovo_vcf_.setf(std::ios::fixed, std::ios::floatfield);
     write_vcf_header(full_command);
   }
 
+  void use_gl_sidecar(GLSidecarReader* gl_reader){ gl_reader_ = gl_reader; }
+
+  void set_prune_gl_mass(double prune_gl_mass){ prune_gl_mass_ = prune_gl_mass; }
+
+  void set_threads(int num_threads){ num_threads_ = num_threads; }
+
+  void compute_family_likelihoods(NuclearFamily& family, PhasedGL& phased_gls, DiploidGenotypePrior& dip_gt_priors, MutationModel& mut_model,
+				  std::vector<int>& maternal_indices, std::vector<int>& paternal_indices, int num_alleles,
+				  double& total_ll_no_mutation, std::vector<double>& total_lls_one_denovo, std::vector<double>& total_lls_one_other,
+				  int64_t& num_configs, double& error_bound);
+
   void scan(std::string& snp_vcf_file, VCF::VCFReader& str_vcf, std::set<std::string>& sites_to_skip,
 	    std::ostream& logger);
 
@@ -163,7 +163,7 @@ void EMStutterGenotyper::recalc_log_read_phase_posteriors(){
   }
 }
 
-bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger){
+bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger, LocusBudget* budget){
   // Initialization
   if (log_allele_priors_ == NULL)
     init_log_gt_priors();
@@ -175,6 +175,11 @@ bool EMStutterGenotyper::train(int max_iter, double min_LL_abs_change, double mi
   use_pop_freqs_ = true;
 
   while (num_iter <= max_iter && !converged){
+    if (budget != NULL && budget->exceeded()){
+      logger << "Stopping stutter model training after " << num_iter-1 << " iterations as the locus exceeded its compute budget" << std::endl;
+      return false;
+    }
+
     // E-step
     calc_hap_aln_probs(log_aln_probs_);
     double new_LL = calc_log_sample_posteriors();
@@ -11,6 +11,7 @@
 
 #include "error.h"
 #include "genotyper.h"
+#include "locus_budget.h"
 #include "stutter_model.h"
 
 class EMStutterGenotyper: public Genotyper {
@@ -103,7 +104,10 @@ class EMStutterGenotyper: public Genotyper {
     delete stutter_model_;
   }  
   
-  bool train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger);
+  /*
+   * Trains the stutter model using EM. If BUDGET isn't NULL, training stops and fails as soon as the budget is exceeded
+   */
+  bool train(int max_iter, double min_LL_abs_change, double min_LL_frac_change, bool disp_stats, std::ostream& logger, LocusBudget* budget=NULL);
 
   StutterModel* get_stutter_model(){
     if (stutter_model_ == NULL)
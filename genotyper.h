@@ -9,6 +9,7 @@
 
 #include "region.h"
 #include "mathops.h"
+#include "vcf_record_formatter.h"
 
 class Genotyper {
  private:
@@ -57,21 +58,21 @@ class Genotyper {
   // the weight for the second read to zero. Elsewhere, the alignments probabilities for the two reads are summed
   std::vector<int> read_weights_;
 
-  // Convert a list of integers into a string with key|count pairs separated by semicolons
-  // e.g. -1,0,-1,2,2,1 will be converted into -1|2;0|1;1|1;2|2
-  std::string condense_read_counts(std::vector<int>& read_diffs){
-    if (read_diffs.size() == 0)
-      return ".";
+  // Write a list of integers to the record as key|count pairs separated by semicolons
+  // e.g. -1,0,-1,2,2,1 will be written as -1|2;0|1;1|1;2|2
+  void condense_read_counts(std::vector<int>& read_diffs, VCFRecordFormatter& out){
+    if (read_diffs.size() == 0){
+      out << ".";
+      return;
+    }
     std::map<int, int> diff_counts;
     for (unsigned int i = 0; i < read_diffs.size(); i++)
       diff_counts[read_diffs[i]]++;
-    std::stringstream res;
     for (auto iter = diff_counts.begin(); iter != diff_counts.end(); iter++){
       if (iter != diff_counts.begin())
-	res << ";";
-      res << iter->first << "|" << iter->second;
+	out << ";";
+      out << iter->first << "|" << iter->second;
     }
-    return res.str();
   }
 
 
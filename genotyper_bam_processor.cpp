@@ -1,12 +1,21 @@
+#include <algorithm>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 //#include "sys/sysinfo.h"
 //#include "sys/types.h"
 
+#include "fastahack/Fasta.h"
+
 #include "extract_indels.h"
 #include "genotyper_bam_processor.h"
+#include "read_reservoir.h"
+#include "seqio.h"
+#include "version.h"
 
 int parseLine(char* line){
   int i = strlen(line);
@@ -101,6 +110,582 @@ void GenotyperBamProcessor::left_align_reads(Region& region, std::string& chrom_
     logger << "Failed to left align " << align_fail_count << " out of " << total_reads << " reads" << std::endl;
 }
 
+bool GenotyperBamProcessor::all_reads_match_reference(std::vector< std::vector<BamTools::BamAlignment> >& alignments){
+  for (unsigned int i = 0; i < alignments.size(); ++i)
+    for (unsigned int j = 0; j < alignments[i].size(); ++j)
+      if (!matchesReference(alignments[i][j]))
+	return false;
+  return true;
+}
+
+bool GenotyperBamProcessor::genotype_reference_locus(Region& region, bool haploid, std::string& chrom_seq, std::vector<Alignment>& left_alns,
+						     std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+						     std::vector<std::string>& rg_names){
+  for (unsigned int i = 0; i < left_alns.size(); ++i)
+    if (!RefGenotyper::is_reference_read(left_alns[i], region))
+      return false;
+
+  // Use the same stutter model as the sequence-based genotyper would, except that no model is trained from the reads
+  StutterModel* stutter_model = NULL;
+  if (def_stutter_model_ != NULL)
+    stutter_model = def_stutter_model_;
+  else if (read_stutter_models_){
+    auto model_iter = stutter_models_.find(region);
+    if (model_iter == stutter_models_.end())
+      return false;
+    stutter_model = model_iter->second;
+  }
+
+  RefGenotyper ref_genotyper(region, haploid, left_alns, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq, stutter_model);
+  if (!ref_genotyper.genotype(chrom_seq, logger()))
+    return false;
+  ref_genotyper.write_vcf_record(samples_to_genotype_, output_bstrap_quals_, output_gls_, output_pls_, output_phased_gls_,
+				 output_all_reads_, output_pall_reads_, output_mall_reads_, locus_downsample_frac(),
+				 (gl_sidecar_.is_open() ? &gl_sidecar_ : NULL), *locus_vcf_out_);
+  return true;
+}
+
+bool GenotyperBamProcessor::genotype_sample_chunks(Region& region, bool haploid, std::string& chrom_seq, StutterModel& stutter_model,
+						   std::vector< std::vector<BamTools::BamAlignment> >& alignments,
+						   std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+						   std::vector<std::string>& rg_names, int chunk_size){
+  assert(chunk_size > 0);
+  int num_chunks = (alignments.size() + chunk_size - 1)/chunk_size;
+  logger() << "Genotyping " << alignments.size() << " samples in " << num_chunks << " chunks of at most " << chunk_size << " samples" << std::endl;
+
+  // Left-aligned reads and phasing likelihoods for each chunk. Each chunk's raw reads are released as soon as they've been left aligned
+  std::vector< std::vector<Alignment> > chunk_left_alns(num_chunks);
+  std::vector< std::vector< std::vector<double> > > chunk_log_p1s(num_chunks), chunk_log_p2s(num_chunks);
+  std::vector< std::vector<bool> > chunk_use_to_generate_haps(num_chunks);
+  std::vector< std::vector<int> > chunk_bp_diffs(num_chunks);
+  std::vector< std::vector<std::string> > chunk_rg_names(num_chunks);
+
+  // The first pass only identifies the candidate alleles in each chunk, without aligning the reads to the haplotypes
+  ChunkAlleleMerger allele_merger;
+  double left_aln_time = 0, hap_build_time = 0;
+  for (int chunk = 0; chunk < num_chunks; chunk++){
+    unsigned int chunk_start = chunk*chunk_size;
+    unsigned int chunk_end   = std::min((unsigned int)alignments.size(), chunk_start + chunk_size);
+    std::vector< std::vector<BamTools::BamAlignment> > chunk_alns(chunk_end-chunk_start);
+    for (unsigned int i = chunk_start; i < chunk_end; i++)
+      chunk_alns[i-chunk_start].swap(alignments[i]);
+    std::vector< std::vector<double> > raw_log_p1s(log_p1s.begin()+chunk_start, log_p1s.begin()+chunk_end);
+    std::vector< std::vector<double> > raw_log_p2s(log_p2s.begin()+chunk_start, log_p2s.begin()+chunk_end);
+    chunk_rg_names[chunk] = std::vector<std::string>(rg_names.begin()+chunk_start, rg_names.begin()+chunk_end);
+
+    left_align_reads(region, chrom_seq, chunk_alns, raw_log_p1s, raw_log_p2s, chunk_log_p1s[chunk], chunk_log_p2s[chunk],
+		     chunk_left_alns[chunk], chunk_bp_diffs[chunk], chunk_use_to_generate_haps[chunk], logger());
+    left_aln_time += locus_left_aln_time_;
+    std::vector< std::vector<BamTools::BamAlignment> >().swap(chunk_alns);
+
+    SeqStutterGenotyper chunk_genotyper(region, haploid, chunk_left_alns[chunk], chunk_use_to_generate_haps[chunk], chunk_bp_diffs[chunk],
+					chunk_log_p1s[chunk], chunk_log_p2s[chunk], chunk_rg_names[chunk], chrom_seq, pool_seqs_, stutter_model, NULL, logger());
+    if (chunk_genotyper.vcf_pos() != -1)
+      allele_merger.add_chunk(chunk_genotyper.vcf_pos(), chunk_genotyper.alleles());
+    hap_build_time += chunk_genotyper.hap_build_time();
+  }
+  locus_left_aln_time_ = left_aln_time;
+  process_timer_.add_time("Left alignment",       left_aln_time);
+  process_timer_.add_time("Haplotype generation", hap_build_time);
+  if (allele_merger.empty())
+    return false;
+
+  std::vector<std::string> alleles;
+  int32_t allele_pos;
+  allele_merger.merge(region, chrom_seq, alleles, allele_pos);
+  logger() << "Genotyping all chunks using the " << alleles.size() << " alleles identified across chunks" << std::endl;
+
+  // The second pass genotypes each chunk using the merged alleles. As in the sequence-based genotyper, alternate alleles that aren't part of
+  // any sample's MAP genotype are then removed and the chunks are genotyped again. Removing these alleles doesn't change the remaining MAP genotypes,
+  // so each chunk's reads are released after it's genotyped in the final pass
+  std::set<std::string> samples_of_interest(samples_to_genotype_.begin(), samples_to_genotype_.end());
+  ChunkRecordMerger record_merger;
+  bool final_pass = false;
+  while (true){
+    std::vector<bool> called(alleles.size(), false);
+    called[0] = true;
+    for (int chunk = 0; chunk < num_chunks; chunk++){
+      SeqStutterGenotyper* chunk_genotyper = new SeqStutterGenotyper(region, haploid, chunk_left_alns[chunk], chunk_use_to_generate_haps[chunk], chunk_bp_diffs[chunk],
+								      chunk_log_p1s[chunk], chunk_log_p2s[chunk], chunk_rg_names[chunk], chrom_seq, pool_seqs_,
+								      stutter_model, alleles, allele_pos, logger());
+      if (chunk_genotyper->genotype(chrom_seq, logger())){
+	std::vector<bool> chunk_called;
+	chunk_genotyper->get_called_alleles(chunk_called);
+	for (unsigned int i = 0; i < chunk_called.size(); i++)
+	  called[i] = (called[i] || chunk_called[i]);
+
+	std::vector<std::string> chunk_samples;
+	for (unsigned int i = 0; i < chunk_rg_names[chunk].size(); i++)
+	  if (samples_of_interest.find(chunk_rg_names[chunk][i]) != samples_of_interest.end())
+	    chunk_samples.push_back(chunk_rg_names[chunk][i]);
+
+	std::stringstream chunk_record;
+	chunk_record.precision(str_vcf_.precision());
+	chunk_genotyper->write_vcf_record(chunk_samples, false, chrom_seq, output_bstrap_quals_, output_gls_, output_pls_, output_phased_gls_,
+					  output_all_reads_, output_pall_reads_, output_mall_reads_, false, max_flank_indel_frac_,
+					  locus_downsample_frac(), false, NULL, viz_out_, chunk_record, logger());
+	record_merger.add_chunk(chunk_record.str(), chunk_samples);
+      }
+      else
+	logger() << "Failed to genotype the samples in chunk " << chunk+1 << ". Their genotypes will be missing" << std::endl;
+
+      process_timer_.add_time("Haplotype generation",  chunk_genotyper->hap_build_time());
+      process_timer_.add_time("Haplotype alignment",   chunk_genotyper->hap_aln_time());
+      process_timer_.add_time("Posterior computation", chunk_genotyper->posterior_time());
+      process_timer_.add_time("Alignment traceback",   chunk_genotyper->aln_trace_time());
+      process_timer_.add_time("Bootstrap computation", chunk_genotyper->bootstrap_time());
+      delete chunk_genotyper;
+
+      if (final_pass){
+	std::vector<Alignment>().swap(chunk_left_alns[chunk]);
+	std::vector< std::vector<double> >().swap(chunk_log_p1s[chunk]);
+	std::vector< std::vector<double> >().swap(chunk_log_p2s[chunk]);
+      }
+    }
+    if (final_pass || record_merger.num_chunks() == 0)
+      break;
+
+    std::vector<std::string> called_alleles;
+    for (unsigned int i = 0; i < alleles.size(); i++)
+      if (called[i])
+	called_alleles.push_back(alleles[i]);
+    if (called_alleles.size() == alleles.size())
+      break;
+
+    logger() << "Regenotyping all chunks after removing " << alleles.size()-called_alleles.size() << " uncalled alleles" << std::endl;
+    alleles.swap(called_alleles);
+    record_merger.clear();
+    final_pass = true;
+  }
+
+  if (record_merger.num_chunks() == 0)
+    return false;
+  record_merger.write(samples_to_genotype_, *locus_vcf_out_);
+  return true;
+}
+
+StutterModel* GenotyperBamProcessor::select_stutter_model(Region& region, bool haploid, std::vector< std::vector<int> >& str_bp_lengths,
+							  std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s,
+							  std::vector<std::string>& rg_names, int inf_reads){
+  StutterModel* stutter_model = NULL;
+  if (def_stutter_model_ != NULL){
+    log("Using default stutter model");
+    stutter_model = def_stutter_model_->copy();
+    stutter_model->set_period(region.period());
+  }
+  else if (read_stutter_models_){
+    // Attempt to extact model from dictionary
+    auto model_iter = stutter_models_.find(region);
+    if (model_iter != stutter_models_.end())
+      stutter_model = model_iter->second->copy();
+    else
+      logger() << "WARNING: No stutter model found for " << region.chrom() << ":" << region.start() << "-" << region.stop() << std::endl;
+  }
+  else {
+    // Learn stutter model using length-based EM algorithm
+    log("Building EM stutter genotyper");
+    EMStutterGenotyper length_genotyper(region, haploid, str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
+    log("Training EM stutter genotyper");
+    bool trained = length_genotyper.train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, logger(), &locus_budget_);
+    if (trained){
+      if (output_stutter_models_)
+	length_genotyper.get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), *locus_stutter_out_);
+      num_em_converge_++;
+      stutter_model = length_genotyper.get_stutter_model()->copy();
+      logger() << "Learned stutter model: " << *stutter_model << std::endl;
+    }
+    else {
+      num_em_fail_++;
+      logger() << "Stutter model training failed for locus " << region.chrom() << ":" << region.start() << "-" << region.stop()
+	       << " with " << inf_reads << " informative reads" << std::endl;
+    }
+  }
+  return stutter_model;
+}
+
+bool GenotyperBamProcessor::admit_locus(Region& region, std::vector< std::vector<BamTools::BamAlignment> >& alignments, int& chunk_size){
+  std::vector<int64_t> sample_reads;
+  std::set<int> str_bp_diffs;
+  int64_t held_bytes = 0, left_aln_bytes = 0, num_em_reads = 0;
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    sample_reads.push_back(alignments[i].size());
+    for (auto aln_iter = alignments[i].begin(); aln_iter != alignments[i].end(); aln_iter++){
+      held_bytes += sizeof(BamTools::BamAlignment) + aln_iter->Name.size() + aln_iter->QueryBases.size() + aln_iter->AlignedBases.size()
+	+ aln_iter->Qualities.size() + aln_iter->TagData.size() + aln_iter->CigarData.size()*sizeof(BamTools::CigarOp);
+      left_aln_bytes += sizeof(Alignment) + 3*aln_iter->QueryBases.size();
+
+      // Each distinct STR length observed in the reads is a likely candidate allele
+      int bp_diff;
+      if (ExtractCigar(aln_iter->CigarData, aln_iter->Position, region.start()-region.period(), region.stop()+region.period(), bp_diff)){
+	str_bp_diffs.insert(bp_diff);
+	num_em_reads++;
+      }
+    }
+  }
+
+  // Allow for a few alleles that are only identified in stutter artifacts
+  int num_alleles = str_bp_diffs.size() + 2;
+  bool train_em   = (def_stutter_model_ == NULL && !read_stutter_models_);
+  LocusMemoryEstimator estimator(sample_reads, held_bytes, left_aln_bytes, num_alleles, (train_em ? num_em_reads : 0), str_bp_diffs.size());
+  bool allow_chunks = (output_str_gts_ && ref_vcf_ == NULL && !output_viz_ && !gl_sidecar_.is_open() && !checkpoint_writer_.is_open());
+
+  int64_t estimate;
+  int admitted_size = memory_admission_.admit(estimator, alignments.size(), chunk_size, allow_chunks, estimate);
+  if (admitted_size == MemoryAdmissionController::DEFER){
+    logger() << "Deferring locus with an estimated memory of " << estimate/1048576.0 << " MB, which exceeds the limit of "
+	     << memory_admission_.max_bytes()/1048576.0 << " MB. The locus won't be genotyped and its VCF record will be filtered" << std::endl;
+    return false;
+  }
+  if (admitted_size != chunk_size)
+    logger() << "Genotyping the locus in chunks of at most " << admitted_size << " samples to fit within the memory limit" << std::endl;
+  logger() << "Estimated locus memory = " << estimate/1048576.0 << " MB" << std::endl;
+  chunk_size = admitted_size;
+  memory_admission_.begin_locus();
+  return true;
+}
+
+void GenotyperBamProcessor::log_locus_peak_memory(){
+  // The process's peak isn't attributed to the locus if the kernel can't reset it
+  int64_t peak = memory_admission_.end_locus();
+  if (peak >= 0)
+    logger() << "Peak resident memory = " << peak/1048576.0 << " MB" << std::endl;
+}
+
+void GenotyperBamProcessor::discard_genotyper(SeqStutterGenotyper* seq_genotyper){
+  process_timer_.add_time("Haplotype generation",  seq_genotyper->hap_build_time());
+  process_timer_.add_time("Haplotype alignment",   seq_genotyper->hap_aln_time());
+  process_timer_.add_time("Posterior computation", seq_genotyper->posterior_time());
+  process_timer_.add_time("Alignment traceback",   seq_genotyper->aln_trace_time());
+  process_timer_.add_time("Bootstrap computation", seq_genotyper->bootstrap_time());
+  delete seq_genotyper;
+}
+
+bool GenotyperBamProcessor::genotype_within_budget(Region& region, bool haploid, std::string& chrom_seq, StutterModel& stutter_model,
+						   std::vector<Alignment>& left_alns, std::vector<bool>& use_to_generate_haps, std::vector<int>& bp_diffs,
+						   std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+						   std::vector<std::string>& rg_names, double& downsample_frac, SeqStutterGenotyper*& seq_genotyper){
+  // Each tier receives the full budget, as the work performed by the previous tiers is discarded
+  locus_budget_.restart();
+  seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alns, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq, pool_seqs_,
+					  stutter_model, NULL, logger());
+  seq_genotyper->set_budget(&locus_budget_, BUDGET_TIER_FULL);
+  if (recalc_stutter_model_)
+    seq_genotyper->record_stutter_emissions();
+  if (seq_genotyper->genotype(chrom_seq, logger()))
+    return true;
+  if (!seq_genotyper->over_budget())
+    return false;
+
+  std::vector<std::string> alleles;
+  int32_t allele_pos = -1;
+  bool capped = seq_genotyper->best_supported_alleles(BUDGET_MAX_ALLELES, alleles, allele_pos);
+  discard_genotyper(seq_genotyper);
+  seq_genotyper = NULL;
+
+  for (int tier = BUDGET_TIER_CAPPED_ALLELES; tier <= BUDGET_TIER_DOWNSAMPLED; tier++){
+    if (tier == BUDGET_TIER_CAPPED_ALLELES && !capped)
+      continue;
+
+    if (tier == BUDGET_TIER_DOWNSAMPLED){
+      // Mates share a name, so each read pair is either retained or discarded as a unit
+      std::vector<Alignment> kept_alns;
+      std::vector<bool> kept_use_to_generate_haps;
+      std::vector<int> kept_bp_diffs;
+      unsigned int read_index = 0;
+      for (unsigned int i = 0; i < filt_log_p1s.size(); i++){
+	std::vector<double> kept_log_p1s, kept_log_p2s;
+	for (unsigned int j = 0; j < filt_log_p1s[i].size(); j++, read_index++){
+	  uint64_t hash = ReadReservoir::hash_read_name(left_alns[read_index].get_name(), region.start());
+	  if ((double)hash >= BUDGET_DOWNSAMPLE_FRAC*18446744073709551616.0)
+	    continue;
+	  kept_alns.push_back(left_alns[read_index]);
+	  kept_use_to_generate_haps.push_back(use_to_generate_haps[read_index]);
+	  kept_bp_diffs.push_back(bp_diffs[read_index]);
+	  kept_log_p1s.push_back(filt_log_p1s[i][j]);
+	  kept_log_p2s.push_back(filt_log_p2s[i][j]);
+	}
+	filt_log_p1s[i].swap(kept_log_p1s);
+	filt_log_p2s[i].swap(kept_log_p2s);
+      }
+      logger() << "Downsampled the locus from " << left_alns.size() << " to " << kept_alns.size() << " reads" << std::endl;
+      if (!left_alns.empty())
+	downsample_frac *= 1.0*kept_alns.size()/left_alns.size();
+      left_alns.swap(kept_alns);
+      use_to_generate_haps.swap(kept_use_to_generate_haps);
+      bp_diffs.swap(kept_bp_diffs);
+    }
+
+    logger() << "Locus exceeded its compute budget. Regenotyping it using budget tier " << tier << std::endl;
+    locus_budget_.restart();
+    if (capped)
+      seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alns, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
+					      pool_seqs_, stutter_model, alleles, allele_pos, logger());
+    else
+      seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alns, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq,
+					      pool_seqs_, stutter_model, NULL, logger());
+    seq_genotyper->set_budget(&locus_budget_, tier);
+    if (recalc_stutter_model_)
+      seq_genotyper->record_stutter_emissions();
+    if (seq_genotyper->genotype(chrom_seq, logger()))
+      return true;
+    if (!seq_genotyper->over_budget())
+      return false;
+    discard_genotyper(seq_genotyper);
+    seq_genotyper = NULL;
+  }
+
+  logger() << "Locus exceeded its compute budget in every tier and won't be genotyped" << std::endl;
+  return false;
+}
+
+void GenotyperBamProcessor::write_checkpoint(Region& region, std::string& chrom_seq, std::vector<std::string>& rg_names, std::vector<Alignment>& left_alns,
+					     std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+					     std::vector<int>& bp_diffs, std::vector<bool>& use_to_generate_haps, std::vector< std::vector<int> >& str_bp_lengths,
+					     std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s,
+					     SeqStutterGenotyper* seq_genotyper){
+  std::vector<int> read_pools;
+  if (seq_genotyper == NULL){
+    std::vector<std::string> ref_alleles(1, uppercase(chrom_seq.substr(region.start(), region.stop()-region.start())));
+    checkpoint_writer_.add_locus(region, rg_names, left_alns, filt_log_p1s, filt_log_p2s, bp_diffs, use_to_generate_haps,
+				 str_bp_lengths, str_log_p1s, str_log_p2s, region.start()+1, ref_alleles, "", NULL, NULL, read_pools);
+    return;
+  }
+
+  // Only the reads are stored if the alignments weren't recorded
+  PooledAlignments pooled;
+  bool have_alns = seq_genotyper->get_pooled_alignments(pooled, read_pools);
+  checkpoint_writer_.add_locus(region, rg_names, left_alns, filt_log_p1s, filt_log_p2s, bp_diffs, use_to_generate_haps,
+			       str_bp_lengths, str_log_p1s, str_log_p2s, seq_genotyper->vcf_pos(), seq_genotyper->alleles(),
+			       seq_genotyper->haplotype_signature(), seq_genotyper->stutter_model(), (have_alns ? &pooled : NULL), read_pools);
+}
+
+void GenotyperBamProcessor::genotype_checkpoint_locus(Region& region, std::string& chrom_seq, std::vector<CheckpointLocus>& batches){
+  // Concatenate the samples from each batch
+  std::vector<std::string> rg_names;
+  std::vector<Alignment> left_alignments;
+  std::vector< std::vector<double> > filt_log_p1s, filt_log_p2s;
+  std::vector<bool> use_to_generate_haps;
+  std::vector<int> bp_diffs;
+  std::vector< std::vector<int> > str_bp_lengths;
+  std::vector< std::vector<double> > str_log_p1s, str_log_p2s;
+  ChunkAlleleMerger allele_merger;
+  int inf_reads = 0;
+  for (unsigned int i = 0; i < batches.size(); i++){
+    for (auto sample_iter = batches[i].samples.begin(); sample_iter != batches[i].samples.end(); sample_iter++){
+      rg_names.push_back(sample_iter->name);
+      left_alignments.insert(left_alignments.end(), sample_iter->alns.begin(), sample_iter->alns.end());
+      filt_log_p1s.push_back(sample_iter->log_p1);
+      filt_log_p2s.push_back(sample_iter->log_p2);
+      bp_diffs.insert(bp_diffs.end(), sample_iter->bp_diffs.begin(), sample_iter->bp_diffs.end());
+      use_to_generate_haps.insert(use_to_generate_haps.end(), sample_iter->use_for_haps.begin(), sample_iter->use_for_haps.end());
+      str_bp_lengths.push_back(sample_iter->em_bp_diffs);
+      str_log_p1s.push_back(sample_iter->em_log_p1);
+      str_log_p2s.push_back(sample_iter->em_log_p2);
+      inf_reads += sample_iter->em_bp_diffs.size();
+    }
+    if (!batches[i].alleles.empty())
+      allele_merger.add_chunk(batches[i].vcf_pos, batches[i].alleles);
+  }
+
+  int32_t total_reads = left_alignments.size();
+  if (total_reads < MIN_TOTAL_READS){
+    logger() << "Skipping locus with too few reads: TOTAL=" << total_reads << ", MIN=" << MIN_TOTAL_READS << std::endl;
+    return;
+  }
+  logger() << "Jointly genotyping " << rg_names.size() << " samples with " << total_reads << " reads from " << batches.size() << " checkpoints" << std::endl;
+
+  bool haploid = (haploid_chroms_.find(region.chrom()) != haploid_chroms_.end());
+  locus_stutter_time_ = clock();
+  StutterModel* stutter_model = select_stutter_model(region, haploid, str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, inf_reads);
+  locus_stutter_time_  = (clock() - locus_stutter_time_)/CLOCKS_PER_SEC;
+  total_stutter_time_ += locus_stutter_time_;
+  if (stutter_model == NULL)
+    return;
+
+  locus_genotype_time_ = clock();
+  SeqStutterGenotyper* seq_genotyper = NULL;
+  if (allele_merger.empty()){
+    // None of the batches were genotyped, so identify the alleles from the reads
+    seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alignments, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s,
+					    rg_names, chrom_seq, pool_seqs_, *stutter_model, NULL, logger());
+    if (checkpoint_writer_.is_open())
+      seq_genotyper->record_pooled_alignments();
+    num_realigned_reads_ += total_reads;
+  }
+  else {
+    std::vector<std::string> alleles;
+    int32_t allele_pos;
+    allele_merger.merge(region, chrom_seq, alleles, allele_pos);
+    seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alignments, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s,
+					    rg_names, chrom_seq, pool_seqs_, *stutter_model, alleles, allele_pos, logger());
+
+    // Reuse the alignments from batches whose reads were aligned to the same haplotype flanks. The reads are only aligned to the alleles
+    // their batch lacks, and are rescored if the batch used a different stutter model
+    std::string signature = (seq_genotyper->vcf_pos() == -1 ? "" : seq_genotyper->haplotype_signature());
+    std::vector<PooledAlignments> stored;
+    std::vector<int> read_groups, read_pools;
+    int32_t num_stored = 0, num_rescored = 0;
+    get_stored_alignments(batches, signature, *stutter_model, stored, read_groups, read_pools, num_stored, num_rescored);
+    if (!stored.empty() && !seq_genotyper->set_stored_alignments(read_groups, read_pools, stored))
+      num_stored = num_rescored = 0;
+    if (checkpoint_writer_.is_open())
+      seq_genotyper->record_pooled_alignments();
+    logger() << "Reusing stored alignments for " << num_stored << " out of " << total_reads << " reads, " << num_rescored
+	     << " of which were computed using a different stutter model" << std::endl;
+    num_stored_prob_reads_ += num_stored;
+    num_realigned_reads_   += total_reads - num_stored;
+  }
+
+  if (seq_genotyper->genotype(chrom_seq, logger())){
+    num_genotype_success_++;
+    seq_genotyper->write_vcf_record(samples_to_genotype_, true, chrom_seq, output_bstrap_quals_, output_gls_, output_pls_, output_phased_gls_,
+				    output_all_reads_, output_pall_reads_, output_mall_reads_, output_viz_, max_flank_indel_frac_,
+				    1.0, viz_left_alns_, (gl_sidecar_.is_open() ? &gl_sidecar_ : NULL), viz_out_, str_vcf_, logger());
+    if (checkpoint_writer_.is_open())
+      write_checkpoint(region, chrom_seq, rg_names, left_alignments, filt_log_p1s, filt_log_p2s, bp_diffs, use_to_generate_haps,
+		       str_bp_lengths, str_log_p1s, str_log_p2s, seq_genotyper);
+  }
+  else
+    num_genotype_fail_++;
+  locus_genotype_time_  = (clock() - locus_genotype_time_)/CLOCKS_PER_SEC;
+  total_genotype_time_ += locus_genotype_time_;
+
+  process_timer_.add_time("Haplotype generation",  seq_genotyper->hap_build_time());
+  process_timer_.add_time("Haplotype alignment",   seq_genotyper->hap_aln_time());
+  process_timer_.add_time("Posterior computation", seq_genotyper->posterior_time());
+  process_timer_.add_time("Alignment traceback",   seq_genotyper->aln_trace_time());
+  process_timer_.add_time("Bootstrap computation", seq_genotyper->bootstrap_time());
+  delete seq_genotyper;
+  delete stutter_model;
+}
+
+std::string GenotyperBamProcessor::locus_cache_key(std::vector< std::vector<BamTools::BamAlignment> >& alignments,
+						    std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+						    std::vector<std::string>& rg_names, Region& region, std::string& chrom_seq, bool haploid){
+  LocusKeyHasher hasher;
+  hasher.add_string(VERSION);
+  hasher.add_string(region.chrom());
+  hasher.add_string(region.name());
+  hasher.add(region.start());
+  hasher.add(region.stop());
+  hasher.add(region.period());
+  hasher.add(haploid);
+
+  // Filtered reads and their phasing likelihoods
+  int32_t min_pos = region.start(), max_pos = region.stop();
+  for (unsigned int i = 0; i < alignments.size(); i++){
+    hasher.add_string(rg_names[i]);
+    hasher.add((uint64_t)alignments[i].size());
+    for (unsigned int j = 0; j < alignments[i].size(); j++){
+      BamTools::BamAlignment& aln = alignments[i][j];
+      hasher.add_string(aln.Name);
+      hasher.add(aln.Position);
+      hasher.add((uint64_t)aln.CigarData.size());
+      for (auto cigar_iter = aln.CigarData.begin(); cigar_iter != aln.CigarData.end(); cigar_iter++){
+	hasher.add(cigar_iter->Type);
+	hasher.add(cigar_iter->Length);
+      }
+      hasher.add_string(aln.QueryBases);
+      hasher.add_string(aln.Qualities);
+      hasher.add(BamProcessor::passes_filters(aln));
+      hasher.add(log_p1s[i][j]);
+      hasher.add(log_p2s[i][j]);
+      min_pos = std::min(min_pos, aln.Position);
+      max_pos = std::max(max_pos, aln.GetEndPosition());
+    }
+  }
+
+  // Reference sequence spanned by the reads and the haplotype flanks
+  int32_t window_start = std::max(0, min_pos-100), window_end = std::min((int32_t)chrom_seq.size(), max_pos+100);
+  hasher.add_bytes(chrom_seq.data()+window_start, window_end-window_start);
+
+  // Stutter model inputs
+  StutterModel* stutter_model = def_stutter_model_;
+  if (stutter_model == NULL && read_stutter_models_){
+    auto model_iter = stutter_models_.find(region);
+    hasher.add(model_iter != stutter_models_.end());
+    if (model_iter != stutter_models_.end())
+      stutter_model = model_iter->second;
+  }
+  if (stutter_model != NULL){
+    for (int in_frame = 0; in_frame < 2; in_frame++){
+      hasher.add(stutter_model->get_parameter(in_frame == 1, 'P'));
+      hasher.add(stutter_model->get_parameter(in_frame == 1, 'U'));
+      hasher.add(stutter_model->get_parameter(in_frame == 1, 'D'));
+    }
+  }
+  else {
+    hasher.add(MAX_EM_ITER);
+    hasher.add(ABS_LL_CONVERGE);
+    hasher.add(FRAC_LL_CONVERGE);
+  }
+
+  // Parameters that affect the VCF record or the stutter model output
+  hasher.add(locus_downsample_frac());
+  hasher.add(locus_budget_.max_cells());
+  hasher.add(locus_budget_.max_seconds());
+  hasher.add(BUDGET_MAX_ALLELES);
+  hasher.add(BUDGET_DOWNSAMPLE_FRAC);
+  hasher.add(max_flank_indel_frac_);
+  hasher.add(pool_seqs_);
+  hasher.add(ref_fast_path_);
+  hasher.add(recalc_stutter_model_);
+  hasher.add(SAMPLE_CHUNK_SIZE);
+  hasher.add(memory_admission_.max_bytes());
+  hasher.add(output_stutter_models_);
+  hasher.add(output_bstrap_quals_);
+  hasher.add(output_gls_);
+  hasher.add(output_pls_);
+  hasher.add(output_phased_gls_);
+  hasher.add(output_all_reads_);
+  hasher.add(output_pall_reads_);
+  hasher.add(output_mall_reads_);
+  hasher.add((uint64_t)samples_to_genotype_.size());
+  for (auto sample_iter = samples_to_genotype_.begin(); sample_iter != samples_to_genotype_.end(); sample_iter++)
+    hasher.add_string(*sample_iter);
+  return hasher.hex_digest();
+}
+
+void GenotyperBamProcessor::begin_cached_locus(const std::string& key){
+  locus_cache_key_                       = key;
+  locus_cache_start_.num_genotype_success = num_genotype_success_;
+  locus_cache_start_.num_genotype_fail    = num_genotype_fail_;
+  locus_cache_start_.num_em_converge      = num_em_converge_;
+  locus_cache_start_.num_em_fail          = num_em_fail_;
+  locus_cache_start_.num_ref_fast_path    = num_ref_fast_path_;
+
+  cached_vcf_.str("");
+  cached_vcf_.clear();
+  cached_vcf_.precision(str_vcf_.precision());
+  cached_vcf_.flags(str_vcf_.flags());
+  cached_stutter_.str("");
+  cached_stutter_.clear();
+  locus_vcf_out_     = &cached_vcf_;
+  locus_stutter_out_ = &cached_stutter_;
+}
+
+void GenotyperBamProcessor::finish_cached_locus(){
+  if (locus_cache_key_.empty())
+    return;
+
+  LocusCacheEntry entry;
+  entry.num_genotype_success = num_genotype_success_ - locus_cache_start_.num_genotype_success;
+  entry.num_genotype_fail    = num_genotype_fail_    - locus_cache_start_.num_genotype_fail;
+  entry.num_em_converge      = num_em_converge_      - locus_cache_start_.num_em_converge;
+  entry.num_em_fail          = num_em_fail_          - locus_cache_start_.num_em_fail;
+  entry.num_ref_fast_path    = num_ref_fast_path_    - locus_cache_start_.num_ref_fast_path;
+  entry.vcf_text             = cached_vcf_.str();
+  entry.stutter_text         = cached_stutter_.str();
+  locus_cache_->store(locus_cache_key_, entry);
+
+  str_vcf_ << entry.vcf_text;
+  if (output_stutter_models_)
+    stutter_model_out_ << entry.stutter_text;
+  locus_vcf_out_     = &str_vcf_;
+  locus_stutter_out_ = &stutter_model_out_;
+  locus_cache_key_.clear();
+}
+
 void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector< std::vector<BamTools::BamAlignment> >& alignments,
 						      std::vector< std::vector<double> >& log_p1s,
 						      std::vector< std::vector<double> >& log_p2s,
@@ -158,84 +743,157 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector< std::vector<B
   }
 
   bool haploid = (haploid_chroms_.find(region.chrom()) != haploid_chroms_.end());
-  bool trained = false;
-  StutterModel* stutter_model          = NULL;
-  EMStutterGenotyper* length_genotyper = NULL;
-  locus_stutter_time_ = clock();
-  if (def_stutter_model_ != NULL){
-    log("Using default stutter model");
-    stutter_model = def_stutter_model_->copy();
-    stutter_model->set_period(region.period());
-  }
-  else if (read_stutter_models_){
-    // Attempt to extact model from dictionary
-    auto model_iter = stutter_models_.find(region);
-    if (model_iter != stutter_models_.end())
-      stutter_model = model_iter->second->copy();
-    else
-      logger() << "WARNING: No stutter model found for " << region.chrom() << ":" << region.start() << "-" << region.stop() << std::endl;
-  }
-  else {
-    // Learn stutter model using length-based EM algorithm
-    log("Building EM stutter genotyper");
-    length_genotyper = new EMStutterGenotyper(region, haploid, str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
-    log("Training EM stutter genotyper");
-    trained = length_genotyper->train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, logger());
-    if (trained){
+
+  // Reuse the locus's cached result if its reads, stutter model inputs and relevant parameters are unchanged
+  // Outputs that aren't stored in the cache disable it
+  std::string cache_key;
+  if (locus_cache_ != NULL && output_str_gts_ && ref_vcf_ == NULL && !output_viz_ && !gl_sidecar_.is_open() && !checkpoint_writer_.is_open()){
+    cache_key = locus_cache_key(alignments, log_p1s, log_p2s, rg_names, region, chrom_seq, haploid);
+    LocusCacheEntry entry;
+    if (locus_cache_->lookup(cache_key, entry)){
+      logger() << "Reusing the cached result for the locus" << std::endl;
+      str_vcf_ << entry.vcf_text;
       if (output_stutter_models_)
-	length_genotyper->get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), stutter_model_out_);
-      num_em_converge_++;
-      stutter_model = length_genotyper->get_stutter_model()->copy();
-      logger() << "Learned stutter model: " << *stutter_model << std::endl;
+	stutter_model_out_ << entry.stutter_text;
+      num_genotype_success_ += entry.num_genotype_success;
+      num_genotype_fail_    += entry.num_genotype_fail;
+      num_em_converge_      += entry.num_em_converge;
+      num_em_fail_          += entry.num_em_fail;
+      num_ref_fast_path_    += entry.num_ref_fast_path;
+      return;
     }
-    else {
-      num_em_fail_++;
-      logger() << "Stutter model training failed for locus " << region.chrom() << ":" << region.start() << "-" << region.stop()
-	       << " with " << inf_reads << " informative reads" << std::endl;
+  }
+
+  // Defer loci whose estimated memory exceeds the limit, unless genotyping their samples in smaller chunks would fit.
+  // Deferred loci are reported using a filtered record, so that every completed region has an entry in the VCF
+  int chunk_size = SAMPLE_CHUNK_SIZE;
+  if (memory_admission_.enabled() && !admit_locus(region, alignments, chunk_size)){
+    if (output_str_gts_){
+      SeqStutterGenotyper::write_over_memory_vcf_record(region, chrom_seq, samples_to_genotype_, *locus_vcf_out_);
+      num_genotype_fail_++;
     }
+    return;
   }
+  if (!cache_key.empty())
+    begin_cached_locus(cache_key);
+
+  // Reads are left aligned at most once per locus, as the sequence-based genotyper reuses the fast path's alignments
+  std::vector<Alignment> left_alignments;
+  std::vector< std::vector<double> > filt_log_p1s, filt_log_p2s;
+  std::vector<bool> use_to_generate_haps;
+  std::vector<int> bp_diffs;
+  bool left_aligned = false;
+
+  // If every read matches the reference, we can avoid training a stutter model and genotyping the locus using haplotypes
+  if (ref_fast_path_ && output_str_gts_ && ref_vcf_ == NULL && !output_viz_ && all_reads_match_reference(alignments)){
+    locus_genotype_time_ = clock();
+    left_align_reads(region, chrom_seq, alignments, log_p1s, log_p2s, filt_log_p1s,
+		     filt_log_p2s, left_alignments, bp_diffs, use_to_generate_haps, logger());
+    left_aligned = true;
+    if (genotype_reference_locus(region, haploid, chrom_seq, left_alignments, filt_log_p1s, filt_log_p2s, rg_names)){
+      // Write the stutter model the full path would have learned, so that every genotyped locus has an entry in the stutter model file.
+      // As each read has the reference length, training only requires a few iterations over the reads' STR lengths
+      if (output_stutter_models_ && def_stutter_model_ == NULL && !read_stutter_models_){
+	EMStutterGenotyper length_genotyper(region, haploid, str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, 0);
+	if (length_genotyper.train(MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE, false, logger()))
+	  length_genotyper.get_stutter_model()->write_model(region.chrom(), region.start(), region.stop(), *locus_stutter_out_);
+      }
+      if (checkpoint_writer_.is_open())
+	write_checkpoint(region, chrom_seq, rg_names, left_alignments, filt_log_p1s, filt_log_p2s, bp_diffs, use_to_generate_haps,
+			 str_bp_lengths, str_log_p1s, str_log_p2s, NULL);
+      num_ref_fast_path_++;
+      num_genotype_success_++;
+      locus_genotype_time_  = (clock() - locus_genotype_time_)/CLOCKS_PER_SEC;
+      total_genotype_time_ += locus_genotype_time_;
+      process_timer_.add_time("Left alignment", locus_left_aln_time_);
+      logger() << "Locus timing:"                                          << "\n"
+	       << " BAM seek time       = " << locus_bam_seek_time()       << " seconds\n"
+	       << " Read filtering      = " << locus_read_filter_time()    << " seconds\n"
+	       << " SNP info extraction = " << locus_snp_phase_info_time() << " seconds\n"
+	       << " Genotyping          = " << locus_genotype_time()       << " seconds\n"
+	       << "\t" << " Left alignment        = "  << locus_left_aln_time_ << " seconds\n";
+      if (memory_admission_.enabled())
+	log_locus_peak_memory();
+      finish_cached_locus();
+      return;
+    }
+    logger() << "Locus contains reads that may not support the reference allele. Genotyping using haplotypes" << std::endl;
+  }
+
+  locus_stutter_time_ = clock();
+  locus_budget_.restart();
+  StutterModel* stutter_model = select_stutter_model(region, haploid, str_bp_lengths, str_log_p1s, str_log_p2s, rg_names, inf_reads);
+  bool em_over_budget  = (stutter_model == NULL && locus_budget_.exceeded());
   locus_stutter_time_  = (clock() - locus_stutter_time_)/CLOCKS_PER_SEC;;
   total_stutter_time_ += locus_stutter_time_;
 
   SeqStutterGenotyper* seq_genotyper = NULL;
   locus_genotype_time_ = clock();
   if (output_str_gts_){
-    if (stutter_model != NULL) {
+    if (stutter_model != NULL && chunk_size > 0 && alignments.size() > chunk_size
+	&& ref_vcf_ == NULL && !output_viz_ && !gl_sidecar_.is_open() && !checkpoint_writer_.is_open()){
+      // Release any alignments from the fast path, as each chunk's reads are left aligned separately
+      std::vector<Alignment>().swap(left_alignments);
+      if (genotype_sample_chunks(region, haploid, chrom_seq, *stutter_model, alignments, log_p1s, log_p2s, rg_names, chunk_size))
+	num_genotype_success_++;
+      else
+	num_genotype_fail_++;
+    }
+    else if (em_over_budget){
+      SeqStutterGenotyper::write_over_budget_vcf_record(region, chrom_seq, samples_to_genotype_, *locus_vcf_out_);
+      num_genotype_fail_++;
+    }
+    else if (stutter_model != NULL) {
       VCF::VCFReader* reference_panel_vcf = NULL;
       if (ref_vcf_ != NULL)
 	reference_panel_vcf = ref_vcf_;
 
-      std::vector<Alignment> left_alignments;
-      std::vector< std::vector<double> > filt_log_p1s, filt_log_p2s;
-      std::vector<bool> use_to_generate_haps;
-      std::vector<int> bp_diffs;
-      left_align_reads(region, chrom_seq, alignments, log_p1s, log_p2s, filt_log_p1s,
-		       filt_log_p2s, left_alignments, bp_diffs, use_to_generate_haps, logger());
-
-      seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alignments, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq, pool_seqs_,
-					      *stutter_model, reference_panel_vcf, logger());
-
-      if (output_str_gts_){
-	if (seq_genotyper->genotype(chrom_seq, logger())) {
-	  bool pass = true;
-
-	  // If appropriate, recalculate the stutter model using the haplotype ML alignments,
-	  // realign the reads and regenotype the samples
-	  if (recalc_stutter_model_)
-	    pass = seq_genotyper->recompute_stutter_models(chrom_seq, logger(), MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE);
-
-	  if (pass){
-	    num_genotype_success_++;
-	    seq_genotyper->write_vcf_record(samples_to_genotype_, true, chrom_seq, output_bstrap_quals_, output_gls_, output_pls_, output_phased_gls_,
-					    output_all_reads_, output_pall_reads_, output_mall_reads_, output_viz_, max_flank_indel_frac_,
-					    viz_left_alns_, viz_out_, str_vcf_, logger());
-	  }
-	  else
-	    num_genotype_fail_++;
+      if (!left_aligned)
+	left_align_reads(region, chrom_seq, alignments, log_p1s, log_p2s, filt_log_p1s,
+			 filt_log_p2s, left_alignments, bp_diffs, use_to_generate_haps, logger());
+
+      // The budget's fallback tiers aren't applied when genotyping using a reference panel or writing a checkpoint
+      double downsample_frac = locus_downsample_frac();
+      bool genotyped;
+      if (locus_budget_.enabled() && reference_panel_vcf == NULL && !checkpoint_writer_.is_open())
+	genotyped = genotype_within_budget(region, haploid, chrom_seq, *stutter_model, left_alignments, use_to_generate_haps, bp_diffs,
+					   filt_log_p1s, filt_log_p2s, rg_names, downsample_frac, seq_genotyper);
+      else {
+	seq_genotyper = new SeqStutterGenotyper(region, haploid, left_alignments, use_to_generate_haps, bp_diffs, filt_log_p1s, filt_log_p2s, rg_names, chrom_seq, pool_seqs_,
+						*stutter_model, reference_panel_vcf, logger());
+	if (recalc_stutter_model_)
+	  seq_genotyper->record_stutter_emissions();
+	if (checkpoint_writer_.is_open())
+	  seq_genotyper->record_pooled_alignments();
+	genotyped = seq_genotyper->genotype(chrom_seq, logger());
+      }
+
+      if (seq_genotyper == NULL){
+	SeqStutterGenotyper::write_over_budget_vcf_record(region, chrom_seq, samples_to_genotype_, *locus_vcf_out_);
+	num_genotype_fail_++;
+      }
+      else if (genotyped) {
+	bool pass = true;
+
+	// If appropriate, recalculate the stutter model using the haplotype ML alignments,
+	// realign the reads and regenotype the samples
+	if (recalc_stutter_model_)
+	  pass = seq_genotyper->recompute_stutter_models(chrom_seq, logger(), MAX_EM_ITER, ABS_LL_CONVERGE, FRAC_LL_CONVERGE);
+
+	if (pass){
+	  num_genotype_success_++;
+	  seq_genotyper->write_vcf_record(samples_to_genotype_, true, chrom_seq, output_bstrap_quals_, output_gls_, output_pls_, output_phased_gls_,
+					  output_all_reads_, output_pall_reads_, output_mall_reads_, output_viz_, max_flank_indel_frac_,
+					  downsample_frac, viz_left_alns_, (gl_sidecar_.is_open() ? &gl_sidecar_ : NULL), viz_out_, *locus_vcf_out_, logger());
+	  if (checkpoint_writer_.is_open())
+	    write_checkpoint(region, chrom_seq, rg_names, left_alignments, filt_log_p1s, filt_log_p2s, bp_diffs, use_to_generate_haps,
+			     str_bp_lengths, str_log_p1s, str_log_p2s, seq_genotyper);
 	}
 	else
 	  num_genotype_fail_++;
       }
+      else
+	num_genotype_fail_++;
     }
   }
   locus_genotype_time_  = (clock() - locus_genotype_time_)/CLOCKS_PER_SEC;
@@ -248,8 +906,9 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector< std::vector<B
 	   << " Stutter estimation  = " << locus_stutter_time()        << " seconds\n";
   if (stutter_model != NULL){
     logger() << " Genotyping          = " << locus_genotype_time()       << " seconds\n";
-    if (output_str_gts_){
-      assert(seq_genotyper != NULL);
+    if (output_str_gts_ && seq_genotyper == NULL)
+      logger() << "\t" << " Left alignment        = "  << locus_left_aln_time_             << " seconds\n"; // Chunk timings were recorded separately
+    else if (output_str_gts_){
       logger() << "\t" << " Left alignment        = "  << locus_left_aln_time_             << " seconds\n"
 	       << "\t" << " Haplotype generation  = "  << seq_genotyper->hap_build_time()  << " seconds\n"
 	       << "\t" << " Haplotype alignment   = "  << seq_genotyper->hap_aln_time()    << " seconds\n"
@@ -273,7 +932,144 @@ void GenotyperBamProcessor::analyze_reads_and_phasing(std::vector< std::vector<B
 
   delete seq_genotyper;
   delete stutter_model;
-  delete length_genotyper;
+  if (memory_admission_.enabled())
+    log_locus_peak_memory();
+  finish_cached_locus();
 }
  
 
+bool GenotyperBamProcessor::resume_output(std::string& vcf_file){
+  std::vector<std::string> samples;
+  std::vector<ProgressEntry> entries;
+  if (progress_log_ == NULL || !progress_log_->read(samples, entries)){
+    log("No progress file was found for " + vcf_file + ". Genotyping will begin with the first region");
+    return false;
+  }
+  if (samples != samples_to_genotype_)
+    printErrorAndDie("The samples being genotyped differ from those in the interrupted run's progress file " + progress_log_->filename());
+
+  struct stat stutter_info;
+  int64_t stutter_size = -1;
+  if (output_stutter_models_ && stat(stutter_model_file_.c_str(), &stutter_info) == 0)
+    stutter_size = stutter_info.st_size;
+
+  // Use the latest checkpoint whose output reached the disk before the run was interrupted
+  for (int i = (int)entries.size()-1; i >= 0; i--){
+    if ((entries[i].stutter_offset >= 0) != output_stutter_models_)
+      printErrorAndDie("The --stutter-out option must be the same as in the interrupted run in order to resume it");
+    if (entries[i].stutter_offset > stutter_size)
+      continue;
+    if (!str_vcf_.resume(vcf_file.c_str(), entries[i].vcf_offset, bgzf_threads_, true))
+      continue;
+
+    if (output_stutter_models_){
+      if (truncate(stutter_model_file_.c_str(), entries[i].stutter_offset) != 0)
+	printErrorAndDie("Failed to truncate the stutter model output file " + stutter_model_file_);
+      stutter_model_out_.open(stutter_model_file_, std::ofstream::in | std::ofstream::out);
+      if (!stutter_model_out_.is_open())
+	printErrorAndDie("Failed to open output file for stutter models");
+      stutter_model_out_.seekp(0, std::ios_base::end);
+    }
+
+    // Discard any later checkpoints, as the output they describe will be regenerated
+    entries.resize(i+1);
+    progress_log_->open(samples_to_genotype_, entries);
+    resume_entry_         = entries[i];
+    num_genotype_success_ = resume_entry_.num_genotype_success;
+    num_genotype_fail_    = resume_entry_.num_genotype_fail;
+    num_em_converge_      = resume_entry_.num_em_converge;
+    num_em_fail_          = resume_entry_.num_em_fail;
+    num_ref_fast_path_    = resume_entry_.num_ref_fast_path;
+    log("Resuming the interrupted run after " + std::to_string(resume_entry_.num_regions) + " completed regions");
+    return true;
+  }
+  log("None of the checkpoints in " + progress_log_->filename() + " were fully written. Genotyping will begin with the first region");
+  return false;
+}
+
+int32_t GenotyperBamProcessor::num_completed_regions(const std::vector<Region>& regions){
+  if (resume_entry_.num_regions == 0)
+    return 0;
+  if (resume_entry_.num_regions > (int32_t)regions.size())
+    printErrorAndDie("The interrupted run completed more regions than are present in the region file");
+
+  // The regions must be the same as in the interrupted run for the output to be identical
+  const Region& last = regions[resume_entry_.num_regions-1];
+  if (last.chrom().compare(resume_entry_.chrom) != 0 || last.start() != resume_entry_.start || last.stop() != resume_entry_.stop)
+    printErrorAndDie("The regions being genotyped differ from those in the interrupted run. Region " + std::to_string(resume_entry_.num_regions)
+		     + " was previously " + resume_entry_.chrom + ":" + std::to_string(resume_entry_.start) + "-" + std::to_string(resume_entry_.stop));
+  logger() << "Skipping the " << resume_entry_.num_regions << " regions completed before the run was interrupted" << std::endl;
+  return resume_entry_.num_regions;
+}
+
+void GenotyperBamProcessor::region_completed(const std::vector<Region>& regions, int32_t num_completed){
+  if (progress_log_ == NULL || !progress_log_->is_open())
+    return;
+  if (num_completed % PROGRESS_INTERVAL != 0 && num_completed != (int32_t)regions.size())
+    return;
+
+  const Region& last = regions[num_completed-1];
+  ProgressEntry entry;
+  entry.num_regions          = num_completed;
+  entry.chrom                = last.chrom();
+  entry.start                = last.start();
+  entry.stop                 = last.stop();
+  entry.vcf_offset           = str_vcf_.uncompressed_offset();
+  entry.num_genotype_success = num_genotype_success_;
+  entry.num_genotype_fail    = num_genotype_fail_;
+  entry.num_em_converge      = num_em_converge_;
+  entry.num_em_fail          = num_em_fail_;
+  entry.num_ref_fast_path    = num_ref_fast_path_;
+  if (output_stutter_models_){
+    stutter_model_out_.flush();
+    entry.stutter_offset = stutter_model_out_.tellp();
+  }
+  progress_log_->add_entry(entry);
+}
+
+void GenotyperBamProcessor::process_checkpoints(std::string& region_file, std::string& fasta_dir, int32_t max_regions, std::string chrom){
+  std::vector<Region> regions;
+  readRegions(region_file, regions, max_regions, chrom, logger());
+  orderRegions(regions);
+
+  FastaReference* fasta_ref = NULL;
+  if (is_file(fasta_dir)){
+    fasta_ref = new FastaReference();
+    log("Fasta file exists... " + fasta_dir);
+    fasta_ref->open(fasta_dir);
+  }
+
+  std::string cur_chrom = "", chrom_seq;
+  // Skip any regions completed by an interrupted run, and record the progress after each region
+  int32_t num_completed = num_completed_regions(regions);
+  for (auto region_iter = regions.begin()+num_completed; region_iter != regions.end(); region_iter++, region_completed(regions, ++num_completed)){
+    logger() << "Processing region " << region_iter->chrom() << " " << region_iter->start() << " " << region_iter->stop() << std::endl;
+
+    // Only loci that were checkpointed for at least one batch of samples can be genotyped
+    std::vector<CheckpointLocus> batches;
+    for (unsigned int i = 0; i < checkpoint_readers_.size(); i++){
+      batches.push_back(CheckpointLocus());
+      if (!checkpoint_readers_[i]->get_locus(*region_iter, batches.back()))
+	batches.pop_back();
+    }
+    if (batches.empty()){
+      logger() << "Skipping region as it isn't present in any of the checkpoint files" << std::endl;
+      continue;
+    }
+
+    // Read FASTA sequence for chromosome
+    if (cur_chrom.compare(region_iter->chrom()) != 0){
+      cur_chrom = region_iter->chrom();
+      if (fasta_ref != NULL)
+	chrom_seq = fasta_ref->getSequence(cur_chrom);
+      else
+	readFastaFromDir(cur_chrom+".fa", fasta_dir, chrom_seq);
+      assert(chrom_seq.size() != 0);
+    }
+
+    genotype_checkpoint_locus(*region_iter, chrom_seq, batches);
+  }
+
+  if (fasta_ref != NULL)
+    delete fasta_ref;
+}
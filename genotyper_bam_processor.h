@@ -5,13 +5,22 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
 #include "bamtools/include/api/BamAlignment.h"
 #include "bgzf_streams.h"
+#include "chunk_merger.h"
 #include "em_stutter_genotyper.h"
+#include "gl_sidecar.h"
+#include "locus_budget.h"
+#include "locus_cache.h"
+#include "memory_admission.h"
 #include "process_timer.h"
+#include "read_checkpoint.h"
+#include "run_progress.h"
+#include "ref_genotyper.h"
 #include "region.h"
 #include "seq_stutter_genotyper.h"
 #include "snp_bam_processor.h"
@@ -39,10 +48,49 @@ private:
   bool output_str_gts_;
   bgzfostream str_vcf_;
   std::vector<std::string> samples_to_genotype_;
+  int bgzf_threads_;  // Number of threads used to compress the STR VCF
+
+  // Optional binary sidecar containing each sample's genotype likelihoods
+  std::string gl_sidecar_file_;
+  GLSidecarWriter gl_sidecar_;
+
+  // Optional binary checkpoint containing each locus's left-aligned reads and haplotype alignment likelihoods
+  std::string checkpoint_file_;
+  ReadCheckpointWriter checkpoint_writer_;
+
+  // Checkpoints for batches of samples that are jointly genotyped instead of reading BAMs
+  std::vector<ReadCheckpointReader*> checkpoint_readers_;
+  int64_t num_stored_prob_reads_, num_realigned_reads_;
+
+  // Optional content-addressed cache of each locus's VCF record and stutter model
+  LocusResultCache* locus_cache_;
+  std::string locus_cache_key_;          // Key for the locus being genotyped, or empty if its result isn't being cached
+  LocusCacheEntry locus_cache_start_;    // Counter values when genotyping of the cached locus began
+  std::stringstream cached_vcf_, cached_stutter_;
+
+  // Destinations for the current locus's VCF records and stutter model, which are buffered while its result is being cached
+  std::ostream* locus_vcf_out_;
+  std::ostream* locus_stutter_out_;
+
+  // Progress log used to resume interrupted runs
+  RunProgressLog* progress_log_;
+  bool resume_;
+  ProgressEntry resume_entry_;     // Checkpoint the run was resumed from
+  std::string stutter_model_file_;
+
+  /*
+   * Truncates the VCF and stutter model output of an interrupted run at its latest checkpoint that was fully written to disk
+   * and restores the counters from the checkpoint. Returns false if the run can't be resumed from any checkpoint
+   */
+  bool resume_output(std::string& vcf_file);
 
   // Counters for genotyping success;
   int num_genotype_success_, num_genotype_fail_;
 
+  // If true, loci at which every read matches the reference are genotyped using the RefGenotyper
+  bool ref_fast_path_;
+  int num_ref_fast_path_;
+
   // VCF containg SNP and STR genotypes for a reference panel
   VCF::VCFReader* ref_vcf_;
 
@@ -81,6 +129,12 @@ private:
   // Simple object to track total times consumed by various processes
   ProcessTimer process_timer_;
 
+  // Optional limit on the computation spent genotyping each locus
+  LocusBudget locus_budget_;
+
+  // Optional limit on the memory used to genotype each locus
+  MemoryAdmissionController memory_admission_;
+
   // If it is not null, this stutter model will be used for each locus
   StutterModel* def_stutter_model_;
 
@@ -91,6 +145,92 @@ private:
 			std::vector< Alignment>& left_alns, std::vector<int>& bp_diffs, std::vector<bool>& use_for_hap_generation,
 			std::ostream& logger);
 
+  /*
+   * Returns the stutter model for the locus: the default model, the model read from file or a model trained using the
+   * length-based EM algorithm on the provided reads. Returns NULL if no model is available. The caller must delete the model
+   */
+  StutterModel* select_stutter_model(Region& region, bool haploid, std::vector< std::vector<int> >& str_bp_lengths,
+				     std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s,
+				     std::vector<std::string>& rg_names, int inf_reads);
+
+  /*
+   * Adds the locus's reads and stutter training data to the checkpoint, along with the alleles and the pooled reads' alignments
+   * from the sequence-based genotyper. If SEQ_GENOTYPER is NULL, the locus was genotyped using only the reference allele
+   */
+  void write_checkpoint(Region& region, std::string& chrom_seq, std::vector<std::string>& rg_names, std::vector<Alignment>& left_alns,
+			std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+			std::vector<int>& bp_diffs, std::vector<bool>& use_to_generate_haps, std::vector< std::vector<int> >& str_bp_lengths,
+			std::vector< std::vector<double> >& str_log_p1s, std::vector< std::vector<double> >& str_log_p2s,
+			SeqStutterGenotyper* seq_genotyper);
+
+  /*
+   * Jointly genotypes the samples from each batch's checkpoint using the union of the batches' alleles. Reads from batches that were aligned
+   * to the same haplotype flanks reuse their stored alignments, are only aligned to the alleles their batch lacks and are rescored if their batch
+   * used a different stutter model, while all other reads are realigned
+   */
+  void genotype_checkpoint_locus(Region& region, std::string& chrom_seq, std::vector<CheckpointLocus>& batches);
+
+  /*
+   * Genotypes the locus using the sequence-based genotyper while enforcing the per-locus compute budget. If the locus exceeds its budget,
+   * it's regenotyped using progressively cheaper tiers: only the BUDGET_MAX_ALLELES best-supported candidate alleles, and then those
+   * alleles with a BUDGET_DOWNSAMPLE_FRAC subset of each sample's read pairs. SEQ_GENOTYPER is set to the genotyper from the final
+   * tier, or to NULL if every tier exceeded the budget, and DOWNSAMPLE_FRAC is updated to reflect any downsampling.
+   * Returns true iff the samples were successfully genotyped
+   */
+  bool genotype_within_budget(Region& region, bool haploid, std::string& chrom_seq, StutterModel& stutter_model,
+			      std::vector<Alignment>& left_alns, std::vector<bool>& use_to_generate_haps, std::vector<int>& bp_diffs,
+			      std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+			      std::vector<std::string>& rg_names, double& downsample_frac, SeqStutterGenotyper*& seq_genotyper);
+
+  // Adds the time spent by a genotyper that was discarded because the locus exceeded its budget and deletes it
+  void discard_genotyper(SeqStutterGenotyper* seq_genotyper);
+
+  /*
+   * Returns the cache key for the locus, a hash of its filtered reads and their phasing likelihoods, the surrounding reference sequence,
+   * the stutter model inputs and the parameters that affect its VCF record or stutter model
+   */
+  std::string locus_cache_key(std::vector< std::vector<BamTools::BamAlignment> >& alignments,
+			      std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+			      std::vector<std::string>& rg_names, Region& region, std::string& chrom_seq, bool haploid);
+
+  // Buffers the locus's output until finish_cached_locus() stores it in the cache under the provided key
+  void begin_cached_locus(const std::string& key);
+
+  // If the locus's result is being cached, stores it in the cache and writes the buffered output
+  void finish_cached_locus();
+
+  // Returns true iff none of the reads contain a mismatch or indel relative to the reference
+  bool all_reads_match_reference(std::vector< std::vector<BamTools::BamAlignment> >& alignments);
+
+  /*
+   * Genotypes each sample as homozygous for the reference allele if every left-aligned read only supports the reference allele.
+   * Returns false, without writing a VCF record, if any read may support a non-reference allele
+   */
+  bool genotype_reference_locus(Region& region, bool haploid, std::string& chrom_seq, std::vector<Alignment>& left_alns,
+				std::vector< std::vector<double> >& filt_log_p1s, std::vector< std::vector<double> >& filt_log_p2s,
+				std::vector<std::string>& rg_names);
+
+  /*
+   * Estimates the locus's memory from its read, allele and sample counts and decides whether it fits within the --max-memory limit.
+   * CHUNK_SIZE is reduced if genotyping the samples in smaller chunks is required to fit. Returns false if the locus should be deferred
+   */
+  bool admit_locus(Region& region, std::vector< std::vector<BamTools::BamAlignment> >& alignments, int& chunk_size);
+
+  /* Logs the peak resident memory measured since the locus was admitted, if the kernel supports resetting it */
+  void log_locus_peak_memory();
+
+  /*
+   * Genotypes the locus in chunks of at most CHUNK_SIZE samples, so that only one chunk's haplotype alignments and
+   * genotype posteriors are held in memory at a time. The first pass left aligns each chunk's reads, frees the raw reads and
+   * identifies the chunk's candidate alleles without aligning the reads to them. The second pass genotypes each chunk using the
+   * union of these alleles, after which alleles absent from every sample's MAP genotype are removed and the chunks are regenotyped.
+   * The chunks' VCF records are then merged into a single record. Returns true iff at least one chunk was successfully genotyped
+   */
+  bool genotype_sample_chunks(Region& region, bool haploid, std::string& chrom_seq, StutterModel& stutter_model,
+			      std::vector< std::vector<BamTools::BamAlignment> >& alignments,
+			      std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+			      std::vector<std::string>& rg_names, int chunk_size);
+
 public:
  GenotyperBamProcessor(bool use_bam_rgs, bool remove_pcr_dups):SNPBamProcessor(use_bam_rgs, remove_pcr_dups){
     output_stutter_models_ = false;
@@ -104,6 +244,8 @@ public:
     num_em_fail_           = 0;
     num_genotype_success_  = 0;
     num_genotype_fail_     = 0;
+    ref_fast_path_         = false;
+    num_ref_fast_path_     = 0;
     MAX_EM_ITER            = 100;
     ABS_LL_CONVERGE        = 0.01;
     FRAC_LL_CONVERGE       = 0.001;
@@ -125,6 +267,18 @@ public:
     recalc_stutter_model_  = false;
     def_stutter_model_     = NULL;
     ref_vcf_               = NULL;
+    bgzf_threads_          = 1;
+    SAMPLE_CHUNK_SIZE      = 0;
+    num_stored_prob_reads_ = 0;
+    num_realigned_reads_   = 0;
+    locus_cache_           = NULL;
+    locus_vcf_out_         = &str_vcf_;
+    locus_stutter_out_     = &stutter_model_out_;
+    progress_log_          = NULL;
+    resume_                = false;
+    PROGRESS_INTERVAL      = 100;
+    BUDGET_MAX_ALLELES     = 5;
+    BUDGET_DOWNSAMPLE_FRAC = 0.25;
   }
 
   ~GenotyperBamProcessor(){
@@ -135,6 +289,12 @@ public:
       delete ref_vcf_;
     if (def_stutter_model_ != NULL)
       delete def_stutter_model_;
+    for (unsigned int i = 0; i < checkpoint_readers_.size(); i++)
+      delete checkpoint_readers_[i];
+    if (locus_cache_ != NULL)
+      delete locus_cache_;
+    if (progress_log_ != NULL)
+      delete progress_log_;
   }
 
   double total_stutter_time()  { return total_stutter_time_;  }
@@ -152,9 +312,36 @@ public:
   void hide_mall_reads()    { output_mall_reads_ = false;   }
   void visualize_left_alns(){ viz_left_alns_     = true;    }
   void pool_sequences()     { pool_seqs_         = true;    }
+  void use_ref_fast_path()  { ref_fast_path_     = true;    }
+  void recalc_stutter_model(){ recalc_stutter_model_ = true; }
 
   void add_haploid_chrom(std::string chrom){ haploid_chroms_.insert(chrom); }
   void set_max_flank_indel_frac(float frac){  max_flank_indel_frac_ = frac; }
+  void set_bgzf_threads(int n_threads)     { bgzf_threads_ = n_threads;     }
+  void set_output_gl_sidecar(std::string& gl_file){ gl_sidecar_file_ = gl_file; }
+  bool output_gl_sidecar()                 { return !gl_sidecar_file_.empty(); }
+  void set_output_checkpoint(std::string& checkpoint_file){ checkpoint_file_ = checkpoint_file; }
+  void set_locus_cache(std::string& cache_dir){
+    if (locus_cache_ != NULL)
+      delete locus_cache_;
+    locus_cache_ = new LocusResultCache(cache_dir);
+  }
+  bool output_checkpoint()                 { return !checkpoint_file_.empty(); }
+  bool output_viz()                        { return output_viz_;               }
+  void set_resume()                        { resume_ = true;                   }
+  void set_locus_budget(int64_t max_cells, double max_seconds){ locus_budget_.set_limits(max_cells, max_seconds); }
+  void set_max_memory(int64_t max_bytes)   { memory_admission_.set_limit(max_bytes); }
+
+  /* Adds a checkpoint whose samples will be jointly genotyped by process_checkpoints() and adds its samples to SAMPLES */
+  void add_input_checkpoint(std::string& checkpoint_file, std::set<std::string>& samples){
+    checkpoint_readers_.push_back(new ReadCheckpointReader(checkpoint_file));
+    const std::vector<std::string>& ckpt_samples = checkpoint_readers_.back()->get_samples();
+    for (auto sample_iter = ckpt_samples.begin(); sample_iter != ckpt_samples.end(); sample_iter++)
+      if (!samples.insert(*sample_iter).second)
+	printErrorAndDie("Sample " + *sample_iter + " is present in more than one checkpoint file");
+    log("Checkpoint file " + checkpoint_file + " contains " + std::to_string(ckpt_samples.size()) + " samples and "
+	+ std::to_string(checkpoint_readers_.back()->num_loci()) + " loci");
+  }
   bool has_default_stutter_model()         { return def_stutter_model_ != NULL; }
   void set_default_stutter_model(double inframe_geom,  double inframe_up,  double inframe_down,
 				 double outframe_geom, double outframe_up, double outframe_down){
@@ -191,6 +378,11 @@ public:
   
   void set_output_stutter(std::string& model_file){
     output_stutter_models_ = true;
+    stutter_model_file_    = model_file;
+
+    // When resuming, the file is truncated at the checkpoint instead of being overwritten
+    if (resume_)
+      return;
     stutter_model_out_.open(model_file, std::ofstream::out);
     if (!stutter_model_out_.is_open())
       printErrorAndDie("Failed to open output file for stutter models");
@@ -198,7 +390,6 @@ public:
 
   void set_output_str_vcf(std::string& vcf_file, std::string& full_command, std::set<std::string>& samples_to_output){
     output_str_gts_ = true;
-    str_vcf_.open(vcf_file.c_str());
 
     // Print floats with exactly 3 decimal places
     str_vcf_.precision(3);
@@ -207,19 +398,60 @@ public:
     // Assemble a list of sample names for genotype output
     std::copy(samples_to_output.begin(), samples_to_output.end(), std::back_inserter(samples_to_genotype_));
     std::sort(samples_to_genotype_.begin(), samples_to_genotype_.end());
-    
-    // Write VCF header
-    SeqStutterGenotyper::write_vcf_header(full_command, samples_to_genotype_, output_gls_, output_pls_, output_phased_gls_, str_vcf_);
+
+    if (PROGRESS_INTERVAL > 0)
+      progress_log_ = new RunProgressLog(vcf_file + ".progress");
+    if (!resume_ || !resume_output(vcf_file)){
+      str_vcf_.open(vcf_file.c_str());
+      str_vcf_.set_threads(bgzf_threads_);
+      str_vcf_.build_index();
+
+      // Write VCF header
+      SeqStutterGenotyper::write_vcf_header(full_command, samples_to_genotype_, output_gls_, output_pls_, output_phased_gls_, str_vcf_);
+
+      // Start the records in a new BGZF block, so that the VCFs of sharded runs can be merged without recompressing them
+      str_vcf_.flush_block();
+
+      if (resume_ && output_stutter_models_){
+	stutter_model_out_.open(stutter_model_file_, std::ofstream::out);
+	if (!stutter_model_out_.is_open())
+	  printErrorAndDie("Failed to open output file for stutter models");
+      }
+      if (progress_log_ != NULL)
+	progress_log_->open(samples_to_genotype_, std::vector<ProgressEntry>());
+    }
+
+    // The genotype likelihood sidecar uses the same sample order and precision as the VCF
+    if (!gl_sidecar_file_.empty())
+      gl_sidecar_.open(gl_sidecar_file_, samples_to_genotype_, str_vcf_.precision());
+    if (!checkpoint_file_.empty())
+      checkpoint_writer_.open(checkpoint_file_, samples_to_genotype_);
   }
 
+  int32_t num_completed_regions(const std::vector<Region>& regions);
+
+  void region_completed(const std::vector<Region>& regions, int32_t num_completed);
+
   void analyze_reads_and_phasing(std::vector< std::vector<BamTools::BamAlignment> >& alignments,
 				 std::vector< std::vector<double> >& log_p1s,
 				 std::vector< std::vector<double> >& log_p2s,
 				 std::vector<std::string>& rg_names, Region& region, std::string& ref_allele, std::string& chrom_seq, int iter);
+
+  /*
+   * Genotypes each region in the BED file using the reads stored in the input checkpoints instead of the BAMs,
+   * so that batches of samples processed separately can be jointly genotyped without rereading or left aligning their reads
+   */
+  void process_checkpoints(std::string& region_file, std::string& fasta_dir, int32_t max_regions, std::string chrom);
   void finish(){
     SNPBamProcessor::finish();
     if (output_str_gts_)
       str_vcf_.close();
+    if (gl_sidecar_.is_open())
+      gl_sidecar_.close();
+    if (checkpoint_writer_.is_open())
+      checkpoint_writer_.close();
+    if (progress_log_ != NULL)
+      progress_log_->close();
     if (output_stutter_models_)
       stutter_model_out_.close();
     if (output_viz_)
@@ -227,11 +459,31 @@ public:
 
     log("Stutter model training succeeded for " + std::to_string(num_em_converge_) + " out of " + std::to_string(num_em_converge_+num_em_fail_) + " loci");
     log("Genotyping succeeded for " + std::to_string(num_genotype_success_) + " out of " + std::to_string(num_genotype_success_+num_genotype_fail_) + " loci");
+    if (ref_fast_path_)
+      log("Genotyped " + std::to_string(num_ref_fast_path_) + " loci with only reference reads using the reference-only fast path");
+    if (locus_cache_ != NULL){
+      int num_lookups = locus_cache_->num_hits() + locus_cache_->num_misses();
+      logger() << "Locus cache: " << locus_cache_->num_hits() << " hits and " << locus_cache_->num_misses() << " misses ("
+	       << (num_lookups == 0 ? 0.0 : 100.0*locus_cache_->num_hits()/num_lookups) << "% hit rate), "
+	       << locus_cache_->num_stores() << " entries stored" << std::endl;
+    }
+    if (memory_admission_.enabled())
+      logger() << "Memory admission: admitted " << memory_admission_.num_admitted() << " loci, including " << memory_admission_.num_chunked()
+	       << " genotyped in smaller sample chunks, and deferred " << memory_admission_.num_deferred() << " loci exceeding the limit of "
+	       << memory_admission_.max_bytes()/1048576.0 << " MB as filtered records. Maximum estimated locus memory = " << memory_admission_.max_estimate()/1048576.0
+	       << " MB, maximum measured peak = " << (memory_admission_.peak_resettable() ? std::to_string(memory_admission_.max_measured()/1048576.0) + " MB" : "unavailable")
+	       << std::endl;
+    if (!checkpoint_readers_.empty())
+      log("Reused stored alignment likelihoods for " + std::to_string(num_stored_prob_reads_) + " reads and realigned "
+	  + std::to_string(num_realigned_reads_) + " reads from the checkpoints");
 
     logger() << "Approximate timing breakdown" << "\n"
              << " BAM seek time       = " << total_bam_seek_time()       << " seconds\n"
-             << " Read filtering      = " << total_read_filter_time()    << " seconds\n"
-             << " SNP info extraction = " << total_snp_phase_info_time() << " seconds\n"
+             << " Read filtering      = " << total_read_filter_time()    << " seconds\n";
+    if (PREFETCH_LOCI > 0)
+      logger() << " Prefetch stalls     = " << total_prefetch_stall_time() << " seconds (mean queue depth = " << mean_prefetch_depth()
+	       << " of " << PREFETCH_LOCI << " loci, reader idle for " << total_prefetch_idle_time() << " seconds)\n";
+    logger() << " SNP info extraction = " << total_snp_phase_info_time() << " seconds\n"
              << " Stutter estimation  = " << total_stutter_time()        << " seconds\n"
              << " Genotyping          = " << total_genotype_time()       << " seconds\n";
     if (output_str_gts_)
@@ -248,6 +500,10 @@ public:
   double ABS_LL_CONVERGE;  // For EM convergence, new_LL - prev_LL < ABS_LL_CONVERGE
   double FRAC_LL_CONVERGE; // For EM convergence, -(new_LL-prev_LL)/prev_LL < FRAC_LL_CONVERGE
   int32_t MIN_TOTAL_READS; // Minimum total reads required to genotype locus
+  int32_t SAMPLE_CHUNK_SIZE; // If > 0, loci with more samples are genotyped in chunks of at most this many samples
+  int32_t PROGRESS_INTERVAL; // If > 0, a checkpoint is added to the progress log after every PROGRESS_INTERVAL regions
+  int BUDGET_MAX_ALLELES;        // Maximum number of candidate alleles genotyped once a locus exceeds its compute budget
+  double BUDGET_DOWNSAMPLE_FRAC; // Fraction of each sample's reads retained if the locus also exceeds its budget with these alleles
 };
 
 #endif
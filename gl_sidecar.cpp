@@ -0,0 +1,216 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "error.h"
+#include "gl_sidecar.h"
+
+static const char     GL_SIDECAR_MAGIC[8]  = {'H', 'I', 'P', 'S', 'T', 'R', 'G', 'L'};
+static const uint32_t GL_SIDECAR_VERSION   = 2;
+static const size_t   GL_SIDECAR_ALIGNMENT = 8;
+static const size_t   GL_SIDECAR_TRAILER   = 4*sizeof(uint64_t) + sizeof(GL_SIDECAR_MAGIC);
+
+void GLSidecarWriter::write_bytes(const void* data, size_t num_bytes){
+  out_.write((const char*)data, num_bytes);
+  if (!out_.good())
+    printErrorAndDie("Failed to write to the genotype likelihood file " + filename_);
+  offset_ += num_bytes;
+}
+
+void GLSidecarWriter::pad_to_alignment(){
+  const char zeros[GL_SIDECAR_ALIGNMENT] = {0};
+  if (offset_ % GL_SIDECAR_ALIGNMENT != 0)
+    write_bytes(zeros, GL_SIDECAR_ALIGNMENT - offset_%GL_SIDECAR_ALIGNMENT);
+}
+
+void GLSidecarWriter::open(const std::string& filename, const std::vector<std::string>& sample_names, int precision){
+  if (out_.is_open())
+    printErrorAndDie("Cannot reopen the genotype likelihood file " + filename_);
+  filename_ = filename;
+  out_.open(filename.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!out_.is_open())
+    printErrorAndDie("Failed to open the genotype likelihood file " + filename);
+
+  offset_      = 0;
+  num_samples_ = sample_names.size();
+  gl_format_   = VCFRecordFormatter(precision);
+  uint32_t num_samples = num_samples_;
+  write_bytes(GL_SIDECAR_MAGIC, sizeof(GL_SIDECAR_MAGIC));
+  write_bytes(&GL_SIDECAR_VERSION, sizeof(GL_SIDECAR_VERSION));
+  write_bytes(&num_samples, sizeof(num_samples));
+  for (auto sample_iter = sample_names.begin(); sample_iter != sample_names.end(); sample_iter++)
+    write_bytes(sample_iter->c_str(), sample_iter->size()+1);
+  pad_to_alignment();
+}
+
+void GLSidecarWriter::add_locus(const std::string& chrom, int32_t pos, int32_t num_alleles,
+				const std::vector<const std::vector<double>*>& phased_gls, const std::vector<const std::vector<double>*>& unphased_gls){
+  if (phased_gls.size() != num_samples_ || unphased_gls.size() != num_samples_)
+    printErrorAndDie("Number of samples for the locus doesn't match the genotype likelihood file's sample list");
+
+  auto chrom_iter = chrom_indices_.find(chrom);
+  if (chrom_iter == chrom_indices_.end()){
+    chrom_iter = chrom_indices_.insert(std::pair<std::string, int32_t>(chrom, chroms_.size())).first;
+    chroms_.push_back(chrom);
+  }
+
+  // Determine the number of GLs per sample from any sample that was called
+  int32_t num_phased = 0, num_unphased = 0;
+  std::vector<uint8_t> called(num_samples_, 0);
+  for (int i = 0; i < num_samples_; i++){
+    if (phased_gls[i] != NULL){
+      called[i]    = 1;
+      num_phased   = phased_gls[i]->size();
+      num_unphased = unphased_gls[i]->size();
+    }
+  }
+
+  index_chroms_.push_back(chrom_iter->second);
+  index_positions_.push_back(pos);
+  index_offsets_.push_back(offset_);
+
+  int32_t header[6] = {chrom_iter->second, pos, num_alleles, num_phased, num_unphased, 0};
+  write_bytes(header, sizeof(header));
+  write_bytes(called.data(), called.size());
+  pad_to_alignment();
+
+  // Uncalled samples are assigned GLs of zero, while the GLs of called samples are rounded exactly as in the VCF
+  for (int pass = 0; pass < 2; pass++){
+    const std::vector<const std::vector<double>*>& gls = (pass == 0 ? phased_gls : unphased_gls);
+    int32_t num_gls = (pass == 0 ? num_phased : num_unphased);
+    float_buffer_.assign((size_t)num_gls*num_samples_, 0.0f);
+    for (int i = 0; i < num_samples_; i++){
+      if (gls[i] == NULL)
+	continue;
+      if (gls[i]->size() != num_gls)
+	printErrorAndDie("Inconsistent number of genotype likelihoods across samples for the genotype likelihood file");
+      for (int32_t j = 0; j < num_gls; j++)
+	float_buffer_[(size_t)i*num_gls + j] = (float)gl_format_.round_trip((*gls[i])[j]);
+    }
+    write_bytes(float_buffer_.data(), float_buffer_.size()*sizeof(float));
+  }
+  pad_to_alignment();
+}
+
+void GLSidecarWriter::close(){
+  if (!out_.is_open())
+    return;
+
+  uint64_t chrom_offset = offset_;
+  for (auto chrom_iter = chroms_.begin(); chrom_iter != chroms_.end(); chrom_iter++)
+    write_bytes(chrom_iter->c_str(), chrom_iter->size()+1);
+  pad_to_alignment();
+
+  uint64_t index_offset = offset_;
+  for (unsigned int i = 0; i < index_offsets_.size(); i++){
+    write_bytes(&index_chroms_[i],    sizeof(int32_t));
+    write_bytes(&index_positions_[i], sizeof(int32_t));
+    write_bytes(&index_offsets_[i],   sizeof(uint64_t));
+  }
+
+  uint64_t trailer[4] = {chrom_offset, chroms_.size(), index_offset, index_offsets_.size()};
+  write_bytes(trailer, sizeof(trailer));
+  write_bytes(GL_SIDECAR_MAGIC, sizeof(GL_SIDECAR_MAGIC));
+  out_.close();
+
+  chrom_indices_.clear();
+  chroms_.clear();
+  index_chroms_.clear();
+  index_positions_.clear();
+  index_offsets_.clear();
+}
+
+GLSidecarReader::GLSidecarReader(const std::string& filename){
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ == -1)
+    printErrorAndDie("Failed to open the genotype likelihood file " + filename);
+  struct stat file_info;
+  if (fstat(fd_, &file_info) != 0)
+    printErrorAndDie("Failed to determine the size of the genotype likelihood file " + filename);
+  size_ = file_info.st_size;
+
+  size_t header_size = sizeof(GL_SIDECAR_MAGIC) + 2*sizeof(uint32_t);
+  if (size_ < header_size + GL_SIDECAR_TRAILER)
+    printErrorAndDie("Genotype likelihood file " + filename + " is truncated or malformed");
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED)
+    printErrorAndDie("Failed to memory map the genotype likelihood file " + filename);
+  data_ = (const char*)data;
+
+  if (memcmp(data_, GL_SIDECAR_MAGIC, sizeof(GL_SIDECAR_MAGIC)) != 0 || memcmp(data_+size_-sizeof(GL_SIDECAR_MAGIC), GL_SIDECAR_MAGIC, sizeof(GL_SIDECAR_MAGIC)) != 0)
+    printErrorAndDie("Genotype likelihood file " + filename + " is truncated or malformed");
+  uint32_t version, num_samples;
+  memcpy(&version,     data_+sizeof(GL_SIDECAR_MAGIC), sizeof(uint32_t));
+  memcpy(&num_samples, data_+sizeof(GL_SIDECAR_MAGIC)+sizeof(uint32_t), sizeof(uint32_t));
+  if (version != GL_SIDECAR_VERSION)
+    printErrorAndDie("Unsupported version of the genotype likelihood file " + filename);
+
+  const char* name_ptr = data_ + header_size;
+  for (uint32_t i = 0; i < num_samples; i++){
+    samples_.push_back(std::string(name_ptr));
+    name_ptr += samples_.back().size()+1;
+  }
+
+  uint64_t trailer[4];
+  memcpy(trailer, data_+size_-GL_SIDECAR_TRAILER, sizeof(trailer));
+  uint64_t index_end = size_ - GL_SIDECAR_TRAILER, index_entry_size = 2*sizeof(int32_t) + sizeof(uint64_t);
+  if (trailer[0] > trailer[2] || trailer[2] > index_end || trailer[3] > (index_end - trailer[2])/index_entry_size)
+    printErrorAndDie("Genotype likelihood file " + filename + " is truncated or malformed");
+  name_ptr = data_ + trailer[0];
+  for (uint64_t i = 0; i < trailer[1]; i++){
+    if (name_ptr >= data_ + trailer[2] || memchr(name_ptr, '\0', data_ + trailer[2] - name_ptr) == NULL)
+      printErrorAndDie("Genotype likelihood file " + filename + " is truncated or malformed");
+    std::string chrom(name_ptr);
+    chrom_indices_[chrom] = i;
+    name_ptr += chrom.size()+1;
+  }
+
+  num_loci_ = trailer[3];
+  const char* index_ptr = data_ + trailer[2];
+  for (uint64_t i = 0; i < trailer[3]; i++, index_ptr += index_entry_size){
+    int32_t chrom_index, pos;
+    uint64_t offset;
+    memcpy(&chrom_index, index_ptr,                   sizeof(int32_t));
+    memcpy(&pos,         index_ptr+sizeof(int32_t),   sizeof(int32_t));
+    memcpy(&offset,      index_ptr+2*sizeof(int32_t), sizeof(uint64_t));
+    if (offset > size_ - GL_SIDECAR_TRAILER - 6*sizeof(int32_t))
+      printErrorAndDie("Genotype likelihood file " + filename + " is truncated or malformed");
+
+    // Loci at the same position are distinguished by their number of alleles and then by their order in the file
+    int32_t num_alleles;
+    memcpy(&num_alleles, data_+offset+2*sizeof(int32_t), sizeof(int32_t));
+    locus_offsets_[std::tuple<int32_t, int32_t, int32_t>(chrom_index, pos, num_alleles)].push_back(offset);
+  }
+}
+
+GLSidecarReader::~GLSidecarReader(){
+  munmap((void*)data_, size_);
+  close(fd_);
+}
+
+bool GLSidecarReader::get_locus(const std::string& chrom, int32_t pos, int32_t num_alleles, int occurrence, GLSidecarLocus& locus) const {
+  auto chrom_iter = chrom_indices_.find(chrom);
+  if (chrom_iter == chrom_indices_.end())
+    return false;
+  auto locus_iter = locus_offsets_.find(std::tuple<int32_t, int32_t, int32_t>(chrom_iter->second, pos, num_alleles));
+  if (locus_iter == locus_offsets_.end() || occurrence < 0 || occurrence >= locus_iter->second.size())
+    return false;
+
+  uint64_t offset       = locus_iter->second[occurrence];
+  const int32_t* header = (const int32_t*)(data_ + offset);
+  locus.num_alleles  = header[2];
+  locus.num_phased   = header[3];
+  locus.num_unphased = header[4];
+  locus.called       = (const uint8_t*)(header + 6);
+
+  size_t gl_offset = offset + 6*sizeof(int32_t) + samples_.size();
+  if (gl_offset % GL_SIDECAR_ALIGNMENT != 0)
+    gl_offset += GL_SIDECAR_ALIGNMENT - gl_offset%GL_SIDECAR_ALIGNMENT;
+  locus.phased_gls   = (const float*)(data_ + gl_offset);
+  locus.unphased_gls = locus.phased_gls + (size_t)locus.num_phased*samples_.size();
+  return true;
+}
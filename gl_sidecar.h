@@ -0,0 +1,121 @@
+#ifndef GL_SIDECAR_H_
+#define GL_SIDECAR_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "vcf_record_formatter.h"
+
+/*
+ * Binary sidecar containing the genotype log-likelihoods (log10) reported for each sample and locus in HipSTR's VCF,
+ * allowing downstream tools such as DenovoFinder to access them without reparsing the VCF's text fields. Each GL is rounded
+ * to the VCF's precision, so the sidecar stores exactly the values obtained by parsing the VCF.
+ *
+ * Layout (native byte order, all sections 8-byte aligned):
+ *   Header:  "HIPSTRGL", uint32 version, uint32 number of samples, null-terminated sample names
+ *   Records: int32 chrom index, int32 position, int32 number of alleles, int32 number of phased GLs per sample,
+ *            int32 number of unphased GLs per sample, int32 reserved, uint8 called flag for each sample,
+ *            float phased GLs (sample-major), float unphased GLs (sample-major)
+ *   Footer:  null-terminated chromosome names, {int32 chrom index, int32 position, uint64 record offset} for each record
+ *   Trailer: uint64 chromosome names offset, uint64 number of chromosomes, uint64 footer index offset,
+ *            uint64 number of records, "HIPSTRGL"
+ *
+ * The reader memory maps the file, so the GLs for a locus are used in place without any parsing or copying
+ */
+
+class GLSidecarLocus {
+ public:
+  int32_t num_alleles;
+  int32_t num_phased;    // Number of phased GLs per sample (NUM_ALLELES^2 for diploid loci)
+  int32_t num_unphased;  // Number of unphased GLs per sample, in VCF GL order
+  const uint8_t* called;
+  const float* phased_gls;
+  const float* unphased_gls;
+
+  GLSidecarLocus(){
+    num_alleles  = 0;
+    num_phased   = 0;
+    num_unphased = 0;
+    called       = NULL;
+    phased_gls   = NULL;
+    unphased_gls = NULL;
+  }
+
+  const float* get_phased_gls(int sample_index)   const { return phased_gls   + (int64_t)sample_index*num_phased;   }
+  const float* get_unphased_gls(int sample_index) const { return unphased_gls + (int64_t)sample_index*num_unphased; }
+};
+
+class GLSidecarWriter {
+ private:
+  std::ofstream out_;
+  std::string filename_;
+  int num_samples_;
+  uint64_t offset_;
+  std::map<std::string, int32_t> chrom_indices_;
+  std::vector<std::string> chroms_;
+  std::vector<int32_t> index_chroms_, index_positions_;
+  std::vector<uint64_t> index_offsets_;
+  std::vector<float> float_buffer_;
+  VCFRecordFormatter gl_format_;  // Rounds each GL to the VCF's precision
+
+  void write_bytes(const void* data, size_t num_bytes);
+  void pad_to_alignment();
+
+ public:
+  GLSidecarWriter() : gl_format_(3){
+    num_samples_ = 0;
+    offset_      = 0;
+  }
+
+  ~GLSidecarWriter(){
+    close();
+  }
+
+  bool is_open() { return out_.is_open(); }
+
+  /* Opens the file for the samples. GLs are rounded to PRECISION decimal places, which should match that of the VCF */
+  void open(const std::string& filename, const std::vector<std::string>& sample_names, int precision);
+
+  /*
+   * Adds a record for the locus. Each entry in the GL vectors corresponds to the sample in the same position
+   * as the sample names provided to open(), and should be NULL if the sample was not called
+   */
+  void add_locus(const std::string& chrom, int32_t pos, int32_t num_alleles,
+		 const std::vector<const std::vector<double>*>& phased_gls, const std::vector<const std::vector<double>*>& unphased_gls);
+
+  void close();
+};
+
+class GLSidecarReader {
+ private:
+  int fd_;
+  const char* data_;
+  size_t size_;
+  int num_loci_;
+  std::vector<std::string> samples_;
+  std::map<std::string, int32_t> chrom_indices_;
+  std::map<std::tuple<int32_t, int32_t, int32_t>, std::vector<uint64_t> > locus_offsets_;  // Keyed by chromosome index, position and number of alleles
+
+ public:
+  GLSidecarReader(const std::string& filename);
+
+  ~GLSidecarReader();
+
+  const std::vector<std::string>& get_samples() const { return samples_; }
+
+  int num_loci() const { return num_loci_; }
+
+  /*
+   * Returns true and fills in the locus iff the sidecar contains a record with NUM_ALLELES alleles at the provided
+   * chromosome and (1-based) position. Records that share these fields are stored in the same order as in the VCF,
+   * and OCCURRENCE selects among them
+   */
+  bool get_locus(const std::string& chrom, int32_t pos, int32_t num_alleles, int occurrence, GLSidecarLocus& locus) const;
+};
+
+#endif
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "haplotype_tracker.h"
 
 std::ostream& operator<< (std::ostream &out, DiploidEditDistance& edit_distance){
@@ -6,65 +8,99 @@ std::ostream& operator<< (std::ostream &out, DiploidEditDistance& edit_distance)
   return out;
 }
 
-void DiploidHaplotype::add_snp(int gt_a, int gt_b){
-  assert(snps_1_.size() > 0 && snps_2_.size() > 0);
-  if (gt_a == 1) snps_1_.back() |= set_mask_;
-  if (gt_b == 1) snps_2_.back() |= set_mask_;
-  
-  set_mask_ <<= 1;
-  if (set_mask_ == MAX_DIGIT){
-    snps_1_.push_back(0);
-    snps_2_.push_back(0);
-    set_mask_ = 1;
+void HaplotypeBitMatrix::grow(){
+  int64_t new_capacity = 2*capacity_;
+  std::vector<uint64_t> new_words(num_rows_*new_capacity, 0);
+  for (int row_index = 0; row_index < num_rows_; row_index++){
+    const uint64_t* old_row = row(row_index);
+    uint64_t* new_row       = new_words.data() + row_index*new_capacity;
+    for (int64_t word = first_word(); word < end_word(); word++)
+      new_row[word & (new_capacity-1)] = old_row[word & (capacity_-1)];
   }
+  words_.swap(new_words);
+  capacity_ = new_capacity;
 }
 
-void DiploidHaplotype::extract_set_bits(int64_t value, int offset, std::set<int>& mismatch_indices){
-  while (value){
-    if (value & 1)
-      mismatch_indices.insert(offset);
-    value >>= 1;
-    offset++;
+void HaplotypeBitMatrix::add_snp(){
+  if (end_snp_%WORD_BITS == 0){
+    // The new SNP starts a new word, which may reuse a slot previously occupied by removed SNPs
+    if (end_snp_/WORD_BITS - first_word() + 1 > capacity_)
+      grow();
+    int64_t slot = (end_snp_/WORD_BITS) & (capacity_-1);
+    for (int row_index = 0; row_index < num_rows_; row_index++)
+      row(row_index)[slot] = 0;
   }
+  end_snp_++;
 }
 
-void DiploidHaplotype::add_mismatched_sites(int hap_index, DiploidHaplotype& other_hap, int other_index,
-					    std::set<int>& mismatch_indices){
-  assert((hap_index == 0 || hap_index == 1) && (other_index == 0 || other_index == 1));
-  std::deque<int64_t>& hap_a = (hap_index == 0 ? snps_1_ : snps_2_);
-  std::deque<int64_t>& hap_b = (other_index == 0 ? other_hap.snps_1_ : other_hap.snps_2_);
-  assert(hap_a.size() == hap_b.size());
-  auto iter_a = hap_a.begin();
-  auto iter_b = hap_b.begin();
-
-  int offset = -num_removed_;
-  while (iter_a != hap_a.end()){
-    int64_t set_bits = (*iter_a)^(*iter_b);
-    if (set_bits)
-      extract_set_bits(set_bits, offset, mismatch_indices);
-    offset += 63;
-    iter_a++; iter_b++;
+void HaplotypeBitMatrix::diploid_distances(int sample, int other_a, int other_b, DiploidEditDistance& distances_a, DiploidEditDistance& distances_b) const {
+  const uint64_t* hap_1   = row(2*sample),  *hap_2   = row(2*sample+1);
+  const uint64_t* a_hap_1 = row(2*other_a), *a_hap_2 = row(2*other_a+1);
+  const uint64_t* b_hap_1 = row(2*other_b), *b_hap_2 = row(2*other_b+1);
+  int counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+  // Visit the ring's words as at most two contiguous runs
+  int64_t num_words = end_word() - first_word();
+  int64_t start     = first_word() & (capacity_-1);
+  uint64_t mask     = first_word_mask();
+  while (num_words > 0){
+    int64_t stop = std::min(capacity_, start + num_words);
+    for (int64_t i = start; i < stop; i++){
+      uint64_t h1 = hap_1[i] & mask, h2 = hap_2[i] & mask;
+      counts[0] += __builtin_popcountll(h1 ^ (a_hap_1[i] & mask));
+      counts[1] += __builtin_popcountll(h1 ^ (a_hap_2[i] & mask));
+      counts[2] += __builtin_popcountll(h2 ^ (a_hap_1[i] & mask));
+      counts[3] += __builtin_popcountll(h2 ^ (a_hap_2[i] & mask));
+      counts[4] += __builtin_popcountll(h1 ^ (b_hap_1[i] & mask));
+      counts[5] += __builtin_popcountll(h1 ^ (b_hap_2[i] & mask));
+      counts[6] += __builtin_popcountll(h2 ^ (b_hap_1[i] & mask));
+      counts[7] += __builtin_popcountll(h2 ^ (b_hap_2[i] & mask));
+      mask = ~0ULL;
+    }
+    num_words -= (stop - start);
+    start      = 0;
   }
+
+  distances_a = DiploidEditDistance(counts[0], counts[1], counts[2], counts[3]);
+  distances_b = DiploidEditDistance(counts[4], counts[5], counts[6], counts[7]);
 }
 
-void DiploidHaplotype::remove_next_snp(){
-  assert(snps_1_.size() > 0 && snps_2_.size() > 0);
-  snps_1_.front() &= erase_mask_;
-  snps_2_.front() &= erase_mask_;
-  erase_mask_ <<= 1;
-  num_removed_++;
-  if (erase_mask_ == 0){
-    snps_1_.pop_front();
-    snps_2_.pop_front();
-    erase_mask_  = -2;
-    num_removed_ = 0;
-  } 
+void HaplotypeBitMatrix::add_mismatched_sites(int row_a, int row_b, std::set<int>& mismatch_indices) const {
+  const uint64_t* hap_a = row(row_a), *hap_b = row(row_b);
+  uint64_t mask = first_word_mask();
+  for (int64_t word = first_word(); word < end_word(); word++){
+    int64_t slot      = word & (capacity_-1);
+    uint64_t set_bits = (hap_a[slot] ^ hap_b[slot]) & mask;
+    while (set_bits != 0){
+      mismatch_indices.insert(word*WORD_BITS + __builtin_ctzll(set_bits) - first_snp_);
+      set_bits &= (set_bits-1);
+    }
+    mask = ~0ULL;
+  }
 }
 
 void HaplotypeTracker::add_snp(VCF::Variant& variant){
   num_snps_++;
   positions_.push_back(variant.get_position());
+  snp_haplotypes_.add_snp();
   
+  PhasingSNP* phasing_snp = NULL;
+  if (cache_phasing_snps_ && variant.is_biallelic_snp()){
+    phasing_snps_.push_back(PhasingSNP());
+    phasing_snp             = &(phasing_snps_.back());
+    phasing_snp->pos        = variant.get_position();
+    phasing_snp->alleles[0] = variant.get_allele(0)[0];
+    phasing_snp->alleles[1] = variant.get_allele(1)[0];
+    int gt_a, gt_b;
+    for (int i = 0; i < variant.num_samples(); i++){
+      if (variant.sample_call_missing(i) || !variant.sample_call_phased(i))
+	continue;
+      variant.get_genotype(i, gt_a, gt_b);
+      if (gt_a != gt_b)
+	phasing_snp->het_calls.push_back(2*i + gt_a);
+    }
+  }
+
   int sample_index = 0;
   for (unsigned int i = 0; i < families_.size(); i++){
     NuclearFamily& family = families_[i];
@@ -74,20 +110,33 @@ void HaplotypeTracker::add_snp(VCF::Variant& variant){
       use_gts = false; // Ignore a SNP if any samples in the family are missing a genotype
     else if (!family.is_mendelian(variant))
       use_gts = false; // Ignore a SNP if any samples in the family have a Mendelian inconsistency
+    if (!use_gts && phasing_snp != NULL)
+      phasing_snp->bad_families.push_back(i);
 
     int gt_a, gt_b;
     for (int j = 0; j < family.size(); j++){
       if (use_gts){
 	variant.get_genotype(vcf_indices_[sample_index], gt_a, gt_b);
-	snp_haplotypes_[sample_index].add_snp(gt_a, gt_b);
+	if (gt_a == 1) snp_haplotypes_.set_last_snp(2*sample_index);
+	if (gt_b == 1) snp_haplotypes_.set_last_snp(2*sample_index+1);
       }
-      else
-	snp_haplotypes_[sample_index].add_snp(0, 0);
       sample_index++;
-    }      
+    }
   }
 }
 
+void HaplotypeTracker::family_edit_distances(const NuclearFamily& family, std::vector<DiploidEditDistance>& maternal_distances,
+					     std::vector<DiploidEditDistance>& paternal_distances){
+  int mat_sample = sample_indices_[family.get_mother()];
+  int pat_sample = sample_indices_[family.get_father()];
+  maternal_distances.resize(family.get_children().size());
+  paternal_distances.resize(family.get_children().size());
+  int child_index = 0;
+  for (auto child_iter = family.get_children().begin(); child_iter != family.get_children().end(); child_iter++, child_index++)
+    snp_haplotypes_.diploid_distances(sample_indices_[*child_iter], mat_sample, pat_sample,
+				      maternal_distances[child_index], paternal_distances[child_index]);
+}
+
 void HaplotypeTracker::advance(std::string chrom, int32_t position, std::set<std::string>& sites_to_skip, std::ostream& logger){
   logger << "Advancing haplotype tracker...";
   int32_t start_of_window = (position >= window_size_ ? position - window_size_ : 0);
@@ -122,6 +171,7 @@ void HaplotypeTracker::advance(std::string chrom, int32_t position, std::set<std
   // Remove SNPs to left of window
   while (next_snp_position() < start_of_window && next_snp_position() != -1)
     remove_next_snp();
+  discard_phasing_snps(start_of_window);
   logger << " done" << std::endl;
 }
 
@@ -138,19 +188,22 @@ void HaplotypeTracker::advance(std::string chrom, int32_t position, std::set<std
 bool HaplotypeTracker::infer_haplotype_inheritance(const NuclearFamily& family, int max_best_score, int min_second_best_score,
 						   std::vector<int>& maternal_indices, std::vector<int>& paternal_indices, std::set<int32_t>& bad_sites){
   assert(maternal_indices.size() == 0 && paternal_indices.size() == 0);
-  DiploidHaplotype& mat_haplotypes = snp_haplotypes_[sample_indices_[family.get_mother()]];
-  DiploidHaplotype& pat_haplotypes = snp_haplotypes_[sample_indices_[family.get_father()]];
+  int mat_sample = sample_indices_[family.get_mother()];
+  int pat_sample = sample_indices_[family.get_father()];
   std::set<int> mismatch_indices;
 
-  for (auto child_iter = family.get_children().begin(); child_iter != family.get_children().end(); child_iter++){
-    DiploidEditDistance maternal_distance = edit_distances(*child_iter, family.get_mother());
+  std::vector<DiploidEditDistance> maternal_distances, paternal_distances;
+  family_edit_distances(family, maternal_distances, paternal_distances);
+  int child_index = 0;
+  for (auto child_iter = family.get_children().begin(); child_iter != family.get_children().end(); child_iter++, child_index++){
+    DiploidEditDistance& maternal_distance = maternal_distances[child_index];
     int min_mat_dist, min_mat_index, second_mat_dist, second_mat_index;
     maternal_distance.min_distance(min_mat_dist, min_mat_index);
     maternal_distance.second_min_distance(second_mat_dist, second_mat_index);
     if (min_mat_dist > max_best_score || second_mat_dist < min_second_best_score)
       return false;
 
-    DiploidEditDistance paternal_distance = edit_distances(*child_iter, family.get_father());
+    DiploidEditDistance& paternal_distance = paternal_distances[child_index];
     int min_pat_dist, min_pat_index, second_pat_dist, second_pat_index;
     paternal_distance.min_distance(min_pat_dist, min_pat_index);
     paternal_distance.second_min_distance(second_pat_dist, second_pat_index);
@@ -168,13 +221,13 @@ bool HaplotypeTracker::infer_haplotype_inheritance(const NuclearFamily& family,
 
     // Identify the indices of sites that are inconsistent with the inheritance structure
     // Only identifies sites that are Mendelian and have no missing genotypes
-    DiploidHaplotype& child_haplotypes = snp_haplotypes_[sample_indices_[*child_iter]];
+    int child_sample = sample_indices_[*child_iter];
     int idx_a = (min_mat_index == 0 || min_mat_index == 1 ? 0 : 1);
     int idx_b = (min_mat_index == 0 || min_mat_index == 2 ? 0 : 1);
-    child_haplotypes.add_mismatched_sites(idx_a, mat_haplotypes, idx_b, mismatch_indices);
+    snp_haplotypes_.add_mismatched_sites(2*child_sample + idx_a, 2*mat_sample + idx_b, mismatch_indices);
     idx_a = (min_pat_index == 0 || min_pat_index == 1 ? 0 : 1);
     idx_b = (min_pat_index == 0 || min_pat_index == 2 ? 0 : 1);
-    child_haplotypes.add_mismatched_sites(idx_a, pat_haplotypes, idx_b, mismatch_indices);
+    snp_haplotypes_.add_mismatched_sites(2*child_sample + idx_a, 2*pat_sample + idx_b, mismatch_indices);
 
     // Store the best indices
     maternal_indices.push_back(min_mat_index);
@@ -183,6 +236,6 @@ bool HaplotypeTracker::infer_haplotype_inheritance(const NuclearFamily& family,
 
   // Convert from internal SNP indices to SNP positions
   for (auto snp_index_iter = mismatch_indices.begin(); snp_index_iter != mismatch_indices.end(); snp_index_iter++)
-    bad_sites.insert(positions_.at(*snp_index_iter));
+    bad_sites.insert(positions_.at(first_position_ + *snp_index_iter));
   return true;
 }
@@ -1,6 +1,9 @@
 #ifndef HAPLOTYPE_TRACKER_H_
 #define HAPLOTYPE_TRACKER_H_
 
+#include <assert.h>
+#include <stdint.h>
+
 #include <climits>
 #include <deque>
 #include <iostream>
@@ -16,6 +19,10 @@ class DiploidEditDistance {
   int distances_[4];
 
  public:
+  DiploidEditDistance(){
+    distances_[0] = distances_[1] = distances_[2] = distances_[3] = 0;
+  }
+
   DiploidEditDistance(int d11, int d12, int d21, int d22){
     distances_[0] = d11;
     distances_[1] = d12;
@@ -60,65 +67,77 @@ class DiploidEditDistance {
   friend std::ostream& operator<< (std::ostream &out, DiploidEditDistance& distances);
 };
 
-class DiploidHaplotype {
+/*
+ * Phased SNP haplotypes for all samples within a window, stored as a bit matrix with one row per haplotype (rows 2*i and 2*i+1 for sample i).
+ * Each row is a ring buffer of 64-bit words in which bit k of word w denotes the allele of the (64*w + k)th SNP added since the last reset().
+ * All rows share the same ring offsets and are allocated contiguously, so comparing two haplotypes reduces to popcounts over aligned runs of words
+ */
+class HaplotypeBitMatrix {
  private:
-  std::deque<int64_t> snps_1_, snps_2_;
-  int64_t erase_mask_, set_mask_;
-  int num_removed_;
-  const static int64_t MAX_DIGIT = (1ULL << 63);
-
-  int num_set_bits(int64_t value){
-    int count = 0;
-    while (value != 0){
-      value &= (value-1);
-      count++;
-    }
-    return count;
-  }
+  const static int64_t WORD_BITS        = 64;
+  const static int64_t INITIAL_CAPACITY = 16;
+  int num_rows_;
+  int64_t first_snp_, end_snp_; // Index of the first stored SNP and one past the last stored SNP
+  int64_t capacity_;            // Number of words per row. Always a power of 2
+  std::vector<uint64_t> words_;
 
-  int edit_distance(std::deque<int64_t>& snp_hap_1, std::deque<int64_t>& snp_hap_2){
-    int distance = 0;
-    assert(snp_hap_1.size() == snp_hap_2.size());
-    auto iter_a = snp_hap_1.begin();
-    auto iter_b = snp_hap_2.begin();
-    while (iter_a != snp_hap_1.end()){
-      distance += num_set_bits((*iter_a) ^ (*iter_b));
-      iter_a++; iter_b++;
-    }
-    return distance;
-  }
+  uint64_t* row(int row_index)             { return words_.data() + row_index*capacity_; }
+  const uint64_t* row(int row_index) const { return words_.data() + row_index*capacity_; }
 
-  void extract_set_bits(int64_t value, int offset, std::set<int>& mismatch_indices);
+  int64_t first_word() const { return first_snp_/WORD_BITS; }
+  int64_t end_word()   const { return (end_snp_ + WORD_BITS - 1)/WORD_BITS; }
 
- public:  
-  DiploidHaplotype(){
+  // Mask for the first word, whose low-order bits may belong to SNPs that have already been removed
+  uint64_t first_word_mask() const { return ~0ULL << (first_snp_%WORD_BITS); }
+
+  void grow();
+
+ public:
+  explicit HaplotypeBitMatrix(int num_samples){
+    num_rows_ = 2*num_samples;
     reset();
   }
 
-  DiploidEditDistance edit_distances(DiploidHaplotype& other_hap){
-    int d11 = edit_distance(snps_1_, other_hap.snps_1_);
-    int d12 = edit_distance(snps_1_, other_hap.snps_2_);
-    int d21 = edit_distance(snps_2_, other_hap.snps_1_);
-    int d22 = edit_distance(snps_2_, other_hap.snps_2_);
-    return DiploidEditDistance(d11, d12, d21, d22);
+  void reset(){
+    first_snp_ = 0;
+    end_snp_   = 0;
+    capacity_  = INITIAL_CAPACITY;
+    words_.assign(num_rows_*capacity_, 0);
   }
 
-  void add_mismatched_sites(int hap_index, DiploidHaplotype& other_hap, int other_index,
-			    std::set<int>& mismatch_indices);
+  int64_t num_snps() const { return end_snp_ - first_snp_; }
 
-  void add_snp(int gt_a, int gt_b);
+  /* Appends a SNP for which all haplotypes carry the reference allele */
+  void add_snp();
 
-  void remove_next_snp();
+  /* Marks the most recently added SNP as non-reference in the given haplotype row */
+  void set_last_snp(int row_index){
+    uint64_t bit = end_snp_ - 1;
+    row(row_index)[(bit/WORD_BITS) & (capacity_-1)] |= (1ULL << (bit%WORD_BITS));
+  }
 
-  void reset(){
-    snps_1_.clear();
-    snps_2_.clear();
-    snps_1_.push_back(0);
-    snps_2_.push_back(0);
-    erase_mask_  = -2;
-    set_mask_    = 1;
-    num_removed_ = 0;
+  void remove_next_snp(){
+    assert(first_snp_ < end_snp_);
+    first_snp_++;
   }
+
+  /* Computes the haplotype distances between a sample and each of two other samples in a single pass over their words */
+  void diploid_distances(int sample, int other_a, int other_b, DiploidEditDistance& distances_a, DiploidEditDistance& distances_b) const;
+
+  /* Adds the indices (relative to the first stored SNP) of the SNPs at which the two haplotype rows differ */
+  void add_mismatched_sites(int row_a, int row_b, std::set<int>& mismatch_indices) const;
+};
+
+/*
+ * Compact copy of a biallelic SNP decoded by the HaplotypeTracker, retaining the information needed to
+ * construct the SNP trees used for physical phasing so that the SNP VCF doesn't need to be decoded a second time
+ */
+class PhasingSNP {
+ public:
+  int32_t pos;                       // 1-based VCF position
+  char alleles[2];                   // First base of the reference and alternate alleles
+  std::vector<int32_t> het_calls;    // 2*VCF sample index + allele index on the first haplotype, for each phased heterozygous call
+  std::vector<int32_t> bad_families; // Indices of families with a missing genotype or a Mendelian inconsistency at the SNP
 };
 
 class HaplotypeTracker {
@@ -128,17 +147,20 @@ class HaplotypeTracker {
   std::vector<std::string> samples_;
   std::vector<int> vcf_indices_;
   std::map<std::string, int> sample_indices_;
-  std::vector<DiploidHaplotype> snp_haplotypes_;
+  HaplotypeBitMatrix snp_haplotypes_;
   VCF::VCFReader snp_vcf_;
   int32_t window_size_;
   int32_t num_snps_;
-  std::deque<int32_t> positions_;
+  std::vector<int32_t> positions_; // Positions of the stored SNPs begin at index first_position_
+  size_t first_position_;
   int32_t prev_window_start_, prev_window_end_;
+  bool cache_phasing_snps_;
+  std::deque<PhasingSNP> phasing_snps_;
 
   int32_t next_snp_position(){
     if (num_snps_ == 0)
       return -1;
-    return positions_.front();
+    return positions_[first_position_];
   }
 
   int32_t last_snp_position(){
@@ -151,25 +173,31 @@ class HaplotypeTracker {
     if (num_snps_ == 0)
       return;
     num_snps_--;
-    for (unsigned int i = 0; i < snp_haplotypes_.size(); i++)
-      snp_haplotypes_[i].remove_next_snp();
-    positions_.pop_front();
+    snp_haplotypes_.remove_next_snp();
+    first_position_++;
+
+    // Periodically discard the positions of removed SNPs
+    if (first_position_ >= 1024 && 2*first_position_ >= positions_.size()){
+      positions_.erase(positions_.begin(), positions_.begin()+first_position_);
+      first_position_ = 0;
+    }
   }
 
   void reset(){
-    num_snps_  = 0;
-    positions_ =  std::deque<int32_t>();
+    num_snps_          = 0;
+    first_position_    = 0;
     prev_window_start_ = -1;
     prev_window_end_   = -1;
-    for (unsigned int i = 0; i < snp_haplotypes_.size(); i++)
-      snp_haplotypes_[i].reset();
+    positions_.clear();
+    snp_haplotypes_.reset();
+    phasing_snps_.clear();
   }
 
   void add_snp(VCF::Variant& variant);
 
  public:
  HaplotypeTracker(std::vector<NuclearFamily>& families, std::string& snp_vcf_file, int32_t window_size):
-  snp_vcf_(snp_vcf_file){
+  snp_haplotypes_(0), snp_vcf_(snp_vcf_file){
     chrom_       = "";
     families_    = families;
     window_size_ = window_size;
@@ -186,11 +214,12 @@ class HaplotypeTracker {
       sample_indices_[samples_[i]] = i;
     }
 
-    snp_haplotypes_    = std::vector<DiploidHaplotype>(samples_.size(), DiploidHaplotype());
+    snp_haplotypes_    = HaplotypeBitMatrix(samples_.size());
     num_snps_          = 0;
-    positions_         = std::deque<int32_t>();
+    first_position_    = 0;
     prev_window_start_ = -1;
     prev_window_end_   = -1;
+    cache_phasing_snps_ = false;
   }
 
   const std::vector<NuclearFamily>& families(){
@@ -199,12 +228,31 @@ class HaplotypeTracker {
 
   int32_t num_stored_snps() { return num_snps_; }
 
-  DiploidEditDistance edit_distances(const std::string& sample_1, const std::string& sample_2){
-    int index_1 = sample_indices_[sample_1];
-    int index_2 = sample_indices_[sample_2];
-    return snp_haplotypes_[index_1].edit_distances(snp_haplotypes_[index_2]);
+  const std::string& chrom() { return chrom_; }
+
+  const std::vector<std::string>& vcf_samples() { return snp_vcf_.get_samples(); }
+
+  /*
+   * Retain a PhasingSNP for each biallelic SNP read while advancing, so that the SNP trees for phasing can be built from the tracker's
+   * stream instead of rereading the SNP VCF. SNPs remain available until they're discarded using discard_phasing_snps()
+   */
+  void cache_phasing_snps(){ cache_phasing_snps_ = true; }
+
+  const std::deque<PhasingSNP>& phasing_snps() { return phasing_snps_; }
+
+  /* Discards any cached phasing SNPs before the provided 1-based position */
+  void discard_phasing_snps(int32_t pos){
+    while (!phasing_snps_.empty() && phasing_snps_.front().pos < pos)
+      phasing_snps_.pop_front();
   }
 
+  /*
+   * Computes the distances between each child's haplotypes and those of its mother and father in a single call,
+   * storing them in the order of the family's children
+   */
+  void family_edit_distances(const NuclearFamily& family, std::vector<DiploidEditDistance>& maternal_distances,
+			     std::vector<DiploidEditDistance>& paternal_distances);
+
   void advance(std::string chrom, int32_t pos, std::set<std::string>& sites_to_skip, std::ostream& logger);
 
   bool infer_haplotype_inheritance(const NuclearFamily& family, int max_best_score, int min_second_best_score,
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <climits>
 #include <fstream>
 #include <getopt.h>
@@ -11,8 +12,11 @@
 
 #include "bamtools/include/api/BamAlignment.h"
 
+#include "bam_file_pool.h"
+#include "bam_header_cache.h"
 #include "error.h"
 #include "genotyper_bam_processor.h"
+#include "memory_admission.h"
 #include "pedigree.h"
 #include "seqio.h"
 #include "stringops.h"
@@ -23,11 +27,14 @@ bool file_exists(std::string path){
   return (access(path.c_str(), F_OK) != -1);
 }
 
-void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_max_str_len){
+void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_max_str_len, int def_progress){
   std::cerr << "Usage: HipSTR --bams <list_of_bams> --fasta <dir> --regions <region_file.bed> [OPTIONS]" << "\n" << "\n"
     
 	    << "Required parameters:" << "\n"
 	    << "\t" << "--bams          <list_of_bams>        "  << "\t" << "Comma separated list of BAM files. Either --bams or --bam-files must be specified"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " Use --bams - to stream a single coordinate-sorted BAM from stdin without an index," << "\n"
+	    << "\t" << "                                      "  << "\t" << " such as one piped from an aligner or samtools merge. Convert SAM streams to BAM"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " using samtools view -u. Not used with --max-open-bams or --bam-cache"               << "\n"
 	    << "\t" << "--fasta         <dir>                 "  << "\t" << "Directory in which FASTA files for each chromosome are located or the path to a"     << "\n"
 	    << "\t" << "                                      "  << "\t" << " single FASTA file that contains all of the relevant sequences"                      << "\n"
 	    << "\t" << "--regions       <region_file.bed>     "  << "\t" << "BED file containing coordinates for each STR region"                         << "\n" << "\n"
@@ -41,6 +48,12 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--snp-vcf    <phased_snps.vcf.gz>     "  << "\t" << "Bgzipped input VCF file containing phased SNP genotypes for the samples"             << "\n" 
 	    << "\t" << "                                      "  << "\t" << " that are going to be genotyped. These SNPs will be used to physically phase any "   << "\n"
 	    << "\t" << "                                      "  << "\t" << " STRs when a read or its mate pair overlaps a heterozygous site"                     << "\n"
+	    << "\t" << "--ckpt-in    <list_of_ckpts>          "  << "\t" << "Comma separated list of checkpoints written by --ckpt-out for disjoint batches of"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " samples. The samples are jointly genotyped using the reads in the checkpoints"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " instead of BAMs, using the union of each batch's alleles. Stored alignments are"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " reused when the haplotype flanks are unchanged: reads are only aligned to alleles" << "\n"
+	    << "\t" << "                                      "  << "\t" << " their batch lacks and are rescored if the joint stutter model differs. Other"      << "\n"
+	    << "\t" << "                                      "  << "\t" << " reads are realigned to the haplotypes. Not used with --ref-vcf or --snp-vcf"       << "\n"
 	    << "\t" << "--stutter-in <stutter_models.txt>     "  << "\t" << "Input file containing stutter models for each locus. By default, an EM algorithm "   << "\n"
 	    << "\t" << "                                      "  << "\t" << "  will be used to learn locus-specific models"                               << "\n" << "\n"
     
@@ -65,7 +78,23 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--output-pallreads                    "  << "\t" << "Output the PALLREADS FORMAT field to the VCF. By default, it will not be output"     << "\n"
 	    << "\t" << "--output-gls                          "  << "\t" << "Write genotype likelihoods to VCF (Default = False)"                                 << "\n"
 	    << "\t" << "--output-pls                          "  << "\t" << "Write phred-scaled genotype likelihoods to VCF (Default = False)"                    << "\n"
-	    << "\t" << "--output-phased-gls                   "  << "\t" << "Write phased genotype likelihoods to VCF (Default = False)"                          << "\n" << "\n"
+	    << "\t" << "--output-phased-gls                   "  << "\t" << "Write phased genotype likelihoods to VCF (Default = False)"                          << "\n"
+	    << "\t" << "--gl-bin        <str_gls.bin>         "  << "\t" << "Output a binary file containing the phased and unphased genotype likelihoods for"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " each sample and locus in the VCF, rounded as in the VCF. Requires --str-vcf."      << "\n"
+	    << "\t" << "                                      "  << "\t" << " DenovoFinder can read likelihoods from this file instead of parsing the VCF"       << "\n"
+	    << "\t" << "--ckpt-out      <ckpt.bin>            "  << "\t" << "Output a binary checkpoint containing each locus's left-aligned reads, phasing and"  << "\n"
+	    << "\t" << "                                      "  << "\t" << " stutter training data and haplotype alignment likelihoods. Checkpoints from"       << "\n"
+	    << "\t" << "                                      "  << "\t" << " separate batches of samples can be jointly genotyped using --ckpt-in"             << "\n"
+	    << "\t" << "                                      "  << "\t" << " Requires --str-vcf and isn't used with --sample-chunk-size"                       << "\n"
+	    << "\t" << "--bgzf-threads  <num_threads>         "  << "\t" << "Number of threads used to compress the VCF passed to --str-vcf (Default = 1)"       << "\n"
+	    << "\t" << "                                      "  << "\t" << " A tabix index for the VCF is constructed as it is written"                         << "\n"
+	    << "\t" << "--progress-interval <num_regions>     "  << "\t" << "Record a checkpoint in STR_VCF.progress after every NUM_REGIONS regions, so that"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " an interrupted run can be resumed using --resume (Default = " << def_progress << ")" << "\n"
+	    << "\t" << "                                      "  << "\t" << " Use 0 to disable checkpoints"                                                      << "\n"
+	    << "\t" << "--resume                              "  << "\t" << "Resume an interrupted run from its latest checkpoint. The VCF and stutter model"   << "\n"
+	    << "\t" << "                                      "  << "\t" << " output are truncated at the checkpoint and genotyping continues with the next"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " region, producing the same output as an uninterrupted run. All other options"    << "\n"
+	    << "\t" << "                                      "  << "\t" << " must be unchanged. Not used with --viz-out, --gl-bin, --ckpt-out or BAM output"   << "\n" << "\n"
 
 	    << "Optional read filtering parameters:" << "\n"
 	    << "\t" << "--no-rmdup                            "  << "\t" << "Don't remove PCR duplicates. By default, they'll be removed"                         << "\n"
@@ -81,10 +110,48 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--hap-chr-file  <hap_chroms.txt>      "  << "\t" << "File containing chromosomes to treat as haploid, one per line"                       << "\n"
 	    << "\t" << "--min-reads     <num_reads>           "  << "\t" << "Minimum total reads required to genotype a locus (Default = " << def_min_reads << ")" << "\n"
 	    << "\t" << "--max-reads     <num_reads>           "  << "\t" << "Skip a locus if it has more than NUM_READS reads (Default = " << def_max_reads << ")" << "\n"
+	    << "\t" << "--max-sample-reads <num_reads>        "  << "\t" << "Instead of skipping loci with more than --max-reads reads, downsample each sample"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  to at most NUM_READS STR read pairs. Read pairs are selected using a hash of their"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  names, so results are reproducible. Downsampled loci have a DSFRAC INFO field"    << "\n"
+	    << "\t" << "--sample-chunk-size <num_samples>     "  << "\t" << "Genotype loci in chunks of at most NUM_SAMPLES samples to bound memory usage"       << "\n"
+	    << "\t" << "                                      "  << "\t" << "  for very large cohorts. Alleles are first identified in each chunk, and each"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  chunk is genotyped using the alleles from all chunks. Not used with --ref-vcf,"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  --viz-out or --gl-bin. By default, all samples are genotyped together"            << "\n"
+	    << "\t" << "--max-locus-cells <num_cells>         "  << "\t" << "Limit the haplotype alignment matrix cells computed for each locus to NUM_CELLS."  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  Loci that exceed this budget are regenotyped without bootstrapped qualities, then"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  using only the best-supported alleles and then with downsampled reads. Loci that"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  exceed the budget in every tier are output with a BUDGET filter. The tier used is"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  recorded in the BUDGETTIER INFO field. Not used with --ref-vcf or --ckpt-out, for"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  which only stutter training is limited. By default, loci aren't limited"            << "\n"
+	    << "\t" << "--max-locus-time <seconds>            "  << "\t" << "Limit the time spent genotyping each locus to SECONDS, using the same tiers as"      << "\n"
+	    << "\t" << "                                      "  << "\t" << "  --max-locus-cells. Results then depend on the machine's speed"                      << "\n"
+	    << "\t" << "--max-memory    <size>                "  << "\t" << "Estimate each locus's memory from its read, allele and sample counts before"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  genotyping it and keep it below SIZE (e.g. 4096M or 8G). Loci that don't fit are"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  genotyped in smaller sample chunks when possible and are otherwise written as"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  filtered VCF records (FILTER=MEMORY). Estimated and measured peaks are"            << "\n"
+	    << "\t" << "                                      "  << "\t" << "  logged. By default, memory isn't limited"                                          << "\n"
 	    << "\t" << "--max-str-len   <max_bp>              "  << "\t" << "Only genotype STRs in the provided BED file with length < MAX_BP (Default = " << def_max_str_len << ")" << "\n"
 	    << "\t" << "--bam-samps     <list_of_samples>     "  << "\t" << "Comma separated list of read groups in same order as BAM files. "                    << "\n"
 	    << "\t" << "                                      "  << "\t" << "  Assign each read the read group corresponding to its file. By default, "           << "\n"
 	    << "\t" << "                                      "  << "\t" << "  each read must have an RG tag and the sample is determined from the SM field"      << "\n"
+	    << "\t" << "--bam-cache     <bam_cache.txt>       "  << "\t" << "File used to cache the read groups and reference sequences in each BAM header, so"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  that subsequent runs on the same BAMs don't need to reparse each header. Entries"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  are validated using the size and modification time of each BAM and its index."     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  Created if it's absent. The BAMs are still opened and merged by position unless"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  --max-open-bams is also specified, in which case each BAM is only opened once a"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  locus requires it"                                                                 << "\n"
+	    << "\t" << "--locus-cache   <cache_dir>           "  << "\t" << "Directory used to cache each locus's VCF record and stutter model, keyed by a hash"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  of its reads, reference sequence, stutter model inputs and output options. Reruns"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  and parameter sweeps reuse the results for unchanged loci. Not used with"          << "\n"
+	    << "\t" << "                                      "  << "\t" << "  --ref-vcf, --viz-out, --gl-bin or --ckpt-out. Created if it's absent"              << "\n"
+	    << "\t" << "--max-open-bams <max_files>           "  << "\t" << "Read the BAMs for each locus one file at a time, keeping at most MAX_FILES BAMs"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  open and closing the least recently used BAM when another needs to be opened"      << "\n"
+	    << "\t" << "                                      "  << "\t" << "  Useful when the number of BAMs exceeds the open file limit. By default, all BAMs"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  are opened and their reads are merged by position"                                   << "\n"
+	    << "\t" << "--prefetch-loci <num_loci>            "  << "\t" << "Read and filter the BAM alignments for up to NUM_LOCI upcoming loci on a separate"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  thread while the current locus is genotyped, which hides BAM seek latency on"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  network filesystems. Holds the reads for NUM_LOCI additional loci in memory"        << "\n"
+	    << "\t" << "                                      "  << "\t" << "  By default, each locus's reads are loaded after the previous locus is genotyped"   << "\n"
 	    << "\t" << "--bam-libs      <list_of_libraries>   "  << "\t" << "Comma separated list of libraries in same order as BAM files. "                      << "\n"
 	    << "\t" << "                                      "  << "\t" << "  Assign each read the library corresponding to its file. By default, "              << "\n"
 	    << "\t" << "                                      "  << "\t" << "  each read must have an RG tag and the library is determined from the LB field"     << "\n"
@@ -96,8 +163,13 @@ void print_usage(int def_mdist, int def_min_reads, int def_max_reads, int def_ma
 	    << "\t" << "--no-pool-seqs                        "  << "\t" << "Do not merge reads with identical sequences and combine their base quality scores."  << "\n"
 	    << "\t" << "                                      "  << "\t" << "  By default, pooled reads will be aligned using the haplotype aligner instead"      << "\n"
 	    << "\t" << "                                      "  << "\t" << "  of the reads themselves, resulting in a large speedup."                            << "\n"
+	    << "\t" << "--ref-fast-path                       "  << "\t" << "Genotype each sample as homozygous for the reference allele at loci where every"   << "\n"
+	    << "\t" << "                                      "  << "\t" << "  read exactly matches the reference and spans the STR, skipping stutter training"  << "\n"
+	    << "\t" << "                                      "  << "\t" << "  and haplotype-based genotyping. Not used with --ref-vcf or --viz-out"              << "\n"
 	    << "\t" << "--def-stutter-model                   "  << "\t" << "For each locus, use a stutter model with PGEOM=0.9, UP=0.05, DOWN=0.05 for "         << "\n"
 	    << "\t" << "                                      "  << "\t" << " in-frame artifacts and PGEOM=0.9, UP=0.01, DOWN=0.01 for out-of-frame artifacts"    << "\n"
+	    << "\t" << "--recalc-stutter                      "  << "\t" << "After genotyping each locus, retrain its stutter model using the reads' maximum"     << "\n"
+	    << "\t" << "                                      "  << "\t" << "  likelihood haplotype alignments, rescore the reads and regenotype the samples"     << "\n"
 	    << "\t" << "--use-all-reads                       "  << "\t" << "Use all reads overlapping the region to genotype the STR, even those that are "      << "\n"
 	    << "\t" << "                                      "  << "\t" << " unlikely to be informative. By default, HipSTR only utilizes the reads it thinks"   << "\n"
 	    << "\t" << "                                      "  << "\t" << " will be informative. Enabling this option can slightly increase accuracy but at"    << "\n"
@@ -118,37 +190,56 @@ void parse_command_line_args(int argc, char** argv,
 			     std::string& str_vcf_out_file,   std::string& fam_file,          std::string& log_file,         int& use_all_reads,
 			     int& remove_pcr_dups,   int& bams_from_10x,    int& bam_lib_from_samp,     int& def_stutter_model, int& output_gls,
 			     int& output_pls,      int& output_phased_gls, int& output_all_reads, int& output_pall_reads,     int& output_mall_reads, std::string& ref_vcf_file,
-			     GenotyperBamProcessor& bam_processor){
+			     std::string& bam_cache_file, int& max_open_bams, std::string& ckpt_in_string, std::string& stutter_out_file, int& resume, GenotyperBamProcessor& bam_processor){
   int def_mdist       = bam_processor.MAX_MATE_DIST;
   int def_min_reads   = bam_processor.MIN_TOTAL_READS;
   int def_max_reads   = bam_processor.MAX_TOTAL_READS;
+  int def_progress    = bam_processor.PROGRESS_INTERVAL;
   int def_max_str_len = bam_processor.MAX_STR_LENGTH;
   if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
-    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len);
+    print_usage(def_mdist, def_min_reads, def_max_reads, def_max_str_len, def_progress);
     exit(0);
   }
 
   int print_help           = 0;
   int pool_seqs            = 1;
+  int64_t max_locus_cells  = 0;
+  double max_locus_time    = 0;
+  int64_t max_memory       = 0;
   int viz_left_alns        = 0;
+  int ref_fast_path        = 0;
+  int recalc_stutter       = 0;
   int print_version        = 0;
 
   static struct option long_options[] = {
     {"10x-bams",        no_argument, &bams_from_10x, 1},
+    {"bgzf-threads",    required_argument, 0, 'a'},
     {"bams",            required_argument, 0, 'b'},
     {"bam-files",       required_argument, 0, 'B'},
+    {"bam-cache",       required_argument, 0, 'C'},
     {"chrom",           required_argument, 0, 'c'},
+    {"ckpt-in",         required_argument, 0, 'I'},
+    {"ckpt-out",        required_argument, 0, 'K'},
     {"max-mate-dist",   required_argument, 0, 'd'},
     {"fam",             required_argument, 0, 'D'},
     {"fasta",           required_argument, 0, 'f'},
+    {"gl-bin",          required_argument, 0, 'G'},
     {"bam-samps",       required_argument, 0, 'g'},
     {"bam-libs",        required_argument, 0, 'q'},
     {"lib-from-samp",    no_argument, &bam_lib_from_samp,    1},
     {"min-mapq",        required_argument, 0, 'e'},
+    {"max-open-bams",   required_argument, 0, 'O'},
+    {"prefetch-loci",   required_argument, 0, 'R'},
     {"min-reads",       required_argument, 0, 'i'},
     {"read-qual-trim",  required_argument, 0, 'j'},
+    {"locus-cache",     required_argument, 0, 'L'},
     {"log",             required_argument, 0, 'l'},
     {"max-reads",       required_argument, 0, 'n'},
+    {"max-sample-reads", required_argument, 0, 'M'},
+    {"max-locus-cells", required_argument, 0, 'X'},
+    {"max-locus-time",  required_argument, 0, 'T'},
+    {"max-memory",      required_argument, 0, 'E'},
+    {"sample-chunk-size", required_argument, 0, 'S'},
     {"h",               no_argument, &print_help, 1},
     {"help",            no_argument, &print_help, 1},
     {"hide-allreads",   no_argument, &output_all_reads,   0},
@@ -163,6 +254,10 @@ void parse_command_line_args(int argc, char** argv,
     {"max-flank-indel", required_argument, 0, 'F'},
     {"str-vcf",         required_argument, 0, 'o'},
     {"ref-vcf",         required_argument, 0, 'p'},
+    {"progress-interval", required_argument, 0, 'P'},
+    {"resume",          no_argument, &resume, 1},
+    {"ref-fast-path",   no_argument, &ref_fast_path, 1},
+    {"recalc-stutter",  no_argument, &recalc_stutter, 1},
     {"regions",         required_argument, 0, 'r'},
     {"use-unpaired",    no_argument, &(bam_processor.REQUIRE_PAIRED_READS), 0},
     {"use-all-reads",   no_argument, &use_all_reads, 1},
@@ -184,7 +279,7 @@ void parse_command_line_args(int argc, char** argv,
   int c;
   while (true){
     int option_index = 0;
-    c = getopt_long(argc, argv, "b:B:c:d:D:e:f:F:g:i:j:k:l:m:n:o:p:q:r:s:t:u:v:w:x:y:z:", long_options, &option_index);
+    c = getopt_long(argc, argv, "a:b:B:c:C:d:D:e:E:f:F:g:G:i:I:j:k:K:l:L:m:M:n:o:O:p:P:q:r:R:s:S:t:T:u:v:w:x:X:y:z:", long_options, &option_index);
     if (c == -1)
       break;
 
@@ -197,6 +292,11 @@ void parse_command_line_args(int argc, char** argv,
     switch(c){
     case 0:
       break;
+    case 'a':
+      if (atoi(optarg) < 1)
+	printErrorAndDie("--bgzf-threads must be greater than 0");
+      bam_processor.set_bgzf_threads(atoi(optarg));
+      break;
     case 'b':
       bamlist_string = std::string(optarg);
       break;
@@ -206,6 +306,9 @@ void parse_command_line_args(int argc, char** argv,
     case 'c':
       chrom = std::string(optarg);
       break;
+    case 'C':
+      bam_cache_file = std::string(optarg);
+      break;
     case 'd':
       bam_processor.MAX_MATE_DIST = atoi(optarg);
       break;
@@ -221,29 +324,74 @@ void parse_command_line_args(int argc, char** argv,
     case 'g':
       rg_sample_string = std::string(optarg);
       break;
+    case 'G':
+      filename = std::string(optarg);
+      bam_processor.set_output_gl_sidecar(filename);
+      break;
     case 'i':
       bam_processor.MIN_TOTAL_READS = atoi(optarg);
       if (bam_processor.MIN_TOTAL_READS < 1)
 	printErrorAndDie("--min-total-reads must be greater than 0");
       break;
+    case 'I':
+      ckpt_in_string = std::string(optarg);
+      break;
     case 'j':
       if (std::string(optarg).size() != 1)
 	printErrorAndDie("--read-qual-trim requires a single character argument");
       bam_processor.BASE_QUAL_TRIM = std::string(optarg)[0];
       break;
+    case 'K':
+      filename = std::string(optarg);
+      bam_processor.set_output_checkpoint(filename);
+      break;
     case 'l':
       log_file = std::string(optarg);
       break;
+    case 'L':
+      filename = std::string(optarg);
+      bam_processor.set_locus_cache(filename);
+      break;
     case 'm':
       filename = std::string(optarg);
       bam_processor.set_input_stutter(filename);
       break;
+    case 'M':
+      bam_processor.MAX_SAMPLE_READS = atoi(optarg);
+      if (bam_processor.MAX_SAMPLE_READS < 1)
+	printErrorAndDie("--max-sample-reads must be greater than 0");
+      break;
     case 'n':
       bam_processor.MAX_TOTAL_READS = atoi(optarg);
       break;
+    case 'X':
+      max_locus_cells = atoll(optarg);
+      if (max_locus_cells < 1)
+	printErrorAndDie("--max-locus-cells must be greater than 0");
+      break;
+    case 'T':
+      max_locus_time = atof(optarg);
+      if (max_locus_time <= 0)
+	printErrorAndDie("--max-locus-time must be greater than 0");
+      break;
+    case 'E':
+      max_memory = parse_memory_size(std::string(optarg));
+      if (max_memory <= 0)
+	printErrorAndDie("--max-memory must be a positive size such as 4096M or 8G");
+      break;
     case 'o':
       str_vcf_out_file = std::string(optarg);
       break;
+    case 'O':
+      max_open_bams = atoi(optarg);
+      if (max_open_bams < 1)
+	printErrorAndDie("--max-open-bams must be greater than 0");
+      break;
+    case 'R':
+      bam_processor.PREFETCH_LOCI = atoi(optarg);
+      if (bam_processor.PREFETCH_LOCI < 1)
+	printErrorAndDie("--prefetch-loci must be greater than 0");
+      break;
     case 'p':
       ref_vcf_file = std::string(optarg);
       break;
@@ -253,9 +401,18 @@ void parse_command_line_args(int argc, char** argv,
     case 'r':
       region_file = std::string(optarg);
       break;
+    case 'P':
+      bam_processor.PROGRESS_INTERVAL = atoi(optarg);
+      if (bam_processor.PROGRESS_INTERVAL < 0)
+	printErrorAndDie("--progress-interval must be >= 0");
+      break;
     case 's':
-      filename = std::string(optarg);
-      bam_processor.set_output_stutter(filename);
+      stutter_out_file = std::string(optarg);
+      break;
+    case 'S':
+      bam_processor.SAMPLE_CHUNK_SIZE = atoi(optarg);
+      if (bam_processor.SAMPLE_CHUNK_SIZE < 1)
+	printErrorAndDie("--sample-chunk-size must be greater than 0");
       break;
     case 't':
       haploid_chr_string = std::string(optarg);
@@ -309,11 +466,17 @@ void parse_command_line_args(int argc, char** argv,
   if (pool_seqs == 1)
     bam_processor.pool_sequences();
   if (print_help){
-    print_usage(def_mdist, def_min_reads, def_max_reads,  def_max_str_len);
+    print_usage(def_mdist, def_min_reads, def_max_reads,  def_max_str_len, def_progress);
     exit(0);
   }
   if (viz_left_alns)
     bam_processor.visualize_left_alns();
+  if (ref_fast_path)
+    bam_processor.use_ref_fast_path();
+  if (recalc_stutter)
+    bam_processor.recalc_stutter_model();
+  bam_processor.set_locus_budget(max_locus_cells, max_locus_time);
+  bam_processor.set_max_memory(max_memory);
 }
 
 int main(int argc, char** argv){
@@ -334,11 +497,12 @@ int main(int argc, char** argv){
   std::string region_file="", fasta_dir="", chrom="", snp_vcf_file="";
   std::string bam_pass_out_file="", bam_filt_out_file="", str_vcf_out_file="", fam_file = "", log_file = "";
   int output_gls = 0, output_pls = 0, output_phased_gls = 0, output_all_reads = 1, output_pall_reads = 0, output_mall_reads = 1;
-  std::string ref_vcf_file="";
+  std::string ref_vcf_file="", bam_cache_file="", ckpt_in_string="", stutter_out_file="";
+  int max_open_bams = 0, resume = 0;
   parse_command_line_args(argc, argv, bamfile_string, bamlist_string, rg_sample_string, rg_lib_string, hap_chr_string, hap_chr_file, fasta_dir, region_file, snp_vcf_file, chrom,
 			  bam_pass_out_file, bam_filt_out_file, str_vcf_out_file, fam_file, log_file, use_all_reads, remove_pcr_dups, bams_from_10x,
 			  bam_lib_from_samp, def_stutter_model, output_gls, output_pls, output_phased_gls, output_all_reads, output_pall_reads, output_mall_reads,
-			  ref_vcf_file, bam_processor);
+			  ref_vcf_file, bam_cache_file, max_open_bams, ckpt_in_string, stutter_out_file, resume, bam_processor);
 
   if (!log_file.empty())
     bam_processor.set_log(log_file);
@@ -356,6 +520,73 @@ int main(int argc, char** argv){
   if (remove_pcr_dups == 0)   bam_processor.allow_pcr_dups();
   if (def_stutter_model == 1) bam_processor.set_default_stutter_model(0.95, 0.05, 0.05, 0.95, 0.01, 0.01);
 
+  if (!hap_chr_string.empty()){
+    std::vector<std::string> haploid_chroms;
+    split_by_delim(hap_chr_string, ',', haploid_chroms);
+    for (auto chrom_iter = haploid_chroms.begin(); chrom_iter != haploid_chroms.end(); chrom_iter++)
+      bam_processor.add_haploid_chrom(*chrom_iter);
+  }
+  if (!hap_chr_file.empty()){
+    if (!file_exists(hap_chr_file))
+      printErrorAndDie("File containing haploid chromosome names does not exist: " + hap_chr_file);
+    std::ifstream input(hap_chr_file.c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open file containing haploid chromosome names: " + hap_chr_file);
+    std::string line;
+    while (std::getline(input, line))
+      if (!line.empty())
+	bam_processor.add_haploid_chrom(line);
+    input.close();
+  }
+
+  if (str_vcf_out_file.empty() && bam_processor.output_checkpoint())
+    printErrorAndDie("--ckpt-out option requires --str-vcf");
+
+  // The stutter model output is opened after any --resume option has been parsed, so that it's only truncated at the checkpoint
+  if (resume){
+    if (str_vcf_out_file.empty())
+      printErrorAndDie("--resume option requires --str-vcf");
+    if (bam_processor.PROGRESS_INTERVAL == 0)
+      printErrorAndDie("--resume option can't be used with --progress-interval 0");
+    if (bam_processor.output_viz() || bam_processor.output_gl_sidecar() || bam_processor.output_checkpoint()
+	|| !bam_pass_out_file.empty() || !bam_filt_out_file.empty())
+      printErrorAndDie("--resume option can't be used with --viz-out, --gl-bin, --ckpt-out, --pass-bam or --filt-bam, as their output can't be resumed");
+    bam_processor.set_resume();
+  }
+  if (!stutter_out_file.empty())
+    bam_processor.set_output_stutter(stutter_out_file);
+
+  // Jointly genotype the samples in the checkpoints instead of reading BAMs
+  if (!ckpt_in_string.empty()){
+    if (!bamfile_string.empty() || !bamlist_string.empty())
+      printErrorAndDie("The --bams and --bam-files options can't be used with --ckpt-in");
+    if (!ref_vcf_file.empty() || !snp_vcf_file.empty())
+      printErrorAndDie("The --ref-vcf and --snp-vcf options can't be used with --ckpt-in");
+    if (region_file.empty())
+      printErrorAndDie("--region option required");
+    if (fasta_dir.empty())
+      printErrorAndDie("--fasta option required");
+    if (str_vcf_out_file.empty())
+      printErrorAndDie("--ckpt-in option requires --str-vcf");
+    if (!string_ends_with(str_vcf_out_file, ".gz"))
+      printErrorAndDie("Path for STR VCF output file must end in .gz as it will be bgzipped");
+    if (fasta_dir.back() != '/' && !is_file(fasta_dir))
+      fasta_dir += "/";
+
+    std::vector<std::string> ckpt_files;
+    std::set<std::string> ckpt_samples;
+    split_by_delim(ckpt_in_string, ',', ckpt_files);
+    for (unsigned int i = 0; i < ckpt_files.size(); i++)
+      bam_processor.add_input_checkpoint(ckpt_files[i], ckpt_samples);
+    bam_processor.set_output_str_vcf(str_vcf_out_file, full_command, ckpt_samples);
+    bam_processor.process_checkpoints(region_file, fasta_dir, 1000000, chrom);
+    bam_processor.finish();
+
+    total_time = (clock() - total_time)/CLOCKS_PER_SEC;
+    bam_processor.logger() << "HipSTR execution finished: Total runtime = " << total_time << " sec" << std::endl;
+    return 0;
+  }
+
   if (bamfile_string.empty() && bamlist_string.empty())
     printErrorAndDie("You must specify either the --bams or --bam-files option");
   else if ((!bamfile_string.empty()) && (!bamlist_string.empty()))
@@ -387,19 +618,60 @@ int main(int argc, char** argv){
   }
   bam_processor.logger() << "Detected " << bam_files.size() << " BAM files" << std::endl;
 
-  // Open all BAM files
+  // A single unindexed, coordinate-sorted BAM can be streamed from stdin
+  bool stream_bam = (std::find(bam_files.begin(), bam_files.end(), "-") != bam_files.end());
+  BamTools::BamReader stream_reader;
+  if (stream_bam){
+    if (bam_files.size() != 1)
+      printErrorAndDie("A BAM streamed from stdin can't be combined with other BAM files");
+    if (max_open_bams != 0 || !bam_cache_file.empty())
+      printErrorAndDie("The --max-open-bams and --bam-cache options can't be used with a BAM streamed from stdin");
+    if (!stream_reader.Open(bam_files[0]))
+      printErrorAndDie("Failed to open the BAM stream from stdin: " + stream_reader.GetErrorString());
+  }
+
+  // Open all BAM files, unless they'll be read one at a time using a pool of file handles or streamed.
+  // The header cache doesn't change how the BAMs are read, so that it can't alter the reads used for each locus
   BamTools::BamMultiReader reader;
-  if (!reader.Open(bam_files)) {
+  if (max_open_bams == 0 && !stream_bam && !reader.Open(bam_files)) {
     std::cerr << reader.GetErrorString() << std::endl;
     printErrorAndDie("Failed to open one or more BAM files");
   }
   //reader.SetExplicitMergeOrder(BamTools::BamMultiReader::MergeOrder::RoundRobinMerge);
 
 
+  // Locate BAM index files, assuming they're either the same path with a .bai suffix or a path where .bai replaces .bam
+  std::vector<std::string> bam_indexes;
+  for (unsigned int i = 0; i < bam_files.size() && !stream_bam; i++){
+    bool have_index      = false;
+    std::string bai_file = bam_files[i] + ".bai";
+    if (!file_exists(bai_file)){
+      int filename_len = bam_files[i].size();
+      if (filename_len > 4 && bam_files[i].substr(filename_len-4).compare(".bam") == 0){
+	bai_file = bam_files[i].substr(0, filename_len-4) + ".bai";
+	if (file_exists(bai_file)){
+	  have_index = true;
+	  bam_indexes.push_back(bai_file);
+	}
+      }
+    }
+    else {
+      have_index = true;
+      bam_indexes.push_back(bai_file);
+    }
+
+    if(!have_index){
+      std::stringstream error_msg;
+      error_msg << "Unable to find a BAM index file for " << bam_files[i] << "\n"
+		<< "Please ensure that each BAM has been sorted by position and indexed using samtools.";
+      printErrorAndDie(error_msg.str());
+    }
+  }
   // Construct filename->read group map (if one has been specified) and determine the list
   // of samples of interest based on either the specified names or the RG tags in the BAM headers
   std::set<std::string> rg_samples, rg_libs;
   std::map<std::string, std::string> rg_ids_to_sample, rg_ids_to_library;
+  std::vector<CachedReference> bam_references; // Reference sequences shared by all BAMs, if their headers were parsed or cached
   if (!rg_sample_string.empty()){
     if ((bam_lib_from_samp == 0) && rg_lib_string.empty())
       printErrorAndDie("--bam-libs option required when --bam-samps option specified");
@@ -421,87 +693,126 @@ int main(int argc, char** argv){
     bam_processor.logger() << "User-specified read groups for " << rg_samples.size() << " unique samples" << std::endl;
   }
   else {
-    if (!reader.GetHeader().HasReadGroups())
-      printErrorAndDie("Provided BAM files don't contain read groups in the header and the --bam-samps flag was not specified");
-
+    // Load any previously cached read groups, so that only new or modified BAMs need to be reopened
+    BamHeaderCache* bam_cache = (bam_cache_file.empty() ? NULL : new BamHeaderCache(bam_cache_file));
+    int num_read_groups = 0;
     for (unsigned int i = 0; i < bam_files.size(); i++){
       // Although it would be ideal to use the dictionary provided by the BamMultiReader, it doesn't appropriately handle
       // read group ID collisions across BAMs (as it just overwrites the previous entry).
       // Instead, we can open an individual reader for each BAM and allow for conficting IDs, as long as they lie in separate files
+      std::vector<CachedReadGroup> read_groups;
+      std::vector<CachedReference> references;
+      if (bam_cache == NULL || !bam_cache->lookup(bam_files[i], bam_indexes[i], read_groups, references)){
+	// The header of a stream can only be read once, so it's obtained from the streaming reader
+	BamTools::SamReadGroupDictionary rg_dict;
+	if (stream_bam)
+	  rg_dict = stream_reader.GetHeader().ReadGroups;
+	else {
+	  BamTools::BamReader single_file_reader;
+	  if (!single_file_reader.Open(bam_files[i]))
+	    printErrorAndDie("Failed to open one or more BAM files");
+	  rg_dict = single_file_reader.GetHeader().ReadGroups;
+	  const BamTools::RefVector& ref_vector = single_file_reader.GetReferenceData();
+	  for (auto ref_iter = ref_vector.begin(); ref_iter != ref_vector.end(); ref_iter++)
+	    references.push_back(CachedReference(ref_iter->RefName, ref_iter->RefLength));
+	  single_file_reader.Close();
+	}
+	for (auto rg_iter = rg_dict.Begin(); rg_iter != rg_dict.End(); rg_iter++){
+	  if (!rg_iter->HasID())     printErrorAndDie("RG in BAM header is lacking the ID tag");
+	  if (!rg_iter->HasSample()) printErrorAndDie("RG in BAM header is lacking the SM tag");
+	  read_groups.push_back(CachedReadGroup(rg_iter->ID, rg_iter->Sample, rg_iter->Library, rg_iter->HasLibrary()));
+	}
+	if (bam_cache != NULL)
+	  bam_cache->update(bam_files[i], bam_indexes[i], read_groups, references);
+      }
 
-      BamTools::BamReader single_file_reader;
-      if (!single_file_reader.Open(bam_files[i]))
-	printErrorAndDie("Failed to open one or more BAM files");
+      // As BAMs aren't opened up front when they're read using a pool of file handles, ensure that they share the same reference sequences
+      // using their headers, which is otherwise done by the BamMultiReader
+      if (!stream_bam){
+	if (i == 0)
+	  bam_references = references;
+	else {
+	  bool same_references = (references.size() == bam_references.size());
+	  for (unsigned int j = 0; same_references && j < references.size(); j++)
+	    same_references = (references[j].name.compare(bam_references[j].name) == 0 && references[j].length == bam_references[j].length);
+	  if (!same_references)
+	    printErrorAndDie("BAM file " + bam_files[i] + " has different reference sequences than BAM file " + bam_files[0]);
+	}
+      }
 
-      BamTools::SamReadGroupDictionary rg_dict = single_file_reader.GetHeader().ReadGroups;
-      for (auto rg_iter = rg_dict.Begin(); rg_iter != rg_dict.End(); rg_iter++){
-	if (!rg_iter->HasID())     printErrorAndDie("RG in BAM header is lacking the ID tag");
-	if (!rg_iter->HasSample()) printErrorAndDie("RG in BAM header is lacking the SM tag");
-	if ((bam_lib_from_samp == 0) && !rg_iter->HasLibrary())
+      for (auto rg_iter = read_groups.begin(); rg_iter != read_groups.end(); rg_iter++){
+	if ((bam_lib_from_samp == 0) && !rg_iter->has_library)
 	  printErrorAndDie("RG in BAM header is lacking the LB tag");
 
-	std::string rg_library = (bam_lib_from_samp == 0 ? rg_iter->Library : rg_iter->Sample);
+	std::string rg_library = (bam_lib_from_samp == 0 ? rg_iter->library : rg_iter->sample);
 
 	// Ensure that there aren't identical read group ids that map to different samples or libraries
-	if (rg_ids_to_sample.find(rg_iter->ID) != rg_ids_to_sample.end())
-	  if (rg_ids_to_sample[rg_iter->ID].compare(rg_iter->Sample) != 0)
-	    printErrorAndDie("Read group id " + rg_iter->ID + " maps to more than one sample");
-	if (rg_ids_to_library.find(rg_iter->ID) != rg_ids_to_library.end())
-	  if (rg_ids_to_library[rg_iter->ID].compare(rg_library) != 0)
-	    printErrorAndDie("Read group id " + rg_iter->ID + " maps to more than one library");
-
-	rg_ids_to_sample[bam_files[i] + rg_iter->ID]  = rg_iter->Sample;
-	rg_ids_to_library[bam_files[i] + rg_iter->ID] = rg_library;
-	rg_samples.insert(rg_iter->Sample);
+	if (rg_ids_to_sample.find(rg_iter->id) != rg_ids_to_sample.end())
+	  if (rg_ids_to_sample[rg_iter->id].compare(rg_iter->sample) != 0)
+	    printErrorAndDie("Read group id " + rg_iter->id + " maps to more than one sample");
+	if (rg_ids_to_library.find(rg_iter->id) != rg_ids_to_library.end())
+	  if (rg_ids_to_library[rg_iter->id].compare(rg_library) != 0)
+	    printErrorAndDie("Read group id " + rg_iter->id + " maps to more than one library");
+
+	rg_ids_to_sample[bam_files[i] + rg_iter->id]  = rg_iter->sample;
+	rg_ids_to_library[bam_files[i] + rg_iter->id] = rg_library;
+	rg_samples.insert(rg_iter->sample);
 	rg_libs.insert(rg_library);
+	num_read_groups++;
       }
-      single_file_reader.Close();
+    }
+    if (num_read_groups == 0)
+      printErrorAndDie("Provided BAM files don't contain read groups in the header and the --bam-samps flag was not specified");
+
+    if (bam_cache != NULL){
+      bam_processor.logger() << "Read groups for " << bam_cache->num_hits() << " out of " << bam_files.size()
+			     << " BAMs were loaded from the header cache " << bam_cache_file << std::endl;
+      bam_cache->save();
+      delete bam_cache;
     }
     bam_processor.logger() << "BAMs contain unique read group IDs for "
 			   << rg_libs.size()    << " unique libraries and "
 			   << rg_samples.size() << " unique samples" << std::endl;
   }
 
-  // Open BAM index files, assuming they're either the same path with a .bai suffix or a path where .bai replaces .bam
-  std::vector<std::string> bam_indexes;
-  for (unsigned int i = 0; i < bam_files.size(); i++){
-    bool have_index      = false;
-    std::string bai_file = bam_files[i] + ".bai";
-    if (!file_exists(bai_file)){
-      int filename_len = bam_files[i].size();
-      if (filename_len > 4 && bam_files[i].substr(filename_len-4).compare(".bam") == 0){
-	bai_file = bam_files[i].substr(0, filename_len-4) + ".bai";
-	if (file_exists(bai_file)){
-	  have_index = true;
-	  bam_indexes.push_back(bai_file);
-	}
-      }
-    }
-    else {
-      have_index = true;
-      bam_indexes.push_back(bai_file);
-    }
-
-    if(!have_index){
-      std::stringstream error_msg;
-      error_msg << "Unable to find a BAM index file for " << bam_files[i] << "\n"
-		<< "Please ensure that each BAM has been sorted by position and indexed using samtools.";
-      printErrorAndDie(error_msg.str());
-    }
+  BamRegionReader* region_reader = NULL;
+  BamFilePool* bam_pool = NULL;
+  StreamingBamReader* bam_stream = NULL;
+  std::string header_text;
+  if (stream_bam){
+    bam_stream    = new StreamingBamReader(stream_reader);
+    region_reader = bam_stream;
+    header_text   = stream_reader.GetHeaderText();
+    bam_processor.logger() << "Streaming a coordinate-sorted BAM from stdin. Regions will be genotyped in the order of its reference sequences" << std::endl;
+  }
+  else if (max_open_bams == 0){
+    if (!reader.OpenIndexes(bam_indexes))
+      printErrorAndDie("Failed to open one or more BAM index files");
+    region_reader = new MergedBamReader(reader);
+    header_text   = reader.GetHeaderText();
+  }
+  else {
+    // The pool opens each BAM and its index only when a locus requires them, using the parsed or cached headers' reference sequences
+    BamTools::RefVector ref_vector;
+    for (auto ref_iter = bam_references.begin(); ref_iter != bam_references.end(); ref_iter++)
+      ref_vector.push_back(BamTools::RefData(ref_iter->name, ref_iter->length));
+    bam_pool      = new BamFilePool(bam_files, bam_indexes, max_open_bams, (bam_references.empty() ? NULL : &ref_vector));
+    region_reader = bam_pool;
+    if (!bam_pass_out_file.empty() || !bam_filt_out_file.empty())
+      header_text = bam_pool->get_header_text();
+    bam_processor.logger() << "Reading the BAMs for each region one file at a time, with at most " << max_open_bams << " open BAM files" << std::endl;
   }
-  if (!reader.OpenIndexes(bam_indexes))
-    printErrorAndDie("Failed to open one or more BAM index files");
 
   BamTools::BamWriter bam_pass_writer;
   if (!bam_pass_out_file.empty()){
-    BamTools::RefVector ref_vector = reader.GetReferenceData();
-    bool file_open = bam_pass_writer.Open(bam_pass_out_file, reader.GetHeaderText(), ref_vector);
+    BamTools::RefVector ref_vector = region_reader->get_reference_data();
+    bool file_open = bam_pass_writer.Open(bam_pass_out_file, header_text, ref_vector);
     if (!file_open) printErrorAndDie("Failed to open output BAM file for reads used to genotype region");
   }
   BamTools::BamWriter bam_filt_writer;
   if (!bam_filt_out_file.empty()){
-    BamTools::RefVector ref_vector = reader.GetReferenceData();
-    bool file_open = bam_filt_writer.Open(bam_filt_out_file, reader.GetHeaderText(), ref_vector);
+    BamTools::RefVector ref_vector = region_reader->get_reference_data();
+    bool file_open = bam_filt_writer.Open(bam_filt_out_file, header_text, ref_vector);
     if (!file_open) printErrorAndDie("Failed to open output BAM file for reads filtered for each region");
   }
 
@@ -534,31 +845,14 @@ int main(int argc, char** argv){
     bam_processor.set_input_snp_vcf(snp_vcf_file);
   }
 
+  if (str_vcf_out_file.empty() && bam_processor.output_gl_sidecar())
+    printErrorAndDie("--gl-bin option requires --str-vcf");
   if(!str_vcf_out_file.empty()){
     if (!string_ends_with(str_vcf_out_file, ".gz"))
       printErrorAndDie("Path for STR VCF output file must end in .gz as it will be bgzipped");
     bam_processor.set_output_str_vcf(str_vcf_out_file, full_command, rg_samples);
   }
 
-  if (!hap_chr_string.empty()){
-    std::vector<std::string> haploid_chroms;
-    split_by_delim(hap_chr_string, ',', haploid_chroms);
-    for (auto chrom_iter = haploid_chroms.begin(); chrom_iter != haploid_chroms.end(); chrom_iter++)
-      bam_processor.add_haploid_chrom(*chrom_iter);
-  }
-  if (!hap_chr_file.empty()){
-    if (!file_exists(hap_chr_file))
-      printErrorAndDie("File containing haploid chromosome names does not exist: " + hap_chr_file);
-    std::ifstream input(hap_chr_file.c_str());
-    if (!input.is_open())
-      printErrorAndDie("Failed to open file containing haploid chromosome names: " + hap_chr_file);
-    std::string line;
-    while (std::getline(input, line))
-      if (!line.empty())
-	bam_processor.add_haploid_chrom(line);
-    input.close();
-  }
-
   // Extract any relevant pedigree information to be used to filter SNPs before physically phasing STRs
   if (!fam_file.empty()){
     if (snp_vcf_file.empty())
@@ -575,12 +869,25 @@ int main(int argc, char** argv){
   }
 
   // Run analysis
-  bam_processor.process_regions(reader, region_file, fasta_dir, rg_ids_to_sample, rg_ids_to_library, bam_pass_writer, bam_filt_writer, std::cout, 1000000, chrom);
+  bam_processor.process_regions(*region_reader, region_file, fasta_dir, rg_ids_to_sample, rg_ids_to_library, bam_pass_writer, bam_filt_writer, std::cout, 1000000, chrom);
   bam_processor.finish();
 
   if (!bam_pass_out_file.empty()) bam_pass_writer.Close();
   if (!bam_filt_out_file.empty()) bam_filt_writer.Close();
+  if (bam_pool != NULL)
+    bam_processor.logger() << "BAM file pool statistics:"                                      << "\n"
+			   << " Handle hits       = " << bam_pool->num_hits()      << "\n"
+			   << " Initial opens     = " << bam_pool->num_opens()     << "\n"
+			   << " Reopens           = " << bam_pool->num_reopens()   << "\n"
+			   << " Evictions         = " << bam_pool->num_evictions() << "\n"
+			   << " Time opening BAMs = " << bam_pool->open_time()     << " seconds" << std::endl;
+  if (bam_stream != NULL)
+    bam_processor.logger() << "Read " << bam_stream->num_reads() << " alignments from the BAM stream, buffering at most "
+			   << bam_stream->max_buffered() << " alignments at once" << std::endl;
+  delete region_reader;
   reader.Close();
+  if (stream_bam)
+    stream_reader.Close();
 
   total_time = (clock() - total_time)/CLOCKS_PER_SEC;
   bam_processor.logger() << "HipSTR execution finished: Total runtime = " << total_time << " sec" << std::endl;
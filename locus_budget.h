@@ -0,0 +1,67 @@
+#ifndef LOCUS_BUDGET_H_
+#define LOCUS_BUDGET_H_
+
+#include <stdint.h>
+
+#include <chrono>
+
+// Tiers used to genotype a locus, in order of decreasing cost. Each tier is only used if the locus exceeded its budget in the previous tiers
+const int BUDGET_TIER_FULL           = 0;
+const int BUDGET_TIER_NO_BOOTSTRAP   = 1;  // Bootstrapped quality scores weren't computed
+const int BUDGET_TIER_CAPPED_ALLELES = 2;  // Only the best-supported candidate alleles were considered
+const int BUDGET_TIER_DOWNSAMPLED    = 3;  // The best-supported alleles were genotyped using a subset of the reads
+const int BUDGET_TIER_FILTERED       = 4;  // The locus wasn't genotyped
+
+/*
+ * Limits the computation spent genotyping a locus, measured in haplotype alignment matrix cells and in wall time.
+ * The alignment, EM and bootstrap loops check the budget between units of work, so a locus can overrun it by at most one unit.
+ * A limit of 0 disables that part of the budget
+ */
+class LocusBudget {
+ private:
+  int64_t max_cells_;
+  double max_seconds_;
+  int64_t num_cells_;
+  bool exceeded_;
+  std::chrono::steady_clock::time_point start_;
+
+ public:
+  LocusBudget(){
+    max_cells_   = 0;
+    max_seconds_ = 0;
+    restart();
+  }
+
+  void set_limits(int64_t max_cells, double max_seconds){
+    max_cells_   = max_cells;
+    max_seconds_ = max_seconds;
+  }
+
+  bool enabled()         const { return max_cells_ > 0 || max_seconds_ > 0; }
+  int64_t max_cells()    const { return max_cells_;   }
+  double max_seconds()   const { return max_seconds_; }
+  int64_t num_cells()    const { return num_cells_;   }
+
+  void restart(){
+    num_cells_ = 0;
+    exceeded_  = false;
+    start_     = std::chrono::steady_clock::now();
+  }
+
+  void add_cells(int64_t num_cells){
+    num_cells_ += num_cells;
+  }
+
+  double elapsed_seconds() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+  }
+
+  /* Returns true iff the budget has been exceeded since it was last restarted */
+  bool exceeded(){
+    if (!exceeded_ && enabled())
+      exceeded_ = ((max_cells_ > 0 && num_cells_ > max_cells_) || (max_seconds_ > 0 && elapsed_seconds() > max_seconds_));
+    return exceeded_;
+  }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "error.h"
+#include "locus_cache.h"
+#include "stringops.h"
+
+void LocusKeyHasher::add_bytes(const void* data, size_t num_bytes){
+  // Two independent 64-bit lanes: FNV-1a and a multiply-rotate mixer
+  const unsigned char* bytes = (const unsigned char*)data;
+  for (size_t i = 0; i < num_bytes; i++){
+    fnv_hash_ ^= bytes[i];
+    fnv_hash_ *= 1099511628211ULL;
+    mix_hash_  = (mix_hash_ ^ bytes[i]) * 0x9E3779B97F4A7C15ULL;
+    mix_hash_  = (mix_hash_ << 31) | (mix_hash_ >> 33);
+  }
+}
+
+std::string LocusKeyHasher::hex_digest() const {
+  char digest[33];
+  snprintf(digest, sizeof(digest), "%016llx%016llx", (unsigned long long)fnv_hash_, (unsigned long long)mix_hash_);
+  return std::string(digest);
+}
+
+LocusResultCache::LocusResultCache(const std::string& directory){
+  directory_  = directory;
+  num_hits_   = 0;
+  num_misses_ = 0;
+  num_stores_ = 0;
+  while (directory_.size() > 1 && directory_.back() == '/')
+    directory_.pop_back();
+
+  struct stat dir_info;
+  if (stat(directory_.c_str(), &dir_info) != 0){
+    if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST)
+      printErrorAndDie("Failed to create the locus cache directory " + directory_);
+  }
+  else if (!S_ISDIR(dir_info.st_mode))
+    printErrorAndDie("Locus cache path " + directory_ + " exists but is not a directory");
+}
+
+static bool read_text_block(std::istream& input, const std::string& label, std::string& text){
+  std::string line;
+  std::vector<std::string> tokens;
+  if (!std::getline(input, line))
+    return false;
+  split_by_delim(line, '\t', tokens);
+  if (tokens.size() != 2 || tokens[0].compare(label) != 0)
+    return false;
+  long num_bytes = atol(tokens[1].c_str());
+  if (num_bytes < 0)
+    return false;
+  text.resize(num_bytes);
+  if (num_bytes > 0 && !input.read(&text[0], num_bytes))
+    return false;
+  return true;
+}
+
+bool LocusResultCache::lookup(const std::string& key, LocusCacheEntry& entry){
+  std::ifstream input(entry_path(key).c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!input.is_open()){
+    num_misses_++;
+    return false;
+  }
+
+  // Treat entries from other versions or with a mismatched key as misses, as they'll be overwritten
+  std::string line;
+  std::vector<std::string> tokens;
+  bool valid = (std::getline(input, line) && line.compare("##hipstr_locus_cache_version=" + std::to_string(VERSION)) == 0);
+  valid = valid && std::getline(input, line) && line.compare("KEY\t" + key) == 0;
+  if (valid && std::getline(input, line)){
+    split_by_delim(line, '\t', tokens);
+    valid = (tokens.size() == 6 && tokens[0].compare("COUNTS") == 0);
+    if (valid){
+      entry.num_genotype_success = atoi(tokens[1].c_str());
+      entry.num_genotype_fail    = atoi(tokens[2].c_str());
+      entry.num_em_converge      = atoi(tokens[3].c_str());
+      entry.num_em_fail          = atoi(tokens[4].c_str());
+      entry.num_ref_fast_path    = atoi(tokens[5].c_str());
+    }
+  }
+  else
+    valid = false;
+  valid = valid && read_text_block(input, "STUTTER", entry.stutter_text);
+  valid = valid && std::getline(input, line) && line.empty();
+  valid = valid && read_text_block(input, "VCF", entry.vcf_text);
+  input.close();
+
+  if (!valid){
+    num_misses_++;
+    return false;
+  }
+  num_hits_++;
+  return true;
+}
+
+void LocusResultCache::store(const std::string& key, const LocusCacheEntry& entry){
+  // Create the entry's shard directory on first use
+  if (mkdir(shard_path(key).c_str(), 0755) != 0 && errno != EEXIST)
+    printErrorAndDie("Failed to create the locus cache directory " + shard_path(key));
+
+  std::stringstream tmp_path;
+  tmp_path << entry_path(key) << ".tmp" << getpid();
+  std::ofstream output(tmp_path.str().c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!output.is_open())
+    printErrorAndDie("Failed to write to the locus cache directory " + directory_);
+  output << "##hipstr_locus_cache_version=" << VERSION << "\n"
+	 << "KEY"     << "\t" << key << "\n"
+	 << "COUNTS"  << "\t" << entry.num_genotype_success << "\t" << entry.num_genotype_fail
+	 << "\t" << entry.num_em_converge << "\t" << entry.num_em_fail << "\t" << entry.num_ref_fast_path << "\n"
+	 << "STUTTER" << "\t" << entry.stutter_text.size() << "\n" << entry.stutter_text << "\n"
+	 << "VCF"     << "\t" << entry.vcf_text.size()     << "\n" << entry.vcf_text;
+  output.close();
+  if (output.fail() || rename(tmp_path.str().c_str(), entry_path(key).c_str()) != 0){
+    remove(tmp_path.str().c_str());
+    printErrorAndDie("Failed to write to the locus cache directory " + directory_);
+  }
+  num_stores_++;
+}
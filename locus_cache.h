@@ -0,0 +1,86 @@
+#ifndef LOCUS_CACHE_H_
+#define LOCUS_CACHE_H_
+
+#include <stdint.h>
+
+#include <string>
+
+/* Incrementally computes a 128-bit hash of a locus's inputs, which is used as its key in the LocusResultCache */
+class LocusKeyHasher {
+ private:
+  uint64_t fnv_hash_, mix_hash_;
+
+ public:
+  LocusKeyHasher(){
+    fnv_hash_ = 14695981039346656037ULL;
+    mix_hash_ = 0x243F6A8885A308D3ULL;
+  }
+
+  void add_bytes(const void* data, size_t num_bytes);
+
+  template<typename T> void add(const T& value){ add_bytes(&value, sizeof(T)); }
+
+  /* Strings are prefixed by their length so that adjacent strings can't be confused */
+  void add_string(const std::string& value){
+    add((uint64_t)value.size());
+    add_bytes(value.data(), value.size());
+  }
+
+  /* Returns the hash as 32 hexadecimal characters */
+  std::string hex_digest() const;
+};
+
+class LocusCacheEntry {
+ public:
+  // Changes to the genotyping and stutter training counters caused by the locus
+  int num_genotype_success, num_genotype_fail;
+  int num_em_converge, num_em_fail;
+  int num_ref_fast_path;
+  std::string stutter_text;  // Stutter model output for the locus
+  std::string vcf_text;      // VCF record(s) for the locus
+
+  LocusCacheEntry(){
+    num_genotype_success = num_genotype_fail = 0;
+    num_em_converge      = num_em_fail       = 0;
+    num_ref_fast_path    = 0;
+  }
+};
+
+/*
+ * Content-addressed on-disk cache of the results for each locus, so that reruns and parameter sweeps only genotype loci
+ * whose reads, reference sequence, stutter model inputs or output-relevant parameters have changed.
+ *
+ * Each entry is stored in its own file named by the hex digest of its key, in a subdirectory of the cache directory named by the
+ * digest's first two characters so that no directory grows past a few thousand files for genome-wide runs. Files are written to
+ * a temporary path and renamed, so an interrupted run never leaves a partial entry and concurrent runs can share a directory.
+ * Each file is a versioned text header followed by the length-prefixed stutter model and VCF text:
+ *   ##hipstr_locus_cache_version=<version>
+ *   KEY      <key>
+ *   COUNTS   <genotype successes>  <genotype failures>  <EM successes>  <EM failures>  <reference-only loci>
+ *   STUTTER  <number of bytes>  followed by the text on the next line(s)
+ *   VCF      <number of bytes>  followed by the text on the next line(s)
+ */
+class LocusResultCache {
+ private:
+  const static int VERSION = 1;
+  std::string directory_;
+  int num_hits_, num_misses_, num_stores_;
+
+  std::string shard_path(const std::string& key) const { return directory_ + "/" + key.substr(0, 2); }
+  std::string entry_path(const std::string& key) const { return shard_path(key) + "/" + key + ".locus"; }
+
+ public:
+  /* Opens the cache in the provided directory, creating the directory if it doesn't exist */
+  explicit LocusResultCache(const std::string& directory);
+
+  /* Returns true and fills in the entry iff the cache contains a valid entry for the key */
+  bool lookup(const std::string& key, LocusCacheEntry& entry);
+
+  void store(const std::string& key, const LocusCacheEntry& entry);
+
+  int num_hits()   const { return num_hits_;   }
+  int num_misses() const { return num_misses_; }
+  int num_stores() const { return num_stores_; }
+};
+
+#endif
@@ -44,7 +44,7 @@ double log_sum_exp(double* begin, double* end){
   double total   = 0.0;
   for (double* iter = begin; iter != end; iter++)
     total += exp(*iter - max_val);
-  return max_val + log(total);
+  return (total > 0 ? max_val + log(total) : max_val);
 }
 
 double log_sum_exp(double log_v1, double log_v2){
@@ -64,7 +64,7 @@ double log_sum_exp(std::vector<double>& log_vals){
   double total   = 0;
   for (auto iter = log_vals.begin(); iter != log_vals.end(); iter++)
     total += exp(*iter - max_val);
-  return max_val + log(total);
+  return (total > 0 ? max_val + log(total) : max_val);
 }
 
 double expected_value(double* log_likelihoods, std::vector<int>& vals){
@@ -84,16 +84,18 @@ double expected_value(std::vector<double>& log_likelihoods, std::vector<int>& va
   return total;
 }
 
+// Streaming sums use the exact exponential and logarithm, as the approximations' errors of up to several percent
+// would otherwise depend on the order in which the values are accumulated
 void update_streaming_log_sum_exp(double log_val, double& max_val, double& total){
   if (log_val <= max_val)
-    total += fasterexp(log_val - max_val);
+    total += exp(log_val - max_val);
   else {
-    total  *= fasterexp(max_val-log_val);
+    total  *= exp(max_val-log_val);
     total  += 1.0;
     max_val = log_val;
   }
 }
 
 double finish_streaming_log_sum_exp(double max_val, double total){
-  return max_val + fasterlog(total);
+  return (total > 0 ? max_val + log(total) : max_val);
 }
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memory_admission.h"
+
+// Per-read arrays of the sequence-based genotyper other than the alignment likelihoods: seed positions, phasing likelihoods,
+// sample labels, pool indices, base pair differences, mate flags and read weights
+static const int64_t GENOTYPER_BYTES_PER_READ = 40;
+
+// Per-read arrays of the EM genotyper other than the phase posteriors: base pair differences, phasing likelihoods and sample labels
+static const int64_t EM_BYTES_PER_READ = 24;
+
+LocusMemoryEstimator::LocusMemoryEstimator(const std::vector<int64_t>& sample_reads, int64_t held_bytes, int64_t left_aln_bytes,
+					   int num_alleles, int64_t num_em_reads, int num_em_alleles){
+  sample_reads_   = sample_reads;
+  held_bytes_     = held_bytes;
+  left_aln_bytes_ = left_aln_bytes;
+  num_alleles_    = std::max(1, num_alleles);
+  num_em_reads_   = num_em_reads;
+  num_em_alleles_ = std::max(1, num_em_alleles);
+  num_reads_      = 0;
+  for (unsigned int i = 0; i < sample_reads_.size(); i++)
+    num_reads_ += sample_reads_[i];
+}
+
+int64_t LocusMemoryEstimator::em_bytes() const {
+  if (num_em_reads_ == 0)
+    return 0;
+  int64_t num_gts = num_em_alleles_*num_em_alleles_;
+  return num_em_reads_*(EM_BYTES_PER_READ + 2*num_gts*sizeof(double)) + num_gts*sample_reads_.size()*sizeof(double);
+}
+
+int64_t LocusMemoryEstimator::chunk_bytes(size_t start, size_t end) const {
+  int64_t chunk_reads = 0, max_sample_reads = 0;
+  for (size_t i = start; i < end; i++){
+    chunk_reads     += sample_reads_[i];
+    max_sample_reads = std::max(max_sample_reads, sample_reads_[i]);
+  }
+  int64_t num_gts      = num_alleles_*num_alleles_;
+  int64_t aln_bytes    = (num_reads_ == 0 ? 0 : (int64_t)(1.0*left_aln_bytes_*chunk_reads/num_reads_));
+  int64_t read_bytes   = chunk_reads*(num_alleles_*sizeof(double) + GENOTYPER_BYTES_PER_READ);
+  int64_t sample_bytes = (end-start)*(2*num_gts + 1)*sizeof(double);  // Unphased and phased posteriors and total likelihoods
+  int64_t boot_bytes   = max_sample_reads*num_gts*sizeof(double);      // Bootstrapping computes each read's genotype likelihoods for one sample at a time
+  return aln_bytes + read_bytes + sample_bytes + boot_bytes;
+}
+
+int64_t LocusMemoryEstimator::genotyper_bytes(int chunk_size) const {
+  size_t step = (chunk_size <= 0 ? sample_reads_.size() : (size_t)chunk_size);
+  if (step == 0)
+    return 0;
+  int64_t max_bytes = 0;
+  for (size_t start = 0; start < sample_reads_.size(); start += step)
+    max_bytes = std::max(max_bytes, chunk_bytes(start, std::min(sample_reads_.size(), start+step)));
+  return max_bytes;
+}
+
+int MemoryAdmissionController::admit(const LocusMemoryEstimator& estimator, int num_samples, int chunk_size, bool allow_chunks, int64_t& estimate){
+  estimate = estimator.peak_bytes(chunk_size);
+  if (estimate <= max_bytes_){
+    num_admitted_++;
+    max_estimate_ = std::max(max_estimate_, estimate);
+    return chunk_size;
+  }
+
+  if (allow_chunks){
+    for (int size = (chunk_size > 0 && chunk_size < num_samples ? chunk_size : num_samples)/2; size >= 1; size /= 2){
+      int64_t chunk_estimate = estimator.peak_bytes(size);
+      if (chunk_estimate <= max_bytes_){
+	estimate = chunk_estimate;
+	num_admitted_++;
+	num_chunked_++;
+	max_estimate_ = std::max(max_estimate_, estimate);
+	return size;
+      }
+    }
+  }
+  num_deferred_++;
+  return DEFER;
+}
+
+// Returns the value of the provided field in /proc/self/status in bytes, or -1 if it's unavailable
+static int64_t read_status_bytes(const char* field){
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file == NULL)
+    return -1;
+  int64_t bytes = -1;
+  size_t field_len = strlen(field);
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL){
+    if (strncmp(line, field, field_len) == 0){
+      bytes = 1024*atoll(line+field_len);
+      break;
+    }
+  }
+  fclose(file);
+  return bytes;
+}
+
+void MemoryAdmissionController::begin_locus(){
+  if (!peak_resettable_)
+    return;
+
+  // Writing 5 to clear_refs resets the peak resident set size (Linux >= 4.0)
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  peak_resettable_ = (file != NULL && fputs("5", file) >= 0);
+  if (file != NULL && fclose(file) != 0)
+    peak_resettable_ = false;
+}
+
+int64_t MemoryAdmissionController::end_locus(){
+  // Without a reset, VmHWM is the peak of the whole process and would be misattributed to the locus
+  if (!peak_resettable_)
+    return -1;
+  int64_t peak = read_status_bytes("VmHWM:");
+  if (peak < 0)
+    return -1;
+  max_measured_ = std::max(max_measured_, peak);
+  return peak;
+}
+
+int64_t parse_memory_size(const std::string& value){
+  if (value.empty())
+    return -1;
+  char* end;
+  double size = strtod(value.c_str(), &end);
+  if (end == value.c_str() || size <= 0)
+    return -1;
+
+  std::string suffix(end);
+  if (suffix.size() == 2 && (suffix[1] == 'B' || suffix[1] == 'b'))
+    suffix = suffix.substr(0, 1);
+  double scale;
+  if (suffix.empty())
+    scale = 1;
+  else if (suffix.size() == 1 && (suffix[0] == 'K' || suffix[0] == 'k'))
+    scale = 1024.0;
+  else if (suffix.size() == 1 && (suffix[0] == 'M' || suffix[0] == 'm'))
+    scale = 1024.0*1024;
+  else if (suffix.size() == 1 && (suffix[0] == 'G' || suffix[0] == 'g'))
+    scale = 1024.0*1024*1024;
+  else if (suffix.size() == 1 && (suffix[0] == 'T' || suffix[0] == 't'))
+    scale = 1024.0*1024*1024*1024;
+  else
+    return -1;
+  return (int64_t)(size*scale);
+}
@@ -0,0 +1,99 @@
+#ifndef MEMORY_ADMISSION_H_
+#define MEMORY_ADMISSION_H_
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+ * Estimates the memory required to genotype a locus before any of its genotyping arrays are allocated. The estimate is dominated by
+ * the reads, the read x allele haplotype alignment likelihoods, the EM genotyper's allele^2 x read x 2 phase posteriors and the
+ * allele^2 x sample genotype posteriors. All sizes are in bytes
+ */
+class LocusMemoryEstimator {
+ private:
+  std::vector<int64_t> sample_reads_;  // Number of reads for each sample, in the order in which samples are chunked
+  int64_t num_reads_;
+  int64_t held_bytes_;      // Memory held by the BAM reads throughout genotyping
+  int64_t left_aln_bytes_;  // Memory required for the left-aligned copy of every read
+  int64_t num_alleles_;
+  int64_t num_em_reads_, num_em_alleles_;
+
+  // Memory used by the sequence-based genotyper for the samples in [START, END)
+  int64_t chunk_bytes(size_t start, size_t end) const;
+
+ public:
+  LocusMemoryEstimator(const std::vector<int64_t>& sample_reads, int64_t held_bytes, int64_t left_aln_bytes,
+		       int num_alleles, int64_t num_em_reads, int num_em_alleles);
+
+  int64_t held_bytes() const { return held_bytes_; }
+
+  // Memory used to train the stutter model using the length-based EM genotyper
+  int64_t em_bytes() const;
+
+  // Peak memory used by the sequence-based genotyper when samples are genotyped in chunks of at most CHUNK_SIZE samples (0 = all samples at once)
+  int64_t genotyper_bytes(int chunk_size) const;
+
+  // The EM and sequence-based genotypers never coexist, so the peak is the larger of the two in addition to the reads
+  int64_t peak_bytes(int chunk_size) const {
+    return held_bytes_ + std::max(em_bytes(), genotyper_bytes(chunk_size));
+  }
+};
+
+/*
+ * Admits loci whose estimated memory fits within a limit. A locus that doesn't fit is genotyped in smaller chunks of samples if
+ * chunking is allowed and a chunk size fits, and is otherwise deferred. Deferred loci aren't genotyped.
+ * Also measures each locus's peak resident memory so that the estimates can be compared to it, where the kernel supports resetting it
+ */
+class MemoryAdmissionController {
+ private:
+  int64_t max_bytes_;
+  int64_t max_estimate_, max_measured_;
+  int num_admitted_, num_chunked_, num_deferred_;
+  bool peak_resettable_;
+
+ public:
+  static const int DEFER = -1;
+
+  MemoryAdmissionController(){
+    max_bytes_       = 0;
+    max_estimate_    = 0;
+    max_measured_    = 0;
+    num_admitted_    = 0;
+    num_chunked_     = 0;
+    num_deferred_    = 0;
+    peak_resettable_ = true;
+  }
+
+  void set_limit(int64_t max_bytes){ max_bytes_ = max_bytes; }
+  bool enabled()      const { return max_bytes_ > 0;  }
+  int64_t max_bytes() const { return max_bytes_;      }
+
+  /*
+   * Returns the sample chunk size to use for the locus: CHUNK_SIZE if the locus fits using it, the largest smaller chunk size that
+   * fits (obtained by repeatedly halving it) if ALLOW_CHUNKS is true, or DEFER if the locus doesn't fit.
+   * ESTIMATE is set to the estimated peak memory for the returned chunk size, or for CHUNK_SIZE if the locus is deferred
+   */
+  int admit(const LocusMemoryEstimator& estimator, int num_samples, int chunk_size, bool allow_chunks, int64_t& estimate);
+
+  /* Resets the peak resident memory so that end_locus() measures the peak of a single locus, where supported by the kernel */
+  void begin_locus();
+
+  /* Returns the peak resident memory since begin_locus(), or -1 if the peak couldn't be reset or measured */
+  int64_t end_locus();
+
+  bool peak_resettable()  const { return peak_resettable_; }
+
+  int num_admitted()      const { return num_admitted_; }
+  int num_chunked()       const { return num_chunked_;  }
+  int num_deferred()      const { return num_deferred_; }
+  int64_t max_estimate()  const { return max_estimate_; }
+  int64_t max_measured()  const { return max_measured_; }
+};
+
+/* Parses a memory size such as 4096, 512M or 8G, where the suffixes are powers of 1024. Returns -1 if the size is invalid */
+int64_t parse_memory_size(const std::string& value);
+
+#endif
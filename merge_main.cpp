@@ -0,0 +1,162 @@
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "stringops.h"
+#include "vcf_shard_merger.h"
+#include "version.h"
+
+void print_usage(){
+  std::cerr << "Usage: ShardMerger --vcfs <list_of_vcfs> --str-vcf <merged.vcf.gz> [OPTIONS]" << "\n" << "\n"
+
+	    << "Merges the VCFs written by HipSTR for shards of a region file, such as those created by RegionSharder, into a single"   << "\n"
+	    << "bgzipped and indexed VCF. The shards' BGZF blocks are concatenated, so the records are never recompressed"             << "\n" << "\n"
+
+	    << "Required parameters:" << "\n"
+	    << "\t" << "--vcfs        <list_of_vcfs>       "  << "\t" << "Comma separated list of the shards' bgzipped VCFs, in the order of their regions"  << "\n"
+	    << "\t" << "--str-vcf     <merged.vcf.gz>      "  << "\t" << "Output file for the merged VCF. A tabix index is also written"                     << "\n" << "\n"
+
+	    << "Optional input parameters:" << "\n"
+	    << "\t" << "--vcf-files   <vcf_files.txt>      "  << "\t" << "File containing the shards' VCFs, one per line, in the order of their regions"     << "\n"
+	    << "\t" << "--stutter-ins <list_of_models>     "  << "\t" << "Comma separated list of the stutter models written for each shard using"          << "\n"
+	    << "\t" << "                                   "  << "\t" << " HipSTR's --stutter-out option, in the same order as the VCFs"                     << "\n" << "\n"
+
+	    << "Optional output parameters:" << "\n"
+	    << "\t" << "--stutter-out <stutter_models.txt> "  << "\t" << "Output file for the merged stutter models"                                       << "\n" << "\n"
+
+	    << "Other optional parameters:" << "\n"
+	    << "\t" << "--help                             "  << "\t" << "Print this help message and exit"                                                 << "\n"
+	    << "\t" << "--version                          "  << "\t" << "Print ShardMerger version and exit"                                               << "\n"
+	    << "\n";
+}
+
+void parse_command_line_args(int argc, char** argv, std::string& vcf_string, std::string& vcf_list_file, std::string& out_vcf,
+			     std::string& stutter_string, std::string& stutter_out){
+  if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
+    print_usage();
+    exit(0);
+  }
+
+  int print_help    = 0;
+  int print_version = 0;
+
+  static struct option long_options[] = {
+    {"h",               no_argument, &print_help, 1},
+    {"help",            no_argument, &print_help, 1},
+    {"version",         no_argument, &print_version, 1},
+    {"str-vcf",         required_argument, 0, 'o'},
+    {"stutter-ins",     required_argument, 0, 's'},
+    {"stutter-out",     required_argument, 0, 'S'},
+    {"vcfs",            required_argument, 0, 'v'},
+    {"vcf-files",       required_argument, 0, 'V'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while (true){
+    int option_index = 0;
+    c = getopt_long(argc, argv, "o:s:S:v:V:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch(c){
+    case 0:
+      break;
+    case 'o':
+      out_vcf = std::string(optarg);
+      break;
+    case 's':
+      stutter_string = std::string(optarg);
+      break;
+    case 'S':
+      stutter_out = std::string(optarg);
+      break;
+    case 'v':
+      vcf_string = std::string(optarg);
+      break;
+    case 'V':
+      vcf_list_file = std::string(optarg);
+      break;
+    case '?':
+      printErrorAndDie("Unrecognized command line option");
+      break;
+    default:
+      abort();
+      break;
+    }
+  }
+
+  if (optind < argc) {
+    std::stringstream msg;
+    msg << "Did not recognize the following command line arguments:" << "\n";
+    while (optind < argc)
+      msg << "\t" << argv[optind++] << "\n";
+    msg << "Please check your command line syntax or type ./ShardMerger --help for additional information" << "\n";
+    printErrorAndDie(msg.str());
+  }
+
+  if (print_version == 1){
+    std::cerr << "ShardMerger version " << VERSION << std::endl;
+    exit(0);
+  }
+
+  if (print_help){
+    print_usage();
+    exit(0);
+  }
+}
+
+int main(int argc, char** argv){
+  std::string vcf_string = "", vcf_list_file = "", out_vcf = "", stutter_string = "", stutter_out = "";
+  parse_command_line_args(argc, argv, vcf_string, vcf_list_file, out_vcf, stutter_string, stutter_out);
+  if (vcf_string.empty() && vcf_list_file.empty())
+    printErrorAndDie("--vcfs or --vcf-files option required");
+  if (out_vcf.empty())
+    printErrorAndDie("--str-vcf option required");
+  if (stutter_string.empty() != stutter_out.empty())
+    printErrorAndDie("The --stutter-ins and --stutter-out options must be used together");
+
+  std::vector<std::string> vcf_files;
+  if (!vcf_string.empty())
+    split_by_delim(vcf_string, ',', vcf_files);
+  if (!vcf_list_file.empty()){
+    std::ifstream input(vcf_list_file.c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open the VCF list file " + vcf_list_file);
+    std::string line;
+    while (std::getline(input, line))
+      if (!line.empty())
+	vcf_files.push_back(line);
+    input.close();
+  }
+  for (unsigned int i = 0; i < vcf_files.size(); i++)
+    if (vcf_files[i].compare(out_vcf) == 0)
+      printErrorAndDie("The merged VCF can't overwrite one of the shards' VCFs");
+
+  std::vector<std::string> stutter_files;
+  if (!stutter_string.empty()){
+    split_by_delim(stutter_string, ',', stutter_files);
+    if (stutter_files.size() != vcf_files.size())
+      printErrorAndDie("The number of stutter model files must match the number of VCFs");
+  }
+
+  VCFShardMerger merger(out_vcf);
+  for (unsigned int i = 0; i < vcf_files.size(); i++){
+    merger.add_shard(vcf_files[i]);
+    std::cerr << "Merged shard " << i+1 << " of " << vcf_files.size() << ": " << vcf_files[i] << std::endl;
+  }
+  merger.finish();
+  std::cerr << "Merged " << merger.num_records() << " records from " << merger.num_shards() << " shards into " << out_vcf << std::endl;
+
+  if (!stutter_files.empty()){
+    int64_t num_models = merge_stutter_models(stutter_files, stutter_out);
+    std::cerr << "Merged " << num_models << " stutter models into " << stutter_out << std::endl;
+  }
+  return 0;
+}
@@ -17,6 +17,11 @@ class MutationModel {
     log_mut_prior_ = -log10(2) - log10(str_variant.num_alleles()-1);
   }
 
+  MutationModel(int num_alleles){
+    assert(num_alleles > 1);
+    log_mut_prior_ = -log10(2) - log10(num_alleles-1);
+  }
+
   /*
    * Log10-likelihood of mutating from the parental to the child allele,
    * given that a mutation occurred
@@ -0,0 +1,500 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "error.h"
+#include "read_checkpoint.h"
+
+static const char     CHECKPOINT_MAGIC[8]  = {'H', 'I', 'P', 'S', 'T', 'R', 'C', 'K'};
+static const uint32_t CHECKPOINT_VERSION   = 3;
+static const size_t   CHECKPOINT_ALIGNMENT = 8;
+static const size_t   CHECKPOINT_TRAILER   = 4*sizeof(uint64_t) + sizeof(CHECKPOINT_MAGIC);
+
+void ReadCheckpointWriter::write_bytes(const void* data, size_t num_bytes){
+  out_.write((const char*)data, num_bytes);
+  if (!out_.good())
+    printErrorAndDie("Failed to write to the checkpoint file " + filename_);
+  offset_ += num_bytes;
+}
+
+void ReadCheckpointWriter::pad_to_alignment(){
+  const char zeros[CHECKPOINT_ALIGNMENT] = {0};
+  if (offset_ % CHECKPOINT_ALIGNMENT != 0)
+    write_bytes(zeros, CHECKPOINT_ALIGNMENT - offset_%CHECKPOINT_ALIGNMENT);
+}
+
+void ReadCheckpointWriter::append_string(const std::string& value){
+  uint32_t length = value.size();
+  append(length);
+  record_.append(value);
+}
+
+void ReadCheckpointWriter::append_doubles(const std::vector<double>& values){
+  uint32_t num_values = values.size();
+  append(num_values);
+  record_.append((const char*)values.data(), values.size()*sizeof(double));
+}
+
+void get_stutter_params(StutterModel& stutter_model, std::vector<double>& params){
+  params.clear();
+  params.push_back(stutter_model.get_parameter(true,  'P'));
+  params.push_back(stutter_model.get_parameter(true,  'U'));
+  params.push_back(stutter_model.get_parameter(true,  'D'));
+  params.push_back(stutter_model.get_parameter(false, 'P'));
+  params.push_back(stutter_model.get_parameter(false, 'U'));
+  params.push_back(stutter_model.get_parameter(false, 'D'));
+  params.push_back(stutter_model.period());
+}
+
+void get_stored_alignments(std::vector<CheckpointLocus>& batches, const std::string& signature, StutterModel& stutter_model,
+			   std::vector<PooledAlignments>& stored, std::vector<int>& read_groups, std::vector<int>& read_pools,
+			   int32_t& num_stored, int32_t& num_rescored){
+  std::vector<double> stutter_params;
+  get_stutter_params(stutter_model, stutter_params);
+  stored.clear();
+  read_groups.clear();
+  read_pools.clear();
+  num_stored = num_rescored = 0;
+  for (unsigned int i = 0; i < batches.size(); i++){
+    bool reuse   = (!signature.empty() && batches[i].signature.compare(signature) == 0);
+    bool rescore = (batches[i].stutter_params != stutter_params);
+    for (auto sample_iter = batches[i].samples.begin(); sample_iter != batches[i].samples.end(); sample_iter++){
+      read_groups.insert(read_groups.end(), sample_iter->alns.size(), (reuse ? (int)stored.size() : -1));
+      read_pools.insert(read_pools.end(), sample_iter->read_pools.begin(), sample_iter->read_pools.end());
+      if (reuse){
+	num_stored   += sample_iter->alns.size();
+	num_rescored += (rescore ? sample_iter->alns.size() : 0);
+      }
+    }
+    if (reuse){
+      stored.push_back(PooledAlignments());
+      std::swap(stored.back(), batches[i].pooled);
+      stored.back().rescore = rescore;
+    }
+  }
+}
+
+void ReadCheckpointWriter::open(const std::string& filename, const std::vector<std::string>& sample_names){
+  if (out_.is_open())
+    printErrorAndDie("Cannot reopen the checkpoint file " + filename_);
+  filename_ = filename;
+  out_.open(filename.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!out_.is_open())
+    printErrorAndDie("Failed to open the checkpoint file " + filename);
+
+  offset_ = 0;
+  sample_indices_.clear();
+  uint32_t num_samples = sample_names.size();
+  write_bytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  write_bytes(&CHECKPOINT_VERSION, sizeof(CHECKPOINT_VERSION));
+  write_bytes(&num_samples, sizeof(num_samples));
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    sample_indices_[sample_names[i]] = i;
+    write_bytes(sample_names[i].c_str(), sample_names[i].size()+1);
+  }
+  pad_to_alignment();
+}
+
+void ReadCheckpointWriter::add_locus(const Region& region, const std::vector<std::string>& sample_names, const std::vector<Alignment>& alns,
+				     const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+				     const std::vector<int>& bp_diffs, const std::vector<bool>& use_for_haps,
+				     const std::vector< std::vector<int> >& em_bp_diffs,
+				     const std::vector< std::vector<double> >& em_log_p1s, const std::vector< std::vector<double> >& em_log_p2s,
+				     int32_t vcf_pos, const std::vector<std::string>& alleles, const std::string& signature, StutterModel* stutter_model,
+				     const PooledAlignments* pooled, const std::vector<int>& read_pools){
+  if (log_p1s.size() != sample_names.size() || log_p2s.size() != sample_names.size())
+    printErrorAndDie("Number of samples for the locus doesn't match the number of samples with phasing likelihoods in the checkpoint");
+  if (alns.size() != bp_diffs.size() || alns.size() != use_for_haps.size() || (pooled != NULL && alns.size() != read_pools.size()))
+    printErrorAndDie("Inconsistent number of reads for the checkpoint file");
+
+  auto chrom_iter = chrom_indices_.find(region.chrom());
+  if (chrom_iter == chrom_indices_.end()){
+    chrom_iter = chrom_indices_.insert(std::pair<std::string, int32_t>(region.chrom(), chroms_.size())).first;
+    chroms_.push_back(region.chrom());
+  }
+
+  // Reads that were pooled while genotyping and that share an alignment are stored as a single pooled read
+  std::map<std::pair<int, std::string>, int32_t> unit_indices;
+  std::vector<int32_t> read_units(alns.size());
+  std::vector<int> unit_reads, unit_pools;
+  for (unsigned int i = 0; i < alns.size(); i++){
+    std::stringstream key;
+    key << alns[i].get_start() << ":" << alns[i].get_stop() << ":" << alns[i].get_sequence() << ":" << alns[i].get_alignment() << ":" << alns[i].getCigarString();
+    int pool = (pooled != NULL ? read_pools[i] : -1);
+    auto unit_iter = unit_indices.find(std::pair<int, std::string>(pool, key.str()));
+    if (unit_iter == unit_indices.end()){
+      unit_iter = unit_indices.insert(std::pair<std::pair<int, std::string>, int32_t>(std::pair<int, std::string>(pool, key.str()), unit_reads.size())).first;
+      unit_reads.push_back(i);
+      unit_pools.push_back(pool);
+    }
+    read_units[i] = unit_iter->second;
+  }
+
+  // Samples without any reads aren't recorded
+  int32_t num_samples_with_reads = 0;
+  for (unsigned int i = 0; i < log_p1s.size(); i++)
+    if (!log_p1s[i].empty() || (i < em_bp_diffs.size() && !em_bp_diffs[i].empty()))
+      num_samples_with_reads++;
+
+  int32_t num_alleles = alleles.size(), num_units = unit_reads.size();
+  bool have_probs     = (pooled != NULL);
+  bool have_emissions = (have_probs && !pooled->emissions.empty());
+  if (have_probs && pooled->allele_seqs.size() != alleles.size())
+    printErrorAndDie("Number of aligned alleles doesn't match the number of alleles in the checkpoint");
+  record_.clear();
+  append(chrom_iter->second);
+  append(region.start());
+  append(region.stop());
+  append(vcf_pos);
+  append(num_alleles);
+  append(num_samples_with_reads);
+  append(num_units);
+  append((uint8_t)(have_probs ? 1 : 0));
+  append((uint8_t)(have_emissions ? 1 : 0));
+  for (unsigned int i = 0; i < alleles.size(); i++)
+    append_string(alleles[i]);
+  if (have_probs){
+    std::vector<double> stutter_params;
+    get_stutter_params(*stutter_model, stutter_params);
+    append_string(signature);
+    append_doubles(stutter_params);
+    for (unsigned int i = 0; i < pooled->allele_seqs.size(); i++)
+      append_string(pooled->allele_seqs[i]);
+  }
+
+  for (int32_t i = 0; i < num_units; i++){
+    const Alignment& aln = alns[unit_reads[i]];
+    append(aln.get_start());
+    append(aln.get_stop());
+    append_string(aln.get_sequence());
+    append_string(have_probs ? pooled->alns[unit_pools[i]].get_base_qualities() : "");
+    append_string(aln.get_alignment());
+    const std::vector<CigarElement>& cigar_list = aln.get_cigar_list();
+    append((int32_t)cigar_list.size());
+    for (auto cigar_iter = cigar_list.begin(); cigar_iter != cigar_list.end(); cigar_iter++){
+      append(cigar_iter->get_type());
+      append((int32_t)cigar_iter->get_num());
+    }
+    if (have_probs){
+      append((int32_t)pooled->seed_positions[unit_pools[i]]);
+      record_.append((const char*)(pooled->log_aln_probs.data() + (size_t)unit_pools[i]*num_alleles), num_alleles*sizeof(double));
+    }
+  }
+
+  if (have_emissions){
+    size_t num_pools = pooled->alns.size();
+    for (int32_t j = 0; j < num_alleles; j++){
+      for (int32_t i = 0; i < num_units; i++){
+	const StutterEmissions* emissions = &pooled->emissions[2*(j*num_pools + unit_pools[i])];
+	for (int k = 0; k < 2; k++){
+	  append_doubles(emissions[k].block_lls);
+	  append_doubles(emissions[k].pre_block_lls);
+	  append_doubles(emissions[k].flank_lls);
+	}
+      }
+    }
+  }
+
+  unsigned int read_index = 0;
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    int32_t num_reads    = log_p1s[i].size();
+    int32_t num_em_reads = (i < em_bp_diffs.size() ? em_bp_diffs[i].size() : 0);
+    if (num_reads == 0 && num_em_reads == 0)
+      continue;
+
+    auto sample_iter = sample_indices_.find(sample_names[i]);
+    if (sample_iter == sample_indices_.end())
+      printErrorAndDie("Sample " + sample_names[i] + " is not in the checkpoint file's sample list");
+    append(sample_iter->second);
+    append(num_reads);
+    append(num_em_reads);
+
+    for (int32_t j = 0; j < num_em_reads; j++){
+      append((int32_t)em_bp_diffs[i][j]);
+      append(em_log_p1s[i][j]);
+      append(em_log_p2s[i][j]);
+    }
+
+    for (int32_t j = 0; j < num_reads; j++, read_index++){
+      if (read_index >= alns.size())
+	printErrorAndDie("Number of reads for the locus doesn't match the number of phasing likelihoods in the checkpoint");
+      append_string(alns[read_index].get_name());
+      append(read_units[read_index]);
+      append_string(alns[read_index].get_base_qualities());
+      append(log_p1s[i][j]);
+      append(log_p2s[i][j]);
+      append((int32_t)bp_diffs[read_index]);
+      append((uint8_t)(use_for_haps[read_index] ? 1 : 0));
+    }
+  }
+  if (read_index != alns.size())
+    printErrorAndDie("Number of reads for the locus doesn't match the number of phasing likelihoods in the checkpoint");
+
+  index_chroms_.push_back(chrom_iter->second);
+  index_starts_.push_back(region.start());
+  index_stops_.push_back(region.stop());
+  index_offsets_.push_back(offset_);
+  write_bytes(record_.data(), record_.size());
+  pad_to_alignment();
+  record_.clear();
+}
+
+void ReadCheckpointWriter::close(){
+  if (!out_.is_open())
+    return;
+
+  uint64_t chrom_offset = offset_;
+  for (auto chrom_iter = chroms_.begin(); chrom_iter != chroms_.end(); chrom_iter++)
+    write_bytes(chrom_iter->c_str(), chrom_iter->size()+1);
+  pad_to_alignment();
+
+  uint64_t index_offset = offset_;
+  for (unsigned int i = 0; i < index_offsets_.size(); i++){
+    write_bytes(&index_chroms_[i],  sizeof(int32_t));
+    write_bytes(&index_starts_[i],  sizeof(int32_t));
+    write_bytes(&index_stops_[i],   sizeof(int32_t));
+    write_bytes(&index_offsets_[i], sizeof(uint64_t));
+  }
+
+  uint64_t trailer[4] = {chrom_offset, chroms_.size(), index_offset, index_offsets_.size()};
+  write_bytes(trailer, sizeof(trailer));
+  write_bytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  out_.close();
+
+  chrom_indices_.clear();
+  chroms_.clear();
+  index_chroms_.clear();
+  index_starts_.clear();
+  index_stops_.clear();
+  index_offsets_.clear();
+}
+
+/* Sequentially extracts the values in a checkpoint record, ensuring that they don't extend past the end of the file */
+class CheckpointCursor {
+ private:
+  const char* ptr_;
+  const char* end_;
+  const std::string& filename_;
+
+  void require(size_t num_bytes){
+    if ((size_t)(end_ - ptr_) < num_bytes)
+      printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+  }
+
+ public:
+  CheckpointCursor(const char* ptr, const char* end, const std::string& filename) : ptr_(ptr), end_(end), filename_(filename){}
+
+  template<typename T> T next(){
+    T value;
+    require(sizeof(T));
+    memcpy(&value, ptr_, sizeof(T));
+    ptr_ += sizeof(T);
+    return value;
+  }
+
+  std::string next_string(){
+    uint32_t length = next<uint32_t>();
+    require(length);
+    std::string value(ptr_, length);
+    ptr_ += length;
+    return value;
+  }
+
+  /* Ensures that NUM_ENTRIES entries of at least MIN_BYTES each could fit in the rest of the file before they're allocated */
+  void require_entries(uint64_t num_entries, size_t min_bytes){
+    if (num_entries > (uint64_t)(end_ - ptr_)/min_bytes)
+      printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+  }
+
+  void next_doubles(uint32_t num_values, std::vector<double>& values){
+    require((size_t)num_values*sizeof(double));
+    size_t prev_size = values.size();
+    values.resize(prev_size + num_values);
+    memcpy(values.data()+prev_size, ptr_, num_values*sizeof(double));
+    ptr_ += num_values*sizeof(double);
+  }
+};
+
+const char* ReadCheckpointReader::read_name(const char* ptr, const char* end, std::string& name) const {
+  const char* name_end = (ptr < end ? (const char*)memchr(ptr, '\0', end-ptr) : NULL);
+  if (name_end == NULL)
+    printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+  name.assign(ptr, name_end-ptr);
+  return name_end+1;
+}
+
+ReadCheckpointReader::ReadCheckpointReader(const std::string& filename){
+  filename_ = filename;
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ == -1)
+    printErrorAndDie("Failed to open the checkpoint file " + filename);
+  struct stat file_info;
+  if (fstat(fd_, &file_info) != 0)
+    printErrorAndDie("Failed to determine the size of the checkpoint file " + filename);
+  size_ = file_info.st_size;
+
+  size_t header_size = sizeof(CHECKPOINT_MAGIC) + 2*sizeof(uint32_t);
+  if (size_ < header_size + CHECKPOINT_TRAILER)
+    printErrorAndDie("Checkpoint file " + filename + " is truncated or malformed");
+  void* data = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (data == MAP_FAILED)
+    printErrorAndDie("Failed to memory map the checkpoint file " + filename);
+  data_ = (const char*)data;
+
+  if (memcmp(data_, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 || memcmp(data_+size_-sizeof(CHECKPOINT_MAGIC), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+    printErrorAndDie("Checkpoint file " + filename + " is truncated or malformed");
+  uint32_t version, num_samples;
+  memcpy(&version,     data_+sizeof(CHECKPOINT_MAGIC), sizeof(uint32_t));
+  memcpy(&num_samples, data_+sizeof(CHECKPOINT_MAGIC)+sizeof(uint32_t), sizeof(uint32_t));
+  if (version != CHECKPOINT_VERSION)
+    printErrorAndDie("Unsupported version of the checkpoint file " + filename);
+
+  // The names and the index must lie between the header and the trailer
+  const char* trailer_ptr = data_ + size_ - CHECKPOINT_TRAILER;
+  const char* name_ptr    = data_ + header_size;
+  for (uint32_t i = 0; i < num_samples; i++){
+    samples_.push_back("");
+    name_ptr = read_name(name_ptr, trailer_ptr, samples_.back());
+  }
+
+  uint64_t trailer[4];
+  memcpy(trailer, trailer_ptr, sizeof(trailer));
+  size_t data_size = trailer_ptr - data_;
+  if (trailer[0] < header_size || trailer[0] > data_size || trailer[1] > data_size || trailer[2] < trailer[0] || trailer[2] > data_size)
+    printErrorAndDie("Checkpoint file " + filename + " is truncated or malformed");
+  name_ptr = data_ + trailer[0];
+  for (uint64_t i = 0; i < trailer[1]; i++){
+    std::string chrom;
+    name_ptr = read_name(name_ptr, data_ + trailer[2], chrom);
+    chrom_indices_[chrom] = i;
+  }
+
+  const size_t entry_size = 3*sizeof(int32_t) + sizeof(uint64_t);
+  if (trailer[3] > (data_size - trailer[2])/entry_size)
+    printErrorAndDie("Checkpoint file " + filename + " is truncated or malformed");
+  const char* index_ptr = data_ + trailer[2];
+  for (uint64_t i = 0; i < trailer[3]; i++, index_ptr += entry_size){
+    int32_t chrom_index, start, stop;
+    uint64_t offset;
+    memcpy(&chrom_index, index_ptr,                   sizeof(int32_t));
+    memcpy(&start,       index_ptr+sizeof(int32_t),   sizeof(int32_t));
+    memcpy(&stop,        index_ptr+2*sizeof(int32_t), sizeof(int32_t));
+    memcpy(&offset,      index_ptr+3*sizeof(int32_t), sizeof(uint64_t));
+    if (chrom_index < 0 || chrom_index >= trailer[1] || offset < header_size || offset >= trailer[0])
+      printErrorAndDie("Checkpoint file " + filename + " is truncated or malformed");
+    locus_offsets_[std::pair<int32_t, std::pair<int32_t, int32_t> >(chrom_index, std::pair<int32_t, int32_t>(start, stop))] = offset;
+  }
+}
+
+ReadCheckpointReader::~ReadCheckpointReader(){
+  munmap((void*)data_, size_);
+  close(fd_);
+}
+
+bool ReadCheckpointReader::get_locus(const Region& region, CheckpointLocus& locus) const {
+  auto chrom_iter = chrom_indices_.find(region.chrom());
+  if (chrom_iter == chrom_indices_.end())
+    return false;
+  auto locus_iter = locus_offsets_.find(std::pair<int32_t, std::pair<int32_t, int32_t> >(chrom_iter->second, std::pair<int32_t, int32_t>(region.start(), region.stop())));
+  if (locus_iter == locus_offsets_.end())
+    return false;
+
+  CheckpointCursor cursor(data_ + locus_iter->second, data_ + size_ - CHECKPOINT_TRAILER, filename_);
+  cursor.next<int32_t>(); cursor.next<int32_t>(); cursor.next<int32_t>(); // Chrom index, start and stop
+  locus.vcf_pos           = cursor.next<int32_t>();
+  int32_t num_alleles     = cursor.next<int32_t>();
+  int32_t num_samples     = cursor.next<int32_t>();
+  int32_t num_units       = cursor.next<int32_t>();
+  bool have_probs         = (cursor.next<uint8_t>() != 0);
+  bool have_emissions     = (cursor.next<uint8_t>() != 0);
+  if (num_alleles < 0 || num_samples < 0 || num_units < 0 || (have_emissions && !have_probs))
+    printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+  locus.alleles.clear();
+  for (int32_t i = 0; i < num_alleles; i++)
+    locus.alleles.push_back(cursor.next_string());
+
+  locus.signature.clear();
+  locus.stutter_params.clear();
+  locus.pooled = PooledAlignments();
+  PooledAlignments& pooled = locus.pooled;
+  if (have_probs){
+    locus.signature = cursor.next_string();
+    cursor.next_doubles(cursor.next<uint32_t>(), locus.stutter_params);
+    for (int32_t i = 0; i < num_alleles; i++)
+      pooled.allele_seqs.push_back(cursor.next_string());
+  }
+
+  // Pooled reads are stored with the base qualities used to align them, while the qualities of the reads they represent are stored with each read
+  cursor.require_entries(num_units, 6*sizeof(int32_t));
+  pooled.alns.reserve(num_units);
+  for (int32_t i = 0; i < num_units; i++){
+    int32_t start         = cursor.next<int32_t>();
+    int32_t stop          = cursor.next<int32_t>();
+    std::string sequence  = cursor.next_string();
+    std::string qualities = cursor.next_string();
+    std::string alignment = cursor.next_string();
+    std::vector<CigarElement> cigar_list;
+    int32_t num_cigars    = cursor.next<int32_t>();
+    for (int32_t k = 0; k < num_cigars; k++){
+      char type = cursor.next<char>();
+      cigar_list.push_back(CigarElement(type, cursor.next<int32_t>()));
+    }
+    pooled.alns.push_back(Alignment(start, stop, "READPOOL", qualities, sequence, alignment));
+    pooled.alns.back().set_cigar_list(cigar_list);
+    if (have_probs){
+      if (qualities.size() != sequence.size())
+	printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+      pooled.seed_positions.push_back(cursor.next<int32_t>());
+      cursor.next_doubles(num_alleles, pooled.log_aln_probs);
+    }
+  }
+
+  if (have_emissions){
+    cursor.require_entries(2*(uint64_t)num_alleles*num_units, 3*sizeof(uint32_t));
+    pooled.emissions.resize(2*(size_t)num_alleles*num_units);
+    for (auto emission_iter = pooled.emissions.begin(); emission_iter != pooled.emissions.end(); emission_iter++){
+      cursor.next_doubles(cursor.next<uint32_t>(), emission_iter->block_lls);
+      cursor.next_doubles(cursor.next<uint32_t>(), emission_iter->pre_block_lls);
+      cursor.next_doubles(cursor.next<uint32_t>(), emission_iter->flank_lls);
+    }
+  }
+
+  cursor.require_entries(num_samples, 3*sizeof(int32_t));
+  locus.samples = std::vector<CheckpointSample>(num_samples);
+  for (int32_t i = 0; i < num_samples; i++){
+    CheckpointSample& sample = locus.samples[i];
+    int32_t sample_index = cursor.next<int32_t>();
+    if (sample_index < 0 || sample_index >= samples_.size())
+      printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+    sample.name          = samples_[sample_index];
+    int32_t num_reads    = cursor.next<int32_t>();
+    int32_t num_em_reads = cursor.next<int32_t>();
+
+    for (int32_t j = 0; j < num_em_reads; j++){
+      sample.em_bp_diffs.push_back(cursor.next<int32_t>());
+      sample.em_log_p1.push_back(cursor.next<double>());
+      sample.em_log_p2.push_back(cursor.next<double>());
+    }
+
+    for (int32_t j = 0; j < num_reads; j++){
+      std::string name      = cursor.next_string();
+      int32_t unit          = cursor.next<int32_t>();
+      std::string qualities = cursor.next_string();
+      if (unit < 0 || unit >= num_units || qualities.size() != pooled.alns[unit].get_sequence().size())
+	printErrorAndDie("Checkpoint file " + filename_ + " is truncated or malformed");
+      const Alignment& unit_aln = pooled.alns[unit];
+      sample.alns.push_back(Alignment(unit_aln.get_start(), unit_aln.get_stop(), name, qualities, unit_aln.get_sequence(), unit_aln.get_alignment()));
+      sample.alns.back().set_cigar_list(unit_aln.get_cigar_list());
+      sample.read_pools.push_back(unit);
+      sample.log_p1.push_back(cursor.next<double>());
+      sample.log_p2.push_back(cursor.next<double>());
+      sample.bp_diffs.push_back(cursor.next<int32_t>());
+      sample.use_for_haps.push_back(cursor.next<uint8_t>() != 0);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,157 @@
+#ifndef READ_CHECKPOINT_H_
+#define READ_CHECKPOINT_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "region.h"
+#include "seq_stutter_genotyper.h"
+#include "stutter_model.h"
+#include "SeqAlignment/AlignmentData.h"
+
+/*
+ * Binary checkpoint containing the data HipSTR needs to jointly genotype each locus without revisiting the BAMs:
+ * each sample's left-aligned reads and phasing likelihoods, the read length differences used to train the stutter model
+ * and, if the locus was genotyped, its alleles and the haplotype alignments of each pooled read. Reads pooled while genotyping
+ * that share an alignment are stored once, so that each read only stores its name, base qualities and phasing likelihoods.
+ * Checkpoints from separate batches of samples can then be merged to genotype the combined cohort.
+ *
+ * Layout (native byte order, records 8-byte aligned):
+ *   Header:  "HIPSTRCK", uint32 version, uint32 number of samples, null-terminated sample names
+ *   Records: int32 chrom index, int32 start, int32 stop, int32 VCF position, int32 number of alleles, int32 number of samples,
+ *            int32 number of pooled reads, uint8 likelihoods flag, uint8 stutter terms flag, alleles,
+ *            [haplotype signature, stutter model parameters, repeat block sequence of each allele] if the likelihoods flag is set,
+ *            {int32 start, int32 stop, sequence, qualities, alignment, int32 number of CIGAR elements, {char type, int32 length} for each element,
+ *             [int32 seed position, double log-likelihood for each allele]} for each pooled read,
+ *            [{uint32 number of values, doubles} for the block, pre-block and flank terms on the left and right of the seed for each allele and pooled read]
+ *            if the stutter terms flag is set, then for each sample with reads:
+ *            int32 sample index, int32 number of reads, int32 number of stutter training reads,
+ *            {int32 bp diff, double log_p1, double log_p2} for each stutter training read,
+ *            {name, int32 pooled read index, qualities, double log_p1, double log_p2, int32 bp diff, uint8 use for haplotypes} for each read
+ *   Footer:  null-terminated chromosome names, {int32 chrom index, int32 start, int32 stop, uint64 record offset} for each record
+ *   Trailer: uint64 chromosome names offset, uint64 number of chromosomes, uint64 footer index offset,
+ *            uint64 number of records, "HIPSTRCK"
+ * Strings within records are stored as a uint32 length followed by their characters
+ */
+
+/* Stores the stutter model's in-frame and out-of-frame geometric, up and down parameters, followed by its period, in PARAMS */
+void get_stutter_params(StutterModel& stutter_model, std::vector<double>& params);
+
+class CheckpointSample {
+ public:
+  std::string name;
+  std::vector<Alignment> alns;            // Left-aligned reads
+  std::vector<double> log_p1, log_p2;     // Phasing log-likelihoods for each read
+  std::vector<int> bp_diffs;              // Base pair difference of each read from the reference, or -999 if unknown
+  std::vector<bool> use_for_haps;         // True iff the read can be used to identify candidate alleles
+  std::vector<int> read_pools;            // Index of each read's pooled read in the locus's pooled alignments
+  std::vector<int> em_bp_diffs;           // Base pair differences of the reads used to train the stutter model
+  std::vector<double> em_log_p1, em_log_p2;
+};
+
+class CheckpointLocus {
+ public:
+  int32_t vcf_pos;                        // 1-based position of the alleles
+  std::vector<std::string> alleles;       // Reference allele first
+  std::string signature;                  // Identifies the haplotype flanks the pooled reads were aligned to. Empty if they weren't aligned
+  std::vector<double> stutter_params;     // Parameters of the stutter model used to align the pooled reads (see get_stutter_params())
+  PooledAlignments pooled;                // Pooled reads, along with their alignments to each allele if SIGNATURE isn't empty
+  std::vector<CheckpointSample> samples;
+
+  CheckpointLocus(){
+    vcf_pos = -1;
+  }
+};
+
+/*
+ * Moves the pooled alignments of each batch whose haplotype signature matches SIGNATURE to STORED, flagging them for rescoring
+ * if they were computed using a different stutter model, and stores the group and pooled read of each of the batches' reads
+ * (ordered by batch and then by sample) in READ_GROUPS and READ_POOLS, as required by SeqStutterGenotyper::set_stored_alignments().
+ * NUM_STORED and NUM_RESCORED are set to the number of reads with stored alignments and the number of those that will be rescored
+ */
+void get_stored_alignments(std::vector<CheckpointLocus>& batches, const std::string& signature, StutterModel& stutter_model,
+			   std::vector<PooledAlignments>& stored, std::vector<int>& read_groups, std::vector<int>& read_pools,
+			   int32_t& num_stored, int32_t& num_rescored);
+
+class ReadCheckpointWriter {
+ private:
+  std::ofstream out_;
+  std::string filename_;
+  uint64_t offset_;
+  std::map<std::string, int32_t> sample_indices_;
+  std::map<std::string, int32_t> chrom_indices_;
+  std::vector<std::string> chroms_;
+  std::vector<int32_t> index_chroms_, index_starts_, index_stops_;
+  std::vector<uint64_t> index_offsets_;
+  std::string record_;
+
+  void write_bytes(const void* data, size_t num_bytes);
+  void pad_to_alignment();
+
+  template<typename T> void append(const T& value){ record_.append((const char*)&value, sizeof(T)); }
+  void append_string(const std::string& value);
+  void append_doubles(const std::vector<double>& values);
+
+ public:
+  ReadCheckpointWriter(){
+    offset_ = 0;
+  }
+
+  ~ReadCheckpointWriter(){
+    close();
+  }
+
+  bool is_open() { return out_.is_open(); }
+
+  void open(const std::string& filename, const std::vector<std::string>& sample_names);
+
+  /*
+   * Adds a record for the locus. The reads in ALNS are ordered by sample, with LOG_P1S[i].size() reads for the sample SAMPLE_NAMES[i],
+   * and the EM vectors contain each sample's stutter training data. If POOLED is NULL, the record only contains the reads. Otherwise,
+   * it also contains the alignments of the pooled reads to each allele, which were computed using STUTTER_MODEL for the haplotype
+   * identified by SIGNATURE, where READ_POOLS[i] is the index of the i-th read's pooled read. Samples without any reads are omitted
+   */
+  void add_locus(const Region& region, const std::vector<std::string>& sample_names, const std::vector<Alignment>& alns,
+		 const std::vector< std::vector<double> >& log_p1s, const std::vector< std::vector<double> >& log_p2s,
+		 const std::vector<int>& bp_diffs, const std::vector<bool>& use_for_haps,
+		 const std::vector< std::vector<int> >& em_bp_diffs,
+		 const std::vector< std::vector<double> >& em_log_p1s, const std::vector< std::vector<double> >& em_log_p2s,
+		 int32_t vcf_pos, const std::vector<std::string>& alleles, const std::string& signature, StutterModel* stutter_model,
+		 const PooledAlignments* pooled, const std::vector<int>& read_pools);
+
+  void close();
+};
+
+class ReadCheckpointReader {
+ private:
+  int fd_;
+  const char* data_;
+  size_t size_;
+  std::string filename_;
+  std::vector<std::string> samples_;
+  std::map<std::string, int32_t> chrom_indices_;
+  std::map< std::pair<int32_t, std::pair<int32_t, int32_t> >, uint64_t> locus_offsets_;
+
+  /* Extracts the null-terminated string at PTR, dying if it isn't terminated before END */
+  const char* read_name(const char* ptr, const char* end, std::string& name) const;
+
+ public:
+  ReadCheckpointReader(const std::string& filename);
+
+  ~ReadCheckpointReader();
+
+  const std::string& filename() const { return filename_; }
+
+  const std::vector<std::string>& get_samples() const { return samples_; }
+
+  int num_loci() const { return locus_offsets_.size(); }
+
+  /* Returns true and fills in the locus iff the checkpoint contains a record for the region */
+  bool get_locus(const Region& region, CheckpointLocus& locus) const;
+};
+
+#endif
@@ -3,18 +3,20 @@
 int32_t ReadPooler::add_alignment(Alignment& aln){
   if (pooled_)
     printErrorAndDie("Cannot call add_alignment function once pool() function has been invoked");
-  
-  auto pool_iter = seq_to_pool_.find(aln.get_sequence());
-  if (pool_iter == seq_to_pool_.end()){
-    seq_to_pool_[aln.get_sequence()] = pool_index_;
+
+  int32_t read_index = quality_starts_.size()-1;
+  quality_arena_.append(aln.get_base_qualities());
+  quality_starts_.push_back(quality_arena_.size());
+
+  auto insert_result = seq_to_pool_.insert(std::pair<std::string, int32_t>(aln.get_sequence(), pool_index_));
+  if (insert_result.second){
     pooled_alns_.push_back(Alignment(aln.get_start(), aln.get_stop(), "READPOOL", "", aln.get_sequence(), aln.get_alignment()));
     pooled_alns_.back().set_cigar_list(aln.get_cigar_list());
-    qualities_by_pool_.push_back(std::vector<const std::string*>());
-    qualities_by_pool_.back().push_back(new std::string(aln.get_base_qualities()));
+    reads_by_pool_.push_back(std::vector<int32_t>(1, read_index));
     return pool_index_++;
   }
   else{
-    qualities_by_pool_[pool_iter->second].push_back(new std::string(aln.get_base_qualities()));
-    return pool_iter->second;
+    reads_by_pool_[insert_result.first->second].push_back(read_index);
+    return insert_result.first->second;
   }  
 }
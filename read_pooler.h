@@ -2,8 +2,10 @@
 #define READ_POOLER_H_
 
 #include <assert.h>
-#include <map>
+#include <stdint.h>
+
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "bamtools/include/api/BamAlignment.h"
@@ -15,8 +17,10 @@
 class ReadPooler {
  private:
   std::vector<Alignment> pooled_alns_;
-  std::vector< std::vector<const std::string*> > qualities_by_pool_;
-  std::map<std::string, int32_t> seq_to_pool_;
+  std::unordered_map<std::string, int32_t> seq_to_pool_;
+  std::string quality_arena_;                      // Base quality strings of all added reads, stored contiguously
+  std::vector<int64_t> quality_starts_;            // Start of each read's qualities in the arena, followed by the arena's size
+  std::vector< std::vector<int32_t> > reads_by_pool_;
   bool pooled_;         // True iff pool() function has been invoked
   int32_t pool_index_;
   
@@ -24,13 +28,7 @@ class ReadPooler {
   ReadPooler(){
     pool_index_ = 0;
     pooled_     = false;
-  }
-
-  ~ReadPooler(){
-    for (unsigned int i = 0; i < qualities_by_pool_.size(); i++)
-      for (unsigned int j = 0; j < qualities_by_pool_[i].size(); j++)
-	delete qualities_by_pool_[i][j];
-    qualities_by_pool_.clear();
+    quality_starts_.push_back(0);
   }
 
   int32_t num_pools(){ return pool_index_; }
@@ -38,11 +36,19 @@ class ReadPooler {
   int32_t add_alignment(Alignment& aln);
 
   void pool(BaseQuality& base_quality){
+    if (pooled_)
+      return;
+
     // For each pooled set of reads, set the base quality at each position to be the median across the set
-    assert(pooled_alns_.size() == qualities_by_pool_.size());
+    assert(pooled_alns_.size() == reads_by_pool_.size());
     for (unsigned int i = 0; i < pooled_alns_.size(); i++)
-      pooled_alns_[i].set_base_qualities(base_quality.median_base_qualities(qualities_by_pool_[i]));
+      pooled_alns_[i].set_base_qualities(base_quality.median_base_qualities(quality_arena_, quality_starts_, reads_by_pool_[i]));
     pooled_ = true;
+
+    // The qualities are no longer needed once each pool's medians have been computed
+    std::string().swap(quality_arena_);
+    std::vector<int64_t>().swap(quality_starts_);
+    std::vector< std::vector<int32_t> >().swap(reads_by_pool_);
   }
 
   std::vector<Alignment>& get_alignments(){
@@ -0,0 +1,137 @@
+#ifndef READ_PREFETCHER_H_
+#define READ_PREFETCHER_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bamtools/include/api/BamAlignment.h"
+
+/*
+ * Reads extracted and filtered for a single region, along with the statistics and log messages generated while extracting them
+ */
+class LocusReads {
+ public:
+  bool skipped;                            // True iff the region was skipped without reading its alignments
+  std::shared_ptr<std::string> chrom_seq;  // Sequence of the region's chromosome, shared by all of the chromosome's regions
+  std::vector<std::string> rg_names;
+  std::vector< std::vector<BamTools::BamAlignment> > paired_strs_by_rg, mate_pairs_by_rg, unpaired_strs_by_rg;
+  double bam_seek_time, read_filter_time;  // In seconds
+  double downsample_frac;
+  bool too_many_reads;
+  std::stringstream log;
+
+  LocusReads(){
+    skipped          = true;
+    bam_seek_time    = 0;
+    read_filter_time = 0;
+    downsample_frac  = 1.0;
+    too_many_reads   = false;
+  }
+};
+
+/*
+ * Loads the reads for the regions with indices in [START, END) on a background thread, staying at most MAX_QUEUED regions
+ * ahead of the consumer, so that seeking and filtering the BAM alignments for upcoming regions overlaps with processing the
+ * current region. Regions are returned in order, and the loader is only ever invoked by the background thread
+ */
+class ReadPrefetcher {
+ private:
+  std::function<void(int32_t, LocusReads&)> loader_;
+  int32_t start_, end_;
+  size_t max_queued_;
+  std::deque<LocusReads*> queue_;
+  std::mutex mutex_;
+  std::condition_variable loaded_cv_, taken_cv_;
+  bool shutdown_;
+  std::thread thread_;
+
+  // Statistics
+  int64_t num_taken_, total_depth_;
+  double stall_time_, idle_time_;  // Time the consumer waited for reads and the loader waited for space in the queue
+
+  void load_loop(){
+    for (int32_t index = start_; index < end_; index++){
+      {
+	std::unique_lock<std::mutex> lock(mutex_);
+	if (queue_.size() >= max_queued_){
+	  std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+	  taken_cv_.wait(lock, [this]{ return shutdown_ || queue_.size() < max_queued_; });
+	  idle_time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+	}
+	if (shutdown_)
+	  return;
+      }
+
+      LocusReads* locus = new LocusReads();
+      loader_(index, *locus);
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(locus);
+      loaded_cv_.notify_one();
+    }
+  }
+
+ public:
+  ReadPrefetcher(int32_t start, int32_t end, int max_queued, const std::function<void(int32_t, LocusReads&)>& loader){
+    loader_      = loader;
+    start_       = start;
+    end_         = end;
+    max_queued_  = (max_queued < 1 ? 1 : max_queued);
+    shutdown_    = false;
+    num_taken_   = 0;
+    total_depth_ = 0;
+    stall_time_  = 0;
+    idle_time_   = 0;
+    thread_      = std::thread(&ReadPrefetcher::load_loop, this);
+  }
+
+  ~ReadPrefetcher(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    taken_cv_.notify_all();
+    thread_.join();
+    for (auto locus_iter = queue_.begin(); locus_iter != queue_.end(); locus_iter++)
+      delete *locus_iter;
+  }
+
+  /* Returns the reads for the next region, blocking until they've been loaded. The caller is responsible for deleting them */
+  LocusReads* next(){
+    std::unique_lock<std::mutex> lock(mutex_);
+    total_depth_ += queue_.size();
+    num_taken_++;
+    if (queue_.empty()){
+      std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+      loaded_cv_.wait(lock, [this]{ return !queue_.empty(); });
+      stall_time_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+    }
+    LocusReads* locus = queue_.front();
+    queue_.pop_front();
+    taken_cv_.notify_one();
+    return locus;
+  }
+
+  int max_queued()    const { return max_queued_; }
+  double stall_time() const { return stall_time_; }
+
+  // The loader's idle time is only final once every region has been taken
+  double idle_time(){
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_time_;
+  }
+
+  // Average number of loaded regions waiting in the queue when the consumer requested the next region
+  double mean_queue_depth() const { return (num_taken_ == 0 ? 0.0 : 1.0*total_depth_/num_taken_); }
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <algorithm>
+
+#include "read_reservoir.h"
+
+std::string ReadReservoir::read_unit_name(const std::string& read_name){
+  if (read_name.size() > 2 && read_name[read_name.size()-2] == '/')
+    return read_name.substr(0, read_name.size()-2);
+  return read_name;
+}
+
+uint64_t ReadReservoir::hash_read_name(const std::string& read_name, int32_t locus_start){
+  // 64-bit FNV-1a hash of the unit name, followed by a finalizer that mixes in the locus so that different reads are retained at each locus
+  std::string unit_name = read_unit_name(read_name);
+  uint64_t hash = 14695981039346656037ULL;
+  for (auto char_iter = unit_name.begin(); char_iter != unit_name.end(); char_iter++){
+    hash ^= (unsigned char)(*char_iter);
+    hash *= 1099511628211ULL;
+  }
+  hash ^= (uint64_t)(uint32_t)locus_start * 0x9E3779B97F4A7C15ULL;
+  hash ^= (hash >> 30);
+  hash *= 0xBF58476D1CE4E5B9ULL;
+  hash ^= (hash >> 27);
+  hash *= 0x94D049BB133111EBULL;
+  hash ^= (hash >> 31);
+  return hash;
+}
+
+void ReadReservoir::emit(const BamTools::BamAlignment& str_aln, const BamTools::BamAlignment* mate_aln, bool mate_spans_str){
+  if (mate_aln == NULL){
+    unpaired_str_alns_.push_back(str_aln);
+    if (region_alns_ != NULL)
+      region_alns_->push_back(str_aln);
+    return;
+  }
+
+  paired_str_alns_.push_back(str_aln);
+  mate_alns_.push_back(*mate_aln);
+  if (mate_spans_str){
+    paired_str_alns_.push_back(*mate_aln);
+    mate_alns_.push_back(str_aln);
+  }
+  if (region_alns_ != NULL){
+    region_alns_->push_back(str_aln);
+    region_alns_->push_back(*mate_aln);
+  }
+}
+
+void ReadReservoir::discard(const BamTools::BamAlignment& str_aln, const BamTools::BamAlignment* mate_aln, bool mate_spans_str){
+  num_discarded_ += (mate_spans_str ? 2 : 1);
+  if (discarded_alns_ != NULL){
+    discarded_alns_->push_back(str_aln);
+    if (mate_spans_str)
+      discarded_alns_->push_back(*mate_aln);
+  }
+}
+
+bool ReadReservoir::rejects(const std::string& sample, const BamTools::BamAlignment& aln){
+  if (max_reads_per_sample_ <= 0)
+    return false;
+  auto sample_iter = reservoirs_.find(sample);
+  if (sample_iter == reservoirs_.end() || sample_iter->second.size() < max_reads_per_sample_)
+    return false;
+  if (hash_read(aln) < sample_iter->second.rbegin()->first.hash)
+    return false;
+  downsampled_[sample] = true;
+  return true;
+}
+
+void ReadReservoir::insert(const std::string& sample, const BamTools::BamAlignment& str_aln,
+			   const BamTools::BamAlignment* mate_aln, bool mate_spans_str){
+  if (max_reads_per_sample_ <= 0){
+    emit(str_aln, mate_aln, mate_spans_str);
+    return;
+  }
+  if (rejects(sample, str_aln)){
+    discard(str_aln, mate_aln, mate_spans_str);
+    return;
+  }
+
+  std::map<ReservoirKey, ReservoirEntry>& reservoir = reservoirs_[sample];
+  ReservoirEntry& entry = reservoir[ReservoirKey(hash_read(str_aln), next_order_++)];
+  entry.str_aln        = str_aln;
+  entry.paired         = (mate_aln != NULL);
+  entry.mate_spans_str = mate_spans_str;
+  if (mate_aln != NULL){
+    entry.mate_aln = *mate_aln;
+    num_paired_str_reads_ += (mate_spans_str ? 2 : 1);
+  }
+
+  if (reservoir.size() > max_reads_per_sample_){
+    auto evict_iter = --reservoir.end();
+    const ReservoirEntry& evicted = evict_iter->second;
+    if (evicted.paired)
+      num_paired_str_reads_ -= (evicted.mate_spans_str ? 2 : 1);
+    discard(evicted.str_aln, (evicted.paired ? &(evicted.mate_aln) : NULL), evicted.mate_spans_str);
+    reservoir.erase(evict_iter);
+    downsampled_[sample] = true;
+  }
+}
+
+double ReadReservoir::finish(){
+  if (max_reads_per_sample_ <= 0)
+    return 1.0;
+
+  // Emit the retained units in the order in which they were added
+  std::vector< std::pair<int64_t, const ReservoirEntry*> > entries;
+  double num_retained = 0, num_estimated = 0;
+  for (auto sample_iter = reservoirs_.begin(); sample_iter != reservoirs_.end(); sample_iter++){
+    for (auto entry_iter = sample_iter->second.begin(); entry_iter != sample_iter->second.end(); entry_iter++)
+      entries.push_back(std::pair<int64_t, const ReservoirEntry*>(entry_iter->first.order, &(entry_iter->second)));
+
+    double num_units = sample_iter->second.size();
+    num_retained += num_units;
+    if (downsampled_.find(sample_iter->first) != downsampled_.end()){
+      // The K smallest of N uniform hashes have a largest value of ~K/N
+      double max_hash = (sample_iter->second.rbegin()->first.hash + 1.0)/18446744073709551616.0;
+      num_units = std::max(num_units, (num_units > 1 ? num_units-1 : 1)/max_hash);
+    }
+    num_estimated += num_units;
+  }
+  std::sort(entries.begin(), entries.end());
+  for (auto entry_iter = entries.begin(); entry_iter != entries.end(); entry_iter++){
+    const ReservoirEntry* entry = entry_iter->second;
+    emit(entry->str_aln, (entry->paired ? &(entry->mate_aln) : NULL), entry->mate_spans_str);
+  }
+  reservoirs_.clear();
+  downsampled_.clear();
+  num_paired_str_reads_ = 0;
+  return (num_estimated == 0 ? 1.0 : num_retained/num_estimated);
+}
@@ -0,0 +1,124 @@
+#ifndef READ_RESERVOIR_H_
+#define READ_RESERVOIR_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bamtools/include/api/BamAlignment.h"
+
+/*
+ * Collects the STR reads (and their mate pairs) that pass the BamProcessor's filters for a locus.
+ *
+ * If MAX_READS_PER_SAMPLE is 0, reads are appended to the output vectors as soon as they're added. Otherwise, each sample
+ * retains at most MAX_READS_PER_SAMPLE read units, where a unit is an STR read together with its mate pair. Each unit is assigned
+ * a deterministic 64-bit hash of its read name, and a sample's reservoir keeps the units with the smallest hashes. Mates therefore
+ * share a fate, and the retained reads don't depend on the order in which the reads were encountered, so reruns are reproducible.
+ * Because the reservoir's largest hash only decreases as more units are added, any read whose hash is at least as large
+ * can be discarded as soon as it's encountered, bounding the number of reads held for each sample.
+ * Every read is hashed using read_unit_name(), so a read checked with rejects() and its mate pair added with add_pair() share a hash
+ */
+class ReadReservoir {
+ private:
+  class ReservoirKey {
+  public:
+    uint64_t hash;
+    int64_t order;
+    ReservoirKey(uint64_t unit_hash, int64_t unit_order){ hash = unit_hash; order = unit_order; }
+    bool operator<(const ReservoirKey& other) const {
+      return (hash != other.hash ? hash < other.hash : order < other.order);
+    }
+  };
+
+  class ReservoirEntry {
+  public:
+    BamTools::BamAlignment str_aln, mate_aln;
+    bool paired, mate_spans_str;
+  };
+
+  int32_t max_reads_per_sample_;
+  int32_t locus_start_;
+  int64_t next_order_;
+  int64_t num_paired_str_reads_;  // Paired STR reads held by the reservoirs
+  int64_t num_discarded_;         // STR reads rejected or evicted by the reservoirs
+  std::map<std::string, std::map<ReservoirKey, ReservoirEntry> > reservoirs_;
+  std::map<std::string, bool> downsampled_;  // Samples for which at least one unit was evicted or rejected
+
+  std::vector<BamTools::BamAlignment>& paired_str_alns_;
+  std::vector<BamTools::BamAlignment>& mate_alns_;
+  std::vector<BamTools::BamAlignment>& unpaired_str_alns_;
+  std::vector<BamTools::BamAlignment>* region_alns_;
+  std::vector<BamTools::BamAlignment>* discarded_alns_;
+
+  uint64_t hash_read(const BamTools::BamAlignment& aln) const { return hash_read_name(aln.Name, locus_start_); }
+
+  void discard(const BamTools::BamAlignment& str_aln, const BamTools::BamAlignment* mate_aln, bool mate_spans_str);
+
+  void emit(const BamTools::BamAlignment& str_aln, const BamTools::BamAlignment* mate_aln, bool mate_spans_str);
+
+  void insert(const std::string& sample, const BamTools::BamAlignment& str_aln,
+	      const BamTools::BamAlignment* mate_aln, bool mate_spans_str);
+
+ public:
+  /*
+   * Retained reads are written to the provided vectors, in the order in which they were added. If REGION_ALNS is not NULL,
+   * it receives each retained STR read followed by its mate pair, or just the STR read if it's unpaired.
+   * If DISCARDED_ALNS is not NULL, it receives the STR reads of each unit that's rejected or evicted from a reservoir
+   */
+  ReadReservoir(int32_t max_reads_per_sample, int32_t locus_start,
+		std::vector<BamTools::BamAlignment>& paired_str_alns, std::vector<BamTools::BamAlignment>& mate_alns,
+		std::vector<BamTools::BamAlignment>& unpaired_str_alns, std::vector<BamTools::BamAlignment>* region_alns,
+		std::vector<BamTools::BamAlignment>* discarded_alns)
+    : paired_str_alns_(paired_str_alns), mate_alns_(mate_alns), unpaired_str_alns_(unpaired_str_alns){
+    max_reads_per_sample_ = max_reads_per_sample;
+    locus_start_          = locus_start;
+    next_order_           = 0;
+    num_paired_str_reads_ = 0;
+    num_discarded_        = 0;
+    region_alns_          = region_alns;
+    discarded_alns_       = discarded_alns;
+  }
+
+  bool bounded() const { return max_reads_per_sample_ > 0; }
+
+  /* Name shared by both reads in a read pair, which excludes any /1 or /2 suffix */
+  static std::string read_unit_name(const std::string& read_name);
+
+  /* Deterministic hash of a read's unit name, used to rank the read units at a locus */
+  static uint64_t hash_read_name(const std::string& read_name, int32_t locus_start);
+
+  /*
+   * Returns true iff the unit containing ALN would immediately be evicted from the sample's reservoir,
+   * in which case the caller can discard any of the unit's reads without adding them
+   */
+  bool rejects(const std::string& sample, const BamTools::BamAlignment& aln);
+
+  /*
+   * Adds an STR read and its mate pair. If MATE_SPANS_STR is true, the mate is also an STR read
+   * and is added as a paired STR read whose mate pair is STR_ALN
+   */
+  void add_pair(const std::string& sample, const BamTools::BamAlignment& str_aln,
+		const BamTools::BamAlignment& mate_aln, bool mate_spans_str){
+    insert(sample, str_aln, &mate_aln, mate_spans_str);
+  }
+
+  void add_unpaired(const std::string& sample, const BamTools::BamAlignment& str_aln){
+    insert(sample, str_aln, NULL, false);
+  }
+
+  /* Number of paired STR reads that have been emitted or are held by the reservoirs */
+  int64_t num_paired_str_reads() const { return paired_str_alns_.size() + num_paired_str_reads_; }
+
+  /* Number of STR reads that were added but rejected or evicted by the reservoirs */
+  int64_t num_discarded() const { return num_discarded_; }
+
+  /*
+   * Writes the retained reads to the output vectors and returns the estimated fraction of the locus' read units that were retained.
+   * For each downsampled sample, the number of units is estimated from the largest retained hash (the K-minimum values estimator)
+   */
+  double finish();
+};
+
+#endif
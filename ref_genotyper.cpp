@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <math.h>
+
+#include <set>
+
+#include "mathops.h"
+#include "ref_genotyper.h"
+#include "vcf_record_formatter.h"
+
+bool RefGenotyper::is_reference_read(const Alignment& aln, const Region& region){
+  const std::vector<CigarElement>& cigar_list = aln.get_cigar_list();
+  for (auto cigar_iter = cigar_list.begin(); cigar_iter != cigar_list.end(); cigar_iter++)
+    if (cigar_iter->get_type() != '=')
+      return false;
+
+  if (aln.get_start() > (int32_t)region.start() - MIN_FLANK || aln.get_stop() < (int32_t)region.stop() + MIN_FLANK)
+    return false;
+
+  // As the read has no clipped or inserted bases, each base's offset in the read is its offset from the read's start
+  const std::string& qualities = aln.get_base_qualities();
+  for (int32_t pos = region.start(); pos < region.stop(); pos++)
+    if (qualities[pos-aln.get_start()] < MIN_STR_BASE_QUAL)
+      return false;
+  return true;
+}
+
+bool RefGenotyper::genotype(std::string& chrom_seq, std::ostream& logger){
+  num_alleles_           = 1;
+  log_aln_probs_         = new double[num_reads_];
+  log_sample_posteriors_ = new double[num_samples_];
+
+  // As in the sequence-based genotyper, the second read in a pair that both overlap the STR doesn't contribute to the posteriors
+  double log_no_stutter     = (stutter_model_ == NULL ? 0.0 : stutter_model_->log_stutter_pmf(0, 0));
+  std::string prev_aln_name = "";
+  for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
+    const std::string& qualities = alns_[read_index].get_base_qualities();
+    double log_prob = log_no_stutter;
+    for (unsigned int i = 0; i < qualities.size(); i++)
+      log_prob += base_quality_.log_prob_correct(qualities[i]);
+    log_aln_probs_[read_index] = log_prob;
+    read_weights_[read_index]  = (alns_[read_index].get_name().compare(prev_aln_name) == 0 ? 0 : 1);
+    prev_aln_name              = alns_[read_index].get_name();
+  }
+
+  calc_log_sample_posteriors();
+  logger << "Genotyped all samples as homozygous for the reference allele" << std::endl;
+  return true;
+}
+
+void RefGenotyper::write_vcf_record(std::vector<std::string>& sample_names, bool output_bootstrap_qualities,
+				    bool output_gls, bool output_pls, bool output_phased_gls,
+				    bool output_allreads, bool output_pallreads, bool output_mallreads,
+				    double downsample_frac, GLSidecarWriter* gl_sidecar, std::ostream& out){
+  assert(num_alleles_ == 1);
+
+  // With a single allele, each sample's only genotype has a posterior of 1 and a likelihood equal to the sample's total likelihood
+  std::vector< std::vector<double> > gls(num_samples_);
+  std::vector<int> num_reads(num_samples_, 0), num_reads_with_snps(num_samples_, 0);
+  std::vector<int> num_reads_strand_one(num_samples_, 0), num_reads_strand_two(num_samples_, 0);
+  std::vector<double> phase1_reads(num_samples_, 0.0);
+  for (int sample_index = 0; sample_index < num_samples_; sample_index++)
+    gls[sample_index].push_back(sample_total_LLs_[sample_index]*LOG_E_BASE_10);
+  for (unsigned int read_index = 0; read_index < num_reads_; read_index++){
+    int sample_index = sample_label_[read_index];
+    num_reads[sample_index]++;
+    phase1_reads[sample_index] += exp(LOG_ONE_HALF + log_p1_[read_index] - log_sum_exp(LOG_ONE_HALF + log_p1_[read_index], LOG_ONE_HALF + log_p2_[read_index]));
+    if (fabs(log_p1_[read_index] - log_p2_[read_index]) > TOLERANCE){
+      num_reads_with_snps[sample_index]++;
+      if (log_p1_[read_index] > log_p2_[read_index])
+	num_reads_strand_one[sample_index]++;
+      else
+	num_reads_strand_two[sample_index]++;
+    }
+  }
+
+  std::set<std::string> samples_of_interest(sample_names.begin(), sample_names.end());
+  int allele_number = 0;
+  for (int sample_index = 0; sample_index < num_samples_; sample_index++)
+    if (samples_of_interest.find(sample_names_[sample_index]) != samples_of_interest.end())
+      allele_number += (haploid_ ? 1 : 2);
+
+  VCFRecordFormatter record(out.precision());
+  record.reserve(1024 + 128*sample_names.size());
+  record << region_->chrom() << "\t" << pos_ << "\t" << (region_->name().empty() ? "." : region_->name())
+	 << "\t" << ref_allele_ << "\t" << "." << "\t" << "." << "\t" << ".";
+
+  record << "\t";
+  if (stutter_model_ != NULL)
+    record << "INFRAME_PGEOM="  << stutter_model_->get_parameter(true,  'P') << ";"
+	   << "INFRAME_UP="     << stutter_model_->get_parameter(true,  'U') << ";"
+	   << "INFRAME_DOWN="   << stutter_model_->get_parameter(true,  'D') << ";"
+	   << "OUTFRAME_PGEOM=" << stutter_model_->get_parameter(false, 'P') << ";"
+	   << "OUTFRAME_UP="    << stutter_model_->get_parameter(false, 'U') << ";"
+	   << "OUTFRAME_DOWN="  << stutter_model_->get_parameter(false, 'D') << ";";
+  else
+    record << "INFRAME_PGEOM=.;INFRAME_UP=.;INFRAME_DOWN=.;OUTFRAME_PGEOM=.;OUTFRAME_UP=.;OUTFRAME_DOWN=.;";
+  record << "START="  << region_->start()+1 << ";"
+	 << "END="    << region_->stop()    << ";"
+	 << "PERIOD=" << region_->period()  << ";"
+	 << "NSKIP="  << 0 << ";"
+	 << "NFILT="  << 0 << ";";
+
+  int32_t tot_dp = 0, tot_dsnp = 0;
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    auto sample_iter = sample_indices_.find(sample_names[i]);
+    if (sample_iter == sample_indices_.end())
+      continue;
+    tot_dp   += num_reads[sample_iter->second];
+    tot_dsnp += num_reads_with_snps[sample_iter->second];
+  }
+  record << "DP="          << tot_dp   << ";"
+	 << "DSNP="        << tot_dsnp << ";"
+	 << "DFILT="       << 0        << ";"
+	 << "DSTUTTER="    << 0        << ";"
+	 << "DFLANKINDEL=" << 0        << ";";
+  if (downsample_frac < 1.0)
+    record << "DSFRAC=" << downsample_frac << ";";
+  record << "AN=" << allele_number << ";" << "REFAC=" << allele_number;
+
+  record << (!haploid_ ? "\tGT:GB:Q:PQ:DP:DSNP:DFILT:DSTUTTER:DFLANKINDEL:PDP:PSNP:BPDOSE:GLDIFF" : "\tGT:GB:Q:DP:DFILT:DSTUTTER:DFLANKINDEL:BPDOSE:GLDIFF");
+  if (output_bootstrap_qualities) record << ":BQ";
+  if (output_allreads)            record << ":ALLREADS";
+  if (output_pallreads)           record << ":PALLREADS";
+  if (output_mallreads)           record << ":MALLREADS";
+  if (output_gls)                 record << ":GL";
+  if (output_pls)                 record << ":PL";
+  if (output_phased_gls)          record << ":PHASEDGL";
+
+  const double posterior = 1.0, bp_dosage = 0.0;
+  std::vector<const std::vector<double>*> sidecar_gls(sample_names.size(), NULL);
+  for (unsigned int i = 0; i < sample_names.size(); i++){
+    record << "\t";
+    auto sample_iter = sample_indices_.find(sample_names[i]);
+    if (sample_iter == sample_indices_.end()){
+      record << ".";
+      continue;
+    }
+    int sample_index = sample_iter->second;
+    sidecar_gls[i]   = &gls[sample_index];
+
+    if (!haploid_)
+      record << "0|0" << ":" << "0|0" << ":" << posterior << ":" << posterior
+	     << ":" << num_reads[sample_index] << ":" << num_reads_with_snps[sample_index] << ":" << 0 << ":" << 0 << ":" << 0
+	     << ":" << phase1_reads[sample_index] << "|" << (num_reads[sample_index] - phase1_reads[sample_index])
+	     << ":" << num_reads_strand_one[sample_index] << "|" << num_reads_strand_two[sample_index]
+	     << ":" << bp_dosage << ":" << ".";
+    else
+      record << "0" << ":" << "0" << ":" << posterior
+	     << ":" << num_reads[sample_index] << ":" << 0 << ":" << 0 << ":" << 0
+	     << ":" << bp_dosage << ":" << ".";
+
+    // Every bootstrap sample yields the same genotype
+    if (output_bootstrap_qualities)
+      record << ":" << posterior;
+
+    // Each read has a base pair difference of 0 and spans the STR by at least MIN_FLANK bases
+    std::vector<int> read_bp_diffs(num_reads[sample_index], 0);
+    if (output_allreads)
+      condense_read_counts(read_bp_diffs, record << ":");
+    if (output_pallreads){
+      record << ":" << bp_dosage;
+      for (int j = 1; j < num_reads[sample_index]; j++)
+	record << "," << bp_dosage;
+    }
+    if (output_mallreads)
+      condense_read_counts(read_bp_diffs, record << ":");
+
+    if (output_gls)        record << ":" << gls[sample_index][0];
+    if (output_pls)        record << ":" << 0;
+    if (output_phased_gls) record << ":" << gls[sample_index][0];
+  }
+  record << "\n";
+  record.flush(out);
+
+  if (gl_sidecar != NULL)
+    gl_sidecar->add_locus(region_->chrom(), pos_, num_alleles_, sidecar_gls, sidecar_gls);
+}
@@ -0,0 +1,73 @@
+#ifndef REF_GENOTYPER_H_
+#define REF_GENOTYPER_H_
+
+#include <assert.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "base_quality.h"
+#include "genotyper.h"
+#include "gl_sidecar.h"
+#include "region.h"
+#include "stringops.h"
+#include "stutter_model.h"
+
+#include "SeqAlignment/AlignmentData.h"
+
+/*
+ * Genotyper for loci at which every left-aligned read exactly matches the reference. At such loci, the reference allele
+ * is the only candidate allele, so each sample is called homozygous for the reference allele and the stutter training,
+ * haplotype generation, haplotype alignment and bootstrapping steps of the sequence-based genotyper can be skipped.
+ *
+ * Each read's log-likelihood is computed analytically as the probability of observing its bases without error plus the
+ * probability of no stutter artifact, and is combined with its SNP phasing likelihoods in the same manner as the other genotypers.
+ * If no stutter model is available, the maximum likelihood model for reads without stutter (no artifacts) is used
+ * and the stutter parameters are reported as missing in the VCF
+ */
+class RefGenotyper : public Genotyper {
+ private:
+  std::string ref_allele_;
+  int32_t pos_;
+  StutterModel* stutter_model_;
+  BaseQuality base_quality_;
+  std::vector<Alignment> alns_;
+
+ public:
+  /* Minimum number of bases a reference read must extend beyond each end of the STR */
+  const static int MIN_FLANK = 5;
+
+  /* Minimum quality for each base overlapping the STR in a reference read */
+  const static char MIN_STR_BASE_QUAL = '+'; // Phred score of 10
+
+  RefGenotyper(Region& region, bool haploid, std::vector<Alignment>& alignments,
+	       std::vector< std::vector<double> >& log_p1, std::vector< std::vector<double> >& log_p2,
+	       std::vector<std::string>& sample_names, std::string& chrom_seq, StutterModel* stutter_model)
+    : Genotyper(region, haploid, false, sample_names, log_p1, log_p2){
+    alns_          = alignments;
+    stutter_model_ = (stutter_model == NULL ? NULL : stutter_model->copy());
+    ref_allele_    = uppercase(chrom_seq.substr(region.start(), region.stop()-region.start()));
+    pos_           = region.start()+1;
+    assert(num_reads_ == alns_.size());
+  }
+
+  ~RefGenotyper(){
+    delete stutter_model_;
+  }
+
+  /*
+   * Returns true iff the left-aligned read only supports the reference allele: it has no mismatches, indels or clipped bases,
+   * extends at least MIN_FLANK bases beyond each end of the STR and each of its bases overlapping the STR has a quality of at least MIN_STR_BASE_QUAL
+   */
+  static bool is_reference_read(const Alignment& aln, const Region& region);
+
+  bool genotype(std::string& chrom_seq, std::ostream& logger);
+
+  void write_vcf_record(std::vector<std::string>& sample_names, bool output_bootstrap_qualities,
+			bool output_gls, bool output_pls, bool output_phased_gls,
+			bool output_allreads, bool output_pallreads, bool output_mallreads,
+			double downsample_frac, GLSidecarWriter* gl_sidecar, std::ostream& out);
+};
+
+#endif
@@ -0,0 +1,190 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "error.h"
+#include "region_sharder.h"
+
+BamIndexDepth::~BamIndexDepth(){
+  for (unsigned int i = 0; i < files_.size(); i++){
+    hts_idx_destroy(indices_[i]);
+    bam_hdr_destroy(headers_[i]);
+    sam_close(files_[i]);
+  }
+}
+
+void BamIndexDepth::add_bam(const std::string& bam_file){
+  htsFile* file = sam_open(bam_file.c_str(), "r");
+  if (file == NULL)
+    printErrorAndDie("Failed to open BAM file " + bam_file);
+  bam_hdr_t* header = sam_hdr_read(file);
+  if (header == NULL)
+    printErrorAndDie("Failed to read the header of BAM file " + bam_file);
+  hts_idx_t* index = sam_index_load(file, bam_file.c_str());
+  if (index == NULL)
+    printErrorAndDie("Failed to load the index for BAM file " + bam_file + ". Please index the BAM using samtools index");
+  files_.push_back(file);
+  headers_.push_back(header);
+  indices_.push_back(index);
+  filenames_.push_back(bam_file);
+}
+
+double BamIndexDepth::index_bytes(const std::string& chrom, int32_t start, int32_t stop){
+  double total = 0;
+  for (unsigned int i = 0; i < files_.size(); i++){
+    int tid = bam_name2id(headers_[i], chrom.c_str());
+    if (tid < 0 && chrom.size() > 3 && chrom.substr(0, 3).compare("chr") == 0)
+      tid = bam_name2id(headers_[i], chrom.substr(3).c_str());
+    if (tid < 0)
+      continue;
+
+    hts_itr_t* iter = sam_itr_queryi(indices_[i], tid, start, stop);
+    if (iter == NULL)
+      continue;
+    for (int j = 0; j < iter->n_off; j++){
+      uint64_t u = iter->off[j].u, v = iter->off[j].v;
+      if ((u >> 16) == (v >> 16))
+	total += 1.0*((v & 0xFFFF) - (u & 0xFFFF))/COMPRESSION_RATIO;
+      else
+	total += (v >> 16) - (u >> 16);
+    }
+    hts_itr_destroy(iter);
+  }
+  return total;
+}
+
+double predict_locus_cost(const Region& region, double depth){
+  const double FLANK_LENGTH = 30;  // Typical flank length of each haplotype
+  const double COPIES_SCALE = 10;  // Number of repeat copies that doubles the expected number of alleles
+  double str_length = region.stop() - region.start();
+  double num_copies = str_length/region.period();
+  return 1.0 + depth*(str_length + 2*FLANK_LENGTH)*(1.0 + num_copies/COPIES_SCALE);
+}
+
+void read_locus_timings(const std::string& log_file, std::map<Region, double>& timings){
+  std::ifstream input(log_file.c_str());
+  if (!input.is_open())
+    printErrorAndDie("Failed to open the HipSTR log file " + log_file);
+
+  // Only the top-level stages of each locus's timing block are summed, as the tab-indented lines are a breakdown of the genotyping time
+  // and the run's overall timing breakdown follows the last region
+  const std::string region_prefix = "Processing region ";
+  const std::string timing_header = "Locus timing:";
+  std::string line, chrom;
+  int32_t start = -1, stop = -1;
+  bool in_region = false, in_timing = false;
+  while (std::getline(input, line)){
+    size_t prefix_index = line.find(region_prefix);
+    if (prefix_index != std::string::npos){
+      std::istringstream iss(line.substr(prefix_index + region_prefix.size()));
+      in_region = ((iss >> chrom >> start >> stop) && stop > start);
+      in_timing = false;
+      continue;
+    }
+    if (line.find(timing_header) != std::string::npos){
+      in_timing = in_region;
+      continue;
+    }
+    if (line.empty() || (line[0] != ' ' && line[0] != '\t')){
+      in_timing = false;
+      continue;
+    }
+
+    size_t equals_index = line.find(" = ");
+    if (!in_timing || line[0] != ' ' || equals_index == std::string::npos || line.find(" seconds") == std::string::npos)
+      continue;
+    double seconds = atof(line.c_str() + equals_index + 3);
+    if (seconds > 0)
+      timings[Region(chrom, start, stop, 1)] += seconds;
+  }
+  input.close();
+}
+
+// Returns the number of contiguous shards whose cost is at most MAX_COST, and fills in their starts if SHARD_STARTS isn't NULL
+static int greedy_shards(const std::vector<double>& costs, double max_cost, std::vector<int>* shard_starts){
+  int num_shards = 0;
+  double shard_cost = 0;
+  for (unsigned int i = 0; i < costs.size(); i++){
+    if (num_shards == 0 || shard_cost + costs[i] > max_cost){
+      num_shards++;
+      shard_cost = 0;
+      if (shard_starts != NULL)
+	shard_starts->push_back(i);
+    }
+    shard_cost += costs[i];
+  }
+  return num_shards;
+}
+
+void partition_by_cost(const std::vector<double>& costs, int num_shards, std::vector<int>& shard_starts){
+  assert(num_shards > 0);
+  shard_starts.clear();
+  if (costs.empty()){
+    shard_starts.push_back(0);
+    shard_starts.push_back(0);
+    return;
+  }
+
+  // Binary search for the smallest maximum shard cost that can be achieved using NUM_SHARDS contiguous shards
+  double min_cost = *std::max_element(costs.begin(), costs.end()), max_cost = 0;
+  for (unsigned int i = 0; i < costs.size(); i++)
+    max_cost += costs[i];
+  for (int iter = 0; iter < 100 && max_cost - min_cost > 1e-9*max_cost; iter++){
+    double mid_cost = 0.5*(min_cost + max_cost);
+    if (greedy_shards(costs, mid_cost, NULL) <= num_shards)
+      max_cost = mid_cost;
+    else
+      min_cost = mid_cost;
+  }
+  greedy_shards(costs, max_cost, &shard_starts);
+
+  // Use all of the shards by splitting the shards with the most loci, which can't increase the maximum cost
+  while ((int)shard_starts.size() < num_shards && (int)shard_starts.size() < (int)costs.size()){
+    shard_starts.push_back(costs.size());
+    int best_shard = 0;
+    for (unsigned int i = 1; i+1 < shard_starts.size(); i++)
+      if (shard_starts[i+1]-shard_starts[i] > shard_starts[best_shard+1]-shard_starts[best_shard])
+	best_shard = i;
+    double total = 0, half = 0;
+    for (int i = shard_starts[best_shard]; i < shard_starts[best_shard+1]; i++)
+      total += costs[i];
+    int split = shard_starts[best_shard]+1;
+    for (half = costs[split-1]; split < shard_starts[best_shard+1]-1 && half + costs[split] <= 0.5*total; split++)
+      half += costs[split];
+    shard_starts.pop_back();
+    shard_starts.insert(shard_starts.begin()+best_shard+1, split);
+  }
+  shard_starts.push_back(costs.size());
+}
+
+void partition_by_count(int num_loci, int num_shards, std::vector<int>& shard_starts){
+  assert(num_shards > 0);
+  shard_starts.clear();
+  int num_used = std::max(1, std::min(num_shards, num_loci));
+  for (int i = 0; i < num_used; i++)
+    shard_starts.push_back((int)((int64_t)i*num_loci/num_used));
+  shard_starts.push_back(num_loci);
+}
+
+void shard_costs(const std::vector<double>& costs, const std::vector<int>& shard_starts, std::vector<double>& totals){
+  totals.clear();
+  for (unsigned int i = 0; i+1 < shard_starts.size(); i++){
+    totals.push_back(0);
+    for (int j = shard_starts[i]; j < shard_starts[i+1]; j++)
+      totals.back() += costs[j];
+  }
+}
+
+double shard_imbalance(const std::vector<double>& costs, const std::vector<int>& shard_starts){
+  std::vector<double> totals;
+  shard_costs(costs, shard_starts, totals);
+  double max_total = 0, sum = 0;
+  for (unsigned int i = 0; i < totals.size(); i++){
+    max_total = std::max(max_total, totals[i]);
+    sum      += totals[i];
+  }
+  return (sum == 0 ? 1.0 : max_total/(sum/totals.size()));
+}
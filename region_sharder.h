@@ -0,0 +1,70 @@
+#ifndef REGION_SHARDER_H_
+#define REGION_SHARDER_H_
+
+#include <stdint.h>
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "htslib/htslib/hts.h"
+#include "htslib/htslib/sam.h"
+
+#include "region.h"
+
+/*
+ * Estimates the number of reads overlapping each locus in a set of BAMs using only their indices.
+ * The chunks an index query would read are converted into an approximate number of compressed bytes,
+ * so no reads are decompressed or decoded
+ */
+class BamIndexDepth {
+ private:
+  std::vector<htsFile*> files_;
+  std::vector<bam_hdr_t*> headers_;
+  std::vector<hts_idx_t*> indices_;
+  std::vector<std::string> filenames_;
+
+  // Within a single BGZF block, chunk sizes are uncompressed and are scaled by this typical compression ratio
+  const static int COMPRESSION_RATIO = 3;
+
+ public:
+  ~BamIndexDepth();
+
+  void add_bam(const std::string& bam_file);
+
+  int num_bams() const { return files_.size(); }
+
+  /* Returns the approximate number of compressed bytes for the reads overlapping the region, summed across the BAMs */
+  double index_bytes(const std::string& chrom, int32_t start, int32_t stop);
+};
+
+/*
+ * Predicts the relative cost of genotyping a locus. Haplotype alignment dominates the runtime, so the cost is proportional to
+ * the number of reads times the length of the haplotypes and grows with the number of repeat copies, which determines
+ * how many alleles are likely to be present. DEPTH is the index-based read depth estimate, or 1 if no BAMs were provided
+ */
+double predict_locus_cost(const Region& region, double depth);
+
+/*
+ * Reads the per-locus timings from the log of a previous HipSTR run, which reports each region it processes followed by
+ * a "Locus timing:" block with the time spent on each stage. Returns the total number of seconds for each region that was timed
+ */
+void read_locus_timings(const std::string& log_file, std::map<Region, double>& timings);
+
+/*
+ * Splits the costs into NUM_SHARDS contiguous shards that minimize the cost of the most expensive shard.
+ * SHARD_STARTS is filled with the index of the first locus in each shard, followed by the number of loci
+ */
+void partition_by_cost(const std::vector<double>& costs, int num_shards, std::vector<int>& shard_starts);
+
+/* Splits the loci into NUM_SHARDS contiguous shards with equal numbers of loci */
+void partition_by_count(int num_loci, int num_shards, std::vector<int>& shard_starts);
+
+/* Returns the sum of the costs in each shard */
+void shard_costs(const std::vector<double>& costs, const std::vector<int>& shard_starts, std::vector<double>& totals);
+
+/* Returns the ratio of the most expensive shard's cost to the mean shard cost, where 1 indicates perfect balance */
+double shard_imbalance(const std::vector<double>& costs, const std::vector<int>& shard_starts);
+
+#endif
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "error.h"
+#include "run_progress.h"
+#include "stringops.h"
+
+bool RunProgressLog::read(std::vector<std::string>& samples, std::vector<ProgressEntry>& entries){
+  samples.clear();
+  entries.clear();
+  std::ifstream input(filename_.c_str());
+  if (!input.is_open())
+    return false;
+
+  std::string line;
+  std::vector<std::string> tokens;
+  if (!std::getline(input, line) || line.compare("##hipstr_progress_version=" + std::to_string(VERSION)) != 0)
+    return false;
+  if (!std::getline(input, line))
+    return false;
+  split_by_delim(line, '\t', samples);
+  if (samples.empty() || samples[0].compare("SAMPLES") != 0)
+    return false;
+  samples.erase(samples.begin());
+
+  // Lines without a trailing newline may have been truncated when the run was interrupted
+  while (std::getline(input, line) && !input.eof()){
+    tokens.clear();
+    split_by_delim(line, '\t', tokens);
+    if (tokens.size() != 12 || tokens[0].compare("DONE") != 0)
+      break;
+    ProgressEntry entry;
+    entry.num_regions          = atoi(tokens[1].c_str());
+    entry.chrom                = tokens[2];
+    entry.start                = atoi(tokens[3].c_str());
+    entry.stop                 = atoi(tokens[4].c_str());
+    entry.vcf_offset           = strtoull(tokens[5].c_str(), NULL, 10);
+    entry.stutter_offset       = strtoll(tokens[6].c_str(), NULL, 10);
+    entry.num_genotype_success = atoi(tokens[7].c_str());
+    entry.num_genotype_fail    = atoi(tokens[8].c_str());
+    entry.num_em_converge      = atoi(tokens[9].c_str());
+    entry.num_em_fail          = atoi(tokens[10].c_str());
+    entry.num_ref_fast_path    = atoi(tokens[11].c_str());
+    entries.push_back(entry);
+  }
+  input.close();
+  return true;
+}
+
+void RunProgressLog::write_entry(std::ostream& out, const ProgressEntry& entry){
+  out << "DONE"                     << "\t" << entry.num_regions       << "\t" << entry.chrom
+      << "\t" << entry.start        << "\t" << entry.stop              << "\t" << entry.vcf_offset
+      << "\t" << entry.stutter_offset
+      << "\t" << entry.num_genotype_success << "\t" << entry.num_genotype_fail
+      << "\t" << entry.num_em_converge      << "\t" << entry.num_em_fail
+      << "\t" << entry.num_ref_fast_path    << "\n";
+}
+
+void RunProgressLog::open(const std::vector<std::string>& samples, const std::vector<ProgressEntry>& entries){
+  close();
+
+  // Replace the log atomically so that an interruption can't lose the checkpoints being retained
+  std::stringstream tmp_path;
+  tmp_path << filename_ << ".tmp" << getpid();
+  std::ofstream output(tmp_path.str().c_str());
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the progress file " + filename_);
+  output << "##hipstr_progress_version=" << VERSION << "\n" << "SAMPLES";
+  for (auto sample_iter = samples.begin(); sample_iter != samples.end(); sample_iter++)
+    output << "\t" << *sample_iter;
+  output << "\n";
+  for (auto entry_iter = entries.begin(); entry_iter != entries.end(); entry_iter++)
+    write_entry(output, *entry_iter);
+  output.close();
+  if (output.fail() || rename(tmp_path.str().c_str(), filename_.c_str()) != 0){
+    remove(tmp_path.str().c_str());
+    printErrorAndDie("Failed to write the progress file " + filename_);
+  }
+
+  out_.open(filename_.c_str(), std::ofstream::out | std::ofstream::app);
+  if (!out_.is_open())
+    printErrorAndDie("Failed to open the progress file " + filename_);
+}
+
+void RunProgressLog::add_entry(const ProgressEntry& entry){
+  write_entry(out_, entry);
+  out_.flush();
+  if (out_.fail())
+    printErrorAndDie("Failed to write to the progress file " + filename_);
+}
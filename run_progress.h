@@ -0,0 +1,80 @@
+#ifndef RUN_PROGRESS_H_
+#define RUN_PROGRESS_H_
+
+#include <stdint.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+class ProgressEntry {
+ public:
+  int32_t num_regions;                 // Number of regions completed, in the order they're processed
+  std::string chrom;                   // Coordinates of the last completed region
+  int32_t start, stop;
+  uint64_t vcf_offset;                 // Uncompressed size of the VCF after the last completed region
+  int64_t stutter_offset;              // Size of the stutter model output after the last completed region, or -1 if it isn't output
+  int num_genotype_success, num_genotype_fail;
+  int num_em_converge, num_em_fail;
+  int num_ref_fast_path;
+
+  ProgressEntry(){
+    num_regions          = 0;
+    start = stop         = -1;
+    vcf_offset           = 0;
+    stutter_offset       = -1;
+    num_genotype_success = num_genotype_fail = 0;
+    num_em_converge      = num_em_fail       = 0;
+    num_ref_fast_path    = 0;
+  }
+};
+
+/*
+ * Append-only log of the progress of a run, which allows an interrupted run to resume from its last checkpoint
+ * and produce the same output as an uninterrupted run.
+ *
+ * The log is a versioned, tab-delimited text file containing the genotyped samples and one line per checkpoint:
+ *   SAMPLES  <sample 1>  <sample 2>  ...
+ *   DONE     <number of regions>  <chrom>  <start>  <stop>  <VCF offset>  <stutter offset>
+ *            <genotype successes>  <genotype failures>  <EM successes>  <EM failures>  <reference-only loci>
+ * Lines are flushed as they're written, and a truncated last line is ignored when the log is read.
+ */
+class RunProgressLog {
+ private:
+  const static int VERSION = 1;
+  std::string filename_;
+  std::ofstream out_;
+
+  void write_entry(std::ostream& out, const ProgressEntry& entry);
+
+ public:
+  explicit RunProgressLog(const std::string& filename){
+    filename_ = filename;
+  }
+
+  ~RunProgressLog(){
+    close();
+  }
+
+  const std::string& filename() const { return filename_; }
+
+  bool is_open(){ return out_.is_open(); }
+
+  /*
+   * Reads the samples and checkpoints from an existing log, in the order they were written.
+   * Returns false if the log doesn't exist or wasn't written by a compatible version
+   */
+  bool read(std::vector<std::string>& samples, std::vector<ProgressEntry>& entries);
+
+  /* Starts a new log, replacing the existing log (if any) with the samples and provided checkpoints */
+  void open(const std::vector<std::string>& samples, const std::vector<ProgressEntry>& entries);
+
+  void add_entry(const ProgressEntry& entry);
+
+  void close(){
+    if (out_.is_open())
+      out_.close();
+  }
+};
+
+#endif
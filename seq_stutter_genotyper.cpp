@@ -1,6 +1,7 @@
 #include <algorithm>
 #include <cfloat>
 #include <cstring>
+#include <iterator>
 #include <random>
 #include <string>
 #include <sstream>
@@ -14,6 +15,7 @@
 #include "mathops.h"
 #include "stringops.h"
 #include "vcf_input.h"
+#include "vcf_record_formatter.h"
 
 #include "SeqAlignment/AlignmentData.h"
 #include "SeqAlignment/AlignmentModel.h"
@@ -236,6 +238,13 @@ void SeqStutterGenotyper::init(StutterModel& stutter_model, std::string& chrom_s
     else
       pos_ = -1;
   }
+  else if (fixed_alleles_){
+    // Construct the haplotype using the provided alleles
+    logger << "Using " << alleles_.size() << " provided STR alleles" << std::endl;
+    num_alleles_ = alleles_.size();
+    haplotype_   = generate_haplotype(pos_, *region_, MAX_REF_FLANK_LEN, chrom_seq, alleles_, &stutter_model, hap_blocks_, logger);
+    call_sample_ = std::vector<bool>(num_samples_, true);
+  }
   else {
     // Generate putative haplotypes and determine the number of alleles
     logger << "Generating putative haplotypes..." << std::endl;
@@ -278,33 +287,273 @@ void SeqStutterGenotyper::init(StutterModel& stutter_model, std::string& chrom_s
     logger << "WARNING: Unsuccessful initialization. " << std::endl;
 }
 
-void SeqStutterGenotyper::calc_hap_aln_probs(Haplotype* haplotype, double* log_aln_probs, int* seed_positions){
+// Maximum memory used to record the stutter model-independent alignment terms at a locus. If it's exceeded,
+// the reads are realigned instead of rescored after the stutter model is retrained
+const int64_t MAX_STUTTER_EMISSION_BYTES = 512LL*1024*1024;
+
+static int64_t stutter_emission_bytes(const std::vector<StutterEmissions>& emissions){
+  int64_t bytes = 0;
+  for (auto emission_iter = emissions.begin(); emission_iter != emissions.end(); emission_iter++)
+    bytes += emission_iter->bytes();
+  return bytes;
+}
+
+bool SeqStutterGenotyper::keyed_by_allele(Haplotype* haplotype){
+  return (haplotype->num_blocks() == 3 && haplotype->get_block(1)->get_repeat_info() != NULL
+	  && haplotype->get_block(1)->num_options() == haplotype->num_combs());
+}
+
+bool SeqStutterGenotyper::align_or_rescore_reads(HapAligner& hap_aligner, Haplotype* haplotype, AlnList& alns,
+						  double* log_aln_probs, int* seed_positions){
+  // The terms are keyed by the sequence of the repeat block, so they can only be used when it's the only block with alternate sequences.
+  // They're only used to rescore the same reads they were recorded for, which is verified by the number of entries
+  HapBlock* repeat_block = haplotype->get_block(1);
+  bool keyed             = keyed_by_allele(haplotype);
+
+  // Rescore the reads if the terms were recorded for every allele
+  if (rescore_stutter_ && keyed){
+    std::vector<StutterEmissions*> hap_emissions;
+    for (int i = 0; i < repeat_block->num_options(); i++){
+      auto emission_iter = stutter_emissions_.find(repeat_block->get_seq(i));
+      if (emission_iter == stutter_emissions_.end() || emission_iter->second.size() != 2*alns.size())
+	break;
+      hap_emissions.push_back(emission_iter->second.data());
+    }
+    if (hap_emissions.size() == repeat_block->num_options()){
+      hap_aligner.rescore_reads(alns, &base_quality_, hap_emissions, log_aln_probs, seed_positions);
+      return true;
+    }
+  }
+
+  if (!record_stutter_emissions_ || !keyed)
+    return hap_aligner.process_reads(alns, 0, &base_quality_, log_aln_probs, seed_positions, budget_);
+
+  std::vector<StutterEmissions> emissions;
+  if (!hap_aligner.process_reads(alns, 0, &base_quality_, log_aln_probs, seed_positions, budget_, &emissions))
+    return false;
+  for (int i = 0; i < repeat_block->num_options(); i++){
+    std::vector<StutterEmissions>& allele_emissions = stutter_emissions_[repeat_block->get_seq(i)];
+    stutter_emission_bytes_ -= stutter_emission_bytes(allele_emissions);
+    allele_emissions.assign(std::make_move_iterator(emissions.begin() + 2*i*alns.size()),
+			    std::make_move_iterator(emissions.begin() + 2*(i+1)*alns.size()));
+    stutter_emission_bytes_ += stutter_emission_bytes(allele_emissions);
+  }
+
+  // Stop recording once the terms use too much memory, as the reads can always be realigned instead
+  if (stutter_emission_bytes_ > MAX_STUTTER_EMISSION_BYTES){
+    stutter_emissions_.clear();
+    stutter_emission_bytes_   = 0;
+    record_stutter_emissions_ = false;
+  }
+  return true;
+}
+
+Haplotype* SeqStutterGenotyper::allele_haplotype(const std::vector<std::string>& allele_seqs, std::vector<HapBlock*>& blocks){
+  assert(!allele_seqs.empty());
+  blocks.clear();
+  blocks.push_back(hap_blocks_[0]);
+  blocks.push_back(new RepeatBlock(hap_blocks_[1]->start(), hap_blocks_[1]->end(), allele_seqs[0], region_->period(),
+				   hap_blocks_[1]->get_repeat_info()->get_stutter_model()));
+  blocks.push_back(hap_blocks_[2]);
+  for (unsigned int i = 1; i < allele_seqs.size(); i++){
+    std::string alt_seq = allele_seqs[i];
+    blocks[1]->add_alternate(alt_seq);
+  }
+  return new Haplotype(blocks);
+}
+
+bool SeqStutterGenotyper::resolve_stored_alignments(){
+  HapBlock* repeat_block = haplotype_->get_block(1);
+  int num_alleles        = repeat_block->num_options();
+  std::vector<std::string> allele_seqs;
+  for (int i = 0; i < num_alleles; i++)
+    allele_seqs.push_back(repeat_block->get_seq(i));
+
+  for (auto group_iter = stored_alns_.begin(); group_iter != stored_alns_.end(); group_iter++){
+    PooledAlignments& group = *group_iter;
+    if (!group.rescore && group.allele_seqs == allele_seqs)
+      continue;
+
+    // Determine which of the alleles the group's reads were aligned to. Reads whose likelihoods were computed using
+    // a different stutter model can only be rescored if the stutter model-independent terms were stored
+    int num_pools = group.alns.size();
+    bool rescore  = (group.rescore && !group.emissions.empty());
+    std::vector<int> group_indices(num_alleles, -1);
+    std::vector<std::string> known_seqs, missing_seqs;
+    std::vector<int> known_alleles, missing_alleles;
+    for (int i = 0; i < num_alleles; i++){
+      auto seq_iter = std::find(group.allele_seqs.begin(), group.allele_seqs.end(), allele_seqs[i]);
+      if (seq_iter != group.allele_seqs.end() && (!group.rescore || rescore)){
+	group_indices[i] = seq_iter - group.allele_seqs.begin();
+	known_seqs.push_back(allele_seqs[i]);
+	known_alleles.push_back(i);
+      }
+      else {
+	missing_seqs.push_back(allele_seqs[i]);
+	missing_alleles.push_back(i);
+      }
+    }
+
+    std::vector<double> log_aln_probs((size_t)num_pools*num_alleles);
+    for (int i = 0; i < num_pools; i++)
+      for (unsigned int j = 0; j < known_alleles.size(); j++)
+	log_aln_probs[(size_t)i*num_alleles + known_alleles[j]] = group.log_aln_probs[(size_t)i*group.allele_seqs.size() + group_indices[known_alleles[j]]];
+
+    // Rescore the reads using the stutter model-independent terms of their alignments to each allele
+    std::vector<HapBlock*> blocks;
+    if (rescore && !known_seqs.empty()){
+      std::vector<StutterEmissions*> hap_emissions;
+      for (unsigned int j = 0; j < known_alleles.size(); j++)
+	hap_emissions.push_back(group.emissions.data() + 2*group_indices[known_alleles[j]]*num_pools);
+      std::vector<double> known_log_aln_probs((size_t)num_pools*known_alleles.size());
+      Haplotype* haplotype = allele_haplotype(known_seqs, blocks);
+      HapAligner hap_aligner(haplotype);
+      hap_aligner.rescore_reads(group.alns, &base_quality_, hap_emissions, known_log_aln_probs.data(), group.seed_positions.data());
+      delete blocks[1];
+      delete haplotype;
+      for (int i = 0; i < num_pools; i++)
+	for (unsigned int j = 0; j < known_alleles.size(); j++)
+	  log_aln_probs[(size_t)i*num_alleles + known_alleles[j]] = known_log_aln_probs[(size_t)i*known_alleles.size() + j];
+    }
+
+    // Only align the reads to the alleles that they weren't aligned to
+    std::vector<StutterEmissions> missing_emissions;
+    if (!missing_seqs.empty()){
+      std::vector<double> missing_log_aln_probs((size_t)num_pools*missing_alleles.size());
+      Haplotype* haplotype = allele_haplotype(missing_seqs, blocks);
+      HapAligner hap_aligner(haplotype);
+      bool aligned = hap_aligner.process_reads(group.alns, 0, &base_quality_, missing_log_aln_probs.data(), group.seed_positions.data(),
+					       budget_, (record_pooled_alns_ && !group.emissions.empty() ? &missing_emissions : NULL));
+      delete blocks[1];
+      delete haplotype;
+      if (!aligned)
+	return false;
+      for (int i = 0; i < num_pools; i++)
+	for (unsigned int j = 0; j < missing_alleles.size(); j++)
+	  log_aln_probs[(size_t)i*num_alleles + missing_alleles[j]] = missing_log_aln_probs[(size_t)i*missing_alleles.size() + j];
+    }
+
+    // Reorder the terms to match the alleles if they're available for each allele
+    std::vector<StutterEmissions> emissions;
+    if (record_pooled_alns_ && !group.emissions.empty() && missing_emissions.size() == 2*num_pools*missing_alleles.size()){
+      emissions.resize(2*num_pools*num_alleles);
+      for (unsigned int j = 0; j < known_alleles.size(); j++)
+	std::move(group.emissions.begin() + 2*group_indices[known_alleles[j]]*num_pools, group.emissions.begin() + 2*(group_indices[known_alleles[j]]+1)*num_pools,
+		  emissions.begin() + 2*known_alleles[j]*num_pools);
+      for (unsigned int j = 0; j < missing_alleles.size(); j++)
+	std::move(missing_emissions.begin() + 2*j*num_pools, missing_emissions.begin() + 2*(j+1)*num_pools, emissions.begin() + 2*missing_alleles[j]*num_pools);
+    }
+
+    group.allele_seqs = allele_seqs;
+    group.log_aln_probs.swap(log_aln_probs);
+    group.emissions.swap(emissions);
+    group.rescore = false;
+  }
+  return true;
+}
+
+void SeqStutterGenotyper::record_alignments(Haplotype* haplotype, AlnList& alns, const double* log_aln_probs, const int* seed_positions){
+  if (!record_pooled_alns_ || !keyed_by_allele(haplotype))
+    return;
+
+  // Alignments to the initial haplotype replace any previous alignments, while the alignments to
+  // the stutter alleles identified afterwards are added for the same reads
+  if (haplotype == haplotype_){
+    recorded_alns_ = alns;
+    recorded_seeds_.assign(seed_positions, seed_positions + alns.size());
+    recorded_log_aln_probs_.clear();
+  }
+  else if (alns.size() != recorded_alns_.size())
+    return;
+
+  HapBlock* repeat_block = haplotype->get_block(1);
+  int num_alleles        = repeat_block->num_options();
+  for (int i = 0; i < num_alleles; i++){
+    std::vector<double>& allele_log_aln_probs = recorded_log_aln_probs_[repeat_block->get_seq(i)];
+    allele_log_aln_probs.resize(alns.size());
+    for (unsigned int j = 0; j < alns.size(); j++)
+      allele_log_aln_probs[j] = log_aln_probs[(size_t)j*num_alleles + i];
+  }
+}
+
+bool SeqStutterGenotyper::calc_hap_aln_probs(Haplotype* haplotype, double* log_aln_probs, int* seed_positions){
   double locus_hap_aln_time = clock();
   HapAligner hap_aligner(haplotype);
   int num_alleles = haplotype->num_combs();
 
-  if (pool_identical_seqs_){
-    // Align each pooled read to each haplotype
-    AlnList& pooled_alns = pooler_.get_alignments();
-    double* log_pool_aln_probs = new double[pooled_alns.size()*num_alleles];
-    int* pool_seed_positions   = new int[pooled_alns.size()];
-    hap_aligner.process_reads(pooled_alns, 0, &base_quality_, log_pool_aln_probs, pool_seed_positions);
+  // Stored alignments are only valid for the haplotype they were provided for
+  bool use_stored = (haplotype == haplotype_ && !stored_alns_.empty());
+  if (use_stored && !resolve_stored_alignments()){
+    total_hap_aln_time_ += (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
+    return false;
+  }
+
+  if (pool_identical_seqs_ || use_stored){
+    // Align each pooled read (or each read) that lacks stored alignments to each haplotype
+    AlnList& candidate_alns = (pool_identical_seqs_ ? pooler_.get_alignments() : alns_);
+    AlnList subset_alns;
+    std::vector<int> aligned_index(candidate_alns.size(), -1);
+    if (use_stored){
+      for (unsigned int i = 0; i < num_reads_; i++){
+	int candidate_index = (pool_identical_seqs_ ? pool_index_[i] : i);
+	if (stored_groups_[i] == -1 && aligned_index[candidate_index] == -1){
+	  aligned_index[candidate_index] = subset_alns.size();
+	  subset_alns.push_back(candidate_alns[candidate_index]);
+	}
+      }
+    }
+    else
+      for (unsigned int i = 0; i < candidate_alns.size(); i++)
+	aligned_index[i] = i;
+    AlnList& aligned_alns = (use_stored ? subset_alns : candidate_alns);
+
+    double* log_pool_aln_probs = new double[aligned_alns.size()*num_alleles];
+    int* pool_seed_positions   = new int[aligned_alns.size()];
+    if (!align_or_rescore_reads(hap_aligner, haplotype, aligned_alns, log_pool_aln_probs, pool_seed_positions)){
+      delete [] log_pool_aln_probs;
+      delete [] pool_seed_positions;
+      total_hap_aln_time_ += (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
+      return false;
+    }
+    record_alignments(haplotype, aligned_alns, log_pool_aln_probs, pool_seed_positions);
 
-    // Copy each pool's alignment probabilities to the entries for its constituent reads
+    // Copy each alignment's probabilities to the entries for its constituent reads
     double* log_aln_ptr = log_aln_probs;
     for (unsigned int i = 0; i < num_reads_; i++){
-      seed_positions[i] = pool_seed_positions[pool_index_[i]];
-      std::memcpy(log_aln_ptr, log_pool_aln_probs + num_alleles*pool_index_[i], num_alleles*sizeof(double));
+      if (use_stored && stored_groups_[i] != -1){
+	PooledAlignments& group = stored_alns_[stored_groups_[i]];
+	seed_positions[i] = group.seed_positions[stored_pools_[i]];
+	std::memcpy(log_aln_ptr, &group.log_aln_probs[(size_t)stored_pools_[i]*num_alleles], num_alleles*sizeof(double));
+      }
+      else {
+	int index = aligned_index[pool_identical_seqs_ ? pool_index_[i] : i];
+	seed_positions[i] = pool_seed_positions[index];
+	std::memcpy(log_aln_ptr, log_pool_aln_probs + num_alleles*index, num_alleles*sizeof(double));
+      }
       log_aln_ptr += num_alleles;
     }
 
+    if (record_pooled_alns_ && haplotype == haplotype_){
+      recorded_index_.resize(num_reads_);
+      for (unsigned int i = 0; i < num_reads_; i++)
+	recorded_index_[i] = (use_stored && stored_groups_[i] != -1 ? -1 : aligned_index[pool_identical_seqs_ ? pool_index_[i] : i]);
+    }
+
     delete [] log_pool_aln_probs;
     delete [] pool_seed_positions;
   }
   else {
     // Align each read against each candidate haplotype
-    int read_index = 0;
-    hap_aligner.process_reads(alns_, read_index, &base_quality_, log_aln_probs, seed_positions);
+    if (!align_or_rescore_reads(hap_aligner, haplotype, alns_, log_aln_probs, seed_positions)){
+      total_hap_aln_time_ += (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
+      return false;
+    }
+    record_alignments(haplotype, alns_, log_aln_probs, seed_positions);
+    if (record_pooled_alns_ && haplotype == haplotype_){
+      recorded_index_.resize(num_reads_);
+      for (unsigned int i = 0; i < num_reads_; i++)
+	recorded_index_[i] = i;
+    }
   }
 
   // If both mate pairs overlap the STR region, they share the same phasing probabilities
@@ -325,6 +574,7 @@ void SeqStutterGenotyper::calc_hap_aln_probs(Haplotype* haplotype, double* log_a
 
   locus_hap_aln_time   = (clock() - locus_hap_aln_time)/CLOCKS_PER_SEC;
   total_hap_aln_time_ += locus_hap_aln_time;
+  return true;
 }
 
 bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(std::string& chrom_seq, std::ostream& logger){
@@ -342,17 +592,17 @@ bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(std::string& chrom_seq
 
     // Construct a new haplotype containing only stutter alleles and align each read to it
     std::vector<HapBlock*> blocks;
-    blocks.push_back(hap_blocks_[0]);
-    blocks.push_back(new RepeatBlock(hap_blocks_[1]->start(), hap_blocks_[1]->end(), stutter_seqs[0], region_->period(),
-				     hap_blocks_[1]->get_repeat_info()->get_stutter_model()));
-    blocks.push_back(hap_blocks_[2]);
-    for (unsigned int i = 1; i < stutter_seqs.size(); i++)
-      blocks[1]->add_alternate(stutter_seqs[i]);
-    Haplotype* haplotype      = new Haplotype(blocks);
+    Haplotype* haplotype      = allele_haplotype(stutter_seqs, blocks);
     double* new_log_aln_probs = new double[num_reads_*stutter_seqs.size()];
-    calc_hap_aln_probs(haplotype, new_log_aln_probs, seed_positions_);
+    bool aligned = calc_hap_aln_probs(haplotype, new_log_aln_probs, seed_positions_);
     delete blocks[1];
     delete haplotype;
+    if (!aligned){
+      logger << "Stopped aligning reads to stutter alleles as the locus exceeded its compute budget" << std::endl;
+      delete [] new_log_aln_probs;
+      over_budget_ = true;
+      return false;
+    }
 
     // Create a new sorted list of alleles and an STR haplotype block with all alleles
     std::vector<std::string> str_seqs;
@@ -420,6 +670,87 @@ bool SeqStutterGenotyper::id_and_align_to_stutter_alleles(std::string& chrom_seq
   return true;
 }
 
+std::string SeqStutterGenotyper::haplotype_signature(){
+  assert(haplotype_ != NULL);
+  std::stringstream signature;
+  signature << (pool_identical_seqs_ ? "POOLED" : "UNPOOLED");
+  for (int i = 0; i < haplotype_->num_blocks(); i++){
+    HapBlock* block = haplotype_->get_block(i);
+    signature << ";" << block->start() << "-" << block->end();
+    if (block->get_repeat_info() != NULL)
+      signature << ":" << block->get_repeat_info()->get_period();
+    else
+      for (int j = 0; j < block->num_options(); j++)
+	signature << ":" << block->get_seq(j);
+  }
+  return signature.str();
+}
+
+bool SeqStutterGenotyper::set_stored_alignments(const std::vector<int>& read_groups, const std::vector<int>& read_pools, std::vector<PooledAlignments>& stored){
+  assert(read_groups.size() == num_reads_ && read_pools.size() == num_reads_);
+  if (haplotype_ == NULL || !keyed_by_allele(haplotype_))
+    return false;
+  stored_alns_.swap(stored);
+  stored_groups_ = read_groups;
+  stored_pools_  = read_pools;
+  return true;
+}
+
+bool SeqStutterGenotyper::get_pooled_alignments(PooledAlignments& pooled, std::vector<int>& read_pools){
+  if (!record_pooled_alns_ || recorded_index_.size() != num_reads_ || !keyed_by_allele(haplotype_))
+    return false;
+
+  // The alignments must be available for every allele
+  HapBlock* repeat_block = haplotype_->get_block(1);
+  int num_alleles        = repeat_block->num_options();
+  bool have_emissions    = true;
+  std::vector<std::vector<double>*> allele_log_aln_probs;
+  for (int i = 0; i < num_alleles; i++){
+    auto prob_iter = recorded_log_aln_probs_.find(repeat_block->get_seq(i));
+    if (prob_iter == recorded_log_aln_probs_.end() || prob_iter->second.size() != recorded_alns_.size())
+      return false;
+    allele_log_aln_probs.push_back(&(prob_iter->second));
+    auto emission_iter = stutter_emissions_.find(repeat_block->get_seq(i));
+    have_emissions &= (emission_iter != stutter_emissions_.end() && emission_iter->second.size() == 2*recorded_alns_.size());
+  }
+  for (auto group_iter = stored_alns_.begin(); group_iter != stored_alns_.end(); group_iter++)
+    have_emissions &= !group_iter->emissions.empty();
+
+  // The pooled reads that were aligned precede those from each group of stored alignments
+  pooled = PooledAlignments();
+  std::vector<int> group_offsets;
+  pooled.alns  = recorded_alns_;
+  pooled.seed_positions = recorded_seeds_;
+  for (int i = 0; i < num_alleles; i++)
+    pooled.allele_seqs.push_back(repeat_block->get_seq(i));
+  for (unsigned int j = 0; j < recorded_alns_.size(); j++)
+    for (int i = 0; i < num_alleles; i++)
+      pooled.log_aln_probs.push_back((*allele_log_aln_probs[i])[j]);
+  for (auto group_iter = stored_alns_.begin(); group_iter != stored_alns_.end(); group_iter++){
+    assert(group_iter->allele_seqs == pooled.allele_seqs);
+    group_offsets.push_back(pooled.alns.size());
+    pooled.alns.insert(pooled.alns.end(), group_iter->alns.begin(), group_iter->alns.end());
+    pooled.seed_positions.insert(pooled.seed_positions.end(), group_iter->seed_positions.begin(), group_iter->seed_positions.end());
+    pooled.log_aln_probs.insert(pooled.log_aln_probs.end(), group_iter->log_aln_probs.begin(), group_iter->log_aln_probs.end());
+  }
+
+  if (have_emissions){
+    pooled.emissions.reserve(2*num_alleles*pooled.alns.size());
+    for (int i = 0; i < num_alleles; i++){
+      std::vector<StutterEmissions>& allele_emissions = stutter_emissions_[repeat_block->get_seq(i)];
+      pooled.emissions.insert(pooled.emissions.end(), allele_emissions.begin(), allele_emissions.end());
+      for (auto group_iter = stored_alns_.begin(); group_iter != stored_alns_.end(); group_iter++)
+	pooled.emissions.insert(pooled.emissions.end(), group_iter->emissions.begin() + 2*i*group_iter->alns.size(),
+				group_iter->emissions.begin() + 2*(i+1)*group_iter->alns.size());
+    }
+  }
+
+  read_pools.resize(num_reads_);
+  for (unsigned int i = 0; i < num_reads_; i++)
+    read_pools[i] = (recorded_index_[i] != -1 ? recorded_index_[i] : group_offsets[stored_groups_[i]] + stored_pools_[i]);
+  return true;
+}
+
 bool SeqStutterGenotyper::genotype(std::string& chrom_seq, std::ostream& logger){
   // Unsuccessful initialization. May be due to
   // 1) Failing to find the corresponding allele priors in the VCF (if one has been provided)
@@ -446,17 +777,21 @@ bool SeqStutterGenotyper::genotype(std::string& chrom_seq, std::ostream& logger)
 
   // Align each read to each candidate haplotype and store them in the provided arrays
   logger << "Aligning reads to each candidate haplotype..." << std::endl;
-  calc_hap_aln_probs(haplotype_, log_aln_probs_, seed_positions_);
+  if (!calc_hap_aln_probs(haplotype_, log_aln_probs_, seed_positions_)){
+    logger << "Stopped aligning reads as the locus exceeded its compute budget" << std::endl;
+    over_budget_ = true;
+    return false;
+  }
   calc_log_sample_posteriors();
 
   // Look for additional alleles in stutter artifacts and align to them (if necessary)
-  if (ref_vcf_ == NULL){
+  if (ref_vcf_ == NULL && !fixed_alleles_){
     if(!id_and_align_to_stutter_alleles(chrom_seq, logger))
       return false;
   }
 
   // Remove alleles with no MAP genotype calls and recompute the posteriors
-  if (ref_vcf_ == NULL && log_allele_priors_ == NULL){
+  if (ref_vcf_ == NULL && !fixed_alleles_ && log_allele_priors_ == NULL){
     std::vector<int> uncalled_indices;
     get_uncalled_alleles(uncalled_indices);
     if (uncalled_indices.size() != 0){
@@ -472,7 +807,7 @@ bool SeqStutterGenotyper::genotype(std::string& chrom_seq, std::ostream& logger)
     }
   }
   
-  if (ref_vcf_ != NULL)
+  if (ref_vcf_ != NULL || fixed_alleles_)
     pos_ += 1;
   return true;
 }
@@ -481,6 +816,10 @@ void SeqStutterGenotyper::write_vcf_header(std::string& full_command, std::vecto
   out << "##fileformat=VCFv4.1" << "\n"
       << "##command=" << full_command << "\n";
 
+  // Filter descriptors
+  out << "##FILTER=<ID=" << "BUDGET" << ",Description=\"" << "Locus exceeded its compute budget and wasn't genotyped"              << "\">\n"
+      << "##FILTER=<ID=" << "MEMORY" << ",Description=\"" << "Locus's estimated memory exceeded the limit and it wasn't genotyped" << "\">\n";
+
   // Info field descriptors
   out << "##INFO=<ID=" << "INFRAME_PGEOM"  << ",Number=1,Type=Float,Description=\""   << "Parameter for in-frame geometric step size distribution"                      << "\">\n"
       << "##INFO=<ID=" << "INFRAME_UP"     << ",Number=1,Type=Float,Description=\""   << "Probability that stutter causes an in-frame increase in obs. STR size"        << "\">\n"
@@ -501,7 +840,10 @@ void SeqStutterGenotyper::write_vcf_header(std::string& full_command, std::vecto
       << "##INFO=<ID=" << "DSNP"           << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with SNP phasing information"                           << "\">\n"
       << "##INFO=<ID=" << "DFILT"          << ",Number=1,Type=Integer,Description=\"" << "Total number of reads filtered due to various issues"                         << "\">\n"
       << "##INFO=<ID=" << "DSTUTTER"       << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with a stutter indel in the STR region"                 << "\">\n"
-      << "##INFO=<ID=" << "DFLANKINDEL"    << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with an indel in the regions flanking the STR"          << "\">\n";
+      << "##INFO=<ID=" << "DFLANKINDEL"    << ",Number=1,Type=Integer,Description=\"" << "Total number of reads with an indel in the regions flanking the STR"          << "\">\n"
+      << "##INFO=<ID=" << "DSFRAC"         << ",Number=1,Type=Float,Description=\""   << "Estimated fraction of STR reads retained after per-sample downsampling. Only present if the locus was downsampled" << "\">\n"
+      << "##INFO=<ID=" << "BUDGETTIER"     << ",Number=1,Type=Integer,Description=\"" << "Tier used because the locus exceeded its compute budget: 1 = no bootstrapped qualities, "
+      << "2 = only the best-supported candidate alleles, 3 = best-supported alleles and downsampled reads, 4 = not genotyped. Only present if the budget was exceeded" << "\">\n";
 
   // Format field descriptors
   out << "##FORMAT=<ID=" << "GT"          << ",Number=1,Type=String,Description=\""  << "Genotype" << "\">" << "\n"
@@ -539,6 +881,56 @@ void SeqStutterGenotyper::write_vcf_header(std::string& full_command, std::vecto
   out << "\n";
 }
 
+// Writes a record without any genotypes for a locus that wasn't genotyped, using the provided FILTER value and INFO suffix
+static void write_filtered_vcf_record(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names,
+				      const std::string& filter, const std::string& info, std::ostream& out){
+  std::string ref_allele = uppercase(chrom_seq.substr(region.start(), region.stop()-region.start()));
+  out << region.chrom() << "\t" << region.start()+1 << "\t" << (region.name().empty() ? "." : region.name())
+      << "\t" << ref_allele << "\t" << "." << "\t" << "." << "\t" << filter
+      << "\t" << "START=" << region.start()+1 << ";END=" << region.stop() << ";PERIOD=" << region.period() << info
+      << "\t" << "GT";
+  for (unsigned int i = 0; i < sample_names.size(); i++)
+    out << "\t" << ".";
+  out << "\n";
+}
+
+void SeqStutterGenotyper::write_over_budget_vcf_record(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names, std::ostream& out){
+  write_filtered_vcf_record(region, chrom_seq, sample_names, "BUDGET", ";BUDGETTIER=" + std::to_string(BUDGET_TIER_FILTERED), out);
+}
+
+void SeqStutterGenotyper::write_over_memory_vcf_record(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names, std::ostream& out){
+  write_filtered_vcf_record(region, chrom_seq, sample_names, "MEMORY", "", out);
+}
+
+bool SeqStutterGenotyper::best_supported_alleles(int max_alleles, std::vector<std::string>& alleles, int32_t& allele_pos){
+  alleles.clear();
+  if (pos_ == -1 || alleles_.empty())
+    return false;
+
+  // Rank the non-reference alleles by the number of reads whose base pair difference matches their length
+  std::map<int, int> bp_diff_counts;
+  for (unsigned int i = 0; i < num_reads_; i++)
+    bp_diff_counts[bp_diffs_[i]]++;
+  std::vector< std::pair<int, int> > allele_support;
+  for (unsigned int i = 1; i < alleles_.size(); i++){
+    auto count_iter = bp_diff_counts.find((int)alleles_[i].size() - (int)alleles_[0].size());
+    allele_support.push_back(std::pair<int, int>(count_iter == bp_diff_counts.end() ? 0 : -count_iter->second, i));
+  }
+  std::sort(allele_support.begin(), allele_support.end());
+
+  // Retain the original order of the selected alleles
+  std::vector<int> allele_indices(1, 0);
+  for (unsigned int i = 0; i < allele_support.size() && (int)allele_indices.size() < max_alleles; i++)
+    allele_indices.push_back(allele_support[i].second);
+  std::sort(allele_indices.begin(), allele_indices.end());
+  for (unsigned int i = 0; i < allele_indices.size(); i++)
+    alleles.push_back(alleles_[allele_indices[i]]);
+
+  // Discovered alleles have a 1-based position, while provided alleles retain their 0-based position until genotyping succeeds
+  allele_pos = (fixed_alleles_ ? pos_ : pos_-1);
+  return true;
+}
+
 void SeqStutterGenotyper::get_alleles(std::string& chrom_seq, std::vector<std::string>& alleles){
   assert(alleles.size() == 0);
 
@@ -818,7 +1210,7 @@ void SeqStutterGenotyper::analyze_flank_indels(std::ostream& logger){
 void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_names, bool print_info, std::string& chrom_seq,
 					   bool output_bootstrap_qualities, bool output_gls, bool output_pls, bool output_phased_gls,
 					   bool output_allreads, bool output_pallreads, bool output_mallreads, bool output_viz, float max_flank_indel_frac,
-					   bool visualize_left_alns,
+					   double downsample_frac, bool visualize_left_alns, GLSidecarWriter* gl_sidecar,
 					   std::ostream& html_output, std::ostream& out, std::ostream& logger){
   assert(haplotype_->num_blocks() == 3);
 
@@ -1001,10 +1393,14 @@ void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_name
   }
 
   // Compute bootstrap qualities if flag set
+  // Bootstrapping is the first computation skipped when a locus exceeds its compute budget, in which case the BQ field is omitted
   std::vector<double> bootstrap_qualities;
   int bootstrap_iter = 100;
-  if (output_bootstrap_qualities)
-    compute_bootstrap_qualities(bootstrap_iter, bootstrap_qualities);
+  if (output_bootstrap_qualities && budget_tier_ == BUDGET_TIER_FULL && !compute_bootstrap_qualities(bootstrap_iter, bootstrap_qualities)){
+    logger << "Skipping bootstrapped quality scores as the locus exceeded its compute budget" << std::endl;
+    budget_tier_ = BUDGET_TIER_NO_BOOTSTRAP;
+  }
+  output_bootstrap_qualities = (output_bootstrap_qualities && budget_tier_ == BUDGET_TIER_FULL);
  
   // Compute allele counts for samples of interest
   std::set<std::string> samples_of_interest(sample_names.begin(), sample_names.end());
@@ -1043,21 +1439,25 @@ void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_name
     logger << std::endl;
   }
 
+  // Assemble the record in a buffer and write it to the VCF in a single call
+  VCFRecordFormatter record(out.precision());
+  record.reserve(1024 + 128*sample_names.size());
+
   //VCF line format = CHROM POS ID REF ALT QUAL FILTER INFO FORMAT SAMPLE_1 SAMPLE_2 ... SAMPLE_N
-  out << region_->chrom() << "\t" << pos_ << "\t" << (region_->name().empty() ? "." : region_->name());
+  record << region_->chrom() << "\t" << pos_ << "\t" << (region_->name().empty() ? "." : region_->name());
 
   // Add reference allele and alternate alleles
-  out << "\t" << alleles_[0] << "\t";
+  record << "\t" << alleles_[0] << "\t";
   if (num_alleles_ == 1)
-    out << ".";
+    record << ".";
   else {
     for (int i = 1; i < num_alleles_-1; i++)
-      out << alleles_[i] << ",";
-    out << alleles_[num_alleles_-1];
+      record << alleles_[i] << ",";
+    record << alleles_[num_alleles_-1];
   }
 
   // Add QUAL and FILTER fields
-  out << "\t" << "." << "\t" << ".";
+  record << "\t" << "." << "\t" << ".";
 
   // Obtain relevant stutter model. For now, get it from first repeat block
   // TO DO: Generalize this
@@ -1065,22 +1465,22 @@ void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_name
   StutterModel* stutter_model = haplotype_->get_block(1)->get_repeat_info()->get_stutter_model();
 
   // Add INFO field items
-  out << "\tINFRAME_PGEOM=" << stutter_model->get_parameter(true,  'P') << ";"
-      << "INFRAME_UP="      << stutter_model->get_parameter(true,  'U') << ";"
-      << "INFRAME_DOWN="    << stutter_model->get_parameter(true,  'D') << ";"
-      << "OUTFRAME_PGEOM="  << stutter_model->get_parameter(false, 'P') << ";"
-      << "OUTFRAME_UP="     << stutter_model->get_parameter(false, 'U') << ";"
-      << "OUTFRAME_DOWN="   << stutter_model->get_parameter(false, 'D') << ";"
-      << "START="           << region_->start()+1 << ";"
-      << "END="             << region_->stop()    << ";"
-      << "PERIOD="          << region_->period()  << ";"
-      << "NSKIP="           << skip_count         << ";"
-      << "NFILT="           << filt_count         << ";";
+  record << "\tINFRAME_PGEOM=" << stutter_model->get_parameter(true,  'P') << ";"
+         << "INFRAME_UP="      << stutter_model->get_parameter(true,  'U') << ";"
+         << "INFRAME_DOWN="    << stutter_model->get_parameter(true,  'D') << ";"
+         << "OUTFRAME_PGEOM="  << stutter_model->get_parameter(false, 'P') << ";"
+         << "OUTFRAME_UP="     << stutter_model->get_parameter(false, 'U') << ";"
+         << "OUTFRAME_DOWN="   << stutter_model->get_parameter(false, 'D') << ";"
+         << "START="           << region_->start()+1 << ";"
+         << "END="             << region_->stop()    << ";"
+         << "PERIOD="          << region_->period()  << ";"
+         << "NSKIP="           << skip_count         << ";"
+         << "NFILT="           << filt_count         << ";";
   if (num_alleles_ > 1){
-    out << "BPDIFFS=" << allele_bp_diffs[1];
+    record << "BPDIFFS=" << allele_bp_diffs[1];
     for (unsigned int i = 2; i < num_alleles_; i++)
-      out << "," << allele_bp_diffs[i];
-    out << ";";
+      record << "," << allele_bp_diffs[i];
+    record << ";";
   }
 
   // Compute INFO field values for DP, DFILT, DSTUTTER and DFLANKINDEL and add them to the VCF
@@ -1102,68 +1502,74 @@ void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_name
     tot_dstutter    += num_reads_with_stutter[sample_index];
     tot_dflankindel += num_reads_with_flank_indels[sample_index];
   }
-  out << "DP="          << tot_dp          << ";"
-      << "DSNP="        << tot_dsnp        << ";"
-      << "DFILT="       << tot_dfilt       << ";"
-      << "DSTUTTER="    << tot_dstutter    << ";"
-      << "DFLANKINDEL=" << tot_dflankindel << ";";
+  record << "DP="          << tot_dp          << ";"
+         << "DSNP="        << tot_dsnp        << ";"
+         << "DFILT="       << tot_dfilt       << ";"
+         << "DSTUTTER="    << tot_dstutter    << ";"
+         << "DFLANKINDEL=" << tot_dflankindel << ";";
+  if (downsample_frac < 1.0)
+    record << "DSFRAC=" << downsample_frac << ";";
+  if (budget_tier_ != BUDGET_TIER_FULL)
+    record << "BUDGETTIER=" << budget_tier_ << ";";
 
   // Add allele counts
-  out << "AN=" << allele_number << ";" << "REFAC=" << allele_counts[0];
+  record << "AN=" << allele_number << ";" << "REFAC=" << allele_counts[0];
   if (allele_counts.size() > 1){
-    out << ";AC=";
+    record << ";AC=";
     for (unsigned int i = 1; i < allele_counts.size()-1; i++)
-      out << allele_counts[i] << ",";
-    out << allele_counts.back();
+      record << allele_counts[i] << ",";
+    record << allele_counts.back();
   }
 
   // Add FORMAT field
-  out << (!haploid_ ? "\tGT:GB:Q:PQ:DP:DSNP:DFILT:DSTUTTER:DFLANKINDEL:PDP:PSNP:BPDOSE:GLDIFF" : "\tGT:GB:Q:DP:DFILT:DSTUTTER:DFLANKINDEL:BPDOSE:GLDIFF");
-  if (output_bootstrap_qualities) out << ":BQ";
-  if (output_allreads)            out << ":ALLREADS";
-  if (output_pallreads)           out << ":PALLREADS";
-  if (output_mallreads)           out << ":MALLREADS";
-  if (output_gls)                 out << ":GL";
-  if (output_pls)                 out << ":PL";
-  if (output_phased_gls)          out << ":PHASEDGL";
+  record << (!haploid_ ? "\tGT:GB:Q:PQ:DP:DSNP:DFILT:DSTUTTER:DFLANKINDEL:PDP:PSNP:BPDOSE:GLDIFF" : "\tGT:GB:Q:DP:DFILT:DSTUTTER:DFLANKINDEL:BPDOSE:GLDIFF");
+  if (output_bootstrap_qualities) record << ":BQ";
+  if (output_allreads)            record << ":ALLREADS";
+  if (output_pallreads)           record << ":PALLREADS";
+  if (output_mallreads)           record << ":MALLREADS";
+  if (output_gls)                 record << ":GL";
+  if (output_pls)                 record << ":PL";
+  if (output_phased_gls)          record << ":PHASEDGL";
 
   std::map<std::string, std::string> sample_results;
+  std::vector<const std::vector<double>*> sidecar_phased_gls(sample_names.size(), NULL), sidecar_gls(sample_names.size(), NULL);
   for (unsigned int i = 0; i < sample_names.size(); i++){
-    out << "\t";
+    record << "\t";
     auto sample_iter = sample_indices_.find(sample_names[i]);
     if (sample_iter == sample_indices_.end()){
-      out << ".";
+      record << ".";
       continue;
     }
     
     // Don't report information for a sample if none of its reads were successfully realigned
     // and we require at least one read
     if (require_one_read_ && num_aligned_reads[sample_iter->second] == 0){
-      out << ".";
+      record << ".";
       continue;
     }
 
     // Don't report information for a sample if flag has been set to false
     if (!call_sample_[sample_iter->second]){
-      out << ".";
+      record << ".";
       continue;
     }
 
     // Don't report genotype for a sample if it exceeds the flank indel fraction
     if (num_aligned_reads[sample_iter->second] > 0 &&
 	(num_reads_with_flank_indels[sample_iter->second] > num_aligned_reads[sample_iter->second]*max_flank_indel_frac)){
-      out << ".";
+      record << ".";
       continue;
     }
 
     
     int sample_index    = sample_iter->second;
+    sidecar_phased_gls[i] = &phased_gls[sample_index];
+    sidecar_gls[i]        = &gls[sample_index];
     double phase1_reads = (num_aligned_reads[sample_index] == 0 ? 0 : exp(log_sum_exp(log_read_phases[sample_index])));
     double phase2_reads = num_aligned_reads[sample_index] - phase1_reads;
 
-    std::stringstream samp_info;
-    samp_info << allele_bp_diffs[gts[sample_index].first] << "|" << allele_bp_diffs[gts[sample_index].second];
-    sample_results[sample_names[i]] = samp_info.str();
+    if (output_viz)
+      sample_results[sample_names[i]] = std::to_string(allele_bp_diffs[gts[sample_index].first]) + "|" + std::to_string(allele_bp_diffs[gts[sample_index].second]);
 
     // TO DO: Compute p-value for allele read depth bias
     // i)  Spanning reads
@@ -1172,83 +1578,88 @@ void SeqStutterGenotyper::write_vcf_record(std::vector<std::string>& sample_name
     // e.g.: double val = bdtr (24, 50, 0.5);
 
     if (!haploid_){
-      out << gts[sample_index].first << "|" << gts[sample_index].second                             // Genotype
-	  << ":" << allele_bp_diffs[gts[sample_index].first]
-	  << "|" << allele_bp_diffs[gts[sample_index].second]                                       // Base pair differences from reference
-	  << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
-	  << ":" << exp(log_phased_posteriors[sample_index])                                        // Phased posterior
-	  << ":" << num_aligned_reads[sample_index]                                                 // Total reads used to genotype (after filtering)
-	  << ":" << num_reads_with_snps[sample_index]                                               // Total reads with SNP information
-	  << ":" << masked_reads[sample_index]                                                      // Total masked reads
-	  << ":" << num_reads_with_stutter[sample_index]                                            // Total reads with a non-zero stutter artifact in ML alignment
-	  << ":" << num_reads_with_flank_indels[sample_index]                                       // Total reads with an indel in flank in ML alignment
-	  << ":" << phase1_reads << "|" << phase2_reads                                             // Reads per allele
-	  << ":" << num_reads_strand_one[sample_index] << "|" << num_reads_strand_two[sample_index] // Reads with SNPs supporting each haploid genotype
-	  << ":" << bp_dosages[sample_index];                                                       // Posterior STR dosage (in base pairs)
+      record << gts[sample_index].first << "|" << gts[sample_index].second                             // Genotype
+	     << ":" << allele_bp_diffs[gts[sample_index].first]
+	     << "|" << allele_bp_diffs[gts[sample_index].second]                                       // Base pair differences from reference
+	     << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
+	     << ":" << exp(log_phased_posteriors[sample_index])                                        // Phased posterior
+	     << ":" << num_aligned_reads[sample_index]                                                 // Total reads used to genotype (after filtering)
+	     << ":" << num_reads_with_snps[sample_index]                                               // Total reads with SNP information
+	     << ":" << masked_reads[sample_index]                                                      // Total masked reads
+	     << ":" << num_reads_with_stutter[sample_index]                                            // Total reads with a non-zero stutter artifact in ML alignment
+	     << ":" << num_reads_with_flank_indels[sample_index]                                       // Total reads with an indel in flank in ML alignment
+	     << ":" << phase1_reads << "|" << phase2_reads                                             // Reads per allele
+	     << ":" << num_reads_strand_one[sample_index] << "|" << num_reads_strand_two[sample_index] // Reads with SNPs supporting each haploid genotype
+	     << ":" << bp_dosages[sample_index];                                                       // Posterior STR dosage (in base pairs)
 
       // Difference in GL between the current and next best genotype
       if (num_alleles_ == 1)
-	out << ":" << ".";
+	record << ":" << ".";
       else
-	out << ":" << gl_diffs[sample_index];
+	record << ":" << gl_diffs[sample_index];
     }
     else {
-      out << gts[sample_index].first                                                                // Genotype
-	  << ":" << allele_bp_diffs[gts[sample_index].first]                                        // Base pair differences from reference
-	  << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
-	  << ":" << num_aligned_reads[sample_index]                                                 // Total reads used to genotype (after filtering)
-	  << ":" << masked_reads[sample_index]                                                      // Total masked reads
-	  << ":" << num_reads_with_stutter[sample_index]                                            // Total reads with a non-zero stutter artifact in ML alignment
-	  << ":" << num_reads_with_flank_indels[sample_index]                                       // Total reads with an indel in flank in ML alignment
-	  << ":" << bp_dosages[sample_index];                                                       // Posterior STR dosage (in base pairs)
+      record << gts[sample_index].first                                                                // Genotype
+	     << ":" << allele_bp_diffs[gts[sample_index].first]                                        // Base pair differences from reference
+	     << ":" << exp(log_unphased_posteriors[sample_index])                                      // Unphased posterior
+	     << ":" << num_aligned_reads[sample_index]                                                 // Total reads used to genotype (after filtering)
+	     << ":" << masked_reads[sample_index]                                                      // Total masked reads
+	     << ":" << num_reads_with_stutter[sample_index]                                            // Total reads with a non-zero stutter artifact in ML alignment
+	     << ":" << num_reads_with_flank_indels[sample_index]                                       // Total reads with an indel in flank in ML alignment
+	     << ":" << bp_dosages[sample_index];                                                       // Posterior STR dosage (in base pairs)
 
       // Difference in GL between the current and next best genotype
       if (num_alleles_ == 1)
-	out << ":" << ".";
+	record << ":" << ".";
       else
-	out << ":" << gl_diffs[sample_index];
+	record << ":" << gl_diffs[sample_index];
     }
 
     if (output_bootstrap_qualities)
-      out << ":" << bootstrap_qualities[sample_index];
+      record << ":" << bootstrap_qualities[sample_index];
 
     // Add bp diffs from regular left-alignment
     if (output_allreads)
-	out << ":" << condense_read_counts(bps_per_sample[sample_index]);
+      condense_read_counts(bps_per_sample[sample_index], record << ":");
 
     // Expected base pair differences from alignment probabilities
     if (output_pallreads){
       if (posterior_bps_per_sample[sample_index].size() != 0){
-	out << ":" << posterior_bps_per_sample[sample_index][0];
+	record << ":" << posterior_bps_per_sample[sample_index][0];
 	for (unsigned int j = 1; j < posterior_bps_per_sample[sample_index].size(); j++)
-	  out << "," << posterior_bps_per_sample[sample_index][j];
+	  record << "," << posterior_bps_per_sample[sample_index][j];
       }
       else
-	out << ":" << ".";
+	record << ":" << ".";
     }
 
     // Maximum likelihood base pair differences in each read from alignment probabilites
     if (output_mallreads)
-	out << ":" << condense_read_counts(ml_bps_per_sample[sample_index]);
+      condense_read_counts(ml_bps_per_sample[sample_index], record << ":");
 
     // Genotype and phred-scaled likelihoods
     if (output_gls){
-      out << ":" << gls[sample_index][0];
+      record << ":" << gls[sample_index][0];
       for (unsigned int j = 1; j < gls[sample_index].size(); j++)
-	out << "," << gls[sample_index][j];
+	record << "," << gls[sample_index][j];
     }
     if (output_pls){
-      out << ":" << pls[sample_index][0];
+      record << ":" << pls[sample_index][0];
       for (unsigned int j = 1; j < pls[sample_index].size(); j++)
-	out << "," << pls[sample_index][j];
+	record << "," << pls[sample_index][j];
     }
     if (output_phased_gls){
-      out << ":" << phased_gls[sample_index][0];
+      record << ":" << phased_gls[sample_index][0];
       for (unsigned int j = 1; j < phased_gls[sample_index].size(); j++)
-	out << "," << phased_gls[sample_index][j];
+	record << "," << phased_gls[sample_index][j];
     }
   }
-  out << "\n";
+  record << "\n";
+  record.flush(out);
+
+  // Add the genotype likelihoods to the binary sidecar
+  if (gl_sidecar != NULL)
+    gl_sidecar->add_locus(region_->chrom(), pos_, num_alleles_, sidecar_phased_gls, sidecar_gls);
 
   // Render HTML of Smith-Waterman alignments (or haplotype alignments)
   if (output_viz){
@@ -1313,10 +1724,22 @@ bool SeqStutterGenotyper::recompute_stutter_models(std::string& chrom_seq, std::
     block->get_repeat_info()->set_stutter_model(length_genotyper.get_stutter_model());
   }
   trace_cache_.clear();
-  return genotype(chrom_seq, logger);
+
+  // The stored alignments were computed using the previous stutter model
+  stored_alns_.clear();
+  stored_groups_.clear();
+  stored_pools_.clear();
+
+  // Only the stutter model has changed, so rescore the reads using the recorded terms of their alignments if they're available
+  rescore_stutter_ = !stutter_emissions_.empty();
+  if (rescore_stutter_)
+    logger << "Rescoring reads using the retrained stutter model(s)" << std::endl;
+  bool genotyped   = genotype(chrom_seq, logger);
+  rescore_stutter_ = false;
+  return genotyped;
 }
 
-void SeqStutterGenotyper::compute_bootstrap_qualities(int num_iter, std::vector<double>& bootstrap_qualities){
+bool SeqStutterGenotyper::compute_bootstrap_qualities(int num_iter, std::vector<double>& bootstrap_qualities){
   assert(bootstrap_qualities.size() == 0);
   double bootstrap_start = clock();
 
@@ -1335,6 +1758,10 @@ void SeqStutterGenotyper::compute_bootstrap_qualities(int num_iter, std::vector<
   std::default_random_engine gen;
   double log_homoz_prior = log_homozygous_prior(), log_hetz_prior = log_heterozygous_prior();
   for (unsigned int i = 0; i < num_samples_; i++){
+    if (budget_ != NULL && budget_->exceeded()){
+      total_bootstrap_time_ += (clock() - bootstrap_start)/CLOCKS_PER_SEC;
+      return false;
+    }
     int num_sample_reads = reads_by_sample[i].size();
 
     // Precompute all read LLs for each of the sample's diploid genotypes
@@ -1389,4 +1816,5 @@ void SeqStutterGenotyper::compute_bootstrap_qualities(int num_iter, std::vector<
 
   double bootstrap_time  = (clock() - bootstrap_start)/CLOCKS_PER_SEC;
   total_bootstrap_time_ += bootstrap_time;
+  return true;
 }
@@ -13,6 +13,8 @@
 
 #include "base_quality.h"
 #include "genotyper.h"
+#include "gl_sidecar.h"
+#include "locus_budget.h"
 #include "read_pooler.h"
 #include "region.h"
 #include "stutter_model.h"
@@ -21,9 +23,32 @@
 
 #include "SeqAlignment/AlignmentData.h"
 #include "SeqAlignment/AlignmentTraceback.h"
+#include "SeqAlignment/HapAligner.h"
 #include "SeqAlignment/Haplotype.h"
 #include "SeqAlignment/HapBlock.h"
 
+/*
+ * Alignments of a set of pooled reads (or reads) to each allele of a haplotype. Alignments stored for the reads
+ * can be provided to a genotyper whose haplotype has the same signature instead of realigning the reads
+ */
+class PooledAlignments {
+ public:
+  std::vector<Alignment> alns;              // Pooled reads, with the base qualities used to align them
+  std::vector<int> seed_positions;          // Seed position of each pooled read
+  std::vector<std::string> allele_seqs;     // Repeat block sequence of each allele
+  std::vector<double> log_aln_probs;        // Read-major log-likelihoods for each allele, before the likelihoods of mate pairs are combined
+
+  // Left and right stutter model-independent terms of each alignment, where the entries for allele j and pooled read i begin
+  // at index 2*(j*number of pooled reads + i). Empty if they weren't recorded
+  std::vector<StutterEmissions> emissions;
+
+  bool rescore; // True iff the log-likelihoods were computed using a different stutter model
+
+  PooledAlignments(){
+    rescore = false;
+  }
+};
+
 class SeqStutterGenotyper : public Genotyper {
  private:
   int MAX_REF_FLANK_LEN;
@@ -41,6 +66,7 @@ class SeqStutterGenotyper : public Genotyper {
                                                   // Based on the deletion boundaries in the sample's reads
 
   bool alleles_from_bams_; // Flag that determines if we examine BAMs for candidate alleles
+  bool fixed_alleles_;     // True iff the candidate alleles were provided to the constructor
 
   std::vector<std::string> alleles_; // Vector of indexed alleles
   int32_t pos_;                      // Position of reported alleles in VCF     
@@ -73,9 +99,70 @@ class SeqStutterGenotyper : public Genotyper {
   // True iff both the indexed read and its mate overlap the STR and the current read's index is greater
   bool* second_mate_;
 
+  // Alignments provided for reads that don't need to be realigned, along with the index of each read's group
+  // (or -1 if it has to be aligned) and its index within the group. Only used for the haplotype constructed during initialization
+  std::vector<PooledAlignments> stored_alns_;
+  std::vector<int> stored_groups_, stored_pools_;
+
+  // Alignments of the pooled reads (or reads) to each allele, keyed by the allele's repeat block sequence, along with their seed positions
+  // and the index of each read's pooled read (or -1 if it used stored alignments). Only recorded if enabled
+  bool record_pooled_alns_;
+  AlnList recorded_alns_;
+  std::vector<int> recorded_seeds_, recorded_index_;
+  std::map<std::string, std::vector<double> > recorded_log_aln_probs_;
+
+  // Optional per-locus compute budget, the tier used to genotype the locus and whether genotyping stopped because of the budget
+  LocusBudget* budget_;
+  int budget_tier_;
+  bool over_budget_;
+
+  // Stutter model-independent terms of each read's (or each pooled read's) alignment to each repeat allele, keyed by the allele's
+  // sequence. Only recorded if enabled, so that recompute_stutter_models() can rescore the reads instead of realigning them
+  bool record_stutter_emissions_;
+  bool rescore_stutter_;  // True iff the reads should be rescored using the recorded terms
+  std::map<std::string, std::vector<StutterEmissions> > stutter_emissions_;
+  int64_t stutter_emission_bytes_;
+
   /* Compute the alignment probabilites between each read and each haplotype */
   double calc_align_probs();
 
+  // Set the member variables shared by the constructors
+  void set_defaults(std::vector<Alignment>& alignments, std::vector<bool>& use_to_generate_haps, std::vector<int>& bp_diffs,
+		    bool pool_identical_seqs, VCF::VCFReader* ref_vcf){
+    alns_                  = alignments;
+    bp_diffs_              = bp_diffs;
+    use_for_haps_          = use_to_generate_haps;
+    seed_positions_        = NULL;
+    pool_index_            = NULL;
+    haplotype_             = NULL;
+    second_mate_           = NULL;
+    ref_vcf_               = ref_vcf;
+    MAX_REF_FLANK_LEN      = 30;
+    pos_                   = -1;
+    pool_identical_seqs_   = pool_identical_seqs;
+    total_hap_build_time_  = total_hap_aln_time_    = 0;
+    total_aln_trace_time_  = total_bootstrap_time_  = 0;
+    alleles_from_bams_     = true;
+    fixed_alleles_         = false;
+    budget_                = NULL;
+    budget_tier_           = BUDGET_TIER_FULL;
+    over_budget_           = false;
+    record_stutter_emissions_ = false;
+    rescore_stutter_          = false;
+    stutter_emission_bytes_   = 0;
+    record_pooled_alns_       = false;
+
+    require_one_read_      = true;
+    /* TO DO: Properly set this flag based on whether the VCF has the required FORMAT fields
+    // True iff no allele priors are available (for imputation)
+    if (ref_vcf == NULL)
+      require_one_read_ = true;
+    else
+      require_one_read_ = (ref_vcf->formatTypes.find(PGP_KEY) == ref_vcf->formatTypes.end());
+    */
+    assert(num_reads_ == alns_.size() && num_reads_ == bp_diffs_.size() && num_reads_ == use_for_haps_.size());
+  }
+
   // Set up the relevant data structures. Invoked by the constructor 
   void init(StutterModel& stutter_model, std::string& chrom_seq, std::ostream& logger);
 
@@ -94,8 +181,8 @@ class SeqStutterGenotyper : public Genotyper {
   void remove_alleles(std::vector<int>& allele_indices);
 
   // Compute bootstrapped quality scores by resampling reads and determining how frequently
-  // the genotypes match the ML genotype
-  void compute_bootstrap_qualities(int num_iter, std::vector<double>& bootstrap_qualities);
+  // the genotypes match the ML genotype. Returns false iff the locus exceeded its compute budget
+  bool compute_bootstrap_qualities(int num_iter, std::vector<double>& bootstrap_qualities);
 
   // Retrace the alignment for each read and store the associated pointers in the provided vector
   // Reads which were unaligned will have a NULL pointer
@@ -109,7 +196,25 @@ class SeqStutterGenotyper : public Genotyper {
   void get_stutter_candidate_alleles(std::ostream& logger, std::vector<std::string>& candidate_seqs);
 
   // Align each read to each of the candidate alleles, and store the results in the provided arrays
-  void calc_hap_aln_probs(Haplotype* haplotype, double* log_aln_probs, int* seed_positions);
+  // Returns false iff the alignment stopped because the locus exceeded its compute budget
+  bool calc_hap_aln_probs(Haplotype* haplotype, double* log_aln_probs, int* seed_positions);
+
+  // Align the provided reads to each of the haplotype's alleles, recording their stutter model-independent terms if enabled,
+  // or rescore them using the recorded terms after the stutter model has been retrained. Returns false iff the locus exceeded its compute budget
+  bool align_or_rescore_reads(HapAligner& hap_aligner, Haplotype* haplotype, AlnList& alns, double* log_aln_probs, int* seed_positions);
+
+  // True iff the repeat block is the only one of the haplotype's blocks with alternate sequences, so that its alignments can be keyed by allele
+  bool keyed_by_allele(Haplotype* haplotype);
+
+  // Constructs a haplotype with the initial haplotype's flanks and a repeat block containing only the provided alleles
+  Haplotype* allele_haplotype(const std::vector<std::string>& allele_seqs, std::vector<HapBlock*>& blocks);
+
+  // Converts the stored alignments to the initial haplotype's alleles, aligning the reads to any alleles they lack and rescoring them if they
+  // were computed using a different stutter model. Returns false iff the locus exceeded its compute budget
+  bool resolve_stored_alignments();
+
+  // Records the alignments of the pooled reads (or reads) to each of the haplotype's alleles if enabled
+  void record_alignments(Haplotype* haplotype, AlnList& alns, const double* log_aln_probs, const int* seed_positions);
 
   // Identify alleles present in stutter artifacts
   // Align each read to these alleles and incorporate these alignment probabilities and
@@ -131,31 +236,25 @@ class SeqStutterGenotyper : public Genotyper {
 		      std::vector<std::string>& sample_names, std::string& chrom_seq,
 		      bool pool_identical_seqs,
 		      StutterModel& stutter_model, VCF::VCFReader* ref_vcf, std::ostream& logger): Genotyper(region, haploid, false, sample_names, log_p1, log_p2){
-    alns_                  = alignments;
-    bp_diffs_              = bp_diffs;
-    use_for_haps_          = use_to_generate_haps;
-    seed_positions_        = NULL;
-    pool_index_            = NULL;
-    haplotype_             = NULL;
-    second_mate_           = NULL;
-    ref_vcf_               = ref_vcf;
-    MAX_REF_FLANK_LEN      = 30;
-    pos_                   = -1;
-    pool_identical_seqs_   = pool_identical_seqs;
-    total_hap_build_time_  = total_hap_aln_time_    = 0;
-    total_aln_trace_time_  = total_bootstrap_time_  = 0;
-    ref_vcf_               = ref_vcf;
-    alleles_from_bams_     = true;
+    set_defaults(alignments, use_to_generate_haps, bp_diffs, pool_identical_seqs, ref_vcf);
+    init(stutter_model, chrom_seq, logger);
+  }
 
-    require_one_read_      = true;
-    /* TO DO: Properly set this flag based on whether the VCF has the required FORMAT fields
-    // True iff no allele priors are available (for imputation)
-    if (ref_vcf == NULL)
-      require_one_read_ = true;
-    else
-      require_one_read_ = (ref_vcf->formatTypes.find(PGP_KEY) == ref_vcf->formatTypes.end());
-    */
-    assert(num_reads_ == alns_.size() && num_reads_ == bp_diffs_.size() && num_reads_ == use_for_haps_.size());
+  /*
+   * Genotypes the samples using the provided candidate alleles instead of identifying them from the reads.
+   * ALLELE_POS is the 0-based position of the first base of each allele, and the first allele must match the reference.
+   * Alleles aren't added or removed while genotyping, so that loci genotyped in separate chunks of samples share the same alleles
+   */
+  SeqStutterGenotyper(Region& region, bool haploid,
+		      std::vector<Alignment>& alignments, std::vector<bool>& use_to_generate_haps, std::vector<int>& bp_diffs,
+		      std::vector< std::vector<double> >& log_p1, std::vector< std::vector<double> >& log_p2,
+		      std::vector<std::string>& sample_names, std::string& chrom_seq,
+		      bool pool_identical_seqs, StutterModel& stutter_model,
+		      std::vector<std::string>& alleles, int32_t allele_pos, std::ostream& logger): Genotyper(region, haploid, false, sample_names, log_p1, log_p2){
+    set_defaults(alignments, use_to_generate_haps, bp_diffs, pool_identical_seqs, NULL);
+    fixed_alleles_ = true;
+    alleles_       = alleles;
+    pos_           = allele_pos;
     init(stutter_model, chrom_seq, logger);
   }
 
@@ -174,6 +273,12 @@ class SeqStutterGenotyper : public Genotyper {
   
   static void write_vcf_header(std::string& full_command, std::vector<std::string>& sample_names, bool output_gls, bool output_pls, bool output_phased_gls, std::ostream& out);
 
+  /* Writes a record without genotypes for a locus that exceeded its compute budget in every tier */
+  static void write_over_budget_vcf_record(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names, std::ostream& out);
+
+  /* Writes a record without genotypes for a locus that was deferred because its estimated memory exceeded the limit */
+  static void write_over_memory_vcf_record(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names, std::ostream& out);
+
   /*
    *  Returns true iff the read with the associated retraced maximum log-likelihood alignment should be used in genotyping
    *  Considers factors such as indels in the regions flanking the STR block and the total number of matched bases
@@ -183,7 +288,7 @@ class SeqStutterGenotyper : public Genotyper {
   void write_vcf_record(std::vector<std::string>& sample_names, bool print_info, std::string& chrom_seq,
 			bool output_bootstrap_qualities, bool output_gls, bool output_pls, bool output_phased_gls,
 			bool output_allreads, bool output_pallreads, bool output_mallreads, bool output_viz, float max_flank_indel_frac,
-			bool visualize_left_alns,
+			double downsample_frac, bool visualize_left_alns, GLSidecarWriter* gl_sidecar,
 			std::ostream& html_output, std::ostream& out, std::ostream& logger);
 
 
@@ -192,8 +297,76 @@ class SeqStutterGenotyper : public Genotyper {
   double aln_trace_time() { return total_aln_trace_time_;  }
   double bootstrap_time() { return total_bootstrap_time_;  }
 
+  // The VCF position and sequence of each candidate allele, with the reference allele first. Alleles discovered from the reads
+  // are available once the genotyper has been constructed (the position is -1 if none were), while provided alleles are only valid after genotype() succeeds
+  int32_t vcf_pos()                          { return pos_;     }
+  const std::vector<std::string>& alleles()  { return alleles_; }
+
+  // Flags each allele that's part of at least one sample's MAP genotype. The reference allele is always flagged. Only valid after genotype() succeeds
+  void get_called_alleles(std::vector<bool>& called){
+    std::vector<int> uncalled_indices;
+    get_uncalled_alleles(uncalled_indices);
+    called = std::vector<bool>(num_alleles_, true);
+    for (unsigned int i = 0; i < uncalled_indices.size(); i++)
+      called[uncalled_indices[i]] = false;
+  }
+
+  /*
+   * Returns a string that identifies the haplotype's flanking sequences. A read's alignment to an allele of haplotypes with the same signature
+   * only differs if their stutter models differ, so alignments computed for a haplotype with the same signature can be provided to set_stored_alignments()
+   */
+  std::string haplotype_signature();
+
+  /*
+   * Uses the alignments in STORED[READ_GROUPS[i]] for each read with a non-negative group, where READ_POOLS[i] is the index of the read's pooled read,
+   * instead of aligning the read to each haplotype. The pooled reads are only aligned to the alleles their group lacks, and are rescored using the
+   * genotyper's stutter model if the group was flagged for rescoring. Returns false, in which case all reads are aligned, if the haplotype's alignments
+   * can't be keyed by allele. Must be invoked before genotype()
+   */
+  bool set_stored_alignments(const std::vector<int>& read_groups, const std::vector<int>& read_pools, std::vector<PooledAlignments>& stored);
+
+  /* Records the reads' alignments to the final haplotype, so that they can be retrieved using get_pooled_alignments(). Must be invoked before genotype() */
+  void record_pooled_alignments(){
+    record_pooled_alns_       = true;
+    record_stutter_emissions_ = true;
+  }
+
+  /*
+   * Stores the alignments of the pooled reads to each allele of the final haplotype in POOLED and the index of each read's pooled read in READ_POOLS.
+   * Returns false if they weren't recorded. Only valid after genotype() succeeds
+   */
+  bool get_pooled_alignments(PooledAlignments& pooled, std::vector<int>& read_pools);
+
+  /* The stutter model of the haplotype's repeat block */
+  StutterModel* stutter_model(){ return hap_blocks_[1]->get_repeat_info()->get_stutter_model(); }
+
   bool genotype(std::string& chrom_seq, std::ostream& logger);
 
+  /*
+   * Checks the provided budget while aligning reads and bootstrapping quality scores. TIER is recorded in the VCF and
+   * bootstrapping is only attempted for the full tier. Must be invoked before genotype()
+   */
+  void set_budget(LocusBudget* budget, int tier){
+    budget_      = budget;
+    budget_tier_ = tier;
+  }
+
+  // True iff genotype() failed because the locus exceeded its compute budget
+  bool over_budget() { return over_budget_; }
+
+  /*
+   * Records the stutter model-independent terms of the reads' haplotype alignments, so that recompute_stutter_models() can rescore
+   * the reads using the retrained stutter model instead of realigning them. Must be invoked before genotype()
+   */
+  void record_stutter_emissions(){ record_stutter_emissions_ = true; }
+
+  /*
+   * Selects the reference allele and at most MAX_ALLELES-1 of the other candidate alleles, choosing the alleles whose lengths are
+   * observed in the most left-aligned reads. ALLELE_POS is set to their 0-based position, as required by the constructor that
+   * accepts candidate alleles. Returns false iff no candidate alleles were identified during initialization
+   */
+  bool best_supported_alleles(int max_alleles, std::vector<std::string>& alleles, int32_t& allele_pos);
+
   /*
    * Recompute the stutter model(s) using the PCR artifacts obtained from the ML alignments
    * and regenotype the samples using this new model
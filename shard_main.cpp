@@ -0,0 +1,242 @@
+#include <getopt.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "error.h"
+#include "region.h"
+#include "region_sharder.h"
+#include "stringops.h"
+#include "version.h"
+
+void print_usage(){
+  std::cerr << "Usage: RegionSharder --regions <region_file.bed> --shards <num_shards> --out-prefix <prefix> [OPTIONS]" << "\n" << "\n"
+
+	    << "Splits the regions into contiguous BED shards with balanced predicted genotyping costs, so that the shards of a" << "\n"
+	    << "scattered HipSTR run finish at similar times. Each shard is written to PREFIX.<shard>.bed"                     << "\n" << "\n"
+
+	    << "Required parameters:" << "\n"
+	    << "\t" << "--regions    <region_file.bed>     "  << "\t" << "BED file containing coordinates for each STR, in the format used by HipSTR"      << "\n"
+	    << "\t" << "--shards     <num_shards>          "  << "\t" << "Number of shards to create"                                                          << "\n"
+	    << "\t" << "--out-prefix <prefix>              "  << "\t" << "Prefix for the BED file written for each shard"                                      << "\n" << "\n"
+
+	    << "Optional input parameters:" << "\n"
+	    << "\t" << "--bams       <list_of_bams>        "  << "\t" << "Comma separated list of indexed BAM files that will be genotyped. The number of"    << "\n"
+	    << "\t" << "                                   "  << "\t" << " reads at each locus is estimated from the BAM indices without reading any reads"    << "\n"
+	    << "\t" << "--bam-files  <bam_files.txt>       "  << "\t" << "File containing BAM files to analyze, one per line"                                 << "\n"
+	    << "\t" << "--timing-log <hipstr_log.txt>      "  << "\t" << "Log from a previous HipSTR run on the same BAMs. The recorded time for each locus"   << "\n"
+	    << "\t" << "                                   "  << "\t" << " replaces its predicted cost, and the remaining predictions are scaled to seconds"  << "\n" << "\n"
+
+	    << "Other optional parameters:" << "\n"
+	    << "\t" << "--help                             "  << "\t" << "Print this help message and exit"                                                    << "\n"
+	    << "\t" << "--chrom      <chrom>               "  << "\t" << "Only consider STRs on the provided chromosome"                                       << "\n"
+	    << "\t" << "--version                          "  << "\t" << "Print RegionSharder version and exit"                                                << "\n"
+	    << "\n";
+}
+
+void parse_command_line_args(int argc, char** argv, std::string& region_file, int& num_shards, std::string& out_prefix,
+			     std::string& bam_string, std::string& bam_list_file, std::string& timing_log, std::string& chrom){
+  if (argc == 1 || (argc == 2 && std::string("-h").compare(std::string(argv[1])) == 0)){
+    print_usage();
+    exit(0);
+  }
+
+  int print_help    = 0;
+  int print_version = 0;
+
+  static struct option long_options[] = {
+    {"bams",            required_argument, 0, 'b'},
+    {"bam-files",       required_argument, 0, 'B'},
+    {"chrom",           required_argument, 0, 'c'},
+    {"h",               no_argument, &print_help, 1},
+    {"help",            no_argument, &print_help, 1},
+    {"version",         no_argument, &print_version, 1},
+    {"out-prefix",      required_argument, 0, 'o'},
+    {"regions",         required_argument, 0, 'r'},
+    {"shards",          required_argument, 0, 's'},
+    {"timing-log",      required_argument, 0, 't'},
+    {0, 0, 0, 0}
+  };
+
+  int c;
+  while (true){
+    int option_index = 0;
+    c = getopt_long(argc, argv, "b:B:c:o:r:s:t:", long_options, &option_index);
+    if (c == -1)
+      break;
+
+    switch(c){
+    case 0:
+      break;
+    case 'b':
+      bam_string = std::string(optarg);
+      break;
+    case 'B':
+      bam_list_file = std::string(optarg);
+      break;
+    case 'c':
+      chrom = std::string(optarg);
+      break;
+    case 'o':
+      out_prefix = std::string(optarg);
+      break;
+    case 'r':
+      region_file = std::string(optarg);
+      break;
+    case 's':
+      num_shards = atoi(optarg);
+      if (num_shards <= 0)
+	printErrorAndDie("--shards must be greater than 0");
+      break;
+    case 't':
+      timing_log = std::string(optarg);
+      break;
+    case '?':
+      printErrorAndDie("Unrecognized command line option");
+      break;
+    default:
+      abort();
+      break;
+    }
+  }
+
+  if (optind < argc) {
+    std::stringstream msg;
+    msg << "Did not recognize the following command line arguments:" << "\n";
+    while (optind < argc)
+      msg << "\t" << argv[optind++] << "\n";
+    msg << "Please check your command line syntax or type ./RegionSharder --help for additional information" << "\n";
+    printErrorAndDie(msg.str());
+  }
+
+  if (print_version == 1){
+    std::cerr << "RegionSharder version " << VERSION << std::endl;
+    exit(0);
+  }
+
+  if (print_help){
+    print_usage();
+    exit(0);
+  }
+}
+
+// Reports each shard's number of loci and share of the cost, along with the balance of the shards
+void report_shards(const std::string& label, const std::vector<double>& costs, const std::vector<int>& shard_starts){
+  std::vector<double> totals;
+  shard_costs(costs, shard_starts, totals);
+  double sum = 0;
+  for (unsigned int i = 0; i < totals.size(); i++)
+    sum += totals[i];
+  std::cerr << label << ": max/mean shard cost = " << shard_imbalance(costs, shard_starts) << "\n";
+  for (unsigned int i = 0; i < totals.size(); i++)
+    std::cerr << "\t" << "Shard " << i+1 << ": " << shard_starts[i+1]-shard_starts[i] << " loci, "
+	      << (sum == 0 ? 0.0 : 100.0*totals[i]/sum) << "% of the cost" << "\n";
+  std::cerr << std::endl;
+}
+
+int main(int argc, char** argv){
+  std::string region_file = "", out_prefix = "", bam_string = "", bam_list_file = "", timing_log = "", chrom = "";
+  int num_shards = 0;
+  parse_command_line_args(argc, argv, region_file, num_shards, out_prefix, bam_string, bam_list_file, timing_log, chrom);
+  if (region_file.empty())
+    printErrorAndDie("--regions option required");
+  if (num_shards == 0)
+    printErrorAndDie("--shards option required");
+  if (out_prefix.empty())
+    printErrorAndDie("--out-prefix option required");
+  std::cerr << std::fixed << std::setprecision(3);
+
+  // Shards are contiguous in the order HipSTR processes the regions, so their VCFs can be concatenated
+  std::vector<Region> regions;
+  readRegions(region_file, regions, -1, chrom, std::cerr);
+  orderRegions(regions);
+
+  std::vector<std::string> bam_files;
+  if (!bam_string.empty())
+    split_by_delim(bam_string, ',', bam_files);
+  if (!bam_list_file.empty()){
+    std::ifstream input(bam_list_file.c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open the BAM list file " + bam_list_file);
+    std::string line;
+    while (std::getline(input, line))
+      if (!line.empty())
+	bam_files.push_back(line);
+    input.close();
+  }
+  BamIndexDepth depth_estimator;
+  for (unsigned int i = 0; i < bam_files.size(); i++)
+    depth_estimator.add_bam(bam_files[i]);
+  if (bam_files.empty())
+    std::cerr << "No BAMs were provided. Costs will only reflect the length and period of each STR" << std::endl;
+
+  // Reads within the flanks of each STR are also realigned, so they're included in the depth estimate
+  const int32_t FLANK = 50;
+  std::vector<double> costs;
+  for (auto region_iter = regions.begin(); region_iter != regions.end(); region_iter++){
+    double depth = 1;
+    if (!bam_files.empty())
+      depth = depth_estimator.index_bytes(region_iter->chrom(), std::max(0, region_iter->start()-FLANK), region_iter->stop()+FLANK);
+    costs.push_back(predict_locus_cost(*region_iter, depth));
+  }
+
+  // Use the timings of a previous run where available, scaling the other predictions so that they're also in seconds
+  std::vector<double> observed(regions.size(), 0.0);
+  if (!timing_log.empty()){
+    std::map<Region, double> timings;
+    read_locus_timings(timing_log, timings);
+    double total_observed = 0, total_predicted = 0;
+    int num_timed = 0;
+    for (unsigned int i = 0; i < regions.size(); i++){
+      auto time_iter = timings.find(regions[i]);
+      if (time_iter == timings.end())
+	continue;
+      observed[i]      = time_iter->second;
+      total_observed  += observed[i];
+      total_predicted += costs[i];
+      num_timed++;
+    }
+    double scale = (total_observed > 0 && total_predicted > 0 ? total_observed/total_predicted : 1.0);
+    for (unsigned int i = 0; i < regions.size(); i++)
+      costs[i] = (observed[i] > 0 ? observed[i] : scale*costs[i]);
+    std::cerr << "Timing log contains timings for " << num_timed << " out of " << regions.size() << " loci ("
+	      << total_observed << " seconds)" << std::endl;
+  }
+
+  std::vector<int> count_starts, cost_starts;
+  partition_by_count(regions.size(), num_shards, count_starts);
+  partition_by_cost(costs, num_shards, cost_starts);
+  report_shards("Predicted balance of equal-count shards", costs, count_starts);
+  report_shards("Predicted balance of cost-balanced shards", costs, cost_starts);
+  if (!timing_log.empty()){
+    std::cerr << "Achieved balance for the timed loci:" << "\n"
+	      << "\t" << "Equal-count shards:   max/mean shard time = " << shard_imbalance(observed, count_starts) << "\n"
+	      << "\t" << "Cost-balanced shards: max/mean shard time = " << shard_imbalance(observed, cost_starts) << std::endl;
+  }
+
+  for (unsigned int i = 0; i+1 < cost_starts.size(); i++){
+    std::string filename = out_prefix + "." + std::to_string(i+1) + ".bed";
+    std::ofstream output(filename.c_str());
+    if (!output.is_open())
+      printErrorAndDie("Failed to open the output file " + filename);
+    output << std::fixed << std::setprecision(1);
+    for (int j = cost_starts[i]; j < cost_starts[i+1]; j++){
+      const Region& region = regions[j];
+      output << region.chrom() << "\t" << region.start()+1 << "\t" << region.stop() << "\t" << region.period()
+	     << "\t" << 1.0*(region.stop()-region.start())/region.period();
+      if (!region.name().empty())
+	output << "\t" << region.name();
+      output << "\n";
+    }
+    output.close();
+  }
+  std::cerr << "Wrote " << cost_starts.size()-1 << " shards with the prefix " << out_prefix << std::endl;
+  return 0;
+}
@@ -33,9 +33,15 @@ void SNPBamProcessor::process_reads(std::vector< std::vector<BamTools::BamAlignm
 
     std::vector<SNPTree*> snp_trees;
     std::map<std::string, unsigned int> sample_indices;      
-    if(create_snp_trees(region.chrom(), (region.start() > MAX_MATE_DIST ? region.start()-MAX_MATE_DIST : 1), region.stop()+MAX_MATE_DIST,
-			(region.start() > 15 ? region.start()-15 : 1), region.stop()+15,
-			phased_snp_vcf_, haplotype_tracker_, sample_indices, snp_trees, logger())){
+    // When tracking haplotypes, the tracker has already decoded the SNPs in the region, so they're reused rather than reread from the VCF.
+    // This requires the region to lie within the tracker's window, which extends TRACKER_WINDOW_SIZE bp on either side of the region's start
+    uint32_t snp_start  = (region.start() > MAX_MATE_DIST ? region.start()-MAX_MATE_DIST : 1), snp_end = region.stop()+MAX_MATE_DIST;
+    uint32_t skip_start = (region.start() > 15 ? region.start()-15 : 1), skip_stop = region.stop()+15;
+    bool use_tracker_snps = (haplotype_tracker_ != NULL && snp_end <= region.start() + TRACKER_WINDOW_SIZE);
+    bool snp_trees_built  = (use_tracker_snps && create_snp_trees(region.chrom(), snp_start, snp_end, skip_start, skip_stop, haplotype_tracker_, sample_indices, snp_trees, logger()));
+    if (!snp_trees_built)
+      snp_trees_built = create_snp_trees(region.chrom(), snp_start, snp_end, skip_start, skip_stop, phased_snp_vcf_, haplotype_tracker_, sample_indices, snp_trees, logger());
+    if (snp_trees_built){
       got_snp_info = true;
       std::set<std::string> bad_samples, good_samples;
       for (unsigned int i = 0; i < paired_strs_by_rg.size(); ++i){
@@ -24,6 +24,7 @@ private:
   int32_t match_count_, mismatch_count_;
 
   // Used to enforce pedigree requirements on SNPs used for phasing
+  const static int32_t TRACKER_WINDOW_SIZE = 500000;
   HaplotypeTracker* haplotype_tracker_;
   std::vector<NuclearFamily> families_;
 
@@ -95,15 +96,16 @@ public:
     if (haplotype_tracker_ != NULL)
       delete haplotype_tracker_;
 
-    VCF::VCFReader pedigree_vcf_reader(snp_vcf_file);
-
     // Keep only those families where all members are present in the VCF
     families_.clear();
-    std::set<std::string> snp_samples(pedigree_vcf_reader.get_samples().begin(), pedigree_vcf_reader.get_samples().end());
+    std::set<std::string> snp_samples(phased_snp_vcf_->get_samples().begin(), phased_snp_vcf_->get_samples().end());
     for (auto family_iter = families.begin(); family_iter != families.end(); family_iter++)
       if (!family_iter->is_missing_sample(snp_samples))
 	families_.push_back(*family_iter);
-    haplotype_tracker_ = new HaplotypeTracker(families_, snp_vcf_file, 500000);
+
+    // The tracker's SNP stream also supplies the SNPs used for physical phasing, so the VCF is only decoded once
+    haplotype_tracker_ = new HaplotypeTracker(families_, snp_vcf_file, TRACKER_WINDOW_SIZE);
+    haplotype_tracker_->cache_phasing_snps();
   }
 
   void finish(){
@@ -22,6 +22,47 @@ void filter_snps(std::vector<SNP>& snps, std::set<int32_t>& bad_sites){
   snps.resize(insert_index);
 }
 
+void build_snp_trees(HaplotypeTracker* tracker, std::map<std::string, unsigned int>& sample_indices, std::vector< std::vector<SNP> >& snps_by_sample,
+		     std::vector< std::set<int32_t> >& bad_sites_by_family, std::vector<SNPTree*>& snp_trees, std::ostream& logger){
+  // Filter out SNPs on a per-sample basis using any available pedigree information
+  int MAX_BEST_SCORE = 10;
+  int MIN_SECOND_BEST_SCORE = 100;
+  if (tracker != NULL){
+    int32_t filt_count = 0, unfilt_count = 0;
+    const std::vector<NuclearFamily>& families = tracker->families();
+    int family_index = 0;
+    for (auto family_iter = families.begin(); family_iter != families.end(); ++family_iter, ++family_index){
+      std::vector<int> maternal_indices, paternal_indices;
+      bool good_haplotypes = tracker->infer_haplotype_inheritance(*family_iter, MAX_BEST_SCORE, MIN_SECOND_BEST_SCORE, maternal_indices, paternal_indices, bad_sites_by_family[family_index]);
+
+      // If the family haplotypes aren't good enough, clear all of the sample's SNPs. Otherwise, remove only the bad sites from each sample's list
+      for (auto sample_iter = family_iter->get_samples().begin(); sample_iter != family_iter->get_samples().end(); sample_iter++){
+	auto sample_index = sample_indices.find(*sample_iter);
+	if (sample_index != sample_indices.end()){
+	  filt_count += snps_by_sample[sample_index->second].size();
+	  if (!good_haplotypes)
+	    snps_by_sample[sample_index->second].clear();
+	  else
+	    filter_snps(snps_by_sample[sample_index->second], bad_sites_by_family[family_index]);
+	  filt_count   -= snps_by_sample[sample_index->second].size();
+	  unfilt_count += snps_by_sample[sample_index->second].size();
+	}
+      }
+    }
+    logger << "Removed " << filt_count << " out of " << filt_count+unfilt_count << " individual heterozygous SNP calls due to pedigree uncertainties or inconsistencies" << std::endl;
+  }
+  
+
+  // Create SNP trees
+  for (unsigned int i = 0; i < snps_by_sample.size(); i++){
+    //logger << "Building interval tree for " << variant_file.sampleNames[i] << " containing " << snps_by_sample[i].size() << " heterozygous SNPs" << std::endl;
+    snp_trees.push_back(new SNPTree(snps_by_sample[i]));
+  }
+
+  // Discard SNPs
+  snps_by_sample.clear();
+}
+
 bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, uint32_t skip_start, uint32_t skip_stop, VCF::VCFReader* snp_vcf, HaplotypeTracker* tracker,
                       std::map<std::string, unsigned int>& sample_indices, std::vector<SNPTree*>& snp_trees, std::ostream& logger){
   logger << "Building SNP tree for region " << chrom << ":" << start << "-" << end << std::endl;
@@ -78,45 +119,46 @@ bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, ui
     }
   }
   logger << "Region contained a total of " << locus_count << " valid SNPs" << std::endl;
+  build_snp_trees(tracker, sample_indices, snps_by_sample, bad_sites_by_family, snp_trees, logger);
+  return true;
+}
 
-  // Filter out SNPs on a per-sample basis using any available pedigree information
-  int MAX_BEST_SCORE = 10;
-  int MIN_SECOND_BEST_SCORE = 100;
-  if (tracker != NULL){
-    int32_t filt_count = 0, unfilt_count = 0;
-    const std::vector<NuclearFamily>& families = tracker->families();
-    int family_index = 0;
-    for (auto family_iter = families.begin(); family_iter != families.end(); ++family_iter, ++family_index){
-      std::vector<int> maternal_indices, paternal_indices;
-      bool good_haplotypes = tracker->infer_haplotype_inheritance(*family_iter, MAX_BEST_SCORE, MIN_SECOND_BEST_SCORE, maternal_indices, paternal_indices, bad_sites_by_family[family_index]);
+bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, uint32_t skip_start, uint32_t skip_stop, HaplotypeTracker* tracker,
+		      std::map<std::string, unsigned int>& sample_indices, std::vector<SNPTree*>& snp_trees, std::ostream& logger){
+  logger << "Building SNP tree for region " << chrom << ":" << start << "-" << end << " using the haplotype tracker's SNPs" << std::endl;
+  assert(sample_indices.size() == 0 && snp_trees.size() == 0);
+  // The tracker is advanced using the region's own chromosome name, so the names match exactly unless it was advanced elsewhere
+  if (chrom.compare(tracker->chrom()) != 0)
+    return false;
 
-      // If the family haplotypes aren't good enough, clear all of the sample's SNPs. Otherwise, remove only the bad sites from each sample's list
-      for (auto sample_iter = family_iter->get_samples().begin(); sample_iter != family_iter->get_samples().end(); sample_iter++){
-	auto sample_index = sample_indices.find(*sample_iter);
-	if (sample_index != sample_indices.end()){
-	  filt_count += snps_by_sample[sample_index->second].size();
-	  if (!good_haplotypes)
-	    snps_by_sample[sample_index->second].clear();
-	  else
-	    filter_snps(snps_by_sample[sample_index->second], bad_sites_by_family[family_index]);
-	  filt_count   -= snps_by_sample[sample_index->second].size();
-	  unfilt_count += snps_by_sample[sample_index->second].size();
-	}
-      }
-    }
-    logger << "Removed " << filt_count << " out of " << filt_count+unfilt_count << " individual heterozygous SNP calls due to pedigree uncertainties or inconsistencies" << std::endl;
-  }
-  
+  // Index samples
+  unsigned int sample_count = 0;
+  const std::vector<std::string>& vcf_samples = tracker->vcf_samples();
+  for (auto sample_iter = vcf_samples.begin(); sample_iter != vcf_samples.end(); sample_iter++)
+    sample_indices[*sample_iter] = sample_count++;
 
-  // Create SNP trees
-  for (unsigned int i = 0; i < snps_by_sample.size(); i++){
-    //logger << "Building interval tree for " << variant_file.sampleNames[i] << " containing " << snps_by_sample[i].size() << " heterozygous SNPs" << std::endl;
-    snp_trees.push_back(new SNPTree(snps_by_sample[i]));
-  }
+  // SNPs before the region are no longer needed, as regions are processed in sorted order
+  tracker->discard_phasing_snps(start);
 
-  // Discard SNPs
-  snps_by_sample.clear();
-  
+  std::vector< std::set<int32_t> > bad_sites_by_family(tracker->families().size());
+  std::vector< std::vector<SNP> > snps_by_sample(vcf_samples.size());
+  uint32_t locus_count = 0;
+  const std::deque<PhasingSNP>& phasing_snps = tracker->phasing_snps();
+  for (auto snp_iter = phasing_snps.begin(); snp_iter != phasing_snps.end() && snp_iter->pos <= (int32_t)end; snp_iter++){
+    if ((uint32_t)snp_iter->pos >= skip_start && (uint32_t)snp_iter->pos <= skip_stop)
+      continue;
+    for (auto family_iter = snp_iter->bad_families.begin(); family_iter != snp_iter->bad_families.end(); family_iter++)
+      bad_sites_by_family[*family_iter].insert(snp_iter->pos);
+
+    ++locus_count;
+    for (auto call_iter = snp_iter->het_calls.begin(); call_iter != snp_iter->het_calls.end(); call_iter++){
+      int gt_a = (*call_iter)%2;
+      // IMPORTANT NOTE: VCFs are 1-based, but BAMs are 0-based. Decrease VCF coordinate by 1 for consistency
+      snps_by_sample[(*call_iter)/2].push_back(SNP(snp_iter->pos-1, snp_iter->alleles[gt_a], snp_iter->alleles[1-gt_a]));
+    }
+  }
+  logger << "Region contained a total of " << locus_count << " valid SNPs" << std::endl;
+  build_snp_trees(tracker, sample_indices, snps_by_sample, bad_sites_by_family, snp_trees, logger);
   return true;
 }
 
@@ -156,6 +156,13 @@ class SNPTree {
 bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, uint32_t skip_start, uint32_t skip_stop, VCF::VCFReader* snp_vcf, HaplotypeTracker* tracker,
                       std::map<std::string, unsigned int>& sample_indices, std::vector<SNPTree*>& snp_trees, std::ostream& logger);
 
+/*
+ * Builds the SNP trees from the SNPs cached by a tracker that has been advanced to the region using cache_phasing_snps(),
+ * avoiding a second pass over the SNP VCF. Regions must be provided in sorted order, as earlier SNPs are discarded
+ */
+bool create_snp_trees(const std::string& chrom, uint32_t start, uint32_t end, uint32_t skip_start, uint32_t skip_stop, HaplotypeTracker* tracker,
+		      std::map<std::string, unsigned int>& sample_indices, std::vector<SNPTree*>& snp_trees, std::ostream& logger);
+
 void destroy_snp_trees(std::vector<SNPTree*>& snp_trees);
 
 #endif
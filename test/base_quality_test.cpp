@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../base_quality.h"
+
+// Reference implementation that sorts each position's qualities and selects the element at index N/2
+std::string sorted_median_qualities(const std::vector<std::string>& qualities, const std::vector<int32_t>& reads){
+  std::string medians;
+  for (unsigned int i = 0; i < qualities[reads[0]].size(); i++){
+    std::vector<char> position_quals;
+    for (unsigned int j = 0; j < reads.size(); j++)
+      position_quals.push_back(qualities[reads[j]][i]);
+    std::sort(position_quals.begin(), position_quals.end());
+    medians += position_quals[position_quals.size()/2];
+  }
+  return medians;
+}
+
+// Concatenates the quality strings into an arena and records the start of each string
+void build_arena(const std::vector<std::string>& qualities, std::string& arena, std::vector<int64_t>& starts){
+  arena.clear();
+  starts.clear();
+  for (unsigned int i = 0; i < qualities.size(); i++){
+    starts.push_back(arena.size());
+    arena += qualities[i];
+  }
+  starts.push_back(arena.size());
+}
+
+// Ensure that the histogram-based median of each position's qualities matches a sort-based median
+int main(){
+  srand(47);
+  BaseQuality base_quality;
+  std::string arena;
+  std::vector<int64_t> starts;
+
+  // Ties, where every read shares a quality or the qualities at and around the median rank are identical
+  std::vector<std::string> tied = {"#####", "5555#", "55#5#", "#5555", "55555", "I5555"};
+  build_arena(tied, arena, starts);
+  std::vector<int32_t> all_tied = {0, 1, 2, 3, 4, 5}, even_tied = {0, 3, 2, 5};
+  assert(base_quality.median_base_qualities(arena, starts, all_tied)  == sorted_median_qualities(tied, all_tied));
+  assert(base_quality.median_base_qualities(arena, starts, all_tied)  == "55555");
+  assert(base_quality.median_base_qualities(arena, starts, even_tied) == sorted_median_qualities(tied, even_tied));
+  std::vector<int32_t> same_quals = {0, 0, 0};
+  assert(base_quality.median_base_qualities(arena, starts, same_quals) == "#####");
+
+  // A single read's qualities are returned unchanged
+  std::vector<int32_t> single = {4};
+  assert(base_quality.median_base_qualities(arena, starts, single) == tied[4]);
+
+  // Empty quality strings have an empty median
+  std::vector<std::string> empty = {"", "", ""};
+  build_arena(empty, arena, starts);
+  std::vector<int32_t> all_empty = {0, 1, 2}, one_empty = {1};
+  assert(base_quality.median_base_qualities(arena, starts, all_empty).empty());
+  assert(base_quality.median_base_qualities(arena, starts, one_empty).empty());
+
+  // Random subsets of reads, including qualities outside the printable range whose chars are negative when char is signed
+  for (int iter = 0; iter < 200; iter++){
+    int num_reads = 1 + rand() % 25, length = rand() % 40;
+    std::vector<std::string> qualities(num_reads);
+    for (int i = 0; i < num_reads; i++)
+      for (int j = 0; j < length; j++)
+	qualities[i] += (char)(iter % 4 == 0 ? rand() % 256 : '!' + rand() % 6);
+    build_arena(qualities, arena, starts);
+
+    std::vector<int32_t> reads;
+    int num_selected = 1 + rand() % num_reads;
+    for (int i = 0; i < num_selected; i++)
+      reads.push_back(rand() % num_reads);
+    assert(base_quality.median_base_qualities(arena, starts, reads) == sorted_median_qualities(qualities, reads));
+  }
+  std::cerr << "All base quality tests passed" << std::endl;
+}
@@ -0,0 +1,52 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "../bgzf_streams.h"
+
+std::string read_file(const char* filename){
+  bgzfistream input(filename);
+  std::stringstream contents;
+  contents << input.rdbuf();
+  input.close();
+  return contents.str();
+}
+
+// Ensure that resuming an output stream at a checkpoint reproduces the output of an uninterrupted run
+int main(){
+  const char* filename = "bgzf_resume_test.vcf.gz";
+  std::stringstream records;
+  for (int i = 0; i < 20000; i++)
+    records << "chr1\t" << 100*i+1 << "\t.\tACACAC\tACAC\t.\t.\tSTART=" << 100*i+1 << "\tGT\t0|1\n";
+  std::string header = "##fileformat=VCFv4.1\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\n";
+  std::string expected = header + records.str();
+
+  // Checkpoints within a block and on a block boundary
+  uint64_t checkpoints[2] = {header.size() + 3*BGZF_BLOCK_SIZE + 117, 2*BGZF_BLOCK_SIZE};
+  for (int i = 0; i < 2; i++){
+    bgzfostream out(filename);
+    out << expected;
+    out.close();
+
+    bgzfostream resumed;
+    assert(resumed.resume(filename, checkpoints[i], 1, true));
+    assert(resumed.uncompressed_offset() == checkpoints[i]);
+    resumed << expected.substr(checkpoints[i]);
+    resumed.close();
+    assert(read_file(filename) == expected);
+  }
+
+  // Offsets beyond the complete blocks in the file can't be resumed
+  bgzfostream out(filename);
+  out << header;
+  out.close();
+  bgzfostream resumed;
+  assert(!resumed.resume(filename, 2*BGZF_BLOCK_SIZE, 1, true));
+
+  remove(filename);
+  remove((std::string(filename) + ".tbi").c_str());
+  std::cerr << "All BGZF resume tests passed" << std::endl;
+}
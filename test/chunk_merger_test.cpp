@@ -0,0 +1,45 @@
+#include <assert.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../chunk_merger.h"
+
+// Ensure that the alleles and VCF records from each chunk of samples are merged into those of a single record
+int main(){
+  //                      0         1         2         3
+  //                      0123456789012345678901234567890123
+  std::string chrom_seq = "GGGGGCATACACACACACACTTTTTGGGGGGGGG";
+  Region region("chr1", 6, 20, 2);
+
+  // Chunks reporting alleles over different windows
+  ChunkAlleleMerger allele_merger;
+  std::vector<std::string> chunk_one = {"CATACACACACACACT", "CATACACACACACACACACT"};
+  std::vector<std::string> chunk_two = {"ATACACACACACACTT", "ATACACACACACTT", "ATACACACACACACACACTT"};
+  allele_merger.add_chunk(6, chunk_one);
+  allele_merger.add_chunk(7, chunk_two);
+  std::vector<std::string> alleles;
+  int32_t pos;
+  allele_merger.merge(region, chrom_seq, alleles, pos);
+  assert(pos == 6);
+  assert(alleles.size() == 3);
+  assert(alleles[0] == chrom_seq.substr(6, 14));
+  assert(alleles[1] == "ATACACACACAC");
+  assert(alleles[2] == "ATACACACACACACACAC");
+
+  ChunkRecordMerger record_merger;
+  std::string record_one = "chr1\t6\t.\tCA\tCACA\t.\t.\tINFRAME_PGEOM=0.900;START=7;END=20;NSKIP=0;NFILT=1;DP=12;AN=2;REFAC=1;AC=1\tGT:DP\t0|1:12\n";
+  std::string record_two = "chr1\t6\t.\tCA\tCACA\t.\t.\tINFRAME_PGEOM=0.900;START=7;END=20;NSKIP=1;NFILT=0;DP=30;AN=4;REFAC=1;AC=3\tGT:DP\t1|1:20\t0|1:10\n";
+  std::vector<std::string> samples_one = {"S2"}, samples_two = {"S1", "S4"};
+  record_merger.add_chunk(record_one, samples_one);
+  record_merger.add_chunk(record_two, samples_two);
+  assert(record_merger.num_chunks() == 2);
+
+  std::vector<std::string> all_samples = {"S1", "S2", "S3", "S4"};
+  std::ostringstream merged;
+  record_merger.write(all_samples, merged);
+  assert(merged.str() == "chr1\t6\t.\tCA\tCACA\t.\t.\tINFRAME_PGEOM=0.900;START=7;END=20;NSKIP=1;NFILT=1;DP=42;AN=6;REFAC=2;AC=4\tGT:DP\t1|1:20\t0|1:12\t.\t0|1:10\n");
+  std::cerr << "All chunk merger tests passed" << std::endl;
+}
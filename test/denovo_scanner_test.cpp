@@ -0,0 +1,177 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../denovo_scanner.h"
+#include "../mathops.h"
+#include "../mutation_model.h"
+#include "../pedigree.h"
+#include "../vcf_input.h"
+
+// Ensure that two log-likelihoods are equal within a relative tolerance, as the factorised computation sums the terms in a different order
+bool approx_equal(double ll_a, double ll_b){
+  return fabs(ll_a - ll_b) <= 1e-6*std::max(1.0, std::max(fabs(ll_a), fabs(ll_b)));
+}
+
+// Unfactorised computation of the family's mutation likelihoods that enumerates every parental genotype and mutation
+void reference_family_likelihoods(NuclearFamily& family, PhasedGL& phased_gls, DiploidGenotypePrior& dip_gt_priors, MutationModel& mut_model,
+				  std::vector<int>& maternal_indices, std::vector<int>& paternal_indices, int num_alleles,
+				  double& total_ll_no_mutation, std::vector<double>& total_lls_one_denovo, std::vector<double>& total_lls_one_other){
+  int num_children = family.get_children().size();
+  double ll_no_mutation_max = -DBL_MAX/2, ll_no_mutation_total = 0.0;
+  std::vector<double> ll_one_denovo_max(num_children, -DBL_MAX/2), ll_one_denovo_total(num_children, 0.0);
+  std::vector<double>  ll_one_other_max(num_children, -DBL_MAX/2),  ll_one_other_total(num_children, 0.0);
+
+  int mother_gl_index = phased_gls.get_sample_index(family.get_mother());
+  int father_gl_index = phased_gls.get_sample_index(family.get_father());
+  std::vector<int> children_gl_index;
+  for (int i = 0; i < num_children; i++)
+    children_gl_index.push_back(phased_gls.get_sample_index(family.get_children()[i]));
+
+  for (int mat_i = 0; mat_i < num_alleles; mat_i++){
+    for (int mat_j = 0; mat_j < num_alleles; mat_j++){
+      double mat_ll = dip_gt_priors.log_phased_genotype_prior(mat_i, mat_j, family.get_mother()) + phased_gls.get_gl(mother_gl_index, mat_i, mat_j);
+      for (int pat_i = 0; pat_i < num_alleles; pat_i++){
+	for (int pat_j = 0; pat_j < num_alleles; pat_j++){
+	  double pat_ll = dip_gt_priors.log_phased_genotype_prior(pat_i, pat_j, family.get_father()) + phased_gls.get_gl(father_gl_index, pat_i, pat_j);
+	  double no_mutation_config_ll = mat_ll + pat_ll;
+	  std::vector<int> child_is(num_children), child_js(num_children);
+	  for (int child_index = 0; child_index < num_children; child_index++){
+	    int mat_allele = (maternal_indices[child_index]%2 == 0 ? mat_i : mat_j);
+	    int pat_allele = (paternal_indices[child_index]%2 == 0 ? pat_i : pat_j);
+	    child_is[child_index] = (maternal_indices[child_index] < 2 ? mat_allele : pat_allele);
+	    child_js[child_index] = (maternal_indices[child_index] < 2 ? pat_allele : mat_allele);
+	    no_mutation_config_ll += phased_gls.get_gl(children_gl_index[child_index], child_is[child_index], child_js[child_index]);
+	  }
+	  update_streaming_log_sum_exp(no_mutation_config_ll, ll_no_mutation_max, ll_no_mutation_total);
+
+	  for (int child_index = 0; child_index < num_children; child_index++){
+	    int child_i = child_is[child_index], child_j = child_js[child_index];
+	    double config_ll = no_mutation_config_ll - phased_gls.get_gl(children_gl_index[child_index], child_i, child_j);
+	    for (int mut_allele = 0; mut_allele < num_alleles; mut_allele++){
+	      if (mut_allele == child_i)
+		continue;
+	      double prob = config_ll + phased_gls.get_gl(children_gl_index[child_index], mut_allele, child_j) + mut_model.log_prior_mutation(child_i, mut_allele);
+	      if (mut_allele != mat_i && mut_allele != mat_j && mut_allele != pat_i && mut_allele != pat_j)
+		update_streaming_log_sum_exp(prob, ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]);
+	      else
+		update_streaming_log_sum_exp(prob, ll_one_other_max[child_index], ll_one_other_total[child_index]);
+	    }
+	    for (int mut_allele = 0; mut_allele < num_alleles; mut_allele++){
+	      if (mut_allele == child_j)
+		continue;
+	      double prob = config_ll + phased_gls.get_gl(children_gl_index[child_index], child_i, mut_allele) + mut_model.log_prior_mutation(child_j, mut_allele);
+	      if (mut_allele != mat_i && mut_allele != mat_j && mut_allele != pat_i && mut_allele != pat_j)
+		update_streaming_log_sum_exp(prob, ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]);
+	      else
+		update_streaming_log_sum_exp(prob, ll_one_other_max[child_index], ll_one_other_total[child_index]);
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  total_ll_no_mutation = finish_streaming_log_sum_exp(ll_no_mutation_max, ll_no_mutation_total);
+  total_lls_one_denovo.clear();
+  total_lls_one_other.clear();
+  for (int child_index = 0; child_index < num_children; child_index++){
+    total_lls_one_denovo.push_back(finish_streaming_log_sum_exp(ll_one_denovo_max[child_index], ll_one_denovo_total[child_index]));
+    total_lls_one_other.push_back(finish_streaming_log_sum_exp(ll_one_other_max[child_index], ll_one_other_total[child_index]));
+  }
+}
+
+// Ensure that the scanner's likelihoods match the unfactorised computation within floating-point tolerance when pruning is disabled,
+// and that pruning only removes likelihood mass
+int main(){
+  srand(29);
+  std::string exact_file = "denovo_scanner_test.exact.vcf.gz", pruned_file = "denovo_scanner_test.pruned.vcf.gz", full_command = "denovo_scanner_test";
+  std::vector<NuclearFamily> families;
+  DenovoScanner exact_scanner(families, exact_file, full_command);
+  DenovoScanner pruned_scanner(families, pruned_file, full_command);
+  pruned_scanner.set_prune_gl_mass(0.01);
+
+  for (int iter = 0; iter < 200; iter++){
+    int num_alleles  = 2 + rand()%6;
+    int num_children = 1 + rand()%4;
+    std::vector<std::string> samples, children;
+    samples.push_back("mother");
+    samples.push_back("father");
+    for (int i = 0; i < num_children; i++){
+      children.push_back("child_" + std::to_string(i));
+      samples.push_back(children.back());
+    }
+    NuclearFamily family("family", "mother", "father", children);
+
+    // Random phased GLs, with one genotype per sample strongly favored
+    std::vector< std::vector<float> > gls(samples.size());
+    for (int i = 0; i < samples.size(); i++){
+      int best_gt = rand()%(num_alleles*num_alleles);
+      for (int gt = 0; gt < num_alleles*num_alleles; gt++)
+	gls[i].push_back(gt == best_gt ? -0.01*(rand()%10) : -1.0 - 0.1*(rand()%100));
+    }
+    PhasedGL phased_gls(num_alleles, samples, gls);
+
+    std::vector<double> allele_freqs;
+    double total_freq = 0;
+    for (int i = 0; i < num_alleles; i++){
+      allele_freqs.push_back(1 + rand()%10);
+      total_freq += allele_freqs.back();
+    }
+    for (int i = 0; i < num_alleles; i++)
+      allele_freqs[i] /= total_freq;
+    DiploidGenotypePrior dip_gt_priors(allele_freqs);
+    MutationModel mut_model(num_alleles);
+
+    std::vector<int> maternal_indices, paternal_indices;
+    for (int i = 0; i < num_children; i++){
+      bool mat_first = (rand()%2 == 0);
+      maternal_indices.push_back((mat_first ? 0 : 2) + rand()%2);
+      paternal_indices.push_back((mat_first ? 2 : 0) + rand()%2);
+    }
+
+    double ref_ll_no_mutation, ll_no_mutation, pruned_ll_no_mutation, error_bound, pruned_error_bound;
+    std::vector<double> ref_lls_denovo, ref_lls_other, lls_denovo, lls_other, pruned_lls_denovo, pruned_lls_other;
+    int64_t num_configs = 0, pruned_num_configs = 0;
+    reference_family_likelihoods(family, phased_gls, dip_gt_priors, mut_model, maternal_indices, paternal_indices, num_alleles,
+				 ref_ll_no_mutation, ref_lls_denovo, ref_lls_other);
+    exact_scanner.compute_family_likelihoods(family, phased_gls, dip_gt_priors, mut_model, maternal_indices, paternal_indices, num_alleles,
+					     ll_no_mutation, lls_denovo, lls_other, num_configs, error_bound);
+    pruned_scanner.compute_family_likelihoods(family, phased_gls, dip_gt_priors, mut_model, maternal_indices, paternal_indices, num_alleles,
+					      pruned_ll_no_mutation, pruned_lls_denovo, pruned_lls_other, pruned_num_configs, pruned_error_bound);
+
+    assert(num_configs == num_alleles*num_alleles*num_alleles*num_alleles);
+    assert(error_bound == 0.0);
+    assert(approx_equal(ll_no_mutation, ref_ll_no_mutation));
+    assert(lls_denovo.size() == num_children && lls_other.size() == num_children);
+    for (int i = 0; i < num_children; i++){
+      assert(approx_equal(lls_denovo[i], ref_lls_denovo[i]));
+      assert(approx_equal(lls_other[i],  ref_lls_other[i]));
+    }
+
+    // Pruning only removes likelihood mass, and no more than the reported error bound
+    assert(pruned_num_configs <= num_configs);
+    assert(pruned_ll_no_mutation <= ll_no_mutation + 1e-6);
+    assert(ll_no_mutation <= pruned_ll_no_mutation + pruned_error_bound + 1e-6);
+    for (int i = 0; i < num_children; i++){
+      assert(pruned_lls_denovo[i] <= lls_denovo[i] + 1e-6);
+      assert(pruned_lls_other[i]  <= lls_other[i]  + 1e-6);
+      double mut_ll = log_sum_exp(lls_denovo[i], lls_other[i]), pruned_mut_ll = log_sum_exp(pruned_lls_denovo[i], pruned_lls_other[i]);
+      assert(mut_ll <= pruned_mut_ll + pruned_error_bound + 1e-6);
+    }
+  }
+  exact_scanner.finish();
+  pruned_scanner.finish();
+  remove(exact_file.c_str());
+  remove(pruned_file.c_str());
+  remove((exact_file + ".tbi").c_str());
+  remove((pruned_file + ".tbi").c_str());
+  std::cerr << "All de novo scanner likelihood tests passed" << std::endl;
+}
@@ -0,0 +1,96 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../gl_sidecar.h"
+#include "../vcf_record_formatter.h"
+
+// Ensure that loci at the same position are distinguished by their number of alleles and then by their order,
+// and that each GL matches the value obtained by parsing it from the VCF's text
+int main(){
+  srand(28);
+  std::string filename = "gl_sidecar_test.glbin";
+  std::vector<std::string> samples;
+  samples.push_back("sample_1");
+  samples.push_back("sample_2");
+
+  std::vector<double> biallelic_phased(4, -1.0), biallelic_unphased(3, -1.0), triallelic_phased(9, -2.0), triallelic_unphased(6, -2.0);
+  std::vector<double> duplicate_phased(4, -3.0), duplicate_unphased(3, -3.0);
+  std::vector<const std::vector<double>*> biallelic_phased_gls(2, &biallelic_phased), biallelic_unphased_gls(2, &biallelic_unphased);
+  std::vector<const std::vector<double>*> duplicate_phased_gls(2, &duplicate_phased), duplicate_unphased_gls(2, &duplicate_unphased);
+  std::vector<const std::vector<double>*> triallelic_phased_gls(2, NULL), triallelic_unphased_gls(2, NULL);
+  triallelic_phased_gls[0]   = &triallelic_phased;
+  triallelic_unphased_gls[0] = &triallelic_unphased;
+
+  // GLs with many decimal places, including values that lie on or near a rounding boundary
+  std::vector< std::vector<double> > random_phased(2), random_unphased(2);
+  for (int i = 0; i < 2; i++){
+    for (int j = 0; j < 16; j++)
+      random_phased[i].push_back(j < 4 ? -0.0625*(j+1) - 0.0005*i : -20.0*rand()/RAND_MAX);
+    for (int j = 0; j < 10; j++)
+      random_unphased[i].push_back(j == 0 ? -0.0004 : -20.0*rand()/RAND_MAX);
+  }
+  std::vector<const std::vector<double>*> random_phased_gls, random_unphased_gls;
+  for (int i = 0; i < 2; i++){
+    random_phased_gls.push_back(&random_phased[i]);
+    random_unphased_gls.push_back(&random_unphased[i]);
+  }
+
+  {
+    GLSidecarWriter writer;
+    writer.open(filename, samples, 3);
+    writer.add_locus("chr1", 100, 2, biallelic_phased_gls,  biallelic_unphased_gls);
+    writer.add_locus("chr1", 100, 3, triallelic_phased_gls, triallelic_unphased_gls);
+    writer.add_locus("chr1", 200, 2, biallelic_phased_gls,  biallelic_unphased_gls);
+    writer.add_locus("chr1", 200, 2, duplicate_phased_gls,  duplicate_unphased_gls);
+    writer.add_locus("chr1", 300, 4, random_phased_gls,     random_unphased_gls);
+    writer.close();
+  }
+
+  {
+    GLSidecarReader reader(filename);
+    GLSidecarLocus locus;
+    assert(reader.get_samples() == samples);
+    assert(reader.num_loci() == 5);
+    assert(reader.get_locus("chr1", 100, 2, 0, locus));
+    assert(locus.num_alleles == 2 && locus.num_phased == 4 && locus.called[0] && locus.called[1]);
+    assert(locus.get_phased_gls(1)[3] == -1.0f);
+    assert(reader.get_locus("chr1", 100, 3, 0, locus));
+    assert(locus.num_alleles == 3 && locus.num_phased == 9 && locus.called[0] && !locus.called[1]);
+    assert(locus.get_phased_gls(0)[8] == -2.0f);
+    assert(!reader.get_locus("chr1", 100, 4, 0, locus));
+    assert(!reader.get_locus("chr1", 100, 2, 1, locus));
+    assert(!reader.get_locus("chr2", 100, 2, 0, locus));
+
+    // Records that share a position and number of alleles are returned in the order they were written
+    assert(reader.get_locus("chr1", 200, 2, 0, locus));
+    assert(locus.get_phased_gls(0)[0] == -1.0f);
+    assert(reader.get_locus("chr1", 200, 2, 1, locus));
+    assert(locus.get_phased_gls(0)[0] == -3.0f);
+    assert(!reader.get_locus("chr1", 200, 2, 2, locus));
+
+    // Each GL equals the float parsed from the VCF's text for the same value
+    VCFRecordFormatter record(3);
+    assert(reader.get_locus("chr1", 300, 4, 0, locus));
+    for (int i = 0; i < 2; i++){
+      for (int pass = 0; pass < 2; pass++){
+	const std::vector<double>& gls = (pass == 0 ? random_phased[i] : random_unphased[i]);
+	const float* sidecar_gls       = (pass == 0 ? locus.get_phased_gls(i) : locus.get_unphased_gls(i));
+	for (unsigned int j = 0; j < gls.size(); j++){
+	  std::ostringstream out;
+	  record << gls[j];
+	  record.flush(out);
+	  float vcf_gl = (float)strtod(out.str().c_str(), NULL);
+	  assert(sidecar_gls[j] == vcf_gl);
+	}
+      }
+    }
+  }
+  remove(filename.c_str());
+  std::cerr << "All genotype likelihood sidecar tests passed" << std::endl;
+}
@@ -0,0 +1,95 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../base_quality.h"
+#include "../stutter_model.h"
+#include "../SeqAlignment/AlignmentData.h"
+#include "../SeqAlignment/HapAligner.h"
+#include "../SeqAlignment/HapBlock.h"
+#include "../SeqAlignment/Haplotype.h"
+#include "../SeqAlignment/RepeatBlock.h"
+
+std::string random_flank(int length){
+  std::string seq;
+  while (seq.size() < length)
+    seq += std::string(1 + (rand() % 4 == 0 ? rand() % 5 : 0), "ACGT"[rand() % 4]);
+  return seq.substr(0, length);
+}
+
+// Ensure that recording the stutter-independent alignment terms doesn't change the alignment probabilities
+// and that rescoring the reads after the stutter model changes matches realigning them
+int main(){
+  srand(11);
+  BaseQuality base_quality;
+  StutterModel stutter_model(0.9,  0.01,  0.02, 0.7, 0.001, 0.001, 2);
+  StutterModel new_stutter_model(0.7, 0.05, 0.08, 0.6, 0.01,  0.02,  2);
+
+  for (int iter = 0; iter < 10; iter++){
+    std::string left_seq = random_flank(30), right_seq = random_flank(30), rep_seq = "ACACACACACAC";
+    HapBlock left_flank(0, 30, left_seq);
+    RepeatBlock rep_block(30, 42, rep_seq, 2, &stutter_model);
+    std::string alt_seq = rep_seq;
+    for (int i = 0; i < 5; i++){
+      alt_seq += "AC";
+      rep_block.add_alternate(alt_seq);
+    }
+    HapBlock right_flank(42, 72, right_seq);
+
+    std::vector<HapBlock*> hap_blocks;
+    hap_blocks.push_back(&left_flank);
+    hap_blocks.push_back(&rep_block);
+    hap_blocks.push_back(&right_flank);
+    Haplotype haplotype(hap_blocks);
+
+    // Simulate reads from random haplotypes, with a few sequencing errors
+    std::vector<Alignment> alns;
+    for (int i = 0; i < 12; i++){
+      haplotype.go_to(rand() % haplotype.num_combs());
+      std::string seq = haplotype.get_seq(), quals;
+      haplotype.reset();
+      for (int j = 0; j < 2; j++)
+	seq[rand() % seq.size()] = "ACGT"[rand() % 4];
+      for (unsigned int j = 0; j < seq.size(); j++)
+	quals += (char)('#' + rand() % 38);
+
+      Alignment aln(0, 72, "read", quals, seq, "");
+      std::vector<CigarElement> cigar_list;
+      cigar_list.push_back(CigarElement('=', 30));
+      cigar_list.push_back(CigarElement('I', seq.size()-60));
+      cigar_list.push_back(CigarElement('=', 30));
+      aln.set_cigar_list(cigar_list);
+      alns.push_back(aln);
+    }
+
+    int num_probs = alns.size()*haplotype.num_combs();
+    std::vector<double> probs(num_probs), recorded_probs(num_probs), realigned_probs(num_probs), rescored_probs(num_probs);
+    std::vector<int> seed_positions(alns.size()), rescored_seed_positions(alns.size());
+    std::vector<StutterEmissions> emissions;
+    {
+      HapAligner hap_aligner(&haplotype);
+      hap_aligner.process_reads(alns, 0, &base_quality, probs.data(), seed_positions.data());
+      hap_aligner.process_reads(alns, 0, &base_quality, recorded_probs.data(), seed_positions.data(), NULL, &emissions);
+    }
+    assert(emissions.size() == 2*num_probs);
+    for (int i = 0; i < num_probs; i++)
+      assert(probs[i] == recorded_probs[i]);
+
+    rep_block.get_repeat_info()->set_stutter_model(&new_stutter_model);
+    std::vector<StutterEmissions*> hap_emissions;
+    for (int i = 0; i < haplotype.num_combs(); i++)
+      hap_emissions.push_back(emissions.data() + 2*i*alns.size());
+    {
+      HapAligner hap_aligner(&haplotype);
+      hap_aligner.process_reads(alns, 0, &base_quality, realigned_probs.data(), seed_positions.data());
+      hap_aligner.rescore_reads(alns, &base_quality, hap_emissions, rescored_probs.data(), rescored_seed_positions.data());
+    }
+    assert(seed_positions == rescored_seed_positions);
+    for (int i = 0; i < num_probs; i++)
+      assert(realigned_probs[i] == rescored_probs[i]);
+  }
+  std::cerr << "All haplotype aligner rescoring tests passed" << std::endl;
+}
@@ -40,6 +40,13 @@ int main(){
     std::string s2 = rev_haplotype->get_seq();
     std::cout << s1 << std::endl
 	      << s2 << std::endl;
+    assert(s1.compare(haplotype.flat_seq()) == 0);
+    for (int i = 0; i < haplotype.num_blocks(); i++){
+      assert(haplotype.block_size(i) == haplotype.get_seq(i).size());
+      if (haplotype.get_block(i)->get_repeat_info() == NULL)
+	for (int j = 0; j < haplotype.block_size(i); j++)
+	  assert(haplotype.homopolymer_lengths()[haplotype.block_start(i)+j] == haplotype.homopolymer_length(i, j));
+    }
     std::reverse(s2.begin(), s2.end());
     assert(s2.compare(s1) == 0);
   }
@@ -56,6 +63,49 @@ int main(){
     assert(s2.compare(s1) == 0);
   }
 
+  // Alignments to the reference haplotype are computed on demand, and the reverse haplotype's are the reverse of the forward haplotype's
+  haplotype.reset();
+  rev_haplotype->reset();
+  std::string ref_seq = haplotype.get_seq();
+  for (unsigned int i = 0; i < 3; i++){
+    for (int hap_index = 0; hap_index < haplotype.num_combs(); hap_index++){
+      haplotype.go_to(hap_index);
+      rev_haplotype->go_to(hap_index);
+      std::string aln_info = haplotype.get_aln_info(), rev_aln_info = rev_haplotype->get_aln_info();
+      std::reverse(rev_aln_info.begin(), rev_aln_info.end());
+      assert(aln_info.compare(rev_aln_info) == 0);
+      assert(std::count(aln_info.begin(), aln_info.end(), 'I') + std::count(aln_info.begin(), aln_info.end(), 'M') == haplotype.get_seq().size());
+      assert(std::count(aln_info.begin(), aln_info.end(), 'D') + std::count(aln_info.begin(), aln_info.end(), 'M') == ref_seq.size());
+      if (hap_index == 0)
+	assert(aln_info.compare(std::string(ref_seq.size(), 'M')) == 0);
+    }
+  }
+
+  // Homopolymers can extend into and through a single-base block, so changing the flank that follows it must update the lengths of the blocks before it
+  std::string run_l1 = "ACGTT", run_l2 = "AGCTT", run_mid = "T";
+  std::string run_r1 = "TTCA",  run_r2 = "GTCA",  run_r3  = "TTTA";
+  HapBlock run_left(0, 5, run_l1);
+  run_left.add_alternate(run_l2);
+  HapBlock run_middle(5, 6, run_mid);
+  HapBlock run_right(6, 10, run_r1);
+  run_right.add_alternate(run_r2);
+  run_right.add_alternate(run_r3);
+  std::vector<HapBlock*> run_blocks;
+  run_blocks.push_back(&run_left);
+  run_blocks.push_back(&run_middle);
+  run_blocks.push_back(&run_right);
+  Haplotype run_haplotype(run_blocks);
+  for (int iter = 0; iter < 2; iter++){
+    do {
+      assert(run_haplotype.get_seq().compare(run_haplotype.flat_seq()) == 0);
+      for (int i = 0; i < run_haplotype.num_blocks(); i++)
+	for (int j = 0; j < run_haplotype.block_size(i); j++)
+	  assert(run_haplotype.homopolymer_lengths()[run_haplotype.block_start(i)+j] == run_haplotype.homopolymer_length(i, j));
+    }
+    while (run_haplotype.next());
+    run_haplotype.reset();
+  }
+
   // Delete datastructures for reverse haplotype
   for (unsigned int i = 0; i < rev_blocks.size(); i++)
     delete rev_blocks[i];
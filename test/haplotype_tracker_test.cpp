@@ -0,0 +1,126 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <deque>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include "../haplotype_tracker.h"
+
+// Scalar reference for the bit matrix, storing one allele per SNP for each haplotype
+class ReferenceHaplotypes {
+ public:
+  std::vector< std::deque<bool> > haps;
+
+  explicit ReferenceHaplotypes(int num_samples) : haps(2*num_samples){}
+
+  int edit_distance(int row_a, int row_b){
+    int distance = 0;
+    for (unsigned int i = 0; i < haps[row_a].size(); i++)
+      if (haps[row_a][i] != haps[row_b][i])
+	distance++;
+    return distance;
+  }
+
+  DiploidEditDistance edit_distances(int sample, int other){
+    return DiploidEditDistance(edit_distance(2*sample, 2*other),   edit_distance(2*sample, 2*other+1),
+			       edit_distance(2*sample+1, 2*other), edit_distance(2*sample+1, 2*other+1));
+  }
+
+  void mismatched_sites(int row_a, int row_b, std::set<int>& mismatch_indices){
+    for (unsigned int i = 0; i < haps[row_a].size(); i++)
+      if (haps[row_a][i] != haps[row_b][i])
+	mismatch_indices.insert(i);
+  }
+};
+
+void add_random_snp(HaplotypeBitMatrix& matrix, ReferenceHaplotypes& reference){
+  matrix.add_snp();
+  for (unsigned int row = 0; row < reference.haps.size(); row++){
+    bool alt = (rand()%3 == 0);
+    reference.haps[row].push_back(alt);
+    if (alt)
+      matrix.set_last_snp(row);
+  }
+}
+
+void remove_snp(HaplotypeBitMatrix& matrix, ReferenceHaplotypes& reference){
+  matrix.remove_next_snp();
+  for (unsigned int row = 0; row < reference.haps.size(); row++)
+    reference.haps[row].pop_front();
+}
+
+// Compare the distances for a family with a mother (sample 0), a father (sample 1) and several children, as in family_edit_distances()
+void compare(HaplotypeBitMatrix& matrix, ReferenceHaplotypes& reference, int num_samples){
+  assert(matrix.num_snps() == (int64_t)reference.haps[0].size());
+  for (int child = 2; child < num_samples; child++){
+    DiploidEditDistance maternal, paternal;
+    matrix.diploid_distances(child, 0, 1, maternal, paternal);
+    DiploidEditDistance exp_maternal = reference.edit_distances(child, 0), exp_paternal = reference.edit_distances(child, 1);
+    for (int i = 0; i < 2; i++){
+      for (int j = 0; j < 2; j++){
+	assert(maternal.distance(i, j) == exp_maternal.distance(i, j));
+	assert(paternal.distance(i, j) == exp_paternal.distance(i, j));
+      }
+    }
+
+    for (int parent_row = 0; parent_row < 4; parent_row++){
+      std::set<int> mismatches, exp_mismatches;
+      matrix.add_mismatched_sites(2*child + parent_row%2, parent_row, mismatches);
+      reference.mismatched_sites(2*child + parent_row%2, parent_row, exp_mismatches);
+      assert(mismatches == exp_mismatches);
+    }
+  }
+}
+
+int main(){
+  srand(31);
+  const int num_samples = 6;
+  HaplotypeBitMatrix matrix(num_samples);
+
+  for (int trial = 0; trial < 3; trial++){
+    matrix.reset();
+    ReferenceHaplotypes reference(num_samples);
+    compare(matrix, reference, num_samples);
+
+    // Slide a window of fewer SNPs than the initial 16 words per row, so that it wraps around the ring several times without growing.
+    // Windows that don't start at a word boundary exercise the mask for the partially removed first word
+    for (int step = 0; step < 5000; step++){
+      add_random_snp(matrix, reference);
+      int target = 500 + rand()%300;
+      while (matrix.num_snps() > target)
+	remove_snp(matrix, reference);
+      if (step%97 == 0)
+	compare(matrix, reference, num_samples);
+    }
+    compare(matrix, reference, num_samples);
+
+    // Widen the window while its start lies midway through the ring, forcing the matrix to grow from a wrapped state
+    while (matrix.num_snps() < 5000){
+      add_random_snp(matrix, reference);
+      if (matrix.num_snps()%250 == 0)
+	compare(matrix, reference, num_samples);
+    }
+    compare(matrix, reference, num_samples);
+
+    // Shrink the window past the grown region and keep sliding
+    for (int step = 0; step < 3000; step++){
+      add_random_snp(matrix, reference);
+      while (matrix.num_snps() > 100 + trial*37)
+	remove_snp(matrix, reference);
+      if (step%89 == 0)
+	compare(matrix, reference, num_samples);
+    }
+    compare(matrix, reference, num_samples);
+
+    // Empty the window entirely before refilling it
+    while (matrix.num_snps() > 0)
+      remove_snp(matrix, reference);
+    compare(matrix, reference, num_samples);
+    for (int step = 0; step < 130; step++)
+      add_random_snp(matrix, reference);
+    compare(matrix, reference, num_samples);
+  }
+  std::cerr << "All haplotype bit matrix tests passed" << std::endl;
+}
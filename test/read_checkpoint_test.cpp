@@ -0,0 +1,293 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../mathops.h"
+#include "../read_checkpoint.h"
+#include "../region.h"
+#include "../seq_stutter_genotyper.h"
+#include "../stutter_model.h"
+#include "../SeqAlignment/AlignmentData.h"
+
+std::string random_seq(int length){
+  std::string seq;
+  for (int i = 0; i < length; i++)
+    seq += "ACGT"[rand() % 4];
+  return seq;
+}
+
+// Reads and phasing likelihoods for a batch of samples
+class SimulatedBatch {
+ public:
+  std::vector<std::string> sample_names;
+  std::vector<Alignment> alns;
+  std::vector<bool> use_to_generate_haps;
+  std::vector<int> bp_diffs;
+  std::vector< std::vector<double> > log_p1s, log_p2s;
+  std::vector< std::vector<int> > em_bp_diffs;
+  std::vector< std::vector<double> > em_log_p1s, em_log_p2s;
+};
+
+// Simulates reads from each sample's two alleles, where some reads share their sequence and start and others are mate pairs that overlap the STR
+void simulate_batch(const std::string& chrom_seq, int32_t str_start, int32_t str_stop, const std::vector<std::string>& alleles,
+		    int first_sample, int num_samples, SimulatedBatch& batch){
+  for (int i = 0; i < num_samples; i++){
+    batch.sample_names.push_back("sample_" + std::to_string(first_sample+i));
+    batch.log_p1s.push_back(std::vector<double>());
+    batch.log_p2s.push_back(std::vector<double>());
+    batch.em_bp_diffs.push_back(std::vector<int>());
+    batch.em_log_p1s.push_back(std::vector<double>());
+    batch.em_log_p2s.push_back(std::vector<double>());
+    int gt[2] = {rand() % (int)alleles.size(), rand() % (int)alleles.size()};
+    int num_reads = 2 + rand() % 8;
+    for (int j = 0; j < num_reads; j++){
+      const std::string& allele = alleles[gt[j%2]];
+      int32_t start = str_start - 30 - rand() % 3, stop = str_stop + 30 + rand() % 3;
+      std::string seq = chrom_seq.substr(start, str_start-start) + allele + chrom_seq.substr(str_stop, stop-str_stop), quals;
+      for (unsigned int k = 0; k < seq.size(); k++)
+	quals += (char)('5' + rand() % 10);
+
+      std::vector<CigarElement> cigar_list;
+      int bp_diff = (int)allele.size() - (str_stop-str_start);
+      if (bp_diff == 0)
+	cigar_list.push_back(CigarElement('=', seq.size()));
+      else {
+	cigar_list.push_back(CigarElement('=', str_start-start));
+	if (bp_diff > 0){
+	  cigar_list.push_back(CigarElement('I', bp_diff));
+	  cigar_list.push_back(CigarElement('=', seq.size() - (str_start-start) - bp_diff));
+	}
+	else {
+	  cigar_list.push_back(CigarElement('D', -bp_diff));
+	  cigar_list.push_back(CigarElement('=', seq.size() - (str_start-start)));
+	}
+      }
+
+      // Every third read is the mate of the previous read
+      std::string name = batch.sample_names.back() + "_read_" + std::to_string(j % 3 == 2 ? j-1 : j);
+      Alignment aln(start, stop-1, name, quals, seq, seq);
+      aln.set_cigar_list(cigar_list);
+      batch.alns.push_back(aln);
+      batch.use_to_generate_haps.push_back(true);
+      batch.bp_diffs.push_back(bp_diff);
+      batch.log_p1s.back().push_back(gt[j%2] == gt[0] ? -0.1 : -2.0);
+      batch.log_p2s.back().push_back(gt[j%2] == gt[1] ? -0.1 : -2.0);
+      batch.em_bp_diffs.back().push_back(bp_diff);
+      batch.em_log_p1s.back().push_back(batch.log_p1s.back().back());
+      batch.em_log_p2s.back().push_back(batch.log_p2s.back().back());
+    }
+  }
+}
+
+// Genotypes the batch using the provided alleles and adds its reads and pooled alignments to the checkpoint
+void checkpoint_batch(Region& region, std::string& chrom_seq, SimulatedBatch& batch, std::vector<std::string> alleles, int32_t allele_pos,
+		      bool pool_seqs, StutterModel& stutter_model, ReadCheckpointWriter& writer){
+  std::ostringstream logger;
+  SeqStutterGenotyper seq_genotyper(region, false, batch.alns, batch.use_to_generate_haps, batch.bp_diffs, batch.log_p1s, batch.log_p2s,
+				    batch.sample_names, chrom_seq, pool_seqs, stutter_model, alleles, allele_pos, logger);
+  seq_genotyper.record_pooled_alignments();
+  assert(seq_genotyper.genotype(chrom_seq, logger));
+
+  PooledAlignments pooled;
+  std::vector<int> read_pools;
+  assert(seq_genotyper.get_pooled_alignments(pooled, read_pools));
+  assert(read_pools.size() == batch.alns.size());
+  assert(pooled.allele_seqs.size() == seq_genotyper.alleles().size());
+  assert(pooled.emissions.size() == 2*pooled.alns.size()*pooled.allele_seqs.size());
+  writer.add_locus(region, batch.sample_names, batch.alns, batch.log_p1s, batch.log_p2s, batch.bp_diffs, batch.use_to_generate_haps,
+		   batch.em_bp_diffs, batch.em_log_p1s, batch.em_log_p2s, seq_genotyper.vcf_pos(), seq_genotyper.alleles(),
+		   seq_genotyper.haplotype_signature(), seq_genotyper.stutter_model(), &pooled, read_pools);
+}
+
+bool same_read(const Alignment& aln_1, const Alignment& aln_2){
+  return (aln_1.get_name().compare(aln_2.get_name()) == 0 && aln_1.get_start() == aln_2.get_start() && aln_1.get_stop() == aln_2.get_stop()
+	  && aln_1.get_sequence().compare(aln_2.get_sequence()) == 0 && aln_1.get_base_qualities().compare(aln_2.get_base_qualities()) == 0
+	  && aln_1.get_alignment().compare(aln_2.get_alignment()) == 0 && aln_1.getCigarString().compare(aln_2.getCigarString()) == 0);
+}
+
+// Genotypes the reads and returns the VCF record along with each read's alignment log-likelihoods
+std::string genotype_reads(Region& region, std::string& chrom_seq, std::vector<std::string>& sample_names, std::vector<Alignment>& alns,
+			   std::vector<bool>& use_to_generate_haps, std::vector<int>& bp_diffs,
+			   std::vector< std::vector<double> >& log_p1s, std::vector< std::vector<double> >& log_p2s,
+			   std::vector<std::string> alleles, int32_t allele_pos, bool pool_seqs, StutterModel& stutter_model,
+			   std::vector<CheckpointLocus>* batches, std::vector< std::vector<double> >& read_log_aln_probs){
+  std::ostringstream logger, html_output, out;
+  SeqStutterGenotyper seq_genotyper(region, false, alns, use_to_generate_haps, bp_diffs, log_p1s, log_p2s, sample_names, chrom_seq,
+				    pool_seqs, stutter_model, alleles, allele_pos, logger);
+  if (batches != NULL){
+    std::vector<PooledAlignments> stored;
+    std::vector<int> read_groups, read_pools;
+    int32_t num_stored, num_rescored;
+    get_stored_alignments(*batches, seq_genotyper.haplotype_signature(), stutter_model, stored, read_groups, read_pools, num_stored, num_rescored);
+    assert(num_stored == alns.size() && stored.size() == batches->size());
+
+    // Only the first batch's alignments were computed using a different stutter model
+    int32_t num_batch_reads = 0;
+    for (auto sample_iter = batches->front().samples.begin(); sample_iter != batches->front().samples.end(); sample_iter++)
+      num_batch_reads += sample_iter->alns.size();
+    assert(num_rescored == num_batch_reads);
+    assert(!stored.front().emissions.empty() && stored.front().rescore && !stored.back().rescore);
+    assert(seq_genotyper.set_stored_alignments(read_groups, read_pools, stored));
+  }
+  seq_genotyper.record_pooled_alignments();
+  assert(seq_genotyper.genotype(chrom_seq, logger));
+  seq_genotyper.write_vcf_record(sample_names, true, chrom_seq, false, true, false, false, false, false, false, false, 1.0,
+				 1.0, false, NULL, html_output, out, logger);
+
+  PooledAlignments pooled;
+  std::vector<int> read_pools;
+  assert(seq_genotyper.get_pooled_alignments(pooled, read_pools));
+  int num_alleles = pooled.allele_seqs.size();
+  read_log_aln_probs.clear();
+  for (unsigned int i = 0; i < read_pools.size(); i++)
+    read_log_aln_probs.push_back(std::vector<double>(pooled.log_aln_probs.begin() + read_pools[i]*num_alleles,
+						     pooled.log_aln_probs.begin() + (read_pools[i]+1)*num_alleles));
+  return out.str();
+}
+
+// Ensure that a checkpoint with a corrupt trailer is rejected instead of being read past its end
+void test_corrupt_checkpoint(const std::string& filename){
+  std::ifstream input(filename.c_str(), std::ifstream::binary);
+  std::string data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+  input.close();
+  uint64_t bad_offset = 1ULL << 40;
+  std::string corrupt_file = filename + ".corrupt";
+  for (int i = 0; i < 3; i++){
+    std::string corrupt_data = data;
+    if (i < 2)
+      memcpy(&corrupt_data[data.size() - 8 - 4*sizeof(uint64_t) + 2*i*sizeof(uint64_t)], &bad_offset, sizeof(uint64_t));
+    else
+      corrupt_data = data.substr(0, 64) + data.substr(data.size() - 8 - 4*sizeof(uint64_t));
+    std::ofstream output(corrupt_file.c_str(), std::ofstream::binary);
+    output << corrupt_data;
+    output.close();
+
+    pid_t pid = fork();
+    if (pid == 0){
+      freopen("/dev/null", "w", stderr);
+      ReadCheckpointReader reader(corrupt_file);
+      _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+  }
+  remove(corrupt_file.c_str());
+}
+
+// Ensure that checkpointed reads are restored exactly and that jointly genotyping the batches using their stored alignments,
+// which are rescored and aligned to the alleles the batch lacks, matches genotyping all of the reads from scratch
+int main(){
+  srand(38);
+  precompute_integer_logs();
+  StutterModel stutter_model(0.9, 0.01, 0.02, 0.7, 0.001, 0.001, 2);
+  StutterModel joint_stutter_model(0.7, 0.05, 0.08, 0.6, 0.01, 0.02, 2);
+  std::string file_1 = "read_checkpoint_test.1.bin", file_2 = "read_checkpoint_test.2.bin";
+
+  for (int iter = 0; iter < 6; iter++){
+    bool pool_seqs = (iter % 2 == 1);
+    std::string chrom_seq = random_seq(100) + "ACACACACACACACACACAC" + random_seq(100);
+    Region region("chr1", 100, 120, 2);
+    std::string ref_allele = chrom_seq.substr(100, 20);
+    std::vector<std::string> alleles_1, alleles_2;
+    alleles_1.push_back(ref_allele);
+    alleles_1.push_back(ref_allele + "AC");
+    alleles_2 = alleles_1;
+    alleles_2.push_back(ref_allele + "ACAC");
+    alleles_2.push_back(ref_allele.substr(2));
+
+    // The first batch lacks two of the alleles and uses a different stutter model than the joint genotyper
+    SimulatedBatch batch_1, batch_2;
+    simulate_batch(chrom_seq, 100, 120, alleles_1, 0, 2 + rand() % 3, batch_1);
+    simulate_batch(chrom_seq, 100, 120, alleles_2, 10, 2 + rand() % 3, batch_2);
+    std::vector<std::string> all_samples(batch_1.sample_names);
+    all_samples.insert(all_samples.end(), batch_2.sample_names.begin(), batch_2.sample_names.end());
+    {
+      ReadCheckpointWriter writer_1, writer_2;
+      writer_1.open(file_1, batch_1.sample_names);
+      writer_2.open(file_2, batch_2.sample_names);
+      checkpoint_batch(region, chrom_seq, batch_1, alleles_1, 100, pool_seqs, stutter_model, writer_1);
+      checkpoint_batch(region, chrom_seq, batch_2, alleles_2, 100, pool_seqs, joint_stutter_model, writer_2);
+      writer_1.close();
+      writer_2.close();
+    }
+
+    // Each batch's reads and stutter training data are restored
+    std::vector<CheckpointLocus> batches(2);
+    ReadCheckpointReader reader_1(file_1), reader_2(file_2);
+    assert(reader_1.get_samples() == batch_1.sample_names && reader_1.num_loci() == 1);
+    assert(reader_1.get_locus(region, batches[0]) && reader_2.get_locus(region, batches[1]));
+    CheckpointLocus missing_locus;
+    assert(!reader_1.get_locus(Region("chr2", 100, 120, 2), missing_locus));
+    SimulatedBatch* simulated[2] = {&batch_1, &batch_2};
+    for (int i = 0; i < 2; i++){
+      assert(batches[i].samples.size() == simulated[i]->sample_names.size());
+      assert(batches[i].stutter_params.size() == 7 && !batches[i].signature.empty());
+      assert(batches[i].pooled.alns.size() <= simulated[i]->alns.size());
+      int read_index = 0;
+      for (unsigned int j = 0; j < batches[i].samples.size(); j++){
+	CheckpointSample& sample = batches[i].samples[j];
+	assert(sample.name.compare(simulated[i]->sample_names[j]) == 0);
+	assert(sample.log_p1 == simulated[i]->log_p1s[j] && sample.log_p2 == simulated[i]->log_p2s[j]);
+	assert(sample.em_bp_diffs == simulated[i]->em_bp_diffs[j] && sample.em_log_p1 == simulated[i]->em_log_p1s[j]);
+	for (unsigned int k = 0; k < sample.alns.size(); k++, read_index++){
+	  assert(same_read(sample.alns[k], simulated[i]->alns[read_index]));
+	  assert(sample.bp_diffs[k] == simulated[i]->bp_diffs[read_index]);
+	}
+      }
+      assert(read_index == simulated[i]->alns.size());
+    }
+
+    // Concatenate the samples from each batch, as the joint-merge mode does
+    std::vector<std::string> rg_names;
+    std::vector<Alignment> alns;
+    std::vector<bool> use_to_generate_haps;
+    std::vector<int> bp_diffs;
+    std::vector< std::vector<double> > log_p1s, log_p2s;
+    for (unsigned int i = 0; i < batches.size(); i++){
+      for (auto sample_iter = batches[i].samples.begin(); sample_iter != batches[i].samples.end(); sample_iter++){
+	rg_names.push_back(sample_iter->name);
+	alns.insert(alns.end(), sample_iter->alns.begin(), sample_iter->alns.end());
+	use_to_generate_haps.insert(use_to_generate_haps.end(), sample_iter->use_for_haps.begin(), sample_iter->use_for_haps.end());
+	bp_diffs.insert(bp_diffs.end(), sample_iter->bp_diffs.begin(), sample_iter->bp_diffs.end());
+	log_p1s.push_back(sample_iter->log_p1);
+	log_p2s.push_back(sample_iter->log_p2);
+      }
+    }
+
+    std::vector< std::vector<double> > merged_log_aln_probs, realigned_log_aln_probs;
+    std::string merged_record    = genotype_reads(region, chrom_seq, rg_names, alns, use_to_generate_haps, bp_diffs, log_p1s, log_p2s,
+						  alleles_2, 100, pool_seqs, joint_stutter_model, &batches, merged_log_aln_probs);
+    std::string realigned_record = genotype_reads(region, chrom_seq, rg_names, alns, use_to_generate_haps, bp_diffs, log_p1s, log_p2s,
+						  alleles_2, 100, pool_seqs, joint_stutter_model, NULL, realigned_log_aln_probs);
+    assert(merged_log_aln_probs.size() == alns.size() && realigned_log_aln_probs.size() == alns.size());
+
+    // Pooled reads are aligned using their batch's median base qualities, so they only match realigning the
+    // reads from scratch if the reads aren't pooled or if the batch's pools are unchanged
+    if (!pool_seqs){
+      assert(merged_log_aln_probs == realigned_log_aln_probs);
+      assert(merged_record.compare(realigned_record) == 0);
+    }
+    else {
+      std::vector< std::vector<double> > batch_log_aln_probs;
+      genotype_reads(region, chrom_seq, batch_2.sample_names, batch_2.alns, batch_2.use_to_generate_haps, batch_2.bp_diffs, batch_2.log_p1s,
+		     batch_2.log_p2s, alleles_2, 100, pool_seqs, joint_stutter_model, NULL, batch_log_aln_probs);
+      assert(std::equal(batch_log_aln_probs.begin(), batch_log_aln_probs.end(), merged_log_aln_probs.begin() + batch_1.alns.size()));
+    }
+    if (iter == 0)
+      test_corrupt_checkpoint(file_1);
+  }
+  remove(file_1.c_str());
+  remove(file_2.c_str());
+  std::cerr << "All read checkpoint tests passed" << std::endl;
+}
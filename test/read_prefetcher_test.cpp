@@ -0,0 +1,50 @@
+#include <assert.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "../read_prefetcher.h"
+
+// Ensure that prefetched regions are returned in order, that the loader never runs more than the queue's capacity
+// ahead of the consumer and that abandoning a prefetcher with queued regions doesn't deadlock
+int main(){
+  const int32_t START = 3, END = 200;
+  const int MAX_QUEUED = 4;
+  std::atomic<int32_t> num_taken(0);
+  std::atomic<int32_t> max_ahead(0);
+
+  ReadPrefetcher prefetcher(START, END, MAX_QUEUED, [&](int32_t index, LocusReads& locus){
+      int32_t ahead = index - START - num_taken;
+      if (ahead > max_ahead)
+	max_ahead = ahead;
+      locus.skipped = (index % 7 == 0);
+      locus.rg_names.push_back("locus" + std::to_string(index));
+      locus.log << "Processing region " << index << "\n";
+      if (index % 10 == 0)
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    });
+
+  for (int32_t index = START; index < END; index++){
+    LocusReads* locus = prefetcher.next();
+    num_taken++;
+    assert(locus->skipped == (index % 7 == 0));
+    assert(locus->rg_names.size() == 1 && locus->rg_names[0] == "locus" + std::to_string(index));
+    assert(locus->log.str() == "Processing region " + std::to_string(index) + "\n");
+    if (index % 25 == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    delete locus;
+  }
+  // The consumer may not have recorded the most recent region it took when the loader checks how far ahead it is
+  assert(max_ahead <= MAX_QUEUED + 1);
+  assert(prefetcher.mean_queue_depth() >= 0 && prefetcher.mean_queue_depth() <= MAX_QUEUED);
+  assert(prefetcher.stall_time() >= 0 && prefetcher.idle_time() >= 0);
+
+  {
+    ReadPrefetcher abandoned(0, 1000, 2, [&](int32_t index, LocusReads& locus){ locus.skipped = false; });
+    delete abandoned.next();
+  }
+  std::cerr << "All read prefetcher tests passed" << std::endl;
+}
@@ -0,0 +1,64 @@
+#include <assert.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../read_reservoir.h"
+
+BamTools::BamAlignment make_read(const std::string& name, int32_t position){
+  BamTools::BamAlignment aln;
+  aln.Name     = name;
+  aln.Position = position;
+  return aln;
+}
+
+// Ensure that a read checked by rejects() and the read unit later added for its mate pair are hashed identically,
+// and that the reservoir's paired STR reads are counted before they're emitted
+int main(){
+  const int32_t locus_start = 1000;
+  assert(ReadReservoir::read_unit_name("read_1/1").compare("read_1") == 0);
+  assert(ReadReservoir::read_unit_name("read_1/2").compare("read_1") == 0);
+  assert(ReadReservoir::read_unit_name("read_1").compare("read_1") == 0);
+  assert(ReadReservoir::hash_read_name("read_1/1", locus_start) == ReadReservoir::hash_read_name("read_1/2", locus_start));
+  assert(ReadReservoir::hash_read_name("read_1/1", locus_start) == ReadReservoir::hash_read_name("read_1",   locus_start));
+  assert(ReadReservoir::hash_read_name("read_1",   locus_start) != ReadReservoir::hash_read_name("read_1",   locus_start+1));
+
+  const int max_reads = 5, num_units = 50;
+  std::vector<BamTools::BamAlignment> paired_str_alns, mate_alns, unpaired_str_alns, discarded_alns;
+  ReadReservoir reservoir(max_reads, locus_start, paired_str_alns, mate_alns, unpaired_str_alns, NULL, &discarded_alns);
+  for (int i = 0; i < num_units; i++){
+    std::string name = "read_" + std::to_string(i);
+    BamTools::BamAlignment str_aln = make_read(name + "/1", 990), mate_aln = make_read(name + "/2", 700);
+
+    // A unit whose mate is rejected up front must also be rejected when it's added as a pair
+    bool mate_rejected = reservoir.rejects("sample", mate_aln);
+    assert(mate_rejected == reservoir.rejects("sample", str_aln));
+    reservoir.add_pair("sample", str_aln, mate_aln, false);
+    if (mate_rejected)
+      assert(discarded_alns.back().Name.compare(str_aln.Name) == 0);
+    assert(reservoir.num_paired_str_reads() == std::min(i+1, max_reads));
+    assert(reservoir.num_discarded() == std::max(0, i+1-max_reads));
+  }
+  assert(paired_str_alns.empty());
+  assert(reservoir.num_discarded() == num_units-max_reads);
+  assert(discarded_alns.size() == num_units-max_reads);
+
+  reservoir.finish();
+  assert(paired_str_alns.size() == max_reads && mate_alns.size() == max_reads);
+  assert(reservoir.num_paired_str_reads() == max_reads);
+  for (int i = 0; i < max_reads; i++)
+    assert(ReadReservoir::read_unit_name(paired_str_alns[i].Name).compare(ReadReservoir::read_unit_name(mate_alns[i].Name)) == 0);
+
+  // Without a limit, reads are emitted as soon as they're added
+  std::vector<BamTools::BamAlignment> all_paired_alns, all_mate_alns, all_unpaired_alns;
+  ReadReservoir unbounded(0, locus_start, all_paired_alns, all_mate_alns, all_unpaired_alns, NULL, NULL);
+  for (int i = 0; i < num_units; i++){
+    std::string name = "read_" + std::to_string(i);
+    assert(!unbounded.rejects("sample", make_read(name, 990)));
+    unbounded.add_pair("sample", make_read(name + "/1", 990), make_read(name + "/2", 995), true);
+  }
+  assert(all_paired_alns.size() == 2*num_units && unbounded.num_paired_str_reads() == 2*num_units);
+  std::cerr << "All read reservoir tests passed" << std::endl;
+}
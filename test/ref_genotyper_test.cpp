@@ -0,0 +1,113 @@
+#include <assert.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../ref_genotyper.h"
+#include "../region.h"
+#include "../seq_stutter_genotyper.h"
+#include "../stringops.h"
+#include "../stutter_model.h"
+#include "../SeqAlignment/AlignmentData.h"
+
+std::string random_seq(int length){
+  std::string seq;
+  for (int i = 0; i < length; i++)
+    seq += "ACGT"[rand() % 4];
+  return seq;
+}
+
+// Extracts the ALT column and each sample's FORMAT fields from a single-line VCF record
+void parse_record(const std::string& record, std::string& alt, std::vector< std::map<std::string, std::string> >& sample_fields){
+  std::vector<std::string> columns, format_keys;
+  split_by_delim(record.substr(0, record.find_last_not_of('\n')+1), '\t', columns);
+  assert(columns.size() > 9);
+  alt = columns[4];
+  split_by_delim(columns[8], ':', format_keys);
+  sample_fields.clear();
+  for (unsigned int i = 9; i < columns.size(); i++){
+    std::vector<std::string> values;
+    split_by_delim(columns[i], ':', values);
+    assert(values.size() == format_keys.size());
+    sample_fields.push_back(std::map<std::string, std::string>());
+    for (unsigned int j = 0; j < values.size(); j++)
+      sample_fields.back()[format_keys[j]] = values[j];
+  }
+}
+
+// Ensure that the reference-only fast path calls the same genotypes as the sequence-based genotyper
+// at loci where every read exactly matches the reference
+int main(){
+  srand(36);
+  StutterModel stutter_model(0.9, 0.01, 0.02, 0.7, 0.001, 0.001, 2);
+  std::ostringstream logger, html_output;
+
+  for (int iter = 0; iter < 10; iter++){
+    std::string chrom_seq = random_seq(100) + "ACACACACACAC" + random_seq(100);
+    Region region("chr1", 100, 112, 2);
+    bool haploid = (iter % 2 == 1);
+
+    // Simulate reads that exactly match the reference and span the STR
+    int num_samples = 1 + rand() % 4;
+    std::vector<std::string> sample_names;
+    std::vector<Alignment> alns;
+    std::vector< std::vector<double> > log_p1s(num_samples), log_p2s(num_samples);
+    for (int i = 0; i < num_samples; i++){
+      sample_names.push_back("sample_" + std::to_string(i));
+      int num_reads = 1 + rand() % 8;
+      for (int j = 0; j < num_reads; j++){
+	int32_t start = 20 + rand() % 60, stop = 130 + rand() % 60;
+	std::string seq = chrom_seq.substr(start, stop-start+1), quals;
+	for (unsigned int k = 0; k < seq.size(); k++)
+	  quals += (char)('5' + rand() % 10);
+	Alignment aln(start, stop, sample_names.back() + "_read_" + std::to_string(j), quals, seq, seq);
+	aln.set_cigar_list(std::vector<CigarElement>(1, CigarElement('=', seq.size())));
+	assert(RefGenotyper::is_reference_read(aln, region));
+	alns.push_back(aln);
+
+	// Only a few reads overlap informative SNPs
+	bool phased = (rand() % 3 == 0);
+	log_p1s[i].push_back(phased ? -0.01 : -0.5);
+	log_p2s[i].push_back(phased ? -3.0  : -0.5);
+      }
+    }
+
+    std::string ref_record, seq_record;
+    {
+      RefGenotyper ref_genotyper(region, haploid, alns, log_p1s, log_p2s, sample_names, chrom_seq, &stutter_model);
+      assert(ref_genotyper.genotype(chrom_seq, logger));
+      std::ostringstream out;
+      ref_genotyper.write_vcf_record(sample_names, false, false, false, false, false, false, false, 1.0, NULL, out);
+      ref_record = out.str();
+    }
+    {
+      std::vector<bool> use_to_generate_haps(alns.size(), true);
+      std::vector<int> bp_diffs(alns.size(), 0);
+      SeqStutterGenotyper seq_genotyper(region, haploid, alns, use_to_generate_haps, bp_diffs, log_p1s, log_p2s, sample_names, chrom_seq,
+					false, stutter_model, NULL, logger);
+      assert(seq_genotyper.genotype(chrom_seq, logger));
+      std::ostringstream out;
+      seq_genotyper.write_vcf_record(sample_names, true, chrom_seq, false, false, false, false, false, false, false, false, 1.0,
+				     1.0, false, NULL, html_output, out, logger);
+      seq_record = out.str();
+    }
+
+    std::string ref_alt, seq_alt;
+    std::vector< std::map<std::string, std::string> > ref_fields, seq_fields;
+    parse_record(ref_record, ref_alt, ref_fields);
+    parse_record(seq_record, seq_alt, seq_fields);
+    assert(ref_alt.compare(".") == 0 && seq_alt.compare(".") == 0);
+    assert(ref_fields.size() == num_samples && seq_fields.size() == num_samples);
+    for (int i = 0; i < num_samples; i++){
+      assert(ref_fields[i]["GT"].compare(seq_fields[i]["GT"]) == 0);
+      assert(ref_fields[i]["GB"].compare(seq_fields[i]["GB"]) == 0);
+      assert(ref_fields[i]["Q"].compare(seq_fields[i]["Q"])   == 0);
+      assert(ref_fields[i]["DP"].compare(seq_fields[i]["DP"]) == 0);
+    }
+  }
+  std::cerr << "All reference genotyper tests passed" << std::endl;
+}
@@ -0,0 +1,67 @@
+#include <assert.h>
+#include <math.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "../region_sharder.h"
+
+// Ensure that cost-balanced shards are contiguous, use every shard and minimize the cost of the most expensive shard
+int main(){
+  std::vector<double> costs = {1, 1, 1, 1, 50, 1, 1, 1, 1, 1, 1, 20, 1, 1, 1};
+  std::vector<int> count_starts, cost_starts;
+  partition_by_count(costs.size(), 3, count_starts);
+  assert(count_starts == std::vector<int>({0, 5, 10, 15}));
+  partition_by_cost(costs, 3, cost_starts);
+  assert(cost_starts.size() == 4);
+  assert(cost_starts.front() == 0 && cost_starts.back() == (int)costs.size());
+  for (unsigned int i = 0; i+1 < cost_starts.size(); i++)
+    assert(cost_starts[i] < cost_starts[i+1]);
+
+  // The locus with a cost of 50 bounds the most expensive shard
+  std::vector<double> totals;
+  shard_costs(costs, cost_starts, totals);
+  assert(fabs(*std::max_element(totals.begin(), totals.end()) - 50) < 1e-6);
+  assert(shard_imbalance(costs, cost_starts) < shard_imbalance(costs, count_starts));
+
+  // More shards than loci
+  std::vector<double> few_costs = {3, 4};
+  partition_by_cost(few_costs, 5, cost_starts);
+  assert(cost_starts == std::vector<int>({0, 1, 2}));
+
+  // Longer and shorter-period repeats are predicted to be more expensive
+  assert(predict_locus_cost(Region("chr1", 100, 160, 2), 10) > predict_locus_cost(Region("chr1", 100, 130, 2), 10));
+  assert(predict_locus_cost(Region("chr1", 100, 160, 2), 10) > predict_locus_cost(Region("chr1", 100, 160, 4), 10));
+
+  // Only each locus's top-level timings are attributed to it, and not the run's overall timing breakdown that follows the last locus
+  std::string log_file = "region_sharder_test.log";
+  std::ofstream log(log_file.c_str());
+  log << "Processing region chr1 100 160\n"
+      << "Locus timing:\n"
+      << " BAM seek time       = 1.5 seconds\n"
+      << " Genotyping          = 2 seconds\n"
+      << "\t Haplotype alignment   = 1 seconds\n"
+      << "Processing region chr1 500 520\n"
+      << "Skipping locus with too few reads\n"
+      << " Unrelated stage     = 9 seconds\n"
+      << "Processing region chr2 300 330\n"
+      << "Locus timing:\n"
+      << " Genotyping          = 0.5 seconds\n"
+      << "HipSTR run completed\n"
+      << "Approximate timing breakdown\n"
+      << " BAM seek time       = 100 seconds\n"
+      << " Genotyping          = 200 seconds\n";
+  log.close();
+  std::map<Region, double> timings;
+  read_locus_timings(log_file, timings);
+  remove(log_file.c_str());
+  assert(timings.size() == 2);
+  assert(fabs(timings[Region("chr1", 100, 160, 1)] - 3.5) < 1e-6);
+  assert(fabs(timings[Region("chr2", 300, 330, 1)] - 0.5) < 1e-6);
+  std::cerr << "All region sharder tests passed" << std::endl;
+}
@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../bgzf_streams.h"
+#include "../vcf_shard_merger.h"
+
+std::string read_file(const char* filename){
+  bgzfistream input(filename);
+  std::stringstream contents;
+  contents << input.rdbuf();
+  input.close();
+  return contents.str();
+}
+
+std::string header(const std::string& command){
+  return "##fileformat=VCFv4.1\n##command=" + command + "\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT\tS1\tS2\n";
+}
+
+// Ensure that concatenating the BGZF blocks of sharded VCFs produces the same records as an unsharded run
+int main(){
+  const int NUM_SHARDS = 3;
+  std::vector<std::string> vcf_files, stutter_files;
+  std::string expected_records, expected_models;
+  int locus = 0;
+  for (int i = 0; i < NUM_SHARDS; i++){
+    vcf_files.push_back("shard_merge_test." + std::to_string(i+1) + ".vcf.gz");
+    stutter_files.push_back("shard_merge_test." + std::to_string(i+1) + ".stutter.txt");
+    std::stringstream records, models;
+    int num_loci = (i == 1 ? 0 : 5000*(i+1));
+    for (int j = 0; j < num_loci; j++, locus++){
+      std::string chrom = (locus < 6000 ? "chr1" : "chr2");
+      records << chrom << "\t" << 100*locus+1 << "\t.\tACACAC\tACAC\t.\t.\tSTART=" << 100*locus+1 << ";END=" << 100*locus+6 << "\tGT\t0|1\t1|1\n";
+      models  << chrom << "\t" << 100*locus << "\t" << 100*locus+6 << "\t0.9\t0.01\t0.02\t0.9\t0.01\t0.01\t2\n";
+    }
+    expected_records += records.str();
+    expected_models  += models.str();
+
+    bgzfostream out(vcf_files.back().c_str());
+    out << header("shard " + std::to_string(i+1));
+    out.flush_block();
+    out << records.str();
+    out.close();
+    std::ofstream stutter_out(stutter_files.back().c_str());
+    stutter_out << models.str();
+    stutter_out.close();
+  }
+
+  const char* merged_file = "shard_merge_test.vcf.gz";
+  VCFShardMerger merger(merged_file);
+  for (int i = 0; i < NUM_SHARDS; i++)
+    merger.add_shard(vcf_files[i]);
+  merger.finish();
+  assert(merger.num_shards() == NUM_SHARDS);
+  assert(merger.num_records() == locus);
+  assert(read_file(merged_file) == header("shard 1") + expected_records);
+
+  // The merged file contains a single EOF marker
+  std::vector<uint64_t> block_addresses, block_starts;
+  bgzf_vcf_indexer::read_blocks(merged_file, block_addresses, block_starts);
+  int num_empty = 0;
+  for (unsigned int i = 0; i+1 < block_starts.size(); i++)
+    num_empty += (block_starts[i] == block_starts[i+1]);
+  assert(num_empty == 1 && block_starts[block_starts.size()-2] == block_starts.back());
+
+  const char* merged_models = "shard_merge_test.stutter.txt";
+  assert(merge_stutter_models(stutter_files, merged_models) == locus);
+  std::ifstream model_input(merged_models);
+  std::stringstream models;
+  models << model_input.rdbuf();
+  model_input.close();
+  assert(models.str() == expected_models);
+
+  for (int i = 0; i < NUM_SHARDS; i++){
+    remove(vcf_files[i].c_str());
+    remove(stutter_files[i].c_str());
+  }
+  remove(merged_file);
+  remove((std::string(merged_file) + ".tbi").c_str());
+  remove(merged_models);
+  std::cerr << "All shard merge tests passed" << std::endl;
+}
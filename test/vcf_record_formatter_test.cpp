@@ -0,0 +1,54 @@
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../vcf_record_formatter.h"
+
+// Ensure that the formatter's output is byte-identical to that of a std::ostream with std::fixed and the same precision,
+// and that the values it reports for the formatted text match those parsed from the text
+int main(){
+  std::vector<double> vals = {0.0, -0.0, 0.0005, 0.0015, 0.0025, -0.0005, 1.0005, 2.675, 0.125, -0.125, 0.9995, 999.9995,
+			      1e-300, -1e-300, 1e11, 1e15, -1e20, DBL_MAX, -DBL_MAX, INFINITY, -INFINITY, NAN, log(0.3), exp(-20)};
+  srand(1);
+  for (int i = 0; i < 100000; i++){
+    double magnitude = pow(10.0, rand()%16 - 6);
+    vals.push_back((2.0*rand()/RAND_MAX - 1.0)*magnitude);
+    vals.push_back((rand()%2000000 - 1000000)/2000.0);
+  }
+
+  for (int precision = 0; precision <= 6; precision++){
+    VCFRecordFormatter formatter(precision);
+    std::ostringstream expected;
+    expected.precision(precision);
+    expected.setf(std::ios::fixed, std::ios::floatfield);
+    for (unsigned int i = 0; i < vals.size(); i++){
+      formatter << vals[i] << ":" << (float)vals[i] << "|" << (isfinite(vals[i]) ? (int)fmod(vals[i]*1000, 1e9) : 0) << "," << -(int)i << "\t";
+      expected  << vals[i] << ":" << (float)vals[i] << "|" << (isfinite(vals[i]) ? (int)fmod(vals[i]*1000, 1e9) : 0) << "," << -(int)i << "\t";
+    }
+    formatter << std::string("end") << '\n';
+    expected  << std::string("end") << '\n';
+
+    std::ostringstream observed;
+    formatter.flush(observed);
+    assert(observed.str() == expected.str());
+
+    // Each round-tripped value equals the value parsed from its formatted text
+    for (unsigned int i = 0; i < vals.size(); i++){
+      if (!isfinite(vals[i]))
+	continue;
+      std::ostringstream text;
+      text.precision(precision);
+      text.setf(std::ios::fixed, std::ios::floatfield);
+      text << vals[i];
+      double parsed = strtod(text.str().c_str(), NULL), round_trip = formatter.round_trip(vals[i]);
+      assert(parsed == round_trip && signbit(parsed) == signbit(round_trip));
+    }
+  }
+  std::cerr << "All formatted values matched" << std::endl;
+}
@@ -0,0 +1,96 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Fixed set of worker threads that repeatedly execute batches of independent tasks. A batch is submitted using run(),
+ * which also executes tasks on the calling thread and only returns once every task in the batch has completed.
+ * Tasks are identified by their index in the batch, so callers can write each task's results into a preallocated slot
+ * and consume them in a deterministic order once run() returns
+ */
+class ThreadPool {
+ private:
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_, done_cv_;
+  std::function<void(int)> task_;
+  int num_tasks_, next_task_, num_completed_;
+  uint64_t batch_;
+  bool shutdown_;
+
+  // Must be called while holding the lock, which is released while each task executes
+  void process_tasks(std::unique_lock<std::mutex>& lock){
+    while (next_task_ < num_tasks_){
+      int task_index = next_task_++;
+      lock.unlock();
+      task_(task_index);
+      lock.lock();
+      if (++num_completed_ == num_tasks_)
+	done_cv_.notify_all();
+    }
+  }
+
+  void worker_loop(){
+    uint64_t prev_batch = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true){
+      work_cv_.wait(lock, [this, &prev_batch]{ return shutdown_ || batch_ != prev_batch; });
+      if (shutdown_)
+	return;
+      prev_batch = batch_;
+      process_tasks(lock);
+    }
+  }
+
+ public:
+  /* Creates a pool in which batches are executed by a total of NUM_THREADS threads, including the thread calling run() */
+  explicit ThreadPool(int num_threads){
+    num_tasks_     = 0;
+    next_task_     = 0;
+    num_completed_ = 0;
+    batch_         = 0;
+    shutdown_      = false;
+    for (int i = 1; i < num_threads; i++)
+      workers_.push_back(std::thread(&ThreadPool::worker_loop, this));
+  }
+
+  ~ThreadPool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      shutdown_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto worker_iter = workers_.begin(); worker_iter != workers_.end(); worker_iter++)
+      worker_iter->join();
+  }
+
+  int num_threads() const { return workers_.size() + 1; }
+
+  /* Invokes TASK once for each index in [0, NUM_TASKS), potentially in parallel, and blocks until all invocations have returned */
+  void run(int num_tasks, const std::function<void(int)>& task){
+    if (workers_.empty()){
+      for (int i = 0; i < num_tasks; i++)
+	task(i);
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_          = task;
+    num_tasks_     = num_tasks;
+    next_task_     = 0;
+    num_completed_ = 0;
+    batch_++;
+    work_cv_.notify_all();
+    process_tasks(lock);
+    done_cv_.wait(lock, [this]{ return num_completed_ == num_tasks_; });
+  }
+};
+
+#endif
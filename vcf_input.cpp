@@ -171,6 +171,27 @@ bool PhasedGL::build(VCF::Variant& variant){
     phased_gls_.push_back(values[vcf_sample_index]);
     sample_indices_[*sample_iter] = num_samples_++;
   }
+  for (unsigned int i = 0; i < phased_gls_.size(); i++)
+    sample_gls_.push_back(phased_gls_[i].data());
 
   return true;
 }
+
+bool PhasedGL::build(const GLSidecarReader& gl_reader, const std::string& chrom, int32_t pos, int num_alleles, int occurrence){
+  GLSidecarLocus locus;
+  if (!gl_reader.get_locus(chrom, pos, num_alleles, occurrence, locus))
+    return false;
+  if (locus.num_alleles != num_alleles || locus.num_phased != num_alleles*num_alleles)
+    return false;
+
+  num_samples_ = 0;
+  num_alleles_ = num_alleles;
+  const std::vector<std::string>& samples = gl_reader.get_samples();
+  for (unsigned int i = 0; i < samples.size(); i++){
+    if (!locus.called[i])
+      continue;
+    sample_gls_.push_back(locus.get_phased_gls(i));
+    sample_indices_[samples[i]] = num_samples_++;
+  }
+  return true;
+}
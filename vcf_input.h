@@ -1,12 +1,15 @@
 #ifndef VCF_INPUT_H_
 #define VCF_INPUT_H_
 
+#include <assert.h>
+
 #include <iostream>
 #include <map>
 #include <string>
 #include <vector>
 
 #include "error.h"
+#include "gl_sidecar.h"
 #include "region.h"
 #include "vcf_reader.h"
 
@@ -32,8 +35,10 @@ class PhasedGL{
   int num_samples_;
   std::map<std::string, int> sample_indices_;
   std::vector< std::vector<float> > phased_gls_;
+  std::vector<const float*> sample_gls_; // Points into phased_gls_ or into a memory-mapped GL sidecar
 
   bool build(VCF::Variant& variant);
+  bool build(const GLSidecarReader& gl_reader, const std::string& chrom, int32_t pos, int num_alleles, int occurrence);
 
  public:
   PhasedGL(){
@@ -46,6 +51,34 @@ class PhasedGL{
       printErrorAndDie("Failed to construct PhasedGL instance from VCF record");
   }
 
+  /*
+   * Uses the GLs in the sidecar file's record for the variant if GL_READER isn't NULL, where OCCURRENCE is the number of preceding VCF records
+   * with the same position and number of alleles. Otherwise, parses the GLs in the VCF record. The sidecar must contain every locus, as falling
+   * back to the VCF for individual loci would silently mix the two sources
+   */
+  PhasedGL(const GLSidecarReader* gl_reader, VCF::Variant& variant, int occurrence){
+    if (gl_reader != NULL){
+      if (!build(*gl_reader, variant.get_chromosome(), variant.get_position(), variant.num_alleles(), occurrence))
+	printErrorAndDie("Genotype likelihood file lacks a record for the STR at " + variant.get_chromosome() + ":" + std::to_string(variant.get_position())
+			 + ". Please ensure that it was generated alongside the STR VCF");
+      return;
+    }
+    if (!build(variant))
+      printErrorAndDie("Failed to construct PhasedGL instance from VCF record");
+  }
+
+  PhasedGL(int num_alleles, const std::vector<std::string>& samples, const std::vector< std::vector<float> >& phased_gls){
+    assert(samples.size() == phased_gls.size());
+    num_alleles_ = num_alleles;
+    num_samples_ = samples.size();
+    phased_gls_  = phased_gls;
+    for (int i = 0; i < num_samples_; i++){
+      assert(phased_gls_[i].size() == num_alleles*num_alleles);
+      sample_indices_[samples[i]] = i;
+      sample_gls_.push_back(phased_gls_[i].data());
+    }
+  }
+
   bool has_sample(const std::string& sample){
     return sample_indices_.find(sample) != sample_indices_.end();
   }
@@ -65,11 +98,11 @@ class PhasedGL{
       printErrorAndDie("Genotype index exceeds the number of alleles present in PhasedGL instance");
 
     int gt_index = gt_a*num_alleles_ + gt_b;
-    return phased_gls_[sample_iter->second][gt_index];
+    return sample_gls_[sample_iter->second][gt_index];
   }
 
   float get_gl(int sample_index, int gt_a, int gt_b){
-    return phased_gls_[sample_index][gt_a*num_alleles_ + gt_b];
+    return sample_gls_[sample_index][gt_a*num_alleles_ + gt_b];
   }
 };
 
@@ -0,0 +1,142 @@
+#ifndef VCF_RECORD_FORMATTER_H_
+#define VCF_RECORD_FORMATTER_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+ * Accumulates a VCF record in a reusable byte buffer so that it can be written to the output stream in a single call.
+ * Integers and floating point values are formatted without iostreams, but the output is byte-identical to that of a
+ * std::ostream configured with std::fixed and the same precision (e.g. the STR VCF, which uses a precision of 3)
+ */
+class VCFRecordFormatter {
+ private:
+  std::vector<char> buffer_;
+  int precision_;
+  double scale_;
+
+  template<typename T> void append_unsigned(T val){
+    char digits[24];
+    int num_digits = 0;
+    do {
+      digits[num_digits++] = '0' + (char)(val % 10);
+      val /= 10;
+    } while (val != 0);
+    while (num_digits > 0)
+      buffer_.push_back(digits[--num_digits]);
+  }
+
+  template<typename T, typename U> void append_signed(T val){
+    if (val < 0){
+      buffer_.push_back('-');
+      append_unsigned<U>((U)0 - (U)val);
+    }
+    else
+      append_unsigned<U>((U)val);
+  }
+
+  void append_fixed(double val){
+    // Values whose scaled magnitude lies too close to a rounding boundary (or beyond the range in which
+    // the scaled value is accurate to well below the rounding margin) are handed to snprintf,
+    // which applies the same exact rounding as the iostream formatting
+    double scaled = fabs(val)*scale_;
+    if (precision_ <= 9 && scaled < 1e12){
+      double whole = floor(scaled);
+      double frac  = scaled - whole;
+      if (fabs(frac - 0.5) > 1e-3){
+	uint64_t rounded = (uint64_t)whole + (frac > 0.5 ? 1 : 0);
+	uint64_t divisor = (uint64_t)scale_;
+	if (signbit(val))
+	  buffer_.push_back('-');
+	append_unsigned<uint64_t>(rounded/divisor);
+	if (precision_ > 0){
+	  buffer_.push_back('.');
+	  uint64_t remainder = rounded%divisor;
+	  char digits[16];
+	  for (int i = precision_-1; i >= 0; i--){
+	    digits[i]  = '0' + (char)(remainder%10);
+	    remainder /= 10;
+	  }
+	  buffer_.insert(buffer_.end(), digits, digits+precision_);
+	}
+	return;
+      }
+    }
+
+    char formatted[512];
+    int length = snprintf(formatted, sizeof(formatted), "%.*f", precision_, val);
+    if (length >= (int)sizeof(formatted)){
+      std::vector<char> large(length+1);
+      snprintf(large.data(), large.size(), "%.*f", precision_, val);
+      buffer_.insert(buffer_.end(), large.begin(), large.begin()+length);
+    }
+    else
+      buffer_.insert(buffer_.end(), formatted, formatted+length);
+  }
+
+ public:
+  explicit VCFRecordFormatter(int precision){
+    precision_ = precision;
+    scale_     = pow(10.0, precision);
+  }
+
+  /*
+   * Returns the value represented by VAL's formatted text, which is the value a VCF parser reads back for it.
+   * Allows binary outputs to store exactly the same values as the VCF
+   */
+  double round_trip(double val) const {
+    double scaled = fabs(val)*scale_;
+    if (precision_ <= 9 && scaled < 1e12){
+      double whole = floor(scaled);
+      double frac  = scaled - whole;
+      if (fabs(frac - 0.5) > 1e-3){
+	double rounded = (whole + (frac > 0.5 ? 1 : 0))/scale_;
+	return (signbit(val) ? -rounded : rounded);
+      }
+    }
+
+    char formatted[512];
+    snprintf(formatted, sizeof(formatted), "%.*f", precision_, val);
+    return strtod(formatted, NULL);
+  }
+
+  void reserve(size_t num_bytes) { buffer_.reserve(num_bytes); }
+  void clear()                   { buffer_.clear();            }
+  size_t size()            const { return buffer_.size();      }
+
+  VCFRecordFormatter& operator<<(const std::string& val){
+    buffer_.insert(buffer_.end(), val.begin(), val.end());
+    return *this;
+  }
+
+  VCFRecordFormatter& operator<<(const char* val){
+    while (*val != '\0')
+      buffer_.push_back(*val++);
+    return *this;
+  }
+
+  VCFRecordFormatter& operator<<(char val)              { buffer_.push_back(val);                                       return *this; }
+  VCFRecordFormatter& operator<<(int val)               { append_signed<int, unsigned int>(val);                        return *this; }
+  VCFRecordFormatter& operator<<(long val)              { append_signed<long, unsigned long>(val);                      return *this; }
+  VCFRecordFormatter& operator<<(long long val)         { append_signed<long long, unsigned long long>(val);            return *this; }
+  VCFRecordFormatter& operator<<(unsigned int val)      { append_unsigned<unsigned int>(val);                           return *this; }
+  VCFRecordFormatter& operator<<(unsigned long val)     { append_unsigned<unsigned long>(val);                          return *this; }
+  VCFRecordFormatter& operator<<(unsigned long long val){ append_unsigned<unsigned long long>(val);                     return *this; }
+  VCFRecordFormatter& operator<<(double val)            { append_fixed(val);                                            return *this; }
+  VCFRecordFormatter& operator<<(float val)             { append_fixed(val);                                            return *this; }
+
+  /* Writes the buffered record to the stream in a single call and clears the buffer for the next record */
+  void flush(std::ostream& out){
+    if (!buffer_.empty())
+      out.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+};
+
+#endif
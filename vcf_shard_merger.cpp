@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "error.h"
+#include "stringops.h"
+#include "vcf_shard_merger.h"
+
+// The empty BGZF block that marks the end of a file
+static const char BGZF_EOF_MARKER[28] = {'\037', '\213', '\010', '\004', 0, 0, 0, 0, 0, '\377', '\006', 0, '\102', '\103', '\002', 0,
+					 '\033', 0, '\003', 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+void ShardOrderChecker::add_locus(const std::string& chrom, int32_t start, int32_t end){
+  if (chrom.compare(chrom_) != 0){
+    if (prev_chroms_.find(chrom) != prev_chroms_.end())
+      printErrorAndDie("The loci on chromosome " + chrom + " in " + shard_ + " aren't contiguous with the preceding loci on " + chrom +
+		       ". The shards must be sorted and provided in the order of their regions");
+    prev_chroms_.insert(chrom);
+    chrom_           = chrom;
+    start_           = start;
+    max_end_         = end;
+    prev_shards_end_ = -1;
+    return;
+  }
+
+  if (start < start_)
+    printErrorAndDie("The loci in " + shard_ + " are not sorted. Locus " + chrom + ":" + std::to_string(start+1)
+		     + " follows " + chrom + ":" + std::to_string(start_+1));
+  if (start < prev_shards_end_)
+    printErrorAndDie("Locus " + chrom + ":" + std::to_string(start+1) + "-" + std::to_string(end) + " in " + shard_
+		     + " overlaps the loci in the preceding shards. The shards must be disjoint and provided in the order of their regions");
+  start_   = start;
+  max_end_ = std::max(max_end_, end);
+}
+
+VCFShardMerger::VCFShardMerger(const std::string& out_file){
+  out_file_    = out_file;
+  num_shards_  = 0;
+  num_records_ = 0;
+  output_      = fopen(out_file.c_str(), "wb");
+  if (output_ == NULL)
+    printErrorAndDie("Failed to open the output file " + out_file);
+}
+
+void VCFShardMerger::check_record(const std::string& line, const std::string& vcf_file){
+  std::vector<std::string> fields;
+  split_by_delim(line, '\t', fields);
+  if (fields.size() < 8)
+    printErrorAndDie("Malformed VCF record in " + vcf_file + ":\n" + line);
+
+  // Use the STR coordinates in the INFO field, as the alleles may include flanking sequence
+  int32_t start = atoi(fields[1].c_str())-1, end = start + fields[3].size();
+  std::vector<std::string> info;
+  split_by_delim(fields[7], ';', info);
+  for (auto info_iter = info.begin(); info_iter != info.end(); info_iter++){
+    if (string_starts_with(*info_iter, "START="))
+      start = atoi(info_iter->c_str()+6)-1;
+    else if (string_starts_with(*info_iter, "END="))
+      end = atoi(info_iter->c_str()+4);
+  }
+  order_checker_.add_locus(fields[0], start, end);
+  num_records_++;
+}
+
+void VCFShardMerger::copy_blocks(const std::string& vcf_file, const std::vector<uint64_t>& block_addresses,
+				 const std::vector<uint64_t>& block_starts, size_t first_block){
+  FILE* input = fopen(vcf_file.c_str(), "rb");
+  if (input == NULL)
+    printErrorAndDie("Failed to open VCF file " + vcf_file);
+
+  std::vector<char> buffer(1 << 20);
+  size_t block = first_block;
+  while (block+1 < block_addresses.size()){
+    // Skip empty blocks, including the EOF marker
+    if (block_starts[block+1] == block_starts[block]){
+      block++;
+      continue;
+    }
+
+    // Copy each run of consecutive non-empty blocks at once
+    size_t end_block = block+1;
+    while (end_block+1 < block_addresses.size() && block_starts[end_block+1] != block_starts[end_block])
+      end_block++;
+    if (fseeko(input, (off_t)block_addresses[block], SEEK_SET) != 0)
+      printErrorAndDie("Failed to seek in VCF file " + vcf_file);
+    uint64_t remaining = block_addresses[end_block] - block_addresses[block];
+    while (remaining > 0){
+      size_t n = (size_t)std::min((uint64_t)buffer.size(), remaining);
+      if (fread(buffer.data(), 1, n, input) != n)
+	printErrorAndDie("Failed to read the BGZF blocks in VCF file " + vcf_file);
+      if (fwrite(buffer.data(), 1, n, output_) != n)
+	printErrorAndDie("Failed to write to the output file " + out_file_);
+      remaining -= n;
+    }
+    block = end_block;
+  }
+  fclose(input);
+}
+
+void VCFShardMerger::add_shard(const std::string& vcf_file){
+  std::vector<uint64_t> block_addresses, block_starts;
+  bgzf_vcf_indexer::read_blocks(vcf_file, block_addresses, block_starts);
+  struct stat file_info;
+  if (stat(vcf_file.c_str(), &file_info) != 0 || block_addresses.back() != (uint64_t)file_info.st_size)
+    printErrorAndDie("VCF file " + vcf_file + " is truncated or isn't a bgzipped file");
+
+  BGZF* input = bgzf_open(vcf_file.c_str(), "r");
+  if (input == NULL)
+    printErrorAndDie("Failed to open VCF file " + vcf_file);
+  order_checker_.new_shard(vcf_file);
+  bool first_shard = (num_shards_ == 0);
+
+  // Decompress the shard to split its header from its records, which are validated and tracked for the index
+  std::vector<std::string> header;
+  std::vector<char> buffer(BGZF_MAX_BLOCK_SIZE);
+  std::string line;
+  uint64_t header_end = 0, offset = 0;
+  bool in_header = true;
+  ssize_t n;
+  while ((n = bgzf_read(input, buffer.data(), buffer.size())) > 0){
+    for (ssize_t i = 0; i < n; i++){
+      if (buffer[i] != '\n'){
+	line.push_back(buffer[i]);
+	continue;
+      }
+      offset += line.size()+1;
+      if (in_header && !line.empty() && line[0] == '#'){
+	if (!string_starts_with(line, "##command="))
+	  header.push_back(line);
+	header_end = offset;
+      }
+      else {
+	in_header = false;
+	check_record(line, vcf_file);
+      }
+      if (first_shard || !in_header){
+	line.push_back('\n');
+	indexer_.track(line.data(), line.size());
+      }
+      line.clear();
+    }
+  }
+  if (n < 0)
+    printErrorAndDie("Failed to decompress VCF file " + vcf_file);
+  if (!line.empty())
+    printErrorAndDie("VCF file " + vcf_file + " doesn't end with a newline");
+  bgzf_close(input);
+
+  if (header.empty() || !string_starts_with(header.back(), "#CHROM"))
+    printErrorAndDie("VCF file " + vcf_file + " doesn't contain a #CHROM header line");
+  if (first_shard){
+    first_vcf_ = vcf_file;
+    header_    = header;
+  }
+  else if (header.back().compare(header_.back()) != 0)
+    printErrorAndDie("The samples in VCF file " + vcf_file + " differ from those in " + first_vcf_ + ". Only shards of the same run can be merged");
+  else if (header != header_)
+    printErrorAndDie("The header of VCF file " + vcf_file + " differs from that of " + first_vcf_ + ". Only shards of the same run can be merged");
+
+  // The records are copied without recompressing them, so they can't share a block with the header
+  size_t first_block = 0;
+  if (!first_shard){
+    std::vector<uint64_t>::iterator block_iter = std::lower_bound(block_starts.begin(), block_starts.end(), header_end);
+    if (block_iter == block_starts.end() || *block_iter != header_end)
+      printErrorAndDie("The records in VCF file " + vcf_file + " share a BGZF block with its header, so they can't be merged without "
+		       + "recompressing them. Only VCFs written by this version of HipSTR can be merged");
+    first_block = block_iter - block_starts.begin();
+  }
+  copy_blocks(vcf_file, block_addresses, block_starts, first_block);
+  num_shards_++;
+}
+
+void VCFShardMerger::finish(){
+  if (num_shards_ == 0)
+    printErrorAndDie("No VCF files were provided to merge");
+  if (fwrite(BGZF_EOF_MARKER, 1, sizeof(BGZF_EOF_MARKER), output_) != sizeof(BGZF_EOF_MARKER) || fclose(output_) != 0)
+    printErrorAndDie("Failed to write to the output file " + out_file_);
+  output_ = NULL;
+  indexer_.write_index(out_file_);
+}
+
+int64_t merge_stutter_models(const std::vector<std::string>& stutter_files, const std::string& out_file){
+  std::ofstream output(out_file.c_str());
+  if (!output.is_open())
+    printErrorAndDie("Failed to open the output file " + out_file);
+
+  ShardOrderChecker order_checker;
+  int64_t num_models = 0;
+  std::string line, chrom;
+  int32_t start, end;
+  for (auto file_iter = stutter_files.begin(); file_iter != stutter_files.end(); file_iter++){
+    std::ifstream input(file_iter->c_str());
+    if (!input.is_open())
+      printErrorAndDie("Failed to open the stutter model file " + *file_iter);
+    order_checker.new_shard(*file_iter);
+    while (std::getline(input, line)){
+      std::istringstream iss(line);
+      if (!(iss >> chrom >> start >> end))
+	printErrorAndDie("Malformed stutter model in " + *file_iter + ":\n" + line);
+      order_checker.add_locus(chrom, start, end);
+      output << line << "\n";
+      num_models++;
+    }
+    input.close();
+  }
+  output.close();
+  return num_models;
+}
@@ -0,0 +1,87 @@
+#ifndef VCF_SHARD_MERGER_H_
+#define VCF_SHARD_MERGER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "bgzf_streams.h"
+
+/*
+ * Verifies that the loci from a series of shards are ordered and that the shards are disjoint. Within a shard, loci must be sorted
+ * by their start and the loci on each chromosome must be contiguous. Coordinates are 0-based and half-open
+ */
+class ShardOrderChecker {
+ private:
+  std::set<std::string> prev_chroms_;
+  std::string shard_, chrom_;
+  int32_t start_, max_end_;
+  int32_t prev_shards_end_;  // Maximum end of the loci on the current chromosome in the preceding shards
+
+ public:
+  ShardOrderChecker(){
+    start_           = -1;
+    max_end_         = -1;
+    prev_shards_end_ = -1;
+  }
+
+  void new_shard(const std::string& shard){
+    shard_           = shard;
+    prev_shards_end_ = max_end_;
+  }
+
+  void add_locus(const std::string& chrom, int32_t start, int32_t end);
+};
+
+/*
+ * Merges the bgzipped VCFs that HipSTR writes for contiguous shards of regions by concatenating their BGZF blocks, so the
+ * records are never decompressed and recompressed. The header blocks of the first shard are followed by the record blocks of
+ * each shard, a single EOF marker is appended and a new tabix index is built. The records are decompressed only to validate them
+ * and to index them. The shards' headers must agree, aside from their ##command lines, and their records must begin in a new
+ * BGZF block, which is the case for the VCFs written by HipSTR
+ */
+class VCFShardMerger {
+ private:
+  std::string out_file_;
+  FILE* output_;
+  bgzf_vcf_indexer indexer_;
+  ShardOrderChecker order_checker_;
+
+  std::string first_vcf_;
+  std::vector<std::string> header_;  // Header lines of the first shard, excluding its ##command line
+  int num_shards_;
+  int64_t num_records_;
+
+  void check_record(const std::string& line, const std::string& vcf_file);
+
+  // Copies the non-empty BGZF blocks from index FIRST_BLOCK onward to the output
+  void copy_blocks(const std::string& vcf_file, const std::vector<uint64_t>& block_addresses, const std::vector<uint64_t>& block_starts,
+		   size_t first_block);
+
+ public:
+  explicit VCFShardMerger(const std::string& out_file);
+
+  ~VCFShardMerger(){
+    if (output_ != NULL)
+      fclose(output_);
+  }
+
+  void add_shard(const std::string& vcf_file);
+
+  /* Writes the BGZF EOF marker and the index for the merged VCF */
+  void finish();
+
+  int num_shards()      const { return num_shards_;  }
+  int64_t num_records() const { return num_records_; }
+};
+
+/*
+ * Concatenates the stutter models that HipSTR writes for each shard, after verifying that the loci in the files are ordered and disjoint.
+ * Returns the total number of models
+ */
+int64_t merge_stutter_models(const std::vector<std::string>& stutter_files, const std::string& out_file);
+
+#endif